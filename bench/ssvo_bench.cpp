@@ -0,0 +1,345 @@
+/**
+ * @file ssvo_bench.cpp
+ * @brief 离线吞吐量测试: 以最大吞吐量无界面地运行一个或多个数据集序列,
+ * 统计各阶段耗时的分位数, 帧率, 峰值内存和绝对轨迹误差, 输出JSON格式的汇总
+ * @detials 每个序列在单独的子进程中运行, 因为帧和关键帧的id是全局的, 并且峰值内存需要按序列统计.
+ * 各阶段的耗时从 TimeTracing 输出的csv文件中读取, 需要打开 SSVO_TRACE_ENABLE.
+ * csv文件以固定的文件名写在 Trace.log_dir 下, 同时运行多个测试时每个测试需要使用 Trace.log_dir 不同的配置文件, 否则结果会相互覆盖.
+ * 绝对轨迹误差用Sim3对齐(单目尺度不确定), 对EuRoC数据集直接比较相机位置和IMU位置, 忽略两者之间的外参平移.
+ * @version 0.1
+ * @date 2019-01-18
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <Eigen/Geometry>
+#include "system.hpp"
+#include "dataset.hpp"
+#include "time_tracing.hpp"
+#include "logging.hpp"
+
+using namespace ssvo;
+
+///一个序列的描述, 格式为 euroc:<数据集路径> 或 tum:<数据集路径>:<带真值的关联文件>
+struct Sequence
+{
+    std::string type;
+    std::string path;
+    std::string association;
+};
+
+///需要统计分位数的阶段, 对应 TimeTracing 的csv文件和列名
+static const std::vector<std::pair<std::string, std::string> > STAGES = {
+    {"ssvo_trace_system", "total"},
+    {"ssvo_trace_system", "frame_create"},
+    {"ssvo_trace_system", "img_align"},
+    {"ssvo_trace_system", "feature_reproj"},
+    {"ssvo_trace_system", "motion_ba"},
+    {"ssvo_trace_system", "light_affine"},
+    {"ssvo_trace_system", "per_depth_filter"},
+    {"ssvo_trace_map", "total"},
+    {"ssvo_trace_map", "seeds"},
+    {"ssvo_trace_map", "local_ba"},
+    {"ssvo_trace_map", "reproj"},
+    {"ssvo_trace_filter", "klt_track"},
+    {"ssvo_trace_filter", "update_seeds"},
+    {"ssvo_trace_filter", "epl_search"},
+    {"ssvo_trace_filter", "create_seeds"},
+    {"ssvo_trace_indexer", "total"},
+};
+
+bool parseSequence(const std::string &arg, Sequence &sequence)
+{
+    size_t found = arg.find(':');
+    if(found == std::string::npos)
+        return false;
+
+    sequence.type = arg.substr(0, found);
+    sequence.path = arg.substr(found + 1);
+    if(sequence.type == "tum")
+    {
+        found = sequence.path.rfind(':');
+        if(found == std::string::npos)
+            return false;
+        sequence.association = sequence.path.substr(found + 1);
+        sequence.path = sequence.path.substr(0, found);
+        return true;
+    }
+
+    return sequence.type == "euroc";
+}
+
+/**
+ * @brief 读取 TimeTracing 输出的csv文件中的一列, 只保留计时大于0的行(该阶段在这一行中运行过)
+ */
+std::vector<double> loadTraceColumn(const std::string &file_name, const std::string &column)
+{
+    std::vector<double> values;
+    std::ifstream ifs(file_name.c_str());
+    if(!ifs.is_open())
+        return values;
+
+    std::string line;
+    if(!std::getline(ifs, line))
+        return values;
+
+    int index = -1;
+    int count = 0;
+    std::string name;
+    std::istringstream header(line);
+    while(std::getline(header, name, ','))
+    {
+        if(name == column)
+            index = count;
+        count++;
+    }
+
+    if(index < 0)
+        return values;
+
+    while(std::getline(ifs, line))
+    {
+        std::istringstream row(line);
+        std::string value;
+        for(int i = 0; i <= index && std::getline(row, value, ','); i++) {}
+
+        const double v = std::atof(value.c_str());
+        if(v > 0)
+            values.push_back(v);
+    }
+
+    return values;
+}
+
+double percentile(std::vector<double> &sorted, double p)
+{
+    if(sorted.empty())
+        return 0;
+    const size_t rank = (size_t) std::ceil(p * sorted.size());
+    return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+/**
+ * @brief 按时间戳关联估计和真值, Sim3对齐后计算位置误差的均方根
+ */
+double computeATE(const std::vector<double> &est_timestamps, const std::vector<Vector3d> &est_positions,
+                  const std::vector<double> &gt_timestamps, const std::vector<Vector3d> &gt_positions,
+                  int &num_matched, const double max_dt = 0.02)
+{
+    std::vector<Vector3d> src, dst;
+    size_t j = 0;
+    for(size_t i = 0; i < est_timestamps.size() && !gt_timestamps.empty(); i++)
+    {
+        const double t = est_timestamps[i];
+        while(j + 1 < gt_timestamps.size() && std::abs(gt_timestamps[j+1] - t) <= std::abs(gt_timestamps[j] - t))
+            j++;
+        if(std::abs(gt_timestamps[j] - t) > max_dt)
+            continue;
+        src.push_back(est_positions[i]);
+        dst.push_back(gt_positions[j]);
+    }
+
+    num_matched = (int) src.size();
+    if(num_matched < 3)
+        return -1;
+
+    Eigen::Matrix3Xd src_mat(3, num_matched), dst_mat(3, num_matched);
+    for(int i = 0; i < num_matched; i++)
+    {
+        src_mat.col(i) = src[i];
+        dst_mat.col(i) = dst[i];
+    }
+
+    const Eigen::Matrix4d T = Eigen::umeyama(src_mat, dst_mat, true);
+    const Eigen::Matrix3Xd aligned = (T.topLeftCorner<3,3>() * src_mat).colwise() + T.topRightCorner<3,1>();
+    return std::sqrt((aligned - dst_mat).colwise().squaredNorm().mean());
+}
+
+/**
+ * @brief 在子进程中运行一个序列, 把结果以JSON对象的形式写入文件
+ */
+int runSequence(const std::string &config_file, const std::string &calib_file, const Sequence &sequence, const std::string &result_file)
+{
+    std::vector<std::string> paths;
+    std::vector<double> timestamps;
+    std::vector<double> gt_timestamps;
+    std::vector<Vector3d> gt_positions;
+
+    if(sequence.type == "euroc")
+    {
+        EuRocDataReader dataset(sequence.path);
+        for(size_t i = 0; i < dataset.leftImageSize(); i++)
+        {
+            paths.push_back(dataset.leftImage(i).path);
+            timestamps.push_back(dataset.leftImage(i).timestamp);
+        }
+        for(size_t i = 0; i < dataset.groundtruthSize(); i++)
+        {
+            const EuRocDataReader::GroundTruthData &gt = dataset.groundtruth(i);
+            gt_timestamps.push_back(gt.timestamp);
+            gt_positions.push_back(Vector3d(gt.p[0], gt.p[1], gt.p[2]));
+        }
+    }
+    else
+    {
+        TUMDataReader dataset(sequence.path, sequence.association, true);
+        paths = dataset.rgb_images_;
+        timestamps = dataset.timestamps_;
+        gt_timestamps = dataset.timestamps_;
+        for(const std::vector<double> &gt : dataset.groundtruth_data_)
+            gt_positions.push_back(Vector3d(gt[0], gt[1], gt[2]));
+    }
+
+    std::vector<double> est_timestamps;
+    std::vector<Vector3d> est_positions;
+    int num_frames = 0;
+    double duration = 0;
+    {
+        System vo(config_file, calib_file);
+        LOG_IF(WARNING, vo.isViewerEnabled()) << "[Bench] The viewer is enabled, set Viewer.enable to 0 for a headless run!";
+
+        ImageSource source(paths, timestamps, ImageSource::MAX_THROUGHPUT, 2);
+        ImageSource::Item item;
+        SecondTimer timer;
+        timer.start();
+        while(source.next(item))
+        {
+            if(item.image.empty())
+                continue;
+            vo.process(item.image, item.timestamp);
+            num_frames++;
+        }
+        duration = timer.stop();
+
+        vo.getTrajectory(est_timestamps, est_positions);
+    }
+
+    //! flush the traces of the other threads, which are stopped with the system
+    mapTrace.reset();
+    dfltTrace.reset();
+    indexTrace.reset();
+
+    int num_matched = 0;
+    const double ate = computeATE(est_timestamps, est_positions, gt_timestamps, gt_positions, num_matched);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    std::ofstream ofs(result_file.c_str());
+    ofs.precision(6);
+    ofs.setf(std::ios::fixed, std::ios::floatfield);
+    ofs << "    {\n"
+        << "      \"type\": \"" << sequence.type << "\",\n"
+        << "      \"path\": \"" << sequence.path << "\",\n"
+        << "      \"frames\": " << num_frames << ",\n"
+        << "      \"seconds\": " << duration << ",\n"
+        << "      \"fps\": " << (duration > 0 ? num_frames / duration : 0) << ",\n"
+        << "      \"peak_rss_kb\": " << usage.ru_maxrss << ",\n"
+        << "      \"tracked_frames\": " << est_timestamps.size() << ",\n"
+        << "      \"ate_matched\": " << num_matched << ",\n"
+        << "      \"ate_rmse_m\": " << ate << ",\n"
+        << "      \"stages_ms\": {";
+
+    const std::string trace_dir = Config::timeTracingDirectory();
+    const std::string divide = trace_dir.empty() || trace_dir.back() == '/' ? "" : "/";
+    bool first = true;
+    for(const auto &stage : STAGES)
+    {
+        std::vector<double> values = loadTraceColumn(trace_dir + divide + stage.first + ".csv", stage.second);
+        if(values.empty())
+            continue;
+
+        std::sort(values.begin(), values.end());
+        ofs << (first ? "\n" : ",\n")
+            << "        \"" << stage.first.substr(std::string("ssvo_trace_").size()) << "." << stage.second << "\": {"
+            << "\"count\": " << values.size()
+            << ", \"p50\": " << percentile(values, 0.50) * 1e3
+            << ", \"p95\": " << percentile(values, 0.95) * 1e3
+            << ", \"p99\": " << percentile(values, 0.99) * 1e3
+            << ", \"max\": " << values.back() * 1e3 << "}";
+        first = false;
+    }
+    ofs << "\n      }\n    }";
+    ofs.close();
+
+    //! the child ends with _exit, which runs no static destructors or atexit handlers, so nothing is flushed for it
+    AsyncLogging::instance().flush();
+    google::FlushLogFiles(google::GLOG_INFO);
+    std::cout.flush();
+
+    return ofs.good() ? 0 : 1;
+}
+
+/**
+ * @brief 离线吞吐量测试的程序入口
+ *
+ * @param argc 命令行参数个数
+ * @param argv 命令行参数列表=配置文件 相机参数矫正文件 输出的JSON文件 序列...
+ * @return int 失败的序列数目
+ */
+int main(int argc, char *argv[])
+{
+    google::InitGoogleLogging(argv[0]);
+    LOG_ASSERT(argc >= 5) << "\n Usage : ./ssvo_bench config_file calib_file summary.json euroc:<dataset_path> tum:<dataset_path>:<association_file> ...";
+
+    const std::string config_file = argv[1];
+    const std::string calib_file = argv[2];
+    const std::string summary_file = argv[3];
+
+    std::vector<Sequence> sequences;
+    for(int i = 4; i < argc; i++)
+    {
+        Sequence sequence;
+        LOG_ASSERT(parseSequence(argv[i], sequence)) << "Unknown sequence: " << argv[i];
+        sequences.push_back(sequence);
+    }
+
+    int failed = 0;
+    std::vector<std::string> results;
+    for(size_t i = 0; i < sequences.size(); i++)
+    {
+        const std::string result_file = summary_file + "." + std::to_string(i) + ".part";
+        std::cout << "[Bench] Running " << sequences[i].type << " sequence " << sequences[i].path << std::endl;
+
+        const pid_t pid = fork();
+        LOG_ASSERT(pid >= 0) << "Failed to fork for sequence " << sequences[i].path;
+        if(pid == 0)
+            _exit(runSequence(config_file, calib_file, sequences[i], result_file));
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+
+        std::ifstream ifs(result_file.c_str());
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !ifs.is_open())
+        {
+            LOG(ERROR) << "[Bench] Sequence " << sequences[i].path << " failed with status " << status;
+            failed++;
+            continue;
+        }
+
+        std::stringstream ss;
+        ss << ifs.rdbuf();
+        results.push_back(ss.str());
+        ifs.close();
+        std::remove(result_file.c_str());
+    }
+
+    std::ofstream ofs(summary_file.c_str());
+    ofs << "{\n"
+        << "  \"config\": \"" << config_file << "\",\n"
+        << "  \"calib\": \"" << calib_file << "\",\n"
+        << "  \"failed\": " << failed << ",\n"
+        << "  \"sequences\": [\n";
+    for(size_t i = 0; i < results.size(); i++)
+        ofs << results[i] << (i + 1 < results.size() ? ",\n" : "\n");
+    ofs << "  ]\n}\n";
+    ofs.close();
+
+    std::cout << "[Bench] Summary saved to " << summary_file << std::endl;
+
+    return failed;
+}
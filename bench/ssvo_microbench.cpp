@@ -0,0 +1,314 @@
+/**
+ * @file ssvo_microbench.cpp
+ * @brief 单个特征层面的核心函数的微基准测试
+ * @detials 每个测试的迭代次数是固定的, 先预热一轮, 再重复若干轮, 输出每次调用耗时(ns/op)的最小值/中位数/最大值,
+ * 以及按处理的特征数目平均的耗时(ns/item). 测试用的图像块取自合成的纹理图像, 如果给出了图像文件, 再在真实图像上测试一遍.
+ * 结果与整个系统的运行无关, 用于单独评估SIMD或者数据布局的改动.
+ * @version 0.1
+ * @date 2019-01-18
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#include <iomanip>
+#include <functional>
+#include <opencv2/opencv.hpp>
+#include "config.hpp"
+#include "feature_detector.hpp"
+#include "feature_alignment.hpp"
+#include "image_alignment.hpp"
+#include "brief.hpp"
+#include "seed.hpp"
+#include "keyframe.hpp"
+#include "utils.hpp"
+
+using namespace ssvo;
+
+///防止被测函数的结果被编译器优化掉
+static volatile double sink = 0;
+
+/**
+ * @brief 一个微基准测试
+ */
+struct MicroBenchmark
+{
+    std::string name;
+    int iterations;                 ///<每一轮的调用次数
+    int items;                      ///<每次调用处理的特征数目
+    std::function<void()> setup;    ///<每一轮开始前调用, 不计时
+    std::function<void(int)> run;   ///<第i次调用
+};
+
+/**
+ * @brief 测试用的场景, 由一张图像生成
+ */
+struct Scene
+{
+    cv::Mat image;
+    AbstractCamera::Ptr camera;
+    Frame::Ptr frame_ref;
+    Frame::Ptr frame_cur;
+    KeyFrame::Ptr keyframe;
+    std::vector<Vector2d, Eigen::aligned_allocator<Vector2d> > pxs;
+    std::vector<cv::KeyPoint> keypoints;
+};
+
+///合成的纹理图像, 固定随机种子, 尺寸与EuRoC数据集相同
+cv::Mat createSyntheticImage(const int width = 752, const int height = 480)
+{
+    cv::Mat noise(height, width, CV_32FC1);
+    cv::RNG rng(2019);
+    rng.fill(noise, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    cv::Mat blurred;
+    cv::GaussianBlur(noise, blurred, cv::Size(0, 0), 1.5);
+    cv::normalize(blurred, blurred, 0, 255, cv::NORM_MINMAX);
+
+    cv::Mat image;
+    blurred.convertTo(image, CV_8UC1);
+    return image;
+}
+
+Scene createScene(const cv::Mat &image, const int max_features = 256)
+{
+    Scene scene;
+    scene.image = image;
+    const int width = image.cols;
+    const int height = image.rows;
+    scene.camera = std::static_pointer_cast<AbstractCamera>(PinholeCamera::create(width, height, 0.6*width, 0.6*width, 0.5*width, 0.5*height));
+
+    //! the strongest corners far from the border, sorted for repeatable runs
+    FastGrid grid(width, height, Config::gridSize(), Config::fastMaxThreshold(), Config::fastMinThreshold());
+    Corners corners;
+    FastDetector::detectInLevel(image, grid, corners, Config::fastMinEigen(), 4);
+    std::sort(corners.begin(), corners.end(), [](const Corner &a, const Corner &b)
+    { return a.score != b.score ? a.score > b.score : (a.y != b.y ? a.y < b.y : a.x < b.x); });
+
+    const int border = 16;
+    for(const Corner &corner : corners)
+    {
+        if(corner.x < border || corner.y < border || corner.x >= width - border || corner.y >= height - border)
+            continue;
+
+        scene.pxs.emplace_back(corner.x, corner.y);
+        scene.keypoints.emplace_back(cv::KeyPoint(corner.x, corner.y, 31, -1, 0, 0));
+        if((int) scene.pxs.size() >= max_features)
+            break;
+    }
+    LOG_ASSERT(!scene.pxs.empty()) << "No corners detected in the image!";
+
+    //! map points on a slanted plane in front of the reference frame
+    scene.frame_ref = Frame::create(image, 0, scene.camera);
+    scene.frame_cur = Frame::create(image, 0, scene.camera);
+    for(const Vector2d &px : scene.pxs)
+    {
+        const Vector3d fn = scene.camera->lift(px);
+        const double depth = 2.0 + 0.5 * px[0] / width;
+        MapPoint::Ptr mpt = MapPoint::create(fn * depth);
+        scene.frame_ref->addFeature(Feature::create(px, fn, 0, mpt));
+    }
+    scene.keyframe = KeyFrame::create(scene.frame_ref);
+
+    return scene;
+}
+
+void createBenchmarks(const Scene &scene, const std::string &prefix, std::vector<MicroBenchmark> &benchmarks)
+{
+    typedef Matrix<float, AlignPatch::SizeWithBorder, AlignPatch::SizeWithBorder, RowMajor> PatchWithBorder;
+    typedef Matrix<float, AlignPatch::Size, AlignPatch::Size, RowMajor> Patch;
+
+    struct PatternPatch
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        Matrix<float, AlignPattern::Num, 1> patch;
+        Matrix<float, AlignPattern::Num, 1> gx;
+        Matrix<float, AlignPattern::Num, 1> gy;
+    };
+
+    const cv::Mat image = scene.image;
+    const int N = (int) scene.pxs.size();
+    const std::vector<Vector2d, Eigen::aligned_allocator<Vector2d> > pxs = scene.pxs;
+
+    //! reference patches at the corners, the current estimates are shifted by (1.5, -1.0)
+    auto patches = std::make_shared<std::vector<PatchWithBorder, Eigen::aligned_allocator<PatchWithBorder> > >(N);
+    auto patterns = std::make_shared<std::vector<PatternPatch, Eigen::aligned_allocator<PatternPatch> > >(N);
+    auto zssds = std::make_shared<std::vector<ZSSD<float, AlignPatch::Size>, Eigen::aligned_allocator<ZSSD<float, AlignPatch::Size> > > >();
+    auto patches_cur = std::make_shared<std::vector<Patch, Eigen::aligned_allocator<Patch> > >(N);
+    for(int i = 0; i < N; i++)
+    {
+        utils::interpolateMat<uchar, float, AlignPatch::SizeWithBorder>(image, (*patches)[i], pxs[i][0], pxs[i][1]);
+        AlignPattern::pattern_.getPattern((*patches)[i], (*patterns)[i].patch, (*patterns)[i].gx, (*patterns)[i].gy);
+
+        Patch patch_ref;
+        utils::interpolateMat<uchar, float, AlignPatch::Size>(image, patch_ref, pxs[i][0], pxs[i][1]);
+        zssds->emplace_back(patch_ref);
+        utils::interpolateMat<uchar, float, AlignPatch::Size>(image, (*patches_cur)[i], pxs[i][0] + 0.5, pxs[i][1] + 0.5);
+    }
+
+    const Vector2d offset(1.5, -1.0);
+
+    benchmarks.push_back({prefix + "utils::interpolateMat<10>", 100000, 1, nullptr, [=](int i) {
+        PatchWithBorder patch;
+        const Vector2d &px = pxs[i % N];
+        utils::interpolateMat<uchar, float, AlignPatch::SizeWithBorder>(image, patch, px[0] + 0.3, px[1] + 0.7);
+        sink = sink + patch(4, 4);
+    }});
+
+    Matrix2d A_cur_from_ref;
+    A_cur_from_ref << 1.05*std::cos(0.1), -1.05*std::sin(0.1), 1.05*std::sin(0.1), 1.05*std::cos(0.1);
+    benchmarks.push_back({prefix + "utils::warpAffine<10>", 100000, 1, nullptr, [=](int i) {
+        PatchWithBorder patch;
+        utils::warpAffine<float, AlignPatch::SizeWithBorder>(image, patch, A_cur_from_ref, pxs[i % N], 0, 0);
+        sink = sink + patch(4, 4);
+    }});
+
+    benchmarks.push_back({prefix + "AlignPatch::align2DI", 20000, 1, nullptr, [=](int i) {
+        const Vector2d &px = pxs[i % N];
+        Vector3d estimate(px[0] + offset[0], px[1] + offset[1], 0);
+        AlignPatch::align2DI(image, (*patches)[i % N], estimate, 30, 0.01);
+        sink = sink + estimate[0];
+    }});
+
+    benchmarks.push_back({prefix + "AlignPattern::align2DI", 20000, 1, nullptr, [=](int i) {
+        const Vector2d &px = pxs[i % N];
+        const PatternPatch &pattern = (*patterns)[i % N];
+        Vector3d estimate(px[0] + offset[0], px[1] + offset[1], 0);
+        AlignPattern::align2DI(image, pattern.patch, pattern.gx, pattern.gy, estimate, 30, 0.01);
+        sink = sink + estimate[0];
+    }});
+
+    benchmarks.push_back({prefix + "ZSSD<8>::compute_score", 200000, 1, nullptr, [=](int i) {
+        sink = sink + (*zssds)[i % N].compute_score((*patches_cur)[i % N]);
+    }});
+
+    //! the thresholds of the grid adapt to the image, so the grid is reset in each round
+    auto grid = std::make_shared<std::unique_ptr<FastGrid> >();
+    auto corners = std::make_shared<Corners>();
+    benchmarks.push_back({prefix + "FastDetector::detectInLevel", 50, 1, [=]() {
+        grid->reset(new FastGrid(image.cols, image.rows, Config::gridSize(), Config::fastMaxThreshold(), Config::fastMinThreshold()));
+    }, [=](int) {
+        FastDetector::detectInLevel(image, **grid, *corners, Config::fastMinEigen(), 4);
+        sink = sink + corners->size();
+    }});
+
+    BRIEF::Ptr brief = BRIEF::create(2.0, Config::imageNLevel());
+    BRIEF::Pyramid::Ptr brief_pyr = brief->createPyramid(scene.frame_ref->images());
+    const std::vector<cv::KeyPoint> keypoints = scene.keypoints;
+    benchmarks.push_back({prefix + "BRIEF::compute", 200, (int) keypoints.size(), nullptr, [=](int) {
+        std::vector<cv::KeyPoint> kps = keypoints;
+        cv::Mat descriptors;
+        brief->compute(*brief_pyr, kps, descriptors);
+        sink = sink + descriptors.rows;
+    }});
+
+    const Frame::Ptr frame_ref = scene.frame_ref;
+    const Frame::Ptr frame_cur = scene.frame_cur;
+    const Vector3d t_cur(0.01, -0.005, 0.01);
+    const int top_level = std::min(Config::alignTopLevel(), (int) frame_cur->images().size() - 1);
+    const int bottom_level = std::min(Config::alignBottomLevel(), top_level);
+    std::shared_ptr<AlignSE3> align(new AlignSE3(false, false));
+    benchmarks.push_back({prefix + "AlignSE3::run", 50, N, nullptr, [=](int) {
+        frame_cur->setPose(Matrix3d::Identity(), t_cur);
+        sink = sink + align->run(frame_ref, frame_cur, top_level, bottom_level, 30, 1e-5);
+    }});
+
+    //! seeds keep their history, so they are recreated in each round and updated 10 times
+    const int num_seeds = 500;
+    const KeyFrame::Ptr keyframe = scene.keyframe;
+    auto seeds = std::make_shared<std::vector<Seed::Ptr> >();
+    benchmarks.push_back({prefix + "Seed::update", num_seeds * 10, 1, [=]() {
+        seeds->clear();
+        for(int i = 0; i < num_seeds; i++)
+        {
+            const Vector2d &px = pxs[i % N];
+            seeds->push_back(Seed::create(keyframe, px, keyframe->cam_->lift(px), 0, 2.0, 0.5));
+        }
+    }, [=](int i) {
+        const double depth = 2.0 + 0.05 * std::sin(0.37 * i);
+        (*seeds)[i % num_seeds]->update(1.0 / depth, 0.01);
+    }});
+}
+
+/**
+ * @brief 运行一个测试, 返回每一轮中每次调用的耗时(ns)
+ */
+std::vector<double> runBenchmark(const MicroBenchmark &benchmark, const int repeats)
+{
+    std::vector<double> ns_per_op;
+    for(int r = -1; r < repeats; r++)
+    {
+        if(benchmark.setup)
+            benchmark.setup();
+
+        const auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < benchmark.iterations; i++)
+            benchmark.run(i);
+        const auto end = std::chrono::steady_clock::now();
+
+        //! the first round is the warm-up
+        if(r < 0)
+            continue;
+
+        ns_per_op.push_back(std::chrono::duration<double, std::nano>(end - start).count() / benchmark.iterations);
+    }
+
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+    return ns_per_op;
+}
+
+/**
+ * @brief 微基准测试的程序入口
+ *
+ * @param argc 命令行参数个数
+ * @param argv 命令行参数列表=配置文件 [图像文件] [重复轮数] [名称过滤]
+ * @return int
+ */
+int main(int argc, char *argv[])
+{
+    google::InitGoogleLogging(argv[0]);
+    LOG_ASSERT(argc >= 2) << "\n Usage : ./ssvo_microbench config_file [image_file|synthetic] [repeats=7] [filter]";
+
+    Config::file_name_ = std::string(argv[1]);
+    const std::string image_file = argc > 2 ? argv[2] : "synthetic";
+    const int repeats = argc > 3 ? std::max(1, std::atoi(argv[3])) : 7;
+    const std::string filter = argc > 4 ? argv[4] : "";
+
+    std::vector<Scene> scenes;
+    std::vector<std::string> prefixes;
+    scenes.push_back(createScene(createSyntheticImage()));
+    prefixes.push_back("synthetic/");
+    if(image_file != "synthetic")
+    {
+        cv::Mat image = cv::imread(image_file, cv::IMREAD_GRAYSCALE);
+        LOG_ASSERT(!image.empty()) << "Failed to read image: " << image_file;
+        scenes.push_back(createScene(image));
+        prefixes.push_back("recorded/");
+    }
+
+    std::vector<MicroBenchmark> benchmarks;
+    for(size_t i = 0; i < scenes.size(); i++)
+        createBenchmarks(scenes[i], prefixes[i], benchmarks);
+
+    std::cout << std::left << std::setw(44) << "benchmark" << std::right
+              << std::setw(10) << "iters" << std::setw(8) << "items"
+              << std::setw(14) << "min ns/op" << std::setw(14) << "median ns/op" << std::setw(14) << "max ns/op"
+              << std::setw(14) << "ns/item" << std::endl;
+
+    std::cout.setf(std::ios::fixed, std::ios::floatfield);
+    std::cout.precision(1);
+    for(const MicroBenchmark &benchmark : benchmarks)
+    {
+        if(!filter.empty() && benchmark.name.find(filter) == std::string::npos)
+            continue;
+
+        const std::vector<double> ns_per_op = runBenchmark(benchmark, repeats);
+        const double median = ns_per_op[ns_per_op.size() / 2];
+        std::cout << std::left << std::setw(44) << benchmark.name << std::right
+                  << std::setw(10) << benchmark.iterations << std::setw(8) << benchmark.items
+                  << std::setw(14) << ns_per_op.front() << std::setw(14) << median << std::setw(14) << ns_per_op.back()
+                  << std::setw(14) << median / std::max(benchmark.items, 1) << std::endl;
+    }
+
+    return 0;
+}
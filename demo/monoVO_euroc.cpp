@@ -25,7 +25,7 @@ using namespace ssvo;
 int main(int argc, char *argv[])
 {
     google::InitGoogleLogging(argv[0]);
-    LOG_ASSERT(argc == 4) << "\n Usage : ./monoVO_dataset config_file calib_file dataset_path";
+    LOG_ASSERT(argc >= 4 && argc <= 6) << "\n Usage : ./monoVO_dataset config_file calib_file dataset_path [mode(0: max throughput, 1: real time)] [decode_threads]";
 
     //新建ssvo对象
     System vo(argv[1],  //配置文件
@@ -34,40 +34,36 @@ int main(int argc, char *argv[])
     //新建数据读取器对象
     EuRocDataReader dataset(argv[3]);       //给的参数就是数据集的路径
 
-    ssvo::Timer<std::micro> timer;
-    //遍历数据集的每张图片
+    //默认按时间戳实时输出, 批量处理数据集时使用最大吞吐量模式
+    const ImageSource::Mode mode = argc > 4 ? (ImageSource::Mode) atoi(argv[4]) : ImageSource::REAL_TIME;
+    const int decode_threads = argc > 5 ? atoi(argv[5]) : 2;
+
     const size_t N = dataset.leftImageSize();
+    std::vector<std::string> paths(N);
+    std::vector<double> timestamps(N);
     for(size_t i = 0; i < N; i++)
     {
-        //读取图片
-        const EuRocDataReader::Image image_data = dataset.leftImage(i);
-        LOG(INFO) << "=== Load Image " << i << ": " << image_data.path << ", time: " << std::fixed <<std::setprecision(7)<< image_data.timestamp << std::endl;
-        cv::Mat image = cv::imread(image_data.path, CV_LOAD_IMAGE_UNCHANGED);
-        if(image.empty())
+        paths[i] = dataset.leftImage(i).path;
+        timestamps[i] = dataset.leftImage(i).timestamp;
+    }
+
+    //图片在后台线程中预读取
+    ImageSource source(paths, timestamps, mode, decode_threads);
+    ImageSource::Item item;
+    while(source.next(item))
+    {
+        LOG(INFO) << "=== Load Image " << item.index << ": " << item.path << ", time: " << std::fixed <<std::setprecision(7)<< item.timestamp << std::endl;
+        if(item.image.empty())
             continue;
 
-        //对图片进行处理,并且计时
-        timer.start();
         //NOTE 这里就是主要的执行部分 
-        vo.process(image, image_data.timestamp);
-        timer.stop();
-
-        double time_process = timer.duration();
-
-        //时间同步机制
-        double time_wait = 0;
-        if(i < N -1)
-            time_wait = (dataset.leftImage(i+1).timestamp - image_data.timestamp)*1e6;
-        else
-            time_wait = (image_data.timestamp - dataset.leftImage(i-1).timestamp)*1e6;
-
-        if(time_process < time_wait)
-            std::this_thread::sleep_for(std::chrono::microseconds((int)(time_wait - time_process)));
+        vo.process(item.image, item.timestamp);
     }
 
     //当全部都处理完成之后,保存获得到的轨迹
     vo.saveTrajectoryTUM("trajectory.txt");
-    getchar();
+    if(vo.isViewerEnabled())
+        getchar();
 
     return 0;
 }
\ No newline at end of file
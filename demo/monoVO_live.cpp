@@ -1,4 +1,6 @@
+#include <thread>
 #include "system.hpp"
+#include "dataset.hpp"
 
 using namespace ssvo;
 
@@ -19,23 +21,37 @@ int main(int argc, char *argv[])
 
     System vo(argv[1], argv[2]);
 
-    std::string image_name;
-    double timestamp;
-    cv::Mat image;
-    for(;;)
+    //! a failed read is retried, the stream ends after about one second of consecutive failures
+    const int max_failed_reads = 100;
+
+    //! grab in the background, the oldest frame is dropped when tracking falls behind
+    ImageSource source([&vc, max_failed_reads](cv::Mat &image, double &timestamp) -> bool
     {
-        if(!vc.read(image))
+        for(int failed = 0; failed < max_failed_reads; failed++)
         {
+            if(vc.read(image))
+            {
+                timestamp = (double) cv::getTickCount() / cv::getTickFrequency();
+                return true;
+            }
+
             std::cout << "no image" << std::endl;
-            continue;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
         }
+        return false;
+    });
 
-        timestamp = (double) cv::getTickCount() / cv::getTickFrequency();
-        vo.process(image, timestamp);
+    ImageSource::Item item;
+    while(source.next(item))
+    {
+        vo.process(item.image, item.timestamp);
     }
 
+    LOG(INFO) << "Video stream finished, " << source.dropped() << " frames dropped";
+
     vo.saveTrajectoryTUM("trajectory.txt");
-    cv::waitKey(0);
+    if(vo.isViewerEnabled())
+        cv::waitKey(0);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -7,46 +7,29 @@ using namespace ssvo;
 int main(int argc, char *argv[])
 {
     google::InitGoogleLogging(argv[0]);
-    LOG_ASSERT(argc == 5) << "\n Usage : ./monoVO_tum config_file calib_file dataset_path association_file ";
+    LOG_ASSERT(argc >= 5 && argc <= 7) << "\n Usage : ./monoVO_tum config_file calib_file dataset_path association_file [mode(0: max throughput, 1: real time)] [decode_threads]";
 
     System vo(argv[1], argv[2]);
 
     TUMDataReader dataset(argv[3],argv[4]);
 
-    ssvo::Timer<std::micro> timer;
-    const size_t N = dataset.N;
-    for(size_t i = 0; i < N; i++)
+    const ImageSource::Mode mode = argc > 5 ? (ImageSource::Mode) atoi(argv[5]) : ImageSource::REAL_TIME;
+    const int decode_threads = argc > 6 ? atoi(argv[6]) : 2;
+
+    ImageSource source(dataset.rgb_images_, dataset.timestamps_, mode, decode_threads);
+    ImageSource::Item item;
+    while(source.next(item))
     {
-        string rgb_,depth_;
-        double timestamp;
-        if(!dataset.readItemByIndex(i,rgb_,depth_,timestamp))
-            std::cerr<<"NO image to load"<<std::endl;
-
-        LOG(INFO) << "=== Load Image " << i << ": " << rgb_ << ", time: " << std::fixed <<std::setprecision(7)<< timestamp << std::endl;
-        cv::Mat image = cv::imread(rgb_, CV_LOAD_IMAGE_UNCHANGED);
-        if(image.empty())
+        LOG(INFO) << "=== Load Image " << item.index << ": " << item.path << ", time: " << std::fixed <<std::setprecision(7)<< item.timestamp << std::endl;
+        if(item.image.empty())
             continue;
 
-        timer.start();
-        vo.process(image, timestamp);
-        timer.stop();
-
-        double time_process = timer.duration();
-
-        double time_wait = 0;
-        if(i < N -1)
-            time_wait = (dataset.timestamps_[i+1] - dataset.timestamps_[i])*1e6;
-        else
-            time_wait = (dataset.timestamps_[i] - dataset.timestamps_[i-1])*1e6;
-
-        if(time_process < time_wait)
-            std::this_thread::sleep_for(std::chrono::microseconds((int)(time_wait - time_process)));
-
-
+        vo.process(item.image, item.timestamp);
     }
 
     vo.saveTrajectoryTUM("trajectory.txt");
-    getchar();
+    if(vo.isViewerEnabled())
+        getchar();
 
     return 0;
 }
\ No newline at end of file
@@ -37,6 +37,27 @@ public:
     //指向当前类的智能指针类型
     typedef std::shared_ptr<BRIEF> Ptr;
 
+    /**
+     * @brief 计算描述子用的图像金字塔
+     * @detials 每层图像都带有 EDGE_THRESHOLD 的边界, 通过ROI访问, 与原图像大小相同.
+     * 只与图像有关, 因此可以缓存在帧上重复使用.
+     */
+    struct Pyramid
+    {
+        typedef std::shared_ptr<Pyramid> Ptr;
+
+        std::vector<cv::Mat> border;        ///<带边界的原图像, 用于计算方向
+        std::vector<cv::Mat> border_gauss;  ///<带边界的高斯模糊图像, 用于计算描述子
+    };
+
+    /**
+     * @brief 生成计算描述子用的图像金字塔
+     *
+     * @param[in] images    图像金字塔
+     * @return Pyramid::Ptr 带边界和高斯模糊的金字塔
+     */
+    Pyramid::Ptr createPyramid(const std::vector<cv::Mat> &images) const;
+
     /**
      * @brief 计算指定图片上指定特征点的描述子
      * 
@@ -46,6 +67,15 @@ public:
      */
     void compute(const std::vector<cv::Mat> &images, std::vector<cv::KeyPoint> &keypoints, cv::Mat &descriptors) const;
 
+    /**
+     * @brief 在已经生成的金字塔上计算特征点的方向和描述子, 特征点之间并行计算
+     *
+     * @param[in] pyramid       由 createPyramid 生成的金字塔
+     * @param[in] keypoints     给定特征点, 输出时带有方向
+     * @param[out] descriptors  描述子
+     */
+    void compute(const Pyramid &pyramid, std::vector<cv::KeyPoint> &keypoints, cv::Mat &descriptors) const;
+
     /**
      * @brief 计算特征点的方向
      * 
@@ -57,14 +87,14 @@ public:
     float IC_Angle(const cv::Mat &image, cv::Point2f pt, const std::vector<int> &u_max) const;
 
     /**
-     * @brief 根据指定的pattern计算某个特征点的brief描述子
+     * @brief 根据pattern计算某个特征点的brief描述子
+     * @detials 先将全部采样点按特征点方向旋转并取整(支持SSE2时每次4个点), 再逐对比较
      * 
      * @param[in] kpt       给定特征点
      * @param[in] img       特征点所在的图像
-     * @param[in] pattern   模式
      * @param[out] desc     指向描述子结果的指针
      */
-    void compute(const cv::KeyPoint &kpt, const cv::Mat &img, const cv::Point *pattern, uchar *desc) const;
+    void compute(const cv::KeyPoint &kpt, const cv::Mat &img, uchar *desc) const;
 
     /**
      * @brief 创建一个本类的实例
@@ -97,6 +127,10 @@ private:
 
     ///像素点提取模式
     std::vector<cv::Point> pattern_;
+    ///pattern的x坐标, 用于批量旋转
+    std::vector<float> pattern_x_;
+    ///pattern的y坐标
+    std::vector<float> pattern_y_;
     ///TODO 
     std::vector<int> umax_;
     ///TODO 为什么会有一系列的?
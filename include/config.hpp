@@ -88,10 +88,36 @@ public:
     static int maxSeedsBuffer(){return getInstance().max_seeds_buffer_;}
     /** @brief 处理的最大关键帧数目 */
     static int maxPerprocessKeyFrames(){return getInstance().max_perprocess_kfs_;}
+    /** @brief 深度滤波器更新种子所需的最小帧间视差 */
+    static double minFrameDisparity(){return getInstance().min_frame_disparity_;}
+    /** @brief 是否开启半稠密深度估计 */
+    static bool semiDenseEnable(){return getInstance().semi_dense_enable_;}
+    /** @brief 半稠密种子所在的金字塔层 */
+    static int semiDenseLevel(){return getInstance().semi_dense_level_;}
+    /** @brief 半稠密种子的最小梯度 */
+    static double semiDenseMinGradient(){return getInstance().semi_dense_min_gradient_;}
+    /** @brief 回环检测中Sim3 RANSAC的随机数种子, 为0时每个求解器由 std::random_device 初始化 */
+    static uint64_t loopRansacSeed(){return getInstance().loop_ransac_seed_;}
     /** @brief TODO */
     static string timeTracingDirectory(){return getInstance().time_trace_dir_;}
+    /** @brief 是否记录所有线程的时间线, 结束时保存到 Trace.log_dir 下的 ssvo_timeline.json */
+    static bool timelineEnable(){return getInstance().timeline_enable_;}
+    /** @brief 逐帧写入的轨迹文件, 为空时为 Trace.log_dir 下的 ssvo_trajectory_<pid>.bin, 已存在时覆盖. 默认文件在退出时删除(轨迹导出过时), 指定的文件保留 */
+    static std::string trajectoryFile(){return getInstance().trajectory_file_;}
+    /** @brief 是否在后台线程中写日志文件和终端 */
+    static bool logAsync(){return getInstance().log_async_;}
+    /** @brief 编译时打开 SSVO_LOCK_PROFILE 时, 输出锁统计的间隔(秒), 不大于0时只在结束时输出 */
+    static double lockReportInterval(){return getInstance().lock_report_interval_;}
+    /** @brief 输出运行时指标的 Unix 套接字路径, 为空时不监听 */
+    static std::string metricsSocket(){return getInstance().metrics_socket_;}
+    /** @brief 定期写入运行时指标快照的文件, 为空时不写 */
+    static std::string metricsSnapshotFile(){return getInstance().metrics_snapshot_file_;}
+    /** @brief 写入指标快照的间隔(秒) */
+    static double metricsSnapshotInterval(){return getInstance().metrics_snapshot_interval_;}
     /** @brief 词袋模型中字典的存放位置 */
     static std::string DBoWDirectory(){return getInstance().dbow_dir_;}
+    /** @brief 是否显示可视化窗口, 编译时关闭 SSVO_VIEWER_ENABLE 时总是不显示 */
+    static bool viewerEnable(){return getInstance().viewer_enable_;}
 
     /** @} */
 
@@ -159,6 +185,26 @@ private:
 
         max_seeds_buffer_ = (int)fs["DepthFilter.max_seeds_buffer"];
         max_perprocess_kfs_ = (int)fs["DepthFilter.max_perprocess_kfs"];
+        min_frame_disparity_ = 0.0;
+        if(!fs["DepthFilter.min_frame_disparity"].empty())
+            fs["DepthFilter.min_frame_disparity"] >> min_frame_disparity_;
+
+        int semi_dense_enable = 0;
+        if(!fs["DepthFilter.semi_dense"].empty())
+            fs["DepthFilter.semi_dense"] >> semi_dense_enable;
+        semi_dense_enable_ = semi_dense_enable != 0;
+        semi_dense_level_ = 1;
+        if(!fs["DepthFilter.semi_dense_level"].empty())
+            fs["DepthFilter.semi_dense_level"] >> semi_dense_level_;
+        semi_dense_min_gradient_ = 12.0;
+        if(!fs["DepthFilter.semi_dense_min_gradient"].empty())
+            fs["DepthFilter.semi_dense_min_gradient"] >> semi_dense_min_gradient_;
+
+        //! LoopClosure
+        int loop_ransac_seed = 0;
+        if(!fs["LoopClosure.ransac_seed"].empty())
+            fs["LoopClosure.ransac_seed"] >> loop_ransac_seed;
+        loop_ransac_seed_ = (uint64_t) MAX(loop_ransac_seed, 0);
 
         //! glog
         if(!fs["Glog.alsologtostderr"].empty())
@@ -179,14 +225,48 @@ private:
         if(!fs["Glog.log_dir"].empty())
             fs["Glog.log_dir"] >> FLAGS_log_dir;
 
+        int log_async = 0;
+        if(!fs["Glog.async"].empty())
+            fs["Glog.async"] >> log_async;
+        log_async_ = log_async != 0;
+
         //! Time Trace
         if(!fs["Trace.log_dir"].empty())
             fs["Trace.log_dir"] >> time_trace_dir_;
 
+        int timeline_enable = 0;
+        if(!fs["Trace.timeline"].empty())
+            fs["Trace.timeline"] >> timeline_enable;
+        timeline_enable_ = timeline_enable != 0;
+
+        if(!fs["Trace.trajectory_file"].empty())
+            fs["Trace.trajectory_file"] >> trajectory_file_;
+
+        lock_report_interval_ = 10.0;
+        if(!fs["Trace.lock_report_interval"].empty())
+            fs["Trace.lock_report_interval"] >> lock_report_interval_;
+
+        //! Metrics
+        if(!fs["Metrics.socket"].empty())
+            fs["Metrics.socket"] >> metrics_socket_;
+
+        if(!fs["Metrics.snapshot_file"].empty())
+            fs["Metrics.snapshot_file"] >> metrics_snapshot_file_;
+
+        metrics_snapshot_interval_ = 5.0;
+        if(!fs["Metrics.snapshot_interval"].empty())
+            fs["Metrics.snapshot_interval"] >> metrics_snapshot_interval_;
+
         //! DBoW
         if(!fs["DBoW.voc_dir"].empty())
             fs["DBoW.voc_dir"] >> dbow_dir_;
 
+        //! Viewer
+        int viewer_enable = 1;
+        if(!fs["Viewer.enable"].empty())
+            fs["Viewer.enable"] >> viewer_enable;
+        viewer_enable_ = viewer_enable != 0;
+
         fs.release();
     }
 
@@ -238,12 +318,33 @@ private:
     //! DepthFilter
     int max_seeds_buffer_;
     int max_perprocess_kfs_;
+    double min_frame_disparity_;
+    bool semi_dense_enable_;
+    int semi_dense_level_;
+    double semi_dense_min_gradient_;
+
+    //! LoopClosure
+    uint64_t loop_ransac_seed_;
+
+    //! glog
+    bool log_async_;
 
     //! TimeTrace
     string time_trace_dir_;
-    
+    bool timeline_enable_;
+    std::string trajectory_file_;
+    double lock_report_interval_;
+
+    //! Metrics
+    std::string metrics_socket_;
+    std::string metrics_snapshot_file_;
+    double metrics_snapshot_interval_;
+
     //! DBoW
     std::string dbow_dir_;
+
+    //! Viewer
+    bool viewer_enable_;
 };
 
 }
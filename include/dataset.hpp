@@ -15,6 +15,12 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
 #include <opencv2/opencv.hpp>
 
 namespace ssvo {
@@ -476,6 +482,253 @@ private:
     std::vector<GroundTruthData> groundtruth_;  ///<轨迹真值序列
 };
 
+/**
+ * @brief 带预读取队列的图像源
+ * @detials 读取图像文件时由多个线程并行解码, 放入有界的预读取队列, 按索引顺序输出, 解码时间不再和追踪串行.
+ * 读取视频流时由一个线程抓取, 队列满时丢弃最旧的一帧.
+ * 数据集可以按时间戳的节奏实时输出, 也可以不等待, 以最大吞吐量输出.
+ */
+class ImageSource {
+public:
+
+    /** @brief 输出模式 */
+    enum Mode{
+        MAX_THROUGHPUT = 0,     ///<不等待, 解码完成就输出
+        REAL_TIME = 1,          ///<按照时间戳的间隔输出
+    };
+
+    /** @brief 一帧图像 */
+    struct Item{
+        size_t index;           ///<序号
+        double timestamp;       ///<时间戳
+        std::string path;       ///<文件路径, 视频流为空
+        cv::Mat image;          ///<图像, 解码失败时为空
+    };
+
+    /** @brief 视频流的抓取函数, 返回false时表示视频流结束 */
+    typedef std::function<bool(cv::Mat &image, double &timestamp)> Grabber;
+
+    /**
+     * @brief 从图像文件序列构造
+     *
+     * @param[in] paths         图像路径
+     * @param[in] timestamps    对应的时间戳
+     * @param[in] mode          输出模式
+     * @param[in] num_threads   解码线程数
+     * @param[in] capacity      预读取队列的长度
+     * @param[in] flags         cv::imread 的参数
+     */
+    ImageSource(const std::vector<std::string> &paths, const std::vector<double> &timestamps, const Mode mode = REAL_TIME,
+                const int num_threads = 2, const size_t capacity = 8, const int flags = cv::IMREAD_UNCHANGED) :
+        paths_(paths), timestamps_(timestamps), mode_(mode), flags_(flags), capacity_(std::max(capacity, (size_t)1)),
+        slots_(capacity_), ready_(capacity_, false), next_load_(0), next_read_(0), stop_(false), finished_(false), dropped_(0)
+    {
+        if(timestamps_.size() < paths_.size())
+        {
+            std::cerr << "ImageSource, " << paths_.size() << " images with only " << timestamps_.size() << " timestamps!" << std::endl;
+            paths_.resize(timestamps_.size());
+        }
+
+        for(int i = 0; i < std::max(num_threads, 1); i++)
+            workers_.emplace_back(&ImageSource::decode, this);
+    }
+
+    /**
+     * @brief 从视频流构造, 总是实时的
+     *
+     * @param[in] grabber   抓取函数, 只在一个线程中调用
+     * @param[in] capacity  预读取队列的长度
+     */
+    ImageSource(const Grabber &grabber, const size_t capacity = 2) :
+        grabber_(grabber), mode_(MAX_THROUGHPUT), flags_(cv::IMREAD_UNCHANGED), capacity_(std::max(capacity, (size_t)1)),
+        next_load_(0), next_read_(0), stop_(false), finished_(false), dropped_(0)
+    {
+        workers_.emplace_back(&ImageSource::grab, this);
+    }
+
+    ImageSource(const ImageSource&) = delete;
+    ImageSource &operator=(const ImageSource&) = delete;
+
+    ~ImageSource() { stop(); }
+
+    /**
+     * @brief 按顺序取出下一帧, 队列为空时阻塞
+     *
+     * @param[out] item 图像
+     * @return true
+     * @return false    所有图像都已取出或已经停止
+     */
+    bool next(Item &item)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if(grabber_)
+            {
+                cond_read_.wait(lock, [&]{ return stop_ || finished_ || !queue_.empty(); });
+                if(queue_.empty())
+                    return false;
+                item = std::move(queue_.front());
+                queue_.pop_front();
+                return true;
+            }
+
+            if(next_read_ >= paths_.size())
+                return false;
+
+            const size_t slot = next_read_ % capacity_;
+            cond_read_.wait(lock, [&]{ return stop_ || ready_[slot]; });
+            if(stop_)
+                return false;
+
+            item = std::move(slots_[slot]);
+            ready_[slot] = false;
+            next_read_++;
+        }
+        cond_load_.notify_all();
+
+        if(mode_ == REAL_TIME)
+        {
+            //! paced against the first frame, so the time spent by the caller is not accumulated
+            if(item.index == 0)
+                start_time_ = std::chrono::steady_clock::now();
+            else
+                std::this_thread::sleep_until(start_time_ + std::chrono::microseconds((int64_t)((item.timestamp - timestamps_[0]) * 1e6)));
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief 停止并等待所有线程退出
+     */
+    void stop()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_load_.notify_all();
+        cond_read_.notify_all();
+
+        for(std::thread &worker : workers_)
+        {
+            if(worker.joinable())
+                worker.join();
+        }
+        workers_.clear();
+    }
+
+    /** @brief 图像文件的数目, 视频流为0 */
+    size_t size() const { return paths_.size(); }
+
+    /** @brief 视频流中因为队列满而丢弃的帧数 */
+    size_t dropped()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return dropped_;
+    }
+
+private:
+
+    /**
+     * @brief 解码线程, 领取下一个索引, 在锁外解码后放入对应的位置
+     */
+    void decode()
+    {
+        const size_t N = paths_.size();
+        while(true)
+        {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_load_.wait(lock, [&]{ return stop_ || next_load_ >= N || next_load_ < next_read_ + capacity_; });
+                if(stop_ || next_load_ >= N)
+                    return;
+                index = next_load_++;
+            }
+
+            Item item;
+            item.index = index;
+            item.timestamp = timestamps_[index];
+            item.path = paths_[index];
+            item.image = cv::imread(item.path, flags_);
+
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                slots_[index % capacity_] = std::move(item);
+                ready_[index % capacity_] = true;
+            }
+            cond_read_.notify_all();
+        }
+    }
+
+    /**
+     * @brief 视频流的抓取线程
+     */
+    void grab()
+    {
+        while(true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if(stop_)
+                    return;
+            }
+
+            Item item;
+            item.index = next_load_;
+            if(!grabber_(item.image, item.timestamp))
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                finished_ = true;
+                cond_read_.notify_all();
+                return;
+            }
+            next_load_++;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if(queue_.size() >= capacity_)
+                {
+                    queue_.pop_front();
+                    dropped_++;
+                }
+                queue_.push_back(std::move(item));
+            }
+            cond_read_.notify_all();
+        }
+    }
+
+private:
+
+    std::vector<std::string> paths_;
+    std::vector<double> timestamps_;
+    Grabber grabber_;
+
+    const Mode mode_;
+    const int flags_;
+    const size_t capacity_;
+
+    ///图像文件: 以索引对队列长度取模的位置存放
+    std::vector<Item> slots_;
+    std::vector<bool> ready_;
+    ///视频流: 先进先出
+    std::deque<Item> queue_;
+
+    size_t next_load_;
+    size_t next_read_;
+    bool stop_;
+    bool finished_;
+    size_t dropped_;
+
+    std::chrono::steady_clock::time_point start_time_;
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable cond_load_;
+    std::condition_variable cond_read_;
+};
+
 }
 
 #endif //_SSVO_DATASET_HPP_
@@ -12,9 +12,13 @@
 #ifndef _SSVO_DEPTH_FILTER_HPP_
 #define _SSVO_DEPTH_FILTER_HPP_
 
+#include <tuple>
+#include <chrono>
+#include <fstream>
 #include "global.hpp"
 #include "map.hpp"
 #include "seed.hpp"
+#include "semi_dense_filter.hpp"
 #include "feature_detector.hpp"
 #include "local_mapping.hpp"
 
@@ -87,8 +91,23 @@ public:
     void stopMainThread();
 
     /**
-     * @brief TODO 
+     * @brief 获取关键帧的半稠密逆深度图
+     * @detials 需要在配置文件中开启 DepthFilter.semi_dense, 图像大小为 DepthFilter.semi_dense_level 层的大小
      * 
+     * @param[in] keyframe          关键帧
+     * @param[out] inv_depth        逆深度图, CV_32FC1, 没有估计的像素为0
+     * @param[out] variance         逆深度的方差, CV_32FC1, 没有估计的像素为-1
+     * @param[in] converged_only    是否只输出已经收敛的像素
+     * @return true 
+     * @return false                没有开启半稠密模式或者该关键帧没有逆深度图
+     */
+    bool getInverseDepthMap(const KeyFrame::Ptr &keyframe, cv::Mat &inv_depth, cv::Mat &variance, bool converged_only = true);
+
+    /**
+     * @brief 将还没有写入的关键帧的种子收敛统计写入文件并关闭文件
+     * @detials 文件为 ssvo_trace_seeds.csv, 与 dfltTrace 位于同一目录. 每行一个关键帧:
+     * 创建/收敛/发散/剩余的种子数, 收敛所需更新次数的直方图以及收敛用时.
+     * 运行中关键帧的种子全部收敛, 关键帧被删除或者统计的关键帧过多时, 其统计会提前写入文件并从内存中删除
      */
     void logSeedsInfo();
 
@@ -145,15 +164,17 @@ private:
     /**
      * @brief 检查新帧
      * 
-     * @param[TODO] frame       TODO
-     * @param[TODO] keyframe    TODO
+     * @param[out] frame       队首的帧
+     * @param[out] keyframe    队首帧对应的关键帧,可能为空
+     * @param[out] updatable   入队时的视差检查结果,为真时才需要更新种子
      * @return true 
      * @return false 
      */
-    bool checkNewFrame(Frame::Ptr &frame, KeyFrame::Ptr &keyframe);
+    bool checkNewFrame(Frame::Ptr &frame, KeyFrame::Ptr &keyframe, bool &updatable);
 
     /**
      * @brief 计算视差
+     * @detials 在入队时调用(跟踪线程),与上一个通过检查的帧比较视差
      * 
      * @param[in] frame TODO
      * @return true 
@@ -207,6 +228,40 @@ private:
      */
     int reprojectSeeds(const KeyFrame::Ptr& keyframe, const Frame::Ptr &frame, double epl_err, double px_error, bool created = true);
 
+    /**
+     * @brief 更新半稠密种子, 并在新的关键帧上创建半稠密种子
+     * 
+     * @param[in] frame     当前帧
+     * @param[in] keyframe  当前帧对应的关键帧,可能为空
+     * @param[in] updatable 是否通过了视差检查
+     */
+    void updateSemiDense(const Frame::Ptr &frame, const KeyFrame::Ptr &keyframe, bool updatable);
+
+    /**
+     * @brief 种子收敛时调用,记录统计信息并通过回调函数交给建图线程
+     * 
+     * @param[in] seed 已经收敛的种子
+     */
+    void convergeSeed(const Seed::Ptr &seed);
+
+    struct SeedsInfo;
+
+    /**
+     * @brief 把已经结束的关键帧的种子统计写入文件并删除, 调用时需要持有 mutex_seeds_info_
+     * @detials 关键帧已经被删除, 没有剩余的种子, 或者统计的关键帧超过 SeedsInfo::MaxKeyFrames 时(最早的关键帧)结束
+     * 
+     * @param[in] all 为真时写入所有的统计
+     */
+    void finishSeedsInfo(bool all);
+
+    /**
+     * @brief 把一个关键帧的种子统计写入文件, 调用时需要持有 mutex_seeds_info_
+     * 
+     * @param[in] keyframe_id   关键帧id
+     * @param[in] info          种子统计
+     */
+    void writeSeedsInfo(uint64_t keyframe_id, const SeedsInfo &info);
+
     /**
      * @brief 寻找极线上的匹配
      * 
@@ -245,10 +300,42 @@ private:
     ///fast角点提取器句柄
     FastDetector::Ptr fast_detector_;
 
+    ///半稠密深度滤波器, 没有开启时为空
+    SemiDenseFilter::Ptr semi_dense_filter_;
+
     //这个是一种首尾都可以直接插入和删除的vector
-    ///帧和关键帧的句柄对数组
-    std::deque<std::pair<Frame::Ptr, KeyFrame::Ptr> > frames_buffer_;
-//    std::map<uint64_t, std::tuple<int, int> > seeds_convergence_rate_;
+    ///帧,关键帧的句柄以及入队时视差检查的结果
+    std::deque<std::tuple<Frame::Ptr, KeyFrame::Ptr, bool> > frames_buffer_;
+    ///自上次出队以来被合并掉的低视差帧数目
+    int frames_dropped_;
+    ///上一个通过视差检查的帧
+    Frame::Ptr frame_disparity_ref_;
+
+    /**
+     * @brief 每个关键帧上种子的收敛统计
+     * 
+     */
+    struct SeedsInfo{
+        enum {
+            HistSize = 8,   ///<更新次数直方图的桶数, 第i个桶对应 [2^i, 2^(i+1)) 次更新, 最后一个桶包含更多的次数
+            MaxKeyFrames = 64,  ///<内存中最多保留统计的关键帧数
+        };
+        std::weak_ptr<KeyFrame> keyframe;                       ///<种子所在的关键帧
+        int created;                                            ///<创建的种子数
+        int converged;                                          ///<收敛的种子数
+        int updates;                                            ///<收敛的种子的更新次数之和
+        int updates_hist[HistSize];                             ///<收敛所需更新次数的直方图
+        double time_sum;                                        ///<收敛用时之和(ms)
+        double time_max;                                        ///<最长收敛用时(ms)
+        std::chrono::steady_clock::time_point time_created;     ///<种子创建的时刻
+    };
+
+    ///关键帧id到种子统计的映射
+    std::map<uint64_t, SeedsInfo> seeds_info_;
+    ///种子统计的锁
+    std::mutex mutex_seeds_info_;
+    ///种子统计文件, 第一次写入时打开
+    std::ofstream seeds_info_file_;
 
     ///是否汇报
     const bool report_;
@@ -274,6 +361,8 @@ private:
     std::condition_variable cond_process_main_;
     ///多线程消息机制相关
     std::future<int> seeds_track_future_;
+    ///klt跟踪种子的耗时, 在 seeds_track_future_ 就绪前写入
+    mutable double klt_time_;
 };
 
 }
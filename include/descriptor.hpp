@@ -0,0 +1,207 @@
+/**
+ * @file descriptor.hpp
+ * @brief 256位BRIEF描述子的紧凑存储与汉明距离
+ * @detials 描述子以4个64位整数存放, 避免每个描述子一个 cv::Mat 头. 汉明距离使用硬件 popcount 指令,
+ * 没有硬件 popcount 但支持AVX2时, 1对N的距离计算使用向量化的查表法(每次处理一个完整的描述子).
+ * @version 0.1
+ * @date 2019-01-18
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef _SSVO_DESCRIPTOR_HPP_
+#define _SSVO_DESCRIPTOR_HPP_
+
+#include <cstring>
+#include "global.hpp"
+
+#if defined(__AVX2__) || defined(__POPCNT__)
+#include <immintrin.h>
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//! 32字节的描述子用4次硬件 popcount 比AVX2查表更快, 查表法只在没有 popcount 指令时使用
+#if defined(__AVX2__) && !defined(__POPCNT__)
+#define SSVO_HAMMING_LOOKUP_AVX2
+#endif
+
+namespace ssvo
+{
+
+/**
+ * @brief 256位的BRIEF描述子
+ *
+ */
+struct BriefDescriptor
+{
+    enum {
+        BYTES = 32,     ///<字节数, 与 BRIEF::compute 输出的每行相同
+        WORDS = 4,      ///<64位整数的个数
+    };
+
+    uint64_t data[WORDS];
+
+    /**
+     * @brief 从32字节的内存(如描述子矩阵的一行)构造
+     *
+     * @param[in] ptr   描述子数据
+     * @return BriefDescriptor
+     */
+    inline static BriefDescriptor create(const uchar *ptr)
+    {
+        BriefDescriptor desc;
+        std::memcpy(desc.data, ptr, BYTES);
+        return desc;
+    }
+};
+
+typedef std::vector<BriefDescriptor> BriefDescriptors;
+
+/**
+ * @brief 1对N匹配中最近的两个描述子, 用于比值检验
+ *
+ */
+struct HammingMatch
+{
+    int index;      ///<最近描述子的下标, 没有候选时为-1
+    int dist1;      ///<最近距离
+    int dist2;      ///<次近距离
+};
+
+/**
+ * @brief 将 BRIEF::compute 得到的 N x 32 描述子矩阵转换为紧凑存储
+ *
+ * @param[in] mat   CV_8UC1 的描述子矩阵
+ * @param[out] descs 描述子
+ * @param[in] rows  转换的行数, 小于0时转换全部行
+ */
+inline void packDescriptors(const cv::Mat &mat, BriefDescriptors &descs, int rows = -1)
+{
+    LOG_ASSERT(mat.type() == CV_8UC1 && mat.cols == BriefDescriptor::BYTES) << "Wrong descriptor matrix, type: " << mat.type() << ", cols: " << mat.cols;
+    if(rows < 0 || rows > mat.rows)
+        rows = mat.rows;
+
+    descs.resize(rows);
+    for(int i = 0; i < rows; i++)
+        std::memcpy(descs[i].data, mat.ptr<uchar>(i), BriefDescriptor::BYTES);
+}
+
+inline int popcount64(const uint64_t v)
+{
+#if defined(__POPCNT__)
+    return (int) _mm_popcnt_u64(v);
+#elif defined(_MSC_VER)
+    return (int) __popcnt64(v);
+#else
+    return __builtin_popcountll(v);
+#endif
+}
+
+/**
+ * @brief 两个描述子之间的汉明距离
+ *
+ */
+inline int hammingDistance(const BriefDescriptor &a, const BriefDescriptor &b)
+{
+    return popcount64(a.data[0] ^ b.data[0]) + popcount64(a.data[1] ^ b.data[1])
+        + popcount64(a.data[2] ^ b.data[2]) + popcount64(a.data[3] ^ b.data[3]);
+}
+
+#ifdef SSVO_HAMMING_LOOKUP_AVX2
+/**
+ * @brief AVX2 下一个完整描述子的汉明距离, 按4位查表统计每个字节的1的个数
+ *
+ */
+inline int hammingDistanceAVX2(const __m256i &a, const BriefDescriptor &b)
+{
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+
+    const __m256i v = _mm256_xor_si256(a, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b.data)));
+    const __m256i lo = _mm256_and_si256(v, low_mask);
+    const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+    const __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+    const __m256i sum = _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+
+    return _mm256_extract_epi64(sum, 0) + _mm256_extract_epi64(sum, 1) + _mm256_extract_epi64(sum, 2) + _mm256_extract_epi64(sum, 3);
+}
+#endif
+
+/**
+ * @brief 一个描述子与N个描述子之间的汉明距离
+ *
+ * @param[in] query     查询描述子
+ * @param[in] train     N个描述子
+ * @param[in] n         描述子的个数
+ * @param[out] dists    N个距离
+ */
+inline void hammingDistances(const BriefDescriptor &query, const BriefDescriptor *train, const int n, int *dists)
+{
+#ifdef SSVO_HAMMING_LOOKUP_AVX2
+    const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(query.data));
+    for(int i = 0; i < n; i++)
+        dists[i] = hammingDistanceAVX2(q, train[i]);
+#else
+    for(int i = 0; i < n; i++)
+        dists[i] = hammingDistance(query, train[i]);
+#endif
+}
+
+/**
+ * @brief N个描述子与M个描述子两两之间的汉明距离
+ *
+ * @param[in] query     N个描述子
+ * @param[in] n         N
+ * @param[in] train     M个描述子
+ * @param[in] m         M
+ * @param[out] dists    N x M 的距离, 按行存放
+ */
+inline void hammingDistances(const BriefDescriptor *query, const int n, const BriefDescriptor *train, const int m, int *dists)
+{
+    for(int i = 0; i < n; i++)
+        hammingDistances(query[i], train, m, dists + i * m);
+}
+
+/**
+ * @brief 在候选描述子中查找最近的两个
+ *
+ * @param[in] query     查询描述子
+ * @param[in] train     全部描述子
+ * @param[in] indices   候选描述子在 train 中的下标
+ * @return HammingMatch 最近的候选和前两名的距离, 距离初始为256
+ */
+inline HammingMatch hammingSearch(const BriefDescriptor &query, const BriefDescriptor *train, const std::vector<int> &indices)
+{
+    HammingMatch match = {-1, 256, 256};
+
+#ifdef SSVO_HAMMING_LOOKUP_AVX2
+    const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(query.data));
+#endif
+    for(const int idx : indices)
+    {
+#ifdef SSVO_HAMMING_LOOKUP_AVX2
+        const int dist = hammingDistanceAVX2(q, train[idx]);
+#else
+        const int dist = hammingDistance(query, train[idx]);
+#endif
+        if(dist < match.dist1)
+        {
+            match.dist2 = match.dist1;
+            match.dist1 = dist;
+            match.index = idx;
+        }
+        else if(dist < match.dist2)
+        {
+            match.dist2 = dist;
+        }
+    }
+
+    return match;
+}
+
+}
+
+#endif //_SSVO_DESCRIPTOR_HPP_
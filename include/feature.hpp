@@ -17,6 +17,7 @@
 #include <Eigen/Dense>
 
 #include "global.hpp"
+#include "descriptor.hpp"
 
 namespace ssvo {
 
@@ -49,7 +50,7 @@ public:
 
     //如果使用闭环的话,就得需要计算描述子了
 #ifdef SSVO_DBOW_ENABLE
-    cv::Mat descriptors_; //! the descriptor belong to this frame
+    BriefDescriptor descriptor_; //! the descriptor belong to this frame
 #endif
 
     /**
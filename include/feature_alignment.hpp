@@ -85,6 +85,8 @@ public:
                          const bool verbose = false);
 };
 
+static_assert((int) AlignPatchCache::Patch::RowsAtCompileTime == (int) AlignPatch::SizeWithBorder, "AlignPatchCache should have the same size as AlignPatch::SizeWithBorder");
+
 
 //! ====================== Pattern align
 /**
@@ -17,6 +17,8 @@
 #include "map_point.hpp"
 #include "seed.hpp"
 #include "feature_detector.hpp"
+#include "brief.hpp"
+#include "lock_profiler.hpp"
 
 namespace ssvo{
 
@@ -57,6 +59,19 @@ public:
      * @return const cv::Mat 得到的图像
      */
     const cv::Mat getImage(int level) const;
+    /**
+     * @brief 获取计算描述子用的图像金字塔
+     * @detials 第一次调用时由 brief 生成并缓存在帧上; brief 为空时只返回已经缓存的金字塔(可能为空)
+     * 
+     * @param[in] brief                 描述子计算器
+     * @return BRIEF::Pyramid::Ptr      带边界和高斯模糊的图像金字塔
+     */
+    BRIEF::Pyramid::Ptr getBriefPyramid(const BRIEF::Ptr &brief = nullptr);
+    /**
+     * @brief 释放缓存的描述子金字塔
+     * 
+     */
+    void releaseBriefPyramid();
 
     //! Transform (c)amera from (w)orld
     /**
@@ -349,10 +364,14 @@ protected:
     ///当前帧的参考关键帧
     std::shared_ptr<KeyFrame> ref_keyframe_;
 
+    ///计算描述子用的图像金字塔缓存
+    BRIEF::Pyramid::Ptr brief_pyr_;
+
     ///线程锁
-    std::mutex mutex_pose_;
-    std::mutex mutex_feature_;
-    std::mutex mutex_seed_;
+    NamedMutex mutex_pose_{"Frame::mutex_pose_"};
+    NamedMutex mutex_feature_{"Frame::mutex_feature_"};
+    NamedMutex mutex_seed_{"Frame::mutex_seed_"};
+    std::mutex mutex_brief_pyr_;
 
 private:
     ///光流金字塔 TODO 和上面的图像金字塔有啥不同吗?
@@ -66,7 +66,7 @@ public:
 
     std::vector<Feature::Ptr> dbow_fts_;
     cv::Mat descriptors_;
-    unsigned int dbow_Id_;
+    unsigned int dbow_Id_;  ///<在关键帧数据库中的位置, 压缩时重新编号, 不在数据库中时为-1
 
     DBoW3::BowVector bow_vec_;
 
@@ -74,7 +74,8 @@ public:
 
 
     //TODO 可能有特征点融合的问题
-    std::unordered_map<uint64_t , cv::Mat> mptId_des;
+    //! descriptors of featuresInBow, in the same order
+    BriefDescriptors descriptorsInBow;
 
     std::unordered_map<uint64_t , uint> mptId_nodeId;
 
@@ -100,7 +101,7 @@ private:
 
     bool isBad_;
 
-    std::mutex mutex_connection_;
+    NamedMutex mutex_connection_{"KeyFrame::mutex_connection_"};
 
     bool notErase;
 
@@ -0,0 +1,160 @@
+/**
+ * @file keyframe_database.hpp
+ * @brief 用于闭环检测和重定位的关键帧数据库
+ * @detials 以单词id建立倒排索引, 每个单词记录出现过的关键帧及其权重. 查询时只遍历查询向量中单词的倒排表,
+ * 在以数据库位置为下标的数组中同时累加共同单词数和得分, 不需要再对每个结果逐个比较词袋向量.
+ * 被剔除的关键帧先标记删除, 无效的倒排项超过一定比例后压缩数据库并重新编号.
+ * @version 0.1
+ * @date 2019-01-18
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef _SSVO_KEYFRAME_DATABASE_HPP_
+#define _SSVO_KEYFRAME_DATABASE_HPP_
+
+#include <DBoW3/DBoW3.h>
+#include "global.hpp"
+#include "keyframe.hpp"
+
+namespace ssvo
+{
+
+/**
+ * @brief 关键帧数据库
+ * @detials 关键帧在数据库中的位置保存在 KeyFrame::dbow_Id_ 中, 与关键帧id无关, 压缩后会改变.
+ * 数据库内部有锁, 可以被多个线程同时访问, 但 compact 只能在使用 QueryResult 的线程(闭环检测线程)中调用.
+ *
+ */
+class KeyFrameDatabase : public noncopyable
+{
+public:
+    ///指向本类的智能指针
+    typedef std::shared_ptr<KeyFrameDatabase> Ptr;
+
+    /**
+     * @brief 一次查询的结果
+     * @detials 共同单词数和得分以数据库位置为下标, 没有共同单词的关键帧为0, 可以在一次遍历中累加共视关键帧的得分
+     *
+     */
+    struct QueryResult
+    {
+        std::vector<KeyFrame::Ptr> keyframes;   ///<与查询向量有共同单词的关键帧
+        std::vector<int> common_words;          ///<共同单词数
+        std::vector<double> scores;             ///<相似度得分, 与 DBoW3::Vocabulary::score 相同
+
+        inline int commonWords(const KeyFrame::Ptr &kf) const
+        { return kf->dbow_Id_ < common_words.size() ? common_words[kf->dbow_Id_] : 0; }
+
+        inline double score(const KeyFrame::Ptr &kf) const
+        { return kf->dbow_Id_ < scores.size() ? scores[kf->dbow_Id_] : 0.0; }
+    };
+
+    /**
+     * @brief 加入关键帧, 需要已经计算好词袋向量
+     *
+     * @param[in] kf    关键帧
+     */
+    void add(const KeyFrame::Ptr &kf);
+
+    /**
+     * @brief 删除关键帧, 只做标记, 倒排表在 compact 时清理
+     *
+     * @param[in] kf    关键帧
+     * @return true     关键帧在数据库中
+     * @return false
+     */
+    bool remove(const KeyFrame::Ptr &kf);
+
+    /**
+     * @brief 删除已经变坏的关键帧, 无效倒排项的比例超过阈值时压缩倒排表并重新编号
+     *
+     * @param[in] force 不检查比例, 总是压缩
+     * @return int      本次删除的关键帧数目
+     */
+    int compact(bool force = false);
+
+    /**
+     * @brief 查询与词袋向量有共同单词的所有关键帧
+     *
+     * @param[in] bow_vec   词袋向量
+     * @param[out] result   查询结果
+     */
+    void query(const DBoW3::BowVector &bow_vec, QueryResult &result);
+
+    /**
+     * @brief 查询得分最高的关键帧
+     *
+     * @param[in] bow_vec       词袋向量
+     * @param[out] keyframes    按得分降序排列的关键帧
+     * @param[out] scores       对应的得分
+     * @param[in] max_results   最多返回的数目
+     */
+    void query(const DBoW3::BowVector &bow_vec, std::vector<KeyFrame::Ptr> &keyframes, std::vector<double> &scores, int max_results = 1);
+
+    /**
+     * @brief 数据库中有效关键帧的数目
+     *
+     * @return size_t
+     */
+    size_t size();
+
+    /**
+     * @brief 创建本类的一个实例
+     *
+     * @param[in] vocabulary    字典, 决定单词数目和得分的计算方式
+     * @return Ptr
+     */
+    inline static Ptr create(DBoW3::Vocabulary* vocabulary)
+    { return Ptr(new KeyFrameDatabase(vocabulary)); }
+
+private:
+
+    KeyFrameDatabase(DBoW3::Vocabulary* vocabulary);
+
+    /**
+     * @brief 在倒排表上累加共同单词数和得分, 调用时需持有锁
+     *
+     */
+    void accumulate(const DBoW3::BowVector &bow_vec, QueryResult &result);
+
+    /**
+     * @brief 标记删除, 调用时需持有锁
+     *
+     */
+    bool erase(const KeyFrame::Ptr &kf);
+
+private:
+
+    struct Option{
+        double max_dead_ratio;      ///<无效倒排项超过该比例时压缩
+        size_t min_dead_postings;   ///<无效倒排项少于该数目时不压缩
+    } options_;
+
+    ///倒排表中的一项
+    struct Posting
+    {
+        unsigned int slot;
+        DBoW3::WordValue value;
+    };
+
+    DBoW3::Vocabulary* vocabulary_;
+    const DBoW3::ScoringType scoring_;
+
+    ///以单词id为下标的倒排索引
+    std::vector<std::vector<Posting> > inverted_index_;
+
+    ///以数据库位置为下标, 删除的关键帧保留到压缩时
+    std::vector<KeyFrame::Ptr> entries_;
+    std::vector<bool> alive_;
+    size_t num_keyframes_;
+    size_t num_postings_;
+    size_t num_dead_postings_;
+
+    std::mutex mutex_database_;
+};
+
+}
+
+#endif //_SSVO_KEYFRAME_DATABASE_HPP_
@@ -0,0 +1,135 @@
+/**
+ * @file keyframe_indexer.hpp
+ * @brief 关键帧的位置识别索引
+ * @detials 在独立的线程中为关键帧提取角点和描述子、计算词袋向量, 然后一次性加入关键帧数据库并交给闭环检测线程,
+ * 这样建图线程每个关键帧的耗时只包含几何部分.
+ * @version 0.1
+ * @date 2019-01-18
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef _SSVO_KEYFRAME_INDEXER_HPP_
+#define _SSVO_KEYFRAME_INDEXER_HPP_
+
+#include <DBoW3/DBoW3.h>
+#include "global.hpp"
+#include "keyframe.hpp"
+#include "feature_detector.hpp"
+#include "brief.hpp"
+#include "keyframe_database.hpp"
+
+namespace ssvo
+{
+
+class LoopClosure;
+
+/**
+ * @brief 关键帧索引线程
+ * @detials 关键帧按插入顺序加入数据库
+ *
+ */
+class KeyFrameIndexer : public noncopyable
+{
+public:
+    ///指向本类的智能指针
+    typedef std::shared_ptr<KeyFrameIndexer> Ptr;
+
+    /**
+     * @brief 插入新的关键帧, 有线程时放入队列, 否则立即建立索引
+     *
+     * @param[in] keyframe  关键帧
+     */
+    void insertKeyFrame(const KeyFrame::Ptr &keyframe);
+
+    /**
+     * @brief 开启主线程
+     *
+     */
+    void startMainThread();
+
+    /**
+     * @brief 停止主线程
+     *
+     */
+    void stopMainThread();
+
+    /**
+     * @brief 设置闭环检测线程, 关键帧加入数据库后交给它
+     *
+     * @param[in] loop_closure 闭环检测
+     */
+    void setLoopCloser(std::shared_ptr<LoopClosure> loop_closure);
+
+    /**
+     * @brief 等待建立索引的关键帧数目
+     *
+     * @return size_t
+     */
+    size_t queueSize();
+
+    /**
+     * @brief 创建本类的一个实例
+     *
+     * @param[in] vocabulary    字典
+     * @param[in] database      关键帧数据库
+     * @param[in] fast          角点提取器, 只在本线程中使用
+     * @param[in] report        是否输出信息
+     * @param[in] verbose       是否输出详细信息
+     * @return Ptr
+     */
+    inline static Ptr create(DBoW3::Vocabulary* vocabulary, const KeyFrameDatabase::Ptr &database, const FastDetector::Ptr &fast, bool report = false, bool verbose = false)
+    { return Ptr(new KeyFrameIndexer(vocabulary, database, fast, report, verbose)); }
+
+private:
+
+    KeyFrameIndexer(DBoW3::Vocabulary* vocabulary, const KeyFrameDatabase::Ptr &database, const FastDetector::Ptr &fast, bool report, bool verbose);
+
+    void run();
+
+    void setStop();
+
+    bool isRequiredStop();
+
+    KeyFrame::Ptr checkNewKeyFrame();
+
+    /**
+     * @brief 提取描述子和词袋向量, 并加入数据库
+     *
+     * @param[in] keyframe  关键帧
+     */
+    void indexKeyFrame(const KeyFrame::Ptr &keyframe);
+
+private:
+
+    struct Option{
+        int max_features;           ///<每个关键帧的最大特征数目(包括已有的特征)
+        int max_new_corners;        ///<新提取的最大角点数目
+        int direct_index_levels;    ///<正向索引的层数, 需与数据库的设置一致
+    } options_;
+
+    DBoW3::Vocabulary* vocabulary_;
+    KeyFrameDatabase::Ptr database_;
+
+    FastDetector::Ptr fast_detector_;
+    BRIEF::Ptr brief_;
+
+    std::shared_ptr<LoopClosure> loop_closure_;
+
+    const bool report_;
+    const bool verbose_;
+
+    std::deque<KeyFrame::Ptr> keyframes_buffer_;
+
+    std::shared_ptr<std::thread> indexing_thread_;
+
+    bool stop_require_;
+    std::mutex mutex_stop_;
+    std::mutex mutex_keyframe_;
+    std::condition_variable cond_process_;
+};
+
+}
+
+#endif //_SSVO_KEYFRAME_INDEXER_HPP_
@@ -2,6 +2,7 @@
 #define _SSVO_LOCAL_MAPPING_HPP_
 
 #include <future>
+#include <atomic>
 #include "global.hpp"
 #include "feature_detector.hpp"
 #include "brief.hpp"
@@ -10,6 +11,7 @@
 #ifdef SSVO_DBOW_ENABLE
 #include <DBoW3/DBoW3.h>
 #include "loop_closure.hpp"
+#include "keyframe_indexer.hpp"
 #endif
 
 namespace ssvo{
@@ -34,18 +36,18 @@ public:
 
     int refineMapPoints(const int max_optimalize_num = -1, const double outlier_thr = 2.0/480.0);
 
-    void createFeatureFromSeed(const Seed::Ptr &seed);
-
-    KeyFrame::Ptr relocalizeByDBoW(const Frame::Ptr &frame, const Corners &corners);
+    void insertSeed(const Seed::Ptr &seed);
 
     static LocalMapper::Ptr create(const FastDetector::Ptr fast, bool report = false, bool verbose = false)
     { return LocalMapper::Ptr(new LocalMapper(fast, report, verbose));}
 
 #ifdef SSVO_DBOW_ENABLE
-    static LocalMapper::Ptr create(DBoW3::Vocabulary* vocabulary, DBoW3::Database* database, const FastDetector::Ptr fast, bool report = false, bool verbose = false)
+    static LocalMapper::Ptr create(DBoW3::Vocabulary* vocabulary, const KeyFrameDatabase::Ptr &database, const FastDetector::Ptr fast, bool report = false, bool verbose = false)
     { return LocalMapper::Ptr(new LocalMapper(vocabulary, database, fast, report, verbose));}
         
     void setLoopCloser(std::shared_ptr<LoopClosure> loop_closure);
+
+    void setIndexer(KeyFrameIndexer::Ptr indexer);
 #endif
 
     void setStop();
@@ -55,14 +57,18 @@ public:
     void release();
 
     bool finish_once();
+
+    ~LocalMapper();
 private:
 
     LocalMapper(const FastDetector::Ptr fast, bool report, bool verbose);
 
 #ifdef SSVO_DBOW_ENABLE
-    LocalMapper(DBoW3::Vocabulary* vocabulary, DBoW3::Database* database,const FastDetector::Ptr fast, bool report, bool verbose);
+    LocalMapper(DBoW3::Vocabulary* vocabulary, const KeyFrameDatabase::Ptr &database,const FastDetector::Ptr fast, bool report, bool verbose);
 
     std::shared_ptr<LoopClosure> loop_closure_;
+
+    KeyFrameIndexer::Ptr indexer_;
 #endif
     void run();
 
@@ -70,14 +76,16 @@ private:
 
     void finishLastKeyFrame();
 
+    std::vector<Seed::Ptr> takeConvergedSeeds();
+
+    int createFeatureFromSeeds();
+
     int createFeatureFromSeedFeature(const KeyFrame::Ptr &keyframe);
 
     int createFeatureFromLocalMap(const KeyFrame::Ptr &keyframe, const int num = 5);
 
     void checkCulling(const KeyFrame::Ptr &keyframe);
 
-    void addToDatabase(const KeyFrame::Ptr &keyframe);
-
 public:
 
     Map::Ptr map_;
@@ -99,14 +107,12 @@ private:
 
     FastDetector::Ptr fast_detector_;
 
-    BRIEF::Ptr brief_;
-
     std::deque<KeyFrame::Ptr> keyframes_buffer_;
     KeyFrame::Ptr keyframe_last_;
 
 #ifdef SSVO_DBOW_ENABLE
     DBoW3::Vocabulary* vocabulary_;
-    DBoW3::Database* database_;
+    KeyFrameDatabase::Ptr database_;
 
 #endif
 
@@ -117,6 +123,13 @@ private:
 
     std::list<MapPoint::Ptr> optimalize_candidate_mpts_;
 
+    //! converged seeds from depth filter, pushed by the filter thread and taken all at once by the mapper
+    struct SeedNode{
+        Seed::Ptr seed;
+        SeedNode *next;
+    };
+    std::atomic<SeedNode*> converged_seeds_;
+
     bool stop_require_;
     bool finish_once_;
     std::mutex mutex_stop_;
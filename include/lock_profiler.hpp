@@ -0,0 +1,200 @@
+/**
+ * @file lock_profiler.hpp
+ * @brief 带名称的互斥锁, 用于统计每个加锁位置的等待时间, 持有时间和加锁次数
+ * @detials 编译时打开 SSVO_LOCK_PROFILE 才会统计, 否则 NamedMutex 只是 std::mutex 的简单封装.
+ * 同一名称的所有锁(例如所有帧的 Frame::mutex_pose_)累计到同一个 LockSite 中,
+ * 由 LockProfiler 定期和在结束时输出, 用于找出真正让跟踪和建图线程串行化的锁.
+ * @version 0.1
+ * @date 2019-01-22
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef _SSVO_LOCK_PROFILER_HPP_
+#define _SSVO_LOCK_PROFILER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include "global.hpp"
+
+namespace ssvo
+{
+
+/**
+ * @brief 一个加锁位置的统计量, 注册后不会被释放
+ *
+ */
+struct LockSite
+{
+    explicit LockSite(const std::string &name);
+
+    ///取最大值, 多个线程同时更新时用CAS
+    static inline void updateMax(std::atomic<uint64_t> &max, const uint64_t value)
+    {
+        uint64_t current = max.load(std::memory_order_relaxed);
+        while(value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed));
+    }
+
+    const std::string name;
+    std::atomic<uint64_t> acquisitions;
+    std::atomic<uint64_t> contentions;  ///<try_lock 失败, 需要等待的次数
+    std::atomic<uint64_t> wait_ns;
+    std::atomic<uint64_t> max_wait_ns;
+    std::atomic<uint64_t> hold_ns;
+    std::atomic<uint64_t> max_hold_ns;
+};
+
+/**
+ * @brief 锁统计的汇总和输出, 全局只有一个实例
+ * @detials report() 输出上次输出以来的统计, 按等待时间排序, 并累计到总量中; reportTotal() 输出全部的统计.
+ *
+ */
+class LockProfiler : public noncopyable
+{
+public:
+
+    ///一段时间内一个加锁位置的统计
+    struct Stats
+    {
+        std::string name;
+        uint64_t acquisitions;
+        uint64_t contentions;
+        uint64_t wait_ns;
+        uint64_t max_wait_ns;
+        uint64_t hold_ns;
+        uint64_t max_hold_ns;
+    };
+
+    static LockProfiler &instance();
+
+    ~LockProfiler();
+
+    ///纳秒时间戳
+    static inline uint64_t now()
+    { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+    /**
+     * @brief 得到名称对应的加锁位置, 不存在时注册一个
+     *
+     * @param[in] name  加锁位置的名称, 例如 "Frame::mutex_pose_"
+     * @return LockSite*    指针在程序结束前一直有效
+     */
+    LockSite *site(const std::string &name);
+
+    ///输出上次输出以来的统计
+    void report();
+
+    ///输出开始以来的全部统计
+    void reportTotal();
+
+    /**
+     * @brief 开启后台线程定期输出
+     *
+     * @param[in] interval  输出间隔, 秒, 不大于0时不开启
+     */
+    void startReporting(double interval);
+
+    void stopReporting();
+
+private:
+
+    LockProfiler();
+
+    void collect(std::vector<Stats> &stats);
+
+    static void print(const std::string &title, std::vector<Stats> stats, const double elapsed);
+
+private:
+
+    std::map<std::string, std::unique_ptr<LockSite> > sites_;
+    std::mutex mutex_sites_;
+
+    std::map<std::string, Stats> totals_;
+    uint64_t start_ns_;
+    uint64_t last_report_ns_;
+    std::mutex mutex_report_;
+
+    std::shared_ptr<std::thread> reporter_;
+    bool stop_;
+    std::mutex mutex_stop_;
+    std::condition_variable cond_stop_;
+};
+
+/**
+ * @brief 带名称的互斥锁, 满足 Lockable 要求, 可以用于 std::unique_lock 和 std::lock_guard
+ * @detials 先 try_lock, 成功时不计等待时间, 失败时才计时阻塞等待, 所以不竞争时的额外开销只有一次取持有时间.
+ * 持有开始的时刻只由持有锁的线程读写.
+ *
+ */
+class NamedMutex : public noncopyable
+{
+public:
+
+#ifdef SSVO_LOCK_PROFILE
+    explicit NamedMutex(const char *name) :
+        site_(LockProfiler::instance().site(name)), hold_begin_(0)
+    {}
+
+    inline void lock()
+    {
+        if(mutex_.try_lock())
+        {
+            hold_begin_ = LockProfiler::now();
+            site_->acquisitions.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        const uint64_t wait_begin = LockProfiler::now();
+        mutex_.lock();
+        hold_begin_ = LockProfiler::now();
+
+        const uint64_t wait = hold_begin_ - wait_begin;
+        site_->acquisitions.fetch_add(1, std::memory_order_relaxed);
+        site_->contentions.fetch_add(1, std::memory_order_relaxed);
+        site_->wait_ns.fetch_add(wait, std::memory_order_relaxed);
+        LockSite::updateMax(site_->max_wait_ns, wait);
+    }
+
+    inline bool try_lock()
+    {
+        if(!mutex_.try_lock())
+            return false;
+
+        hold_begin_ = LockProfiler::now();
+        site_->acquisitions.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    inline void unlock()
+    {
+        const uint64_t hold = LockProfiler::now() - hold_begin_;
+        mutex_.unlock();
+
+        site_->hold_ns.fetch_add(hold, std::memory_order_relaxed);
+        LockSite::updateMax(site_->max_hold_ns, hold);
+    }
+
+private:
+
+    std::mutex mutex_;
+    LockSite *site_;
+    uint64_t hold_begin_;
+#else
+    explicit NamedMutex(const char *name) {}
+
+    inline void lock() { mutex_.lock(); }
+
+    inline bool try_lock() { return mutex_.try_lock(); }
+
+    inline void unlock() { mutex_.unlock(); }
+
+private:
+
+    std::mutex mutex_;
+#endif // SSVO_LOCK_PROFILE
+};
+
+}
+
+#endif //_SSVO_LOCK_PROFILER_HPP_
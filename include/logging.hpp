@@ -0,0 +1,130 @@
+/**
+ * @file logging.hpp
+ * @brief 按子系统在编译时裁剪的日志, 以及 glog 的异步输出
+ * @detials 每条日志带一个详细等级, 大于子系统阈值的日志在编译时就是常量 false 的分支, 格式化代码被编译器删除.
+ * 等级: 0 必要的信息, 1 每个关键帧一次, 2 每帧一次, 3 内部循环中的调试信息.
+ * 阈值由 SSVO_LOG_LEVEL 给出(CMake 中 Release 默认为1, 其他为3), 每个子系统可以单独用
+ * SSVO_LOG_LEVEL_SYSTEM, SSVO_LOG_LEVEL_TRACKER, SSVO_LOG_LEVEL_FILTER, SSVO_LOG_LEVEL_MAPPER 覆盖.
+ * 保留下来的日志可以由 AsyncLogging 在后台线程中写入文件和终端, 不在跟踪线程中做磁盘IO.
+ * @version 0.1
+ * @date 2019-01-25
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef _SSVO_LOGGING_HPP_
+#define _SSVO_LOGGING_HPP_
+
+#include <deque>
+#include "global.hpp"
+
+#ifndef SSVO_LOG_LEVEL
+#define SSVO_LOG_LEVEL 3
+#endif
+
+#ifndef SSVO_LOG_LEVEL_SYSTEM
+#define SSVO_LOG_LEVEL_SYSTEM SSVO_LOG_LEVEL
+#endif
+
+#ifndef SSVO_LOG_LEVEL_TRACKER
+#define SSVO_LOG_LEVEL_TRACKER SSVO_LOG_LEVEL
+#endif
+
+#ifndef SSVO_LOG_LEVEL_FILTER
+#define SSVO_LOG_LEVEL_FILTER SSVO_LOG_LEVEL
+#endif
+
+#ifndef SSVO_LOG_LEVEL_MAPPER
+#define SSVO_LOG_LEVEL_MAPPER SSVO_LOG_LEVEL
+#endif
+
+///子系统 subsys 的等级 level 的日志是否被编译
+#define SSVO_LOG_ENABLED(subsys, level) ((level) <= SSVO_LOG_LEVEL_##subsys)
+
+///例如 SSVO_LOG(FILTER, 2, WARNING) << "...";
+#define SSVO_LOG(subsys, level, severity) LOG_IF(severity, SSVO_LOG_ENABLED(subsys, level))
+
+///例如 SSVO_LOG_IF(MAPPER, 1, INFO, report_) << "...";
+#define SSVO_LOG_IF(subsys, level, severity, condition) LOG_IF(severity, SSVO_LOG_ENABLED(subsys, level) && (condition))
+
+namespace ssvo
+{
+
+/**
+ * @brief glog 的异步输出, 全局只有一个实例
+ * @detials 替换 INFO, WARNING 和 ERROR 的日志文件输出, 并接管 alsologtostderr 和 stderrthreshold 的终端输出,
+ * 调用日志的线程只把消息放入队列. 队列超过上限时丢弃消息并计数. FATAL 仍然同步输出, 并在程序终止前写完队列.
+ * logtostderr 为真时 glog 直接写终端, 不经过这里.
+ *
+ */
+class AsyncLogging : public noncopyable
+{
+public:
+
+    static AsyncLogging &instance();
+
+    ~AsyncLogging();
+
+    /**
+     * @brief 开始异步输出, 在 glog 的参数设置完成后调用
+     *
+     * @param[in] max_bytes 队列中消息的最大字节数
+     */
+    void start(size_t max_bytes = 8 << 20);
+
+    ///写完队列, 恢复 glog 原来的输出
+    void stop();
+
+    ///等待队列中的消息都写完
+    void flush();
+
+    inline bool isRunning() const { return thread_ != nullptr; }
+
+private:
+
+    AsyncLogging();
+
+    ///一条待写的消息, severity 为负时写终端
+    struct Record
+    {
+        int severity;
+        bool force_flush;
+        time_t timestamp;
+        std::string message;
+    };
+
+    class FileLogger;
+
+    class StderrSink;
+
+    bool push(Record &&record);
+
+    void run();
+
+private:
+
+    size_t max_bytes_;
+    size_t bytes_;
+    uint64_t dropped_;
+    uint64_t pushed_;
+    uint64_t written_;
+
+    std::deque<Record> records_;
+    std::mutex mutex_records_;
+    std::condition_variable cond_process_;
+    std::condition_variable cond_written_;
+    bool stop_;
+
+    std::shared_ptr<std::thread> thread_;
+    std::vector<google::base::Logger*> file_loggers_;
+    std::vector<std::unique_ptr<FileLogger> > async_loggers_;
+    std::unique_ptr<StderrSink> stderr_sink_;
+
+    bool also_log_to_stderr_;
+    int stderr_threshold_;
+};
+
+}
+
+#endif //_SSVO_LOGGING_HPP_
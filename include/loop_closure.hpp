@@ -5,6 +5,8 @@
 #ifndef SSVO_LOOP_CLOSURE_HPP
 #define SSVO_LOOP_CLOSURE_HPP
 
+#include <atomic>
+#include <future>
 #include "global.hpp"
 #include "DBoW3/DBoW3.h"
 #include "DBoW3/DescManip.h"
@@ -13,6 +15,7 @@
 #include "brief.hpp"
 #include <eigen3/Eigen/Dense>
 #include "local_mapping.hpp"
+#include "keyframe_database.hpp"
 
 namespace ssvo{
 
@@ -29,15 +32,20 @@ public:
 
     typedef std::shared_ptr<LoopClosure> Ptr;
 
+    ~LoopClosure();
+
     void startMainThread();
 
+    /**
+     * @brief 结束闭环线程, 并中止正在进行的全局BA, 等待其线程结束
+     */
     void stopMainThread();
 
     void insertKeyFrame(KeyFrame::Ptr kf);
 
     void run();
 
-    inline static Ptr creat(DBoW3::Vocabulary* vocabulary, DBoW3::Database* database)
+    inline static Ptr creat(DBoW3::Vocabulary* vocabulary, const KeyFrameDatabase::Ptr &database)
     { return Ptr(new LoopClosure(vocabulary, database));}
 
     void setLocalMapper(std::shared_ptr<LocalMapper> local_mapper);
@@ -54,10 +62,6 @@ public:
 public:
     std::list<KeyFrame::Ptr> keyFramesList_; //list-快速的插入和删除，可以在两端进行操作
 
-    std::vector<KeyFrame::Ptr> KeyFrames;
-
-    std::mutex mutex_database_;
-
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
     uint64_t LastLoopKFid_;
@@ -66,16 +70,22 @@ public:
 
 
 private:
-    LoopClosure(DBoW3::Vocabulary* vocabulary, DBoW3::Database* database_);
+    LoopClosure(DBoW3::Vocabulary* vocabulary, const KeyFrameDatabase::Ptr &database);
 
     bool CheckNewKeyFrames();
 
+    void setStop();
+
+    bool isRequiredStop();
+
     bool DetectLoop();
 
     bool ComputeSim3();
 
     void CorrectLoop();
 
+    bool verifyLoopCandidate(const KeyFrame::Ptr &loopKeyFrame, std::atomic<bool> &found, Sophus::Sim3d &sim3_lkf2cur, std::vector<MapPoint::Ptr> &MapPointMatches);
+
     int SearchByBoW(KeyFrame::Ptr loopKeyFrame, std::vector<MapPoint::Ptr> &Matches12, std::vector<int > &bestidx);
 
     int SearchBySim3(KeyFrame::Ptr loopKeyFrame,
@@ -90,11 +100,24 @@ private:
 
     void RunGlobalBundleAdjustment(uint64_t nLoopKF);
 
+    /**
+     * @brief 沿生成树分批把全局BA的结果更新到地图中, 每批只在持有 mutex_update_ 时更新, 不需要停止局部建图线程
+     * @detials 没有参与优化的关键帧(优化期间新加入的)用父关键帧的校正量更新, 地图点用参考关键帧的校正量更新
+     *
+     * @param[in] nLoopKF   触发本次全局BA的闭环关键帧id
+     */
+    void UpdateMapByGlobalBundleAdjustment(uint64_t nLoopKF);
+
+    /**
+     * @brief 中止正在进行的全局BA并等待线程结束, 地图更新已经开始时会等待更新完成
+     */
+    void StopGlobalBundleAdjustment();
+
 private:
-    std::vector<KeyFrame::Ptr> DetectLoopCandidates(double minScore);
+    std::vector<KeyFrame::Ptr> DetectLoopCandidates(double minScore, const KeyFrameDatabase::QueryResult &query);
 
     DBoW3::Vocabulary* vocabulary_;
-    DBoW3::Database* database_;
+    KeyFrameDatabase::Ptr database_;
 
     KeyFrame::Ptr curKeyFrame_;
     KeyFrame::Ptr MatchedKeyFrame_;
@@ -126,17 +149,22 @@ private:
 
     bool ifFinished;
 
+    bool stop_require_;
+    std::mutex mutex_stop_;
+
     std::shared_ptr<LocalMapper> local_mapper_;
 
 
     // Variables related to Global Bundle Adjustment
     bool RunningGBA_;
     bool FinishedGBA_;
-    //TODO  还要在迭代的时候设置是否停止的标志位
-    bool StopGBA_;
+    //! 在优化的每次迭代后检查, 新的闭环到来时中止全局BA
+    std::atomic<bool> StopGBA_;
     std::mutex mutex_GBA_;
     std::thread* thread_GBA_;
-    bool FullBAIdx_;
+    int FullBAIdx_;
+    //! 更新全局BA结果时每次持有地图锁处理的关键帧数目
+    int GBA_update_batch_;
 
     //! 通过最小得分计算的闭环次数，仅用于输出信息
     int loop_time_;
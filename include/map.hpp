@@ -18,6 +18,16 @@ class Map: public noncopyable
 public:
     typedef std::shared_ptr<Map> Ptr;
 
+    ///被移除的关键帧在父关键帧坐标系中的位姿, 导出轨迹时沿父关键帧找到仍在地图中的关键帧
+    struct RemovedKeyFrame
+    {
+        uint64_t parent_id;
+        SE3d T_parent_kf;
+    };
+
+    typedef std::unordered_map<uint64_t, RemovedKeyFrame, std::hash<uint64_t>, std::equal_to<uint64_t>,
+        Eigen::aligned_allocator<std::pair<const uint64_t, RemovedKeyFrame> > > RemovedKeyFrames;
+
     KeyFrame::Ptr getKeyFrame(uint64_t id);
 
     std::vector<KeyFrame::Ptr> getAllKeyFrames();
@@ -28,6 +38,8 @@ public:
 
     uint64_t MapPointsInMap();
 
+    RemovedKeyFrames getRemovedKeyFrames();
+
 private:
 
     void clear();
@@ -38,6 +50,8 @@ private:
 
     void insertMapPoint(const MapPoint::Ptr &mpt);
 
+    void insertMapPoints(const std::vector<MapPoint::Ptr> &mpts);
+
     void removeMapPoint(const MapPoint::Ptr &mpt);
 
     inline static Map::Ptr create() {return Map::Ptr(new Map());}
@@ -46,14 +60,16 @@ public:
 
     std::set<MapPoint::Ptr> removed_mpts_;
 
-    std::mutex mutex_kf_;
-    std::mutex mutex_mpt_;
-    std::mutex mutex_update_;
+    NamedMutex mutex_kf_{"Map::mutex_kf_"};
+    NamedMutex mutex_mpt_{"Map::mutex_mpt_"};
+    NamedMutex mutex_update_{"Map::mutex_update_"};
 
 private:
 
     std::unordered_map<uint64_t, KeyFrame::Ptr> kfs_;
 
+    RemovedKeyFrames removed_kfs_;
+
     std::unordered_map<uint64_t, MapPoint::Ptr> mpts_;
 
 
@@ -3,6 +3,8 @@
 
 #include "feature.hpp"
 #include "global.hpp"
+#include "patch_cache.hpp"
+#include "lock_profiler.hpp"
 
 namespace ssvo {
 
@@ -52,7 +54,7 @@ public:
 
     void updateViewAndDepth();
 
-    std::vector<cv::Mat > getDescriptors();
+    BriefDescriptors getDescriptors();
 
     int predictScale(const double dist, const int max_level);
 
@@ -114,6 +116,9 @@ public:
     double optimal_inv_z_;
     uint64_t last_structure_optimal_;
 
+    //! last warped reference patch, reused by FeatureTracker::reprojectMapPoint
+    AlignPatchCache patch_cache_;
+
 private:
 
     Vector3d pose_;
@@ -131,8 +136,8 @@ private:
     uint64_t found_cunter_;
     uint64_t visiable_cunter_;
 
-    std::mutex mutex_obs_;
-    std::mutex mutex_pose_;
+    NamedMutex mutex_obs_{"MapPoint::mutex_obs_"};
+    NamedMutex mutex_pose_{"MapPoint::mutex_pose_"};
 
 };
 
@@ -0,0 +1,191 @@
+/**
+ * @file metrics.hpp
+ * @brief 运行时指标(计数器, 仪表, 直方图)的注册表, 以 Prometheus 文本格式输出
+ * @detials 各模块在处理时只更新原子变量, 不做任何格式化. 格式化只在有请求时进行:
+ * MetricsServer 在本地 Unix 套接字上应答请求, 或者定期把快照写入文件.
+ * 例如 `curl --unix-socket /tmp/ssvo.sock http://localhost/metrics` 或 `socat - UNIX-CONNECT:/tmp/ssvo.sock`.
+ * @version 0.1
+ * @date 2019-01-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef _SSVO_METRICS_HPP_
+#define _SSVO_METRICS_HPP_
+
+#include <atomic>
+#include "global.hpp"
+
+namespace ssvo
+{
+
+///只增不减的计数, 速率由监控端计算, 例如关键帧速率
+class MetricCounter : public noncopyable
+{
+public:
+
+    MetricCounter() : value_(0) {}
+
+    inline void inc(const uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+
+    inline uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+
+    std::atomic<uint64_t> value_;
+};
+
+///当前值, 例如队列长度和跟踪状态
+class MetricGauge : public noncopyable
+{
+public:
+
+    MetricGauge() : value_(0) {}
+
+    inline void set(const double value) { value_.store(value, std::memory_order_relaxed); }
+
+    inline double value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+
+    std::atomic<double> value_;
+};
+
+/**
+ * @brief 固定分桶的直方图, 桶的上界在注册时给定, 与 Prometheus 的 histogram 一致
+ *
+ */
+class MetricHistogram : public noncopyable
+{
+public:
+
+    explicit MetricHistogram(const std::vector<double> &bounds);
+
+    void observe(const double value);
+
+    inline const std::vector<double> &bounds() const { return bounds_; }
+
+    ///第i个桶的计数, 不累加, i == bounds().size() 时为超过所有上界的计数
+    inline uint64_t bucket(const size_t i) const { return buckets_[i].load(std::memory_order_relaxed); }
+
+    inline uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+    inline double sum() const { return sum_.load(std::memory_order_relaxed); }
+
+private:
+
+    const std::vector<double> bounds_;
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+    std::atomic<uint64_t> count_;
+    std::atomic<double> sum_;
+};
+
+/**
+ * @brief 指标注册表, 全局只有一个实例
+ * @detials 同名的指标只注册一次, 返回的指针在程序结束前一直有效, 调用处应缓存指针而不是每次按名称查找.
+ *
+ */
+class Metrics : public noncopyable
+{
+public:
+
+    static Metrics &instance();
+
+    MetricCounter *counter(const std::string &name, const std::string &help);
+
+    MetricGauge *gauge(const std::string &name, const std::string &help);
+
+    MetricHistogram *histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds);
+
+    ///耗时直方图默认的桶, 1ms 到 2s, 单位秒
+    static std::vector<double> timeBuckets();
+
+    ///Prometheus 文本格式
+    std::string exposition();
+
+    /**
+     * @brief 写入快照文件, 先写临时文件再重命名, 读取者不会读到写了一半的文件
+     *
+     * @param[in] file_name 文件名
+     * @return true         成功
+     */
+    bool writeSnapshot(const std::string &file_name);
+
+private:
+
+    Metrics() = default;
+
+    enum Type {COUNTER, GAUGE, HISTOGRAM};
+
+    struct Entry
+    {
+        std::string name;
+        std::string help;
+        Type type;
+        std::unique_ptr<MetricCounter> counter;
+        std::unique_ptr<MetricGauge> gauge;
+        std::unique_ptr<MetricHistogram> histogram;
+    };
+
+    Entry *find(const std::string &name, Type type);
+
+private:
+
+    std::vector<std::unique_ptr<Entry> > entries_;
+    std::mutex mutex_entries_;
+};
+
+/**
+ * @brief 在后台线程中输出指标
+ * @detials 套接字上每个连接应答一次. 客户端发送了 HTTP 请求时按 HTTP/1.0 应答, 否则直接写出文本.
+ *
+ */
+class MetricsServer : public noncopyable
+{
+public:
+
+    typedef std::shared_ptr<MetricsServer> Ptr;
+
+    ~MetricsServer();
+
+    void startMainThread();
+
+    void stopMainThread();
+
+    /**
+     * @brief 创建指标输出线程
+     *
+     * @param[in] socket_path       Unix 套接字路径, 为空时不监听
+     * @param[in] snapshot_file     快照文件, 为空时不写
+     * @param[in] snapshot_interval 写快照的间隔, 秒
+     * @return Ptr
+     */
+    inline static Ptr create(const std::string &socket_path, const std::string &snapshot_file, double snapshot_interval)
+    { return Ptr(new MetricsServer(socket_path, snapshot_file, snapshot_interval)); }
+
+private:
+
+    MetricsServer(const std::string &socket_path, const std::string &snapshot_file, double snapshot_interval);
+
+    bool openSocket();
+
+    void serve(int fd);
+
+    void run();
+
+private:
+
+    const std::string socket_path_;
+    const std::string snapshot_file_;
+    const double snapshot_interval_;
+
+    int socket_fd_;
+
+    std::shared_ptr<std::thread> server_thread_;
+    std::atomic<bool> stop_;
+};
+
+}
+
+#endif //_SSVO_METRICS_HPP_
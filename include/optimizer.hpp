@@ -3,6 +3,7 @@
 
 #include <ceres/ceres.h>
 #include <ceres/rotation.h>
+#include <atomic>
 
 #include "map_point.hpp"
 #include "keyframe.hpp"
@@ -20,17 +21,46 @@ public:
     typedef std::map<KeyFrame::Ptr,Sophus::Sim3d ,std::less<KeyFrame::Ptr>,
             Eigen::aligned_allocator<std::pair<const KeyFrame::Ptr, Sophus::Sim3d> > > KeyFrameAndPose;
 
-    static void globleBundleAdjustment(const Map::Ptr &map, int max_iters,const uint64_t nLoopKF = 0, bool report=false, bool verbose=false);
+    /**
+     * @brief 全局BA
+     *
+     * @param[in] map       地图
+     * @param[in] max_iters 最大迭代次数
+     * @param[in] nLoopKF   为0时直接更新地图, 否则只保存优化结果并标记为该闭环的结果, 由闭环线程更新地图
+     * @param[in] stop      不为空时每次迭代后检查, 为true时中止优化
+     * @return true         优化完成
+     * @return false        优化被中止, 结果不可用
+     */
+    static bool globleBundleAdjustment(const Map::Ptr &map, int max_iters,const uint64_t nLoopKF = 0, bool report=false, bool verbose=false,
+                                       const std::atomic<bool> *stop = nullptr);
 
     static void motionOnlyBundleAdjustment(const Frame::Ptr &frame, bool use_seeds, bool reject=false, bool report=false, bool verbose=false);
 
-    static void localBundleAdjustment(const KeyFrame::Ptr &keyframe, std::list<MapPoint::Ptr> &bad_mpts, int size=10, int min_shared_fts=50, bool report=false, bool verbose=false);
+    /**
+     * @brief 局部BA, 结果在持有 map->mutex_update_ 时写回, 优化期间被全局BA标记或更新的关键帧和地图点不会被覆盖
+     *
+     * @param[in] map       地图
+     * @param[in] keyframe  当前关键帧
+     * @param[out] bad_mpts 被剔除观测后变为BAD的地图点
+     */
+    static void localBundleAdjustment(const Map::Ptr &map, const KeyFrame::Ptr &keyframe, std::list<MapPoint::Ptr> &bad_mpts, int size=10, int min_shared_fts=50, bool report=false, bool verbose=false);
 
     static int optimizeSim3(KeyFrame::Ptr pKF1, KeyFrame::Ptr pKF2, std::vector<MapPoint::Ptr> &vpMatches1,
                                   Sophus::Sim3d &S12, const float th2, const bool bFixScale);
     static void OptimizeEssentialGraph(Map::Ptr pMap, KeyFrame::Ptr pLoopKF, KeyFrame::Ptr pCurKF, KeyFrameAndPose &NonCorrectedSim3, KeyFrameAndPose &CorrectedSim3,
                                              const std::map<KeyFrame::Ptr, std::set<KeyFrame::Ptr> > &LoopConnections, const bool &bFixScale = false);
 
+    typedef std::vector<Sophus::Sim3d, Eigen::aligned_allocator<Sophus::Sim3d> > Sim3Vector;
+
+    /**
+     * @brief 并行地用参考关键帧的校正量更新地图点并重新计算观测方向和深度, 调用前关键帧位姿需已经更新
+     *
+     * @param[in] mpts          地图点, 每个点只能出现一次
+     * @param[in] refs          每个地图点使用的校正量下标
+     * @param[in] corrections   校正量 corrected_Swr * Srw
+     */
+    static void correctMapPoints(const std::vector<MapPoint::Ptr> &mpts, const std::vector<int> &refs, const Sim3Vector &corrections);
+
 //    static void localBundleAdjustmentWithInvDepth(const KeyFrame::Ptr &keyframe, std::list<MapPoint::Ptr> &bad_mpts, int size=10, bool report=false, bool verbose=false);
 
     static void refineMapPoint(const MapPoint::Ptr &mpt, int max_iter, bool report=false, bool verbose=false);
@@ -461,72 +491,109 @@ private:
     ceres::CostFunctionToFunctor<2,7> intrinsicReprojErrorOnlyPoseInvSim3_;
 };
 
-struct IntrinsicRelativeSim3Error
-{
-    IntrinsicRelativeSim3Error(double* obs)
-    {
-        for (int i = 0; i < 7; ++i)
-        {
-            mObs[i] = obs[i];
-        }
-    }
-
-    bool operator()(const double* const camera1, const double* const camera2, double* residual) const
-    {
-        double camera21[7];
-        for (int i = 0; i < 7; ++i)
-            camera21[i] = mObs[i];
-
-        Eigen::Quaterniond qk1 = Eigen::Quaterniond(camera1[3],camera1[0],camera1[1],camera1[2]);
-        Vector3d tk1 = Vector3d(camera1[4],camera1[5],camera1[6]);
-
-        Sophus::Sim3d Sim3_k1(qk1,tk1);
-
-        Eigen::Quaterniond qk2 = Eigen::Quaterniond(camera2[3],camera2[0],camera2[1],camera2[2]);
-        Vector3d tk2 = Vector3d(camera2[4],camera2[5],camera2[6]);
-
-        Sophus::Sim3d Sim3_k2(qk2,tk2);
+//! 每次迭代后检查停止标志, 用于中止耗时较长的优化
+class StopFlagCallback : public ceres::IterationCallback {
+public:
+    explicit StopFlagCallback(const std::atomic<bool> *stop) : stop_(stop) {}
 
-        Eigen::Quaterniond qk21 = Eigen::Quaterniond(camera21[3],camera21[0],camera21[1],camera21[2]);
-        Vector3d tk21 = Vector3d(camera21[4],camera21[5],camera21[6]);
+    virtual ~StopFlagCallback() {}
 
-        Sophus::Sim3d Sim3_k21(qk21,tk21);
+    virtual ceres::CallbackReturnType operator()(const ceres::IterationSummary &summary) {
+        return stop_->load() ? ceres::SOLVER_ABORT : ceres::SOLVER_CONTINUE;
+    }
 
-        Sophus::Sim3d result = Sim3_k21*Sim3_k1*(Sim3_k2.inverse());
+private:
+    const std::atomic<bool> *stop_;
+};
 
-        //! S21*S1w*Sw2
-        double* tResiduals = result.log().data();
+//! https://github.com/strasdat/Sophus/blob/v1.0.0/test/ceres/local_parameterization_se3.hpp
+//! 与 SE3Parameterization 相同, 在切空间上左乘更新, 雅克比在代价函数中直接对切空间求出
+class Sim3Parameterization : public ceres::LocalParameterization {
+public:
+    virtual ~Sim3Parameterization() {}
+
+    virtual bool Plus(double const *S_raw, double const *delta_raw,
+                      double *S_plus_delta_raw) const {
+        Eigen::Map<Sophus::Sim3d const> const S(S_raw);
+        Eigen::Map<Sophus::Vector7d const> const delta(delta_raw);
+        Eigen::Map<Sophus::Sim3d> S_plus_delta(S_plus_delta_raw);
+        S_plus_delta = Sophus::Sim3d::exp(delta) * S;
+        return true;
+    }
 
-        for (int j = 0; j < 7; ++j)
-            residual[j] = tResiduals[j];
+    // Set to Identity, for we have computed in RelativeSim3Error::Evaluate
+    virtual bool ComputeJacobian(double const *S_raw,
+                                 double *jacobian_raw) const {
+        Eigen::Map<Eigen::Matrix<double, 7, 7, Eigen::RowMajor> > jacobian(jacobian_raw);
+        jacobian.setIdentity();
         return true;
     }
 
-    double mObs[7];
+    virtual int GlobalSize() const { return Sophus::Sim3d::num_parameters; }
 
+    virtual int LocalSize() const { return Sophus::Sim3d::DoF; }
 };
 
-struct RelativeSim3Error
+/**
+ * @brief 本质图中两个关键帧之间的相对Sim3约束, 解析雅克比
+ * @detials 残差 e = log(Sji * Siw * Sjw^-1), 参数以 Sim3Parameterization 左乘更新, 对切空间的雅克比为
+ * de/dSiw = Jl^-1(e) * Adj(Sji), de/dSjw = -Jr^-1(e), 其中 Jl^-1(e) = I - ad(e)/2, Jr^-1(e) = I + ad(e)/2 取一阶近似.
+ * 残差是精确的, 近似只影响收敛速度, 本质图优化时残差很小, 近似误差可以忽略.
+ */
+class RelativeSim3Error : public ceres::SizedCostFunction<7, 7, 7>
 {
-    RelativeSim3Error(double* obs):
-            intrinsicRelativeSim3Error_(new ceres::NumericDiffCostFunction<IntrinsicRelativeSim3Error,ceres::CENTRAL,7,7,7>(
-                    new IntrinsicRelativeSim3Error(obs)))
-    {}
+public:
 
-    template <typename T> bool operator()(const T* const camera1, const T* const camera2, T* residuals) const
+    RelativeSim3Error(const Sophus::Sim3d &Sji) :
+        Sji_(Sji), Adj_Sji_(Sji.Adj()) {}
+
+    virtual bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const
     {
-        return intrinsicRelativeSim3Error_(camera1,camera2,residuals);
+        Eigen::Map<Sophus::Sim3d const> const Siw(parameters[0]);
+        Eigen::Map<Sophus::Sim3d const> const Sjw(parameters[1]);
+
+        const Sophus::Sim3d::Tangent error = (Sji_ * Siw * Sjw.inverse()).log();
+        Eigen::Map<Sophus::Vector7d> residual(residuals);
+        residual = error;
+
+        if(!jacobians) return true;
+
+        //! ad(e)/2 in the order of Sophus::Tangent [upsilon, omega, sigma]
+        const Matrix3d upsilon_hat = Sophus::SO3d::hat(error.head<3>());
+        const Matrix3d omega_hat = Sophus::SO3d::hat(error.segment<3>(3));
+        Eigen::Matrix<double, 7, 7> half_ad = Eigen::Matrix<double, 7, 7>::Zero();
+        half_ad.block<3,3>(0,0) = omega_hat + error[6] * Matrix3d::Identity();
+        half_ad.block<3,3>(0,3) = upsilon_hat;
+        half_ad.block<3,1>(0,6) = -error.head<3>();
+        half_ad.block<3,3>(3,3) = omega_hat;
+        half_ad *= 0.5;
+
+        if(jacobians[0] != nullptr)
+        {
+            Eigen::Map<Eigen::Matrix<double, 7, 7, Eigen::RowMajor> > Ji(jacobians[0]);
+            Ji = (Eigen::Matrix<double, 7, 7>::Identity() - half_ad) * Adj_Sji_;
+        }
+        if(jacobians[1] != nullptr)
+        {
+            Eigen::Map<Eigen::Matrix<double, 7, 7, Eigen::RowMajor> > Jj(jacobians[1]);
+            Jj = -(Eigen::Matrix<double, 7, 7>::Identity() + half_ad);
+        }
+        return true;
     }
 
-    static ceres::CostFunction* Create(double* obs)
-    {
-        return (new ceres::AutoDiffCostFunction<RelativeSim3Error, 7, 7, 7>(new RelativeSim3Error(obs)));
+    static inline ceres::CostFunction *Create(const Sophus::Sim3d &Sji) {
+        return (new RelativeSim3Error(Sji));
     }
 
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
 private:
-    ceres::CostFunctionToFunctor<7,7,7> intrinsicRelativeSim3Error_;
 
-};
+    const Sophus::Sim3d Sji_;
+    const Eigen::Matrix<double, 7, 7> Adj_Sji_;
+
+}; // class RelativeSim3Error
 
 }//! namespace ceres
 
@@ -0,0 +1,122 @@
+/**
+ * @file patch_cache.hpp
+ * @brief 仿射变换后的参考图像块缓存
+ * @detials 种子和地图点在相邻帧之间的相对位姿变化通常很小, 对应的仿射矩阵几乎不变,
+ * 此时可以直接复用上一次由参考关键帧变换得到的图像块, 而不用重新插值.
+ * @version 0.1
+ * @date 2019-01-18
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef _SSVO_PATCH_CACHE_HPP_
+#define _SSVO_PATCH_CACHE_HPP_
+
+#include "global.hpp"
+
+namespace ssvo
+{
+
+/**
+ * @brief 单个图像块的缓存
+ * @detials 缓存记录(参考关键帧id, 参考层, 目标层)以及生成图像块时的仿射矩阵, 参考关键帧和层相同,
+ * 且仿射矩阵的每个元素与缓存的仿射矩阵之差都小于 threshold 时命中. 命中时不更新缓存的仿射矩阵,
+ * 因此复用的图像块与真实仿射矩阵的差总是小于阈值. 缓存内部有锁, 可以被多个线程同时访问.
+ *
+ * @tparam T    图像块的数据类型
+ * @tparam Size 图像块的大小(包含边界)
+ */
+template<typename T, int Size>
+class WarpPatchCache
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    typedef Matrix<T, Size, Size, RowMajor> Patch;
+
+    ///仿射矩阵元素之差的阈值, 超过时缓存失效
+    static constexpr double threshold = 0.02;
+
+    WarpPatchCache() : valid_(false) {}
+
+    /**
+     * @brief 查找缓存
+     *
+     * @param[in] ref_id            参考关键帧id
+     * @param[in] level_ref         参考图像块所在层
+     * @param[in] level_cur         目标层
+     * @param[in] A_cur_from_ref    仿射矩阵
+     * @param[out] patch            命中时输出缓存的图像块
+     * @return true                 命中
+     * @return false
+     */
+    inline bool get(const uint64_t ref_id, const int level_ref, const int level_cur, const Matrix2d &A_cur_from_ref, Patch &patch)
+    {
+        if(!A_cur_from_ref.allFinite())
+            return false;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!valid_ || ref_id_ != ref_id || level_ref_ != level_ref || level_cur_ != level_cur)
+            return false;
+
+        if((A_cur_from_ref - A_cur_from_ref_).cwiseAbs().maxCoeff() >= threshold)
+            return false;
+
+        patch = patch_;
+        return true;
+    }
+
+    /**
+     * @brief 更新缓存
+     *
+     * @param[in] ref_id            参考关键帧id
+     * @param[in] level_ref         参考图像块所在层
+     * @param[in] level_cur         目标层
+     * @param[in] A_cur_from_ref    仿射矩阵
+     * @param[in] patch             变换得到的图像块
+     */
+    inline void set(const uint64_t ref_id, const int level_ref, const int level_cur, const Matrix2d &A_cur_from_ref, const Patch &patch)
+    {
+        if(!A_cur_from_ref.allFinite())
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        ref_id_ = ref_id;
+        level_ref_ = level_ref;
+        level_cur_ = level_cur;
+        A_cur_from_ref_ = A_cur_from_ref;
+        patch_ = patch;
+        valid_ = true;
+    }
+
+    /**
+     * @brief 使缓存失效
+     *
+     */
+    inline void invalidate()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        valid_ = false;
+    }
+
+private:
+
+    Patch patch_;
+    Matrix2d A_cur_from_ref_;
+    uint64_t ref_id_;
+    int level_ref_;
+    int level_cur_;
+    bool valid_;
+    std::mutex mutex_;
+};
+
+template<typename T, int Size>
+constexpr double WarpPatchCache<T, Size>::threshold;
+
+///AlignPatch使用的带边界的图像块缓存, 大小需与 AlignPatch::SizeWithBorder 一致
+typedef WarpPatchCache<float, 10> AlignPatchCache;
+
+}
+
+#endif //_SSVO_PATCH_CACHE_HPP_
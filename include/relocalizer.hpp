@@ -0,0 +1,122 @@
+/**
+ * @file relocalizer.hpp
+ * @brief 跟踪丢失后的重定位
+ * @detials 从关键帧数据库中取出得分最高的若干个候选关键帧, 并行地对每个候选做描述子匹配和PnP RANSAC,
+ * 选择内点最多的候选作为参考关键帧, 并给出当前帧的初始位姿. 每一帧的验证有时间预算, 超时后未开始的步骤直接放弃.
+ * @version 0.1
+ * @date 2019-01-18
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef _SSVO_RELOCALIZER_HPP_
+#define _SSVO_RELOCALIZER_HPP_
+
+#include <future>
+#include <DBoW3/DBoW3.h>
+#include "global.hpp"
+#include "frame.hpp"
+#include "keyframe.hpp"
+#include "feature_detector.hpp"
+#include "brief.hpp"
+#include "descriptor.hpp"
+#include "keyframe_database.hpp"
+
+namespace ssvo
+{
+
+/**
+ * @brief 基于词袋的多候选重定位
+ *
+ */
+class Relocalizer : public noncopyable
+{
+public:
+    ///指向本类的智能指针
+    typedef std::shared_ptr<Relocalizer> Ptr;
+
+    /**
+     * @brief 重定位
+     *
+     * @param[in] frame     当前帧, 成功时设置其位姿
+     * @param[in] corners   当前帧提取的角点
+     * @return KeyFrame::Ptr 内点最多的候选关键帧, 失败时为空
+     */
+    KeyFrame::Ptr run(const Frame::Ptr &frame, const Corners &corners);
+
+    /**
+     * @brief 创建本类的一个实例
+     *
+     * @param[in] vocabulary    字典
+     * @param[in] database      关键帧数据库
+     * @param[in] report        是否输出信息
+     * @param[in] verbose       是否输出详细信息
+     * @return Ptr
+     */
+    inline static Ptr create(DBoW3::Vocabulary* vocabulary, const KeyFrameDatabase::Ptr &database, bool report = false, bool verbose = false)
+    { return Ptr(new Relocalizer(vocabulary, database, report, verbose)); }
+
+private:
+
+    Relocalizer(DBoW3::Vocabulary* vocabulary, const KeyFrameDatabase::Ptr &database, bool report, bool verbose);
+
+    ///当前帧中在各候选之间共享的数据, 验证时只读
+    struct Query
+    {
+        std::vector<Vector2d> px;               ///<第0层的像素坐标
+        std::vector<Vector3d> fn;               ///<归一化平面上的坐标
+        BriefDescriptors descriptors;
+        DBoW3::BowVector bow_vec;
+        DBoW3::FeatureVector feat_vec;
+    };
+
+    ///一个候选的验证结果
+    struct Candidate
+    {
+        KeyFrame::Ptr keyframe;
+        Matrix3d Rcw;       ///<不用 SE3d, 避免 std::future 中的对齐问题
+        Vector3d tcw;
+        int matches;
+        int inliers;
+    };
+
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    /**
+     * @brief 验证一个候选关键帧, 可以在多个线程中同时调用
+     *
+     * @param[in] query     当前帧的数据
+     * @param[in] keyframe  候选关键帧
+     * @param[in] fx        焦距, 用于把像素阈值换算到归一化平面
+     * @param[in] deadline  时间预算的截止时刻
+     * @return Candidate    内点数为0时表示失败
+     */
+    Candidate verify(const Query &query, const KeyFrame::Ptr &keyframe, const double fx, const TimePoint deadline) const;
+
+private:
+
+    struct Option{
+        int num_candidates;         ///<从数据库中取出的候选数目
+        int direct_index_levels;    ///<正向索引的层数, 需与关键帧索引的设置一致
+        int max_hamming;            ///<描述子匹配的最大距离
+        double nn_ratio;            ///<最近邻和次近邻的距离比
+        int min_matches;            ///<进行PnP的最少匹配数目
+        int min_inliers;            ///<重定位成功的最少内点数目
+        int ransac_iterations;      ///<PnP RANSAC的迭代次数
+        double ransac_error;        ///<PnP RANSAC的重投影误差阈值(像素)
+        double time_budget;         ///<每一帧的时间预算(毫秒)
+    } options_;
+
+    DBoW3::Vocabulary* vocabulary_;
+    KeyFrameDatabase::Ptr database_;
+
+    BRIEF::Ptr brief_;
+
+    const bool report_;
+    const bool verbose_;
+};
+
+}
+
+#endif //_SSVO_RELOCALIZER_HPP_
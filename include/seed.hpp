@@ -15,6 +15,7 @@
 #define _SSVO_SEED_HPP_
 
 #include "global.hpp"
+#include "patch_cache.hpp"
 
 namespace ssvo{
 
@@ -53,9 +54,13 @@ public:
 
     ///收敛速率??? 卧槽这个还能自己设?  TODO
     const static double convergence_rate;
+    ///内点概率a/(a+b)低于该值时认为种子已经发散
+    const static double min_inlier_ratio;
 
     ///TODO 啥的历史?
     std::list<std::pair<double, double> > history;
+    ///上一次极线搜索时变换得到的参考图像块
+    AlignPatchCache patch_cache;
 
     /**
      * @brief 计算Tau
@@ -96,6 +101,15 @@ public:
      */
     bool checkConvergence();
 
+    /**
+     * @brief 检查是否发散
+     * @detials beta分布给出的内点概率过低时认为发散,只用于统计,不会删除种子
+     * 
+     * @return true 
+     * @return false 
+     */
+    bool checkDivergence();
+
     /**
      * @brief 获取逆深度
      * 
@@ -0,0 +1,163 @@
+/**
+ * @file semi_dense_filter.hpp
+ * @brief 半稠密深度滤波器
+ * @detials 在关键帧较粗的金字塔层上, 对所有梯度较大的像素估计逆深度, 并导出每个关键帧的逆深度图.
+ * 种子不再是独立的 Seed 对象, 而是按行连续存放在数组中, 每来一帧按行分块并行完成极线搜索与深度更新, 图像块的ZSSD用SSE计算.
+ * 深度模型与 Seed 相同(高斯 x Beta 分布).
+ * @version 0.1
+ * @date 2019-01-18
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef _SSVO_SEMI_DENSE_FILTER_HPP_
+#define _SSVO_SEMI_DENSE_FILTER_HPP_
+
+#include <deque>
+#include "global.hpp"
+#include "frame.hpp"
+#include "keyframe.hpp"
+
+namespace ssvo
+{
+
+/**
+ * @brief 半稠密深度滤波器的实现
+ *
+ */
+class SemiDenseFilter : public noncopyable
+{
+public:
+    ///指向本类的智能指针
+    typedef std::shared_ptr<SemiDenseFilter> Ptr;
+
+    /**
+     * @brief 在关键帧上选取梯度较大的像素作为种子
+     *
+     * @param[in] keyframe  新的关键帧
+     * @return int          创建的种子数目
+     */
+    int createSeeds(const KeyFrame::Ptr &keyframe);
+
+    /**
+     * @brief 用当前帧更新最近几个关键帧上的种子
+     *
+     * @param[in] frame     当前帧
+     * @return int          成功更新的种子数目
+     */
+    int updateSeeds(const Frame::Ptr &frame);
+
+    /**
+     * @brief 获取关键帧的逆深度图
+     * @detials 图像大小与种子所在金字塔层相同, 类型为 CV_32FC1. 没有估计的像素逆深度为0, 方差为-1
+     *
+     * @param[in] keyframe_id       关键帧的id
+     * @param[out] inv_depth        逆深度图
+     * @param[out] variance         逆深度的方差
+     * @param[in] converged_only    是否只输出已经收敛的像素
+     * @return true                 关键帧存在半稠密种子
+     * @return false
+     */
+    bool getInverseDepthMap(const uint64_t keyframe_id, cv::Mat &inv_depth, cv::Mat &variance, bool converged_only = true);
+
+    /**
+     * @brief 种子所在的金字塔层
+     *
+     * @return int
+     */
+    inline int level() const { return options_.level; }
+
+    /**
+     * @brief 创建本类的一个实例
+     *
+     * @param[in] verbose 是否输出详细信息
+     * @return Ptr
+     */
+    inline static Ptr create(bool verbose = false)
+    { return Ptr(new SemiDenseFilter(verbose)); }
+
+private:
+
+    /**
+     * @brief 构造函数
+     *
+     * @param[in] verbose 是否输出详细信息
+     */
+    SemiDenseFilter(bool verbose);
+
+    /**
+     * @brief 一个关键帧上的全部种子, 以数组的形式按行存放
+     *
+     */
+    struct KeyFrameSeeds
+    {
+        typedef std::shared_ptr<KeyFrameSeeds> Ptr;
+
+        enum Status : uint8_t {
+            ACTIVE = 0,
+            CONVERGED = 1,
+            DIVERGED = 2,
+        };
+
+        std::weak_ptr<KeyFrame> keyframe;   ///<种子所在的关键帧
+        uint64_t keyframe_id;               ///<关键帧id
+        int rows;                           ///<种子所在层的图像高度
+        int cols;                           ///<种子所在层的图像宽度
+        double z_range;                     ///<逆深度的最大范围
+
+        std::vector<int> row_start;         ///<第r行的种子在数组中的起始下标, 大小为rows+1
+        std::vector<int> u;                 ///<种子在所在层上的列坐标, 行坐标由row_start确定
+        std::vector<Vector3d> fn;           ///<种子在归一化平面上的坐标
+        std::vector<float> patch;           ///<去均值后的3x3参考图像块, 每个种子3行x4个值, 每行最后一个值为0, 便于SIMD计算
+        std::vector<double> mu;             ///<逆深度均值
+        std::vector<double> sigma2;         ///<逆深度方差
+        std::vector<double> a;              ///<Beta分布参数a
+        std::vector<double> b;              ///<Beta分布参数b
+        std::vector<uint8_t> status;        ///<种子状态
+        std::vector<uint16_t> updates;      ///<更新次数
+
+        std::mutex mutex;                   ///<更新与导出之间的锁
+    };
+
+    /**
+     * @brief 对第 [row_begin, row_end) 行的种子进行极线搜索并更新
+     *
+     * @param[in] seeds         关键帧的种子
+     * @param[in] frame         当前帧
+     * @param[in] T_cur_from_ref 从参考关键帧到当前帧的位姿变换
+     * @param[in] row_begin     起始行
+     * @param[in] row_end       结束行
+     * @return int              更新的种子数目
+     */
+    int updateRows(KeyFrameSeeds &seeds, const Frame::Ptr &frame, const SE3d &T_cur_from_ref, int row_begin, int row_end) const;
+
+    friend class SemiDenseUpdateInvoker;
+
+private:
+
+    struct Option{
+        int level;                  ///<选取种子的金字塔层
+        int max_kfs;                ///<参与更新的最近关键帧数目
+        int max_stored_kfs;         ///<保留逆深度图的关键帧数目
+        int row_blocks;             ///<每个关键帧按行分成的块数, 所有块在 cv::parallel_for_ 中并行更新
+        double min_gradient;        ///<选取种子的最小梯度
+        double max_epl_length;      ///<极线搜索的最大长度(所在层像素)
+        double max_zssd;            ///<3x3图像块的最大平均ZSSD
+        double min_unique_ratio;    ///<最优与次优匹配得分之比的最大值
+        double pixel_error;         ///<匹配的像素误差(所在层像素)
+    } options_;
+
+    const bool verbose_;
+
+    ///正在更新的关键帧种子, 按创建顺序
+    std::deque<KeyFrameSeeds::Ptr> active_seeds_;
+    ///所有保留的关键帧种子
+    std::map<uint64_t, KeyFrameSeeds::Ptr> keyframe_seeds_;
+
+    std::mutex mutex_seeds_;
+};
+
+}
+
+#endif //_SSVO_SEMI_DENSE_FILTER_HPP_
@@ -11,8 +11,20 @@ namespace ssvo{
 class Sim3Solver{
 public:
 
-    Sim3Solver(const SE3d Tcw1, const SE3d Tcw2, const std::vector<Feature::Ptr> &fts1, const std::vector<Feature::Ptr> &fts2, const bool scale_fixed) :
-        scale_fixed_(scale_fixed)
+    /**
+     * @brief 构造函数
+     *
+     * @param[in] Tcw1          关键帧1的位姿
+     * @param[in] Tcw2          关键帧2的位姿
+     * @param[in] fts1          关键帧1中匹配的特征
+     * @param[in] fts2          关键帧2中对应的特征
+     * @param[in] focal_length  焦距, 用于把像素误差阈值换算到归一化平面
+     * @param[in] scale_fixed   是否固定尺度
+     * @param[in] seed          RANSAC的随机数种子, 为0时由 std::random_device 生成
+     */
+    Sim3Solver(const SE3d Tcw1, const SE3d Tcw2, const std::vector<Feature::Ptr> &fts1, const std::vector<Feature::Ptr> &fts2, const double focal_length, const bool scale_fixed,
+               const uint64_t seed = 0) :
+        scale_fixed_(scale_fixed), rng_(seed ? seed : std::random_device()())
     {
         const size_t N = fts1.size();
         LOG_ASSERT(N == fts2.size()) << "fts1(" << N << ") != fts2(" << fts2.size() << ")!";
@@ -44,13 +56,14 @@ public:
             mpts2_.push_back(Rcw2 * ft2->mpt_->pose() + tcw2);
 
             pxls1_.push_back(ft1->fn_.head<2>()/ft1->fn_[2]);
-            pxls1_.push_back(ft2->fn_.head<2>()/ft2->fn_[2]);
+            pxls2_.push_back(ft2->fn_.head<2>()/ft2->fn_[2]);
 
             const double sigm_square1 = 1 << ft1->level_;
             const double sigm_square2 = 1 << ft2->level_;
 
-            max_err1_.push_back(9.210 * sigm_square1);
-            max_err2_.push_back(9.210 * sigm_square2);
+            //! the errors are measured on the normalized plane
+            max_err1_.push_back(9.210 * sigm_square1 / (focal_length * focal_length));
+            max_err2_.push_back(9.210 * sigm_square2 / (focal_length * focal_length));
 
             indices_.push_back(i);
         }
@@ -59,6 +72,13 @@ public:
         noMore_ = false;
     }
 
+    /**
+     * @brief 运行RANSAC, 每批生成多个假设并行打分, 迭代次数用尽时设置 noMore_
+     *
+     * @param[in] max_iterations    本次调用最多的迭代次数
+     * @return true                 本次得到的最好假设内点数足够
+     * @return false
+     */
     bool runRANSAC(const int max_iterations = 5);
 
     void getEstimateSim3(Matrix3d &R, Vector3d &t, double &s, std::vector<bool> &inliers);
@@ -70,7 +90,15 @@ public:
 
 private:
 
-    int checkInliers(Matrix3d R12, Vector3d t12, double s12, std::vector<bool>& inliers);
+    /**
+     * @brief 统计假设的内点, 可以在多个线程中同时调用
+     *
+     * @param[in] max_outliers  外点超过该数目时提前放弃, 此时返回的内点数不完整
+     * @return int              内点数
+     */
+    int checkInliers(const Matrix3d &R12, const Vector3d &t12, const double s12, std::vector<bool>& inliers, const int max_outliers = -1) const;
+
+    friend class Sim3ScoreInvoker;
 
 private:
 
@@ -93,6 +121,9 @@ private:
     double s12_best_;
     int inliers_count_best_;
 
+    //! every solver has its own generator, since the loop candidates are verified concurrently
+    std::mt19937_64 rng_;
+
     int maxIterations_;
     double probability_;
     int min_inliers_;
@@ -22,11 +22,19 @@
 #include "feature_tracker.hpp"
 #include "local_mapping.hpp"
 #include "depth_filter.hpp"
+#include "metrics.hpp"
+#include "trajectory_writer.hpp"
+#include "time_tracing.hpp"
+
+#ifdef SSVO_VIEWER_ENABLE
 #include "viewer.hpp"
+#endif
 
 //姜浩师兄后加的,用于支持闭环
 #ifdef SSVO_DBOW_ENABLE
 #include "loop_closure.hpp"
+#include "keyframe_indexer.hpp"
+#include "relocalizer.hpp"
 #endif
 
 namespace ssvo {
@@ -66,12 +74,48 @@ public:
     System(std::string config_file, std::string calib_flie);
 
     /**
-     * @brief 保存内存中的轨迹数据到文件中
+     * @brief 保存所有帧的轨迹到 TUM 格式的文件中, 位姿按关键帧当前的位姿更新, 关键帧的轨迹保存到 "KF"+file_name
      * 
      * @param[in] file_name 轨迹文件路径
      */
     void saveTrajectoryTUM(const std::string &file_name);
 
+    /**
+     * @brief 保存所有帧的轨迹到二进制文件中, 格式见 TrajectoryWriter
+     * 
+     * @param[in] file_name 轨迹文件路径
+     */
+    void saveTrajectoryBinary(const std::string &file_name);
+
+    /**
+     * @brief 获取所有帧的时间戳和位置, 用于评估轨迹精度
+     * 
+     * @param[out] timestamps   时间戳
+     * @param[out] positions    相机在世界坐标系中的位置
+     */
+    void getTrajectory(std::vector<double> &timestamps, std::vector<Vector3d> &positions) const;
+
+    /**
+     * @brief 获取当前参考关键帧的半稠密逆深度图, 供障碍物建图等使用
+     * @detials 需要在配置文件中开启 DepthFilter.semi_dense, 与 process() 在同一线程中调用
+     * 
+     * @param[out] inv_depth        逆深度图, 格式见 DepthFilter::getInverseDepthMap
+     * @param[out] variance         逆深度的方差
+     * @param[out] Twc              参考关键帧的位姿
+     * @param[in] converged_only    是否只输出已经收敛的像素
+     * @return true 
+     * @return false                没有开启半稠密模式或者参考关键帧还没有逆深度图
+     */
+    bool getInverseDepthMap(cv::Mat &inv_depth, cv::Mat &variance, SE3d &Twc, bool converged_only = true) const;
+
+    /**
+     * @brief 是否有可视化窗口
+     * 
+     * @return true     编译时打开了 SSVO_VIEWER_ENABLE 且配置文件中 Viewer.enable 不为0
+     * @return false    无界面运行, 不绘制任何图像
+     */
+    bool isViewerEnabled() const;
+
     /**
      * @brief 析构函数
      * 
@@ -145,6 +189,13 @@ private:
      */
     void drowTrackedPoints(const Frame::Ptr &frame, cv::Mat &dst);
 
+    /**
+     * @brief 地图中所有关键帧当前的位姿, 被剔除的关键帧沿父关键帧恢复, 用于导出轨迹
+     * 
+     * @return TrajectoryWriter::KeyFramePoses 
+     */
+    TrajectoryWriter::KeyFramePoses getKeyFramePoses() const;
+
 private:
 
     /**
@@ -172,13 +223,19 @@ private:
     //地图相关
     LocalMapper::Ptr mapper_;                   //局部地图
 
+    MetricsServer::Ptr metrics_server_;         //运行时指标输出, 未配置时为空
+
 #ifdef SSVO_DBOW_ENABLE
     LoopClosure::Ptr loop_closure_;             //回环检测模块
+    KeyFrameIndexer::Ptr indexer_;              //关键帧词袋索引
+    Relocalizer::Ptr relocalizer_;              //多候选重定位
 #endif
 
-    //可视化窗口
+#ifdef SSVO_VIEWER_ENABLE
+    //可视化窗口, 无界面运行时为空
     Viewer::Ptr viewer_;
     std::thread viewer_thread_;
+#endif
 
     //图像相关
     cv::Mat rgb_;                               //从数据集中读取到的rgb图像?
@@ -189,14 +246,13 @@ private:
 
     //耗时
     double time_;
+    SecondTimer frame_timer_;                   //一帧的处理时间, 用于指标, 不依赖 SSVO_USE_TRACE
     
     //回环时添加
     uint64_t loopId_;
 
-    //buffer
-    std::list<double > frame_timestamp_buffer_;             //TODO 为什么要存储时间戳?
-    std::list<Sophus::SE3d> frame_pose_buffer_;             //存储所有帧的位姿
-    std::list<KeyFrame::Ptr> reference_keyframe_buffer_;    //存储所有关键帧
+    //所有帧相对于参考关键帧的位姿, 写在 Trace.trajectory_file 中, 默认为 Trace.log_dir 下的 ssvo_trajectory_<pid>.bin, 默认文件在轨迹导出过时于退出时删除
+    TrajectoryWriter::Ptr trajectory_;
 };
 
 }// namespce ssvo
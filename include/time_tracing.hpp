@@ -6,7 +6,16 @@
 #include <memory>
 #include <chrono>
 #include <list>
-#include <unordered_map>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <stdexcept>
+#include <stdint.h>
 
 namespace ssvo
 {
@@ -46,6 +55,124 @@ private:
 typedef Timer<std::milli> MillisecondTimer;
 typedef Timer<std::ratio<1, 1>> SecondTimer;
 
+/**
+ * @brief 对数-线性分桶的延时直方图(HDR风格)
+ * @detials 以纳秒计数, 每个2的幂区间分为 SubBuckets/2 个桶, 相对误差不超过 2/SubBuckets, 最大约 2^MaxBits 纳秒.
+ * 不是线程安全的, 由 TimeTracing 在后台线程中更新, 查询时复制一份.
+ */
+class LatencyHistogram
+{
+public:
+
+    enum {
+        SubBits = 7,
+        SubBuckets = 1 << SubBits,
+        MaxBits = 40,
+        Buckets = (MaxBits - SubBits + 2) * (SubBuckets / 2),
+    };
+
+    LatencyHistogram() { reset(); }
+
+    void reset()
+    {
+        counts_.assign(Buckets, 0);
+        count_ = 0;
+        sum_ = 0;
+        min_ = 0;
+        max_ = 0;
+    }
+
+    ///加入一个以秒为单位的延时
+    void add(const double seconds)
+    {
+        const uint64_t max_ns = ((uint64_t)1 << MaxBits) - 1;
+        const uint64_t ns = seconds <= 0 ? 0 : std::min((uint64_t)(seconds * 1e9), max_ns);
+        counts_[index(ns)]++;
+        min_ = count_ == 0 ? seconds : std::min(min_, seconds);
+        max_ = count_ == 0 ? seconds : std::max(max_, seconds);
+        sum_ += seconds;
+        count_++;
+    }
+
+    void merge(const LatencyHistogram &other)
+    {
+        if(other.count_ == 0)
+            return;
+        for(int i = 0; i < Buckets; i++)
+            counts_[i] += other.counts_[i];
+        min_ = count_ == 0 ? other.min_ : std::min(min_, other.min_);
+        max_ = count_ == 0 ? other.max_ : std::max(max_, other.max_);
+        sum_ += other.sum_;
+        count_ += other.count_;
+    }
+
+    ///分位数(秒), p在[0,1]之间
+    double percentile(const double p) const
+    {
+        if(count_ == 0)
+            return 0;
+
+        const uint64_t rank = std::max((uint64_t)1, (uint64_t)std::ceil(p * count_));
+        uint64_t accumulated = 0;
+        for(int i = 0; i < Buckets; i++)
+        {
+            accumulated += counts_[i];
+            if(accumulated >= rank)
+                return std::min(std::max(value(i), min_), max_);
+        }
+        return max_;
+    }
+
+    inline uint64_t count() const { return count_; }
+
+    inline double mean() const { return count_ == 0 ? 0 : sum_ / count_; }
+
+    inline double min() const { return min_; }
+
+    inline double max() const { return max_; }
+
+private:
+
+    static int index(const uint64_t ns)
+    {
+        if(ns < SubBuckets)
+            return (int) ns;
+
+        int msb = SubBits;
+        while(ns >> (msb + 1))
+            msb++;
+
+        const int shift = msb - (SubBits - 1);
+        return shift * (SubBuckets / 2) + (int)(ns >> shift);
+    }
+
+    ///桶的中点(秒)
+    static double value(const int idx)
+    {
+        if(idx < SubBuckets)
+            return idx * 1e-9;
+
+        const int shift = idx / (SubBuckets / 2) - 1;
+        const uint64_t top = idx - shift * (SubBuckets / 2);
+        return ((top << shift) + (((uint64_t)1 << shift) >> 1)) * 1e-9;
+    }
+
+private:
+
+    std::vector<uint64_t> counts_;
+    uint64_t count_;
+    double sum_;
+    double min_;
+    double max_;
+};
+
+/**
+ * @brief 时间统计
+ * @detials 计时器和记录项在构造时注册, 以注册顺序作为整数id, 热路径上只按id访问数组.
+ * 每个调用线程有自己的一行数据和一个单生产者单消费者的无锁环形缓冲区, writeToFile 只把这一行放入缓冲区;
+ * 后台线程定期取出各线程的行, 写入csv文件并累加到每个计时器的直方图中, 直方图可以在运行时查询.
+ * 缓冲区半满时唤醒后台线程, 满时丢弃该行并计数. 字符串名称的接口保留, 每次调用都要查找id, 只用于非关键路径.
+ */
 class TimeTracing
 {
 public:
@@ -56,8 +183,11 @@ public:
 
 #ifdef SSVO_USE_TRACE
     TimeTracing(const std::string file_name, const std::string file_path,
-                const TraceNames &trace_names, const TraceNames &log_names) :
-        file_name_(file_path), trace_names_(trace_names), log_names_(log_names)
+                const TraceNames &trace_names, const TraceNames &log_names,
+                const size_t capacity = 1024, const int flush_interval_ms = 200) :
+        file_name_(file_path), trace_names_(trace_names.begin(), trace_names.end()), log_names_(log_names.begin(), log_names.end()),
+        serial_(nextSerial()), capacity_(capacity), flush_interval_ms_(flush_interval_ms),
+        histograms_(trace_names.size()), dropped_(0), stop_(false)
     {
 
         size_t found = file_name_.find_last_of("/\\");
@@ -69,131 +199,271 @@ public:
         if(!ofs_.is_open())
             throw std::runtime_error("Could not open tracefile: " + file_name_);
 
-        init();
+        ofs_.precision(15);
+        ofs_.setf(std::ios::fixed, std::ios::floatfield);
 
         traceHeader();
+
+        flusher_ = std::thread(&TimeTracing::flushLoop, this);
     }
 
     ~TimeTracing()
     {
+        {
+            std::lock_guard<std::mutex> lock(mutex_drain_);
+            stop_ = true;
+        }
+        cond_drain_.notify_one();
+        flusher_.join();
+
+        if(dropped_ > 0)
+            std::cerr << "TimeTracing(" << file_name_ << "): " << dropped_ << " rows are dropped as the buffer is full" << std::endl;
+
         ofs_.flush();
         ofs_.close();
     }
 
-    inline void startTimer(const std::string &name)
+    inline void startTimer(const int id)
     {
-        auto t = timers_.find(name);
-        if(t == timers_.end())
-        {
-            throw std::runtime_error("startTimer: Timer(" + name + ") not registered");
-        }
-        t->second.start();
+        local().starts[id] = std::chrono::steady_clock::now();
     }
 
-    inline void stopTimer(const std::string &name)
+    inline double stopTimer(const int id)
     {
-        auto t = timers_.find(name);
-        if(t == timers_.end())
-        {
-            throw std::runtime_error("stopTimer: Timer(" + name + ") not registered");
-        }
-        t->second.stop();
+        ThreadState &state = local();
+        state.row[id] = std::chrono::duration<double>(std::chrono::steady_clock::now() - state.starts[id]).count();
+        return state.row[id];
     }
 
-    inline double getTimer(const std::string &name)
+    inline double getTimer(const int id)
     {
-        auto t = timers_.find(name);
-        if(t == timers_.end())
-        {
-            throw std::runtime_error("getTimer: Timer(" + name + ") not registered");
-        }
-        return t->second.duration();
+        return local().row[id];
     }
 
-    inline void log(const std::string &name, const double value)
+    ///记录在其他线程中测得的时间
+    inline void setTimer(const int id, const double seconds)
     {
-        auto log = logs_.find(name);
-        if(log == logs_.end())
-        {
-            throw std::runtime_error("log: log(" + name + ") not registered");
-        }
-        log->second = value;
+        local().row[id] = seconds;
     }
 
+    inline void log(const int id, const double value)
+    {
+        local().row[trace_names_.size() + id] = value;
+    }
+
+    ///结束当前线程的一行, 放入缓冲区后由后台线程写入文件
     inline void writeToFile()
     {
-        bool first_value = true;
-        ofs_.precision(15);
-        ofs_.setf(std::ios::fixed, std::ios::floatfield);
+        ThreadState &state = local();
+        if(!state.push(state.row.data()))
+            dropped_++;
+        else if(state.size() == capacity_ / 2)
+            cond_drain_.notify_one();
+
+        std::fill(state.row.begin(), state.row.begin() + trace_names_.size(), 0.0);
+        std::fill(state.row.begin() + trace_names_.size(), state.row.end(), -1.0);
+    }
 
-        for(auto it = trace_names_.begin(); it != trace_names_.end(); ++it)
-        {
-            if(first_value)
-            {
-                ofs_ << timers_[*it].duration();
-                first_value = false;
-            }
-            else
-                ofs_ << "," << timers_[*it].duration();
-        }
-        for(auto it = log_names_.begin(); it != log_names_.end(); ++it)
-        {
-            if(first_value)
-            {
-                ofs_ << logs_[*it];
-                first_value = false;
-            }
-            else
-                ofs_ << "," << logs_[*it];
-        }
-        ofs_ << "\n";
+    /**
+     * @brief 获取计时器的延时直方图, 只包含已经被后台线程处理的行
+     *
+     * @param[in] id            计时器id
+     * @param[out] histogram    直方图
+     * @return true             id有效
+     */
+    inline bool getHistogram(const int id, LatencyHistogram &histogram)
+    {
+        if(id < 0 || id >= (int) histograms_.size())
+            return false;
+
+        std::lock_guard<std::mutex> lock(mutex_drain_);
+        histogram = histograms_[id];
+        return true;
+    }
 
-        reset();
+    ///立即处理所有线程缓冲区中的行
+    inline void flush()
+    {
+        std::lock_guard<std::mutex> lock(mutex_drain_);
+        drain();
     }
 
+    inline uint64_t dropped() const { return dropped_; }
+
 #else
 
     TimeTracing(const std::string file_name, const std::string file_path,
-        const TraceNames &trace_names, const TraceNames &log_names) :
-        file_name_(file_path), trace_names_(trace_names), log_names_(log_names)
+        const TraceNames &trace_names, const TraceNames &log_names,
+        const size_t capacity = 1024, const int flush_interval_ms = 200) :
+        file_name_(file_path), trace_names_(trace_names.begin(), trace_names.end()), log_names_(log_names.begin(), log_names.end())
     {}
 
-    inline void startTimer(const std::string &name) {}
+    inline void startTimer(const int id) {}
+
+    inline double stopTimer(const int id) { return 0; }
 
-    inline void stopTimer(const std::string &name) {}
+    inline double getTimer(const int id) { return 0; }
 
-    inline double getTimer(const std::string &name) { return 0; }
+    inline void setTimer(const int id, const double seconds) {}
 
-    inline void log(const std::string &name, const double value) {}
+    inline void log(const int id, const double value) {}
 
     inline void writeToFile() {}
 
+    inline bool getHistogram(const int id, LatencyHistogram &histogram) { return false; }
+
+    inline void flush() {}
+
+    inline uint64_t dropped() const { return 0; }
+
 #endif // SSVO_USE_TRACE
 
+    inline void startTimer(const std::string &name) { startTimer(timerId(name)); }
+
+    inline double stopTimer(const std::string &name) { return stopTimer(timerId(name)); }
+
+    inline double getTimer(const std::string &name) { return getTimer(timerId(name)); }
+
+    inline void log(const std::string &name, const double value) { log(logId(name), value); }
+
+    inline bool getHistogram(const std::string &name, LatencyHistogram &histogram) { return getHistogram(timerId(name), histogram); }
+
+    ///计时器的id, 即注册的顺序
+    int timerId(const std::string &name) const
+    {
+        for(size_t i = 0; i < trace_names_.size(); i++)
+            if(trace_names_[i] == name) return (int) i;
+        throw std::runtime_error("TimeTracing: Timer(" + name + ") not registered");
+    }
+
+    ///记录项的id, 即注册的顺序
+    int logId(const std::string &name) const
+    {
+        for(size_t i = 0; i < log_names_.size(); i++)
+            if(log_names_[i] == name) return (int) i;
+        throw std::runtime_error("TimeTracing: log(" + name + ") not registered");
+    }
+
+    inline const std::vector<std::string> &timerNames() const { return trace_names_; }
+
 private:
 
-    void init()
+#ifdef SSVO_USE_TRACE
+    ///一个线程的当前行和环形缓冲区, 缓冲区只由该线程写入, 由后台线程读出
+    struct ThreadState
+    {
+        ThreadState(const size_t num_timers, const size_t width, const size_t capacity) :
+            starts(num_timers), row(width, -1.0), buffer((capacity + 1) * width), slots(capacity + 1), head(0), tail(0)
+        {
+            std::fill(row.begin(), row.begin() + num_timers, 0.0);
+        }
+
+        bool push(const double *values)
+        {
+            const size_t t = tail.load(std::memory_order_relaxed);
+            const size_t next = (t + 1) % slots;
+            if(next == head.load(std::memory_order_acquire))
+                return false;
+
+            std::copy(values, values + row.size(), buffer.begin() + t * row.size());
+            tail.store(next, std::memory_order_release);
+            return true;
+        }
+
+        size_t size() const
+        {
+            return (tail.load(std::memory_order_relaxed) + slots - head.load(std::memory_order_relaxed)) % slots;
+        }
+
+        bool pop(double *values)
+        {
+            const size_t h = head.load(std::memory_order_relaxed);
+            if(h == tail.load(std::memory_order_acquire))
+                return false;
+
+            std::copy(buffer.begin() + h * row.size(), buffer.begin() + (h + 1) * row.size(), values);
+            head.store((h + 1) % slots, std::memory_order_release);
+            return true;
+        }
+
+        std::vector<std::chrono::steady_clock::time_point> starts;
+        std::vector<double> row;
+        std::vector<double> buffer;
+        const size_t slots;
+        std::atomic<size_t> head;
+        std::atomic<size_t> tail;
+    };
+
+    static uint64_t nextSerial()
+    {
+        static std::atomic<uint64_t> serial(0);
+        return ++serial;
+    }
+
+    ///当前线程的数据, 第一次调用时注册. 以实例序号而不是地址作为键, 销毁的实例不会被新实例误用
+    ThreadState &local()
     {
-        for(const std::string &trace : trace_names_)
+        thread_local std::vector<std::pair<uint64_t, ThreadState*> > cache;
+        for(const auto &item : cache)
         {
-            timers_.emplace(trace, SecondTimer());
+            if(item.first == serial_)
+                return *item.second;
         }
 
-        for(const std::string &log : log_names_)
+        std::lock_guard<std::mutex> lock(mutex_states_);
+        states_.emplace_back(new ThreadState(trace_names_.size(), trace_names_.size() + log_names_.size(), capacity_));
+        cache.emplace_back(serial_, states_.back().get());
+        return *states_.back();
+    }
+
+    void flushLoop()
+    {
+        std::unique_lock<std::mutex> lock(mutex_drain_);
+        while(!stop_)
         {
-            logs_.emplace(log, -1.0);
+            cond_drain_.wait_for(lock, std::chrono::milliseconds(flush_interval_ms_));
+            drain();
         }
+        drain();
     }
 
-    void reset()
+    ///调用时需持有 mutex_drain_
+    void drain()
     {
-        for(auto it = timers_.begin(); it != timers_.end(); ++it)
-           it->second.reset();
+        std::vector<ThreadState*> states;
+        {
+            std::lock_guard<std::mutex> lock(mutex_states_);
+            for(const auto &state : states_)
+                states.push_back(state.get());
+        }
 
-        for(auto it = logs_.begin(); it != logs_.end(); ++it)
-            it->second = -1;
+        const size_t num_timers = trace_names_.size();
+        std::vector<double> values(num_timers + log_names_.size());
+        bool written = false;
+        for(ThreadState *state : states)
+        {
+            while(state->pop(values.data()))
+            {
+                for(size_t i = 0; i < values.size(); i++)
+                {
+                    if(i != 0) ofs_ << ",";
+                    ofs_ << values[i];
+                }
+                ofs_ << "\n";
+
+                for(size_t i = 0; i < num_timers; i++)
+                {
+                    if(values[i] > 0)
+                        histograms_[i].add(values[i]);
+                }
+                written = true;
+            }
+        }
 
+        if(written)
+            ofs_.flush();
     }
+#endif // SSVO_USE_TRACE
 
     void traceHeader()
     {
@@ -223,19 +493,35 @@ private:
 
 private:
 
-    std::unordered_map<std::string, SecondTimer> timers_;
-    std::unordered_map<std::string, double> logs_;
     std::string file_name_;
-    TraceNames trace_names_;
-    TraceNames log_names_;
+    std::vector<std::string> trace_names_;
+    std::vector<std::string> log_names_;
 
     std::ofstream ofs_;
+
+#ifdef SSVO_USE_TRACE
+    const uint64_t serial_;
+    const size_t capacity_;
+    const int flush_interval_ms_;
+
+    std::vector<std::unique_ptr<ThreadState> > states_;
+    std::mutex mutex_states_;
+
+    std::vector<LatencyHistogram> histograms_;
+    std::atomic<uint64_t> dropped_;
+
+    bool stop_;
+    std::thread flusher_;
+    std::mutex mutex_drain_;
+    std::condition_variable cond_drain_;
+#endif // SSVO_USE_TRACE
 };
 
 //! TimeTrace for ssvo
 extern TimeTracing::Ptr sysTrace;
 extern TimeTracing::Ptr dfltTrace;
 extern TimeTracing::Ptr mapTrace;
+extern TimeTracing::Ptr indexTrace;
 
 }
 
@@ -0,0 +1,150 @@
+/**
+ * @file timeline.hpp
+ * @brief 所有线程共享时间基准的时间线, 导出为 Chrome trace-event 格式
+ * @detials 用 ScopedSpan 在作用域开始和结束时记录一个事件, 带有线程id和帧或关键帧的id.
+ * 每个线程写入自己的缓冲区, 导出的json文件可以用 chrome://tracing 或 Perfetto 打开,
+ * 用于查看跟踪, 深度滤波, 建图, 闭环和全局BA线程在时间上的重叠.
+ * @version 0.1
+ * @date 2019-01-18
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef _SSVO_TIMELINE_HPP_
+#define _SSVO_TIMELINE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include "global.hpp"
+
+namespace ssvo
+{
+
+/**
+ * @brief 时间线, 全局只有一个实例
+ * @detials 默认不记录, 由 System 根据配置打开. 每个线程的事件数目有上限, 超过后丢弃并计数.
+ *
+ */
+class Timeline : public noncopyable
+{
+public:
+
+    ///一个完整的事件, 名称必须是字符串常量
+    struct Event
+    {
+        const char *name;
+        const char *arg_name;   ///<参数名, 为空时没有参数
+        int64_t arg;
+        uint64_t begin;         ///<从时间线创建开始的纳秒数
+        uint64_t duration;      ///<纳秒
+    };
+
+    static Timeline &instance();
+
+    void enable(bool enable);
+
+    inline bool isEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 设置当前线程的名称, 在线程开始时调用
+     *
+     * @param[in] name  线程名称
+     */
+    void setThreadName(const std::string &name);
+
+    ///从时间线创建开始的纳秒数
+    inline uint64_t now() const
+    { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count(); }
+
+    /**
+     * @brief 记录当前线程的一个事件
+     *
+     * @param[in] name      事件名称, 字符串常量
+     * @param[in] begin     开始时刻, 由 now() 得到
+     * @param[in] end       结束时刻, 由 now() 得到
+     * @param[in] arg_name  参数名, 字符串常量, 可以为空
+     * @param[in] arg       参数值
+     */
+    void record(const char *name, uint64_t begin, uint64_t end, const char *arg_name = nullptr, int64_t arg = 0);
+
+    /**
+     * @brief 导出为 Chrome trace-event 格式的json文件
+     *
+     * @param[in] file_name 文件名
+     * @return true         成功
+     */
+    bool save(const std::string &file_name);
+
+private:
+
+    Timeline();
+
+    ///一个线程的事件缓冲区, 只由该线程写入, 锁只在导出时才有竞争
+    struct ThreadBuffer
+    {
+        uint32_t tid;
+        std::string name;
+        std::vector<Event> events;
+        uint64_t dropped;
+        std::mutex mutex;
+    };
+
+    ThreadBuffer &local();
+
+private:
+
+    const std::chrono::steady_clock::time_point start_;
+    std::atomic<bool> enabled_;
+    const size_t max_events_per_thread_;
+
+    std::vector<std::unique_ptr<ThreadBuffer> > buffers_;
+    std::mutex mutex_buffers_;
+};
+
+/**
+ * @brief 记录所在作用域的事件, 时间线未打开时只有一次原子读
+ *
+ */
+class ScopedSpan : public noncopyable
+{
+public:
+
+#ifdef SSVO_USE_TRACE
+    explicit ScopedSpan(const char *name, const char *arg_name = nullptr, int64_t arg = 0) :
+        name_(name), arg_name_(arg_name), arg_(arg), active_(Timeline::instance().isEnabled())
+    {
+        if(active_)
+            begin_ = Timeline::instance().now();
+    }
+
+    ~ScopedSpan()
+    {
+        if(active_)
+            Timeline::instance().record(name_, begin_, Timeline::instance().now(), arg_name_, arg_);
+    }
+
+    ///设置参数, 用于在作用域中才知道的id
+    inline void setArg(const char *arg_name, int64_t arg)
+    {
+        arg_name_ = arg_name;
+        arg_ = arg;
+    }
+
+private:
+
+    const char *name_;
+    const char *arg_name_;
+    int64_t arg_;
+    uint64_t begin_;
+    const bool active_;
+#else
+    explicit ScopedSpan(const char *name, const char *arg_name = nullptr, int64_t arg = 0) {}
+
+    inline void setArg(const char *arg_name, int64_t arg) {}
+#endif // SSVO_USE_TRACE
+};
+
+}
+
+#endif //_SSVO_TIMELINE_HPP_
@@ -0,0 +1,118 @@
+/**
+ * @file trajectory_writer.hpp
+ * @brief 逐帧追加写入的轨迹文件, 内存占用有上限
+ * @detials 每帧记录相对于参考关键帧的位姿和当时的绝对位姿, 按块追加到二进制文件中, 不保留关键帧的指针.
+ * 导出时用关键帧当前(闭环和全局BA之后)的位姿重新计算每帧的位姿, 被剔除的参考关键帧通过父关键帧得到位姿,
+ * 仍然找不到时使用记录的绝对位姿.
+ * 可以导出为 TUM 文本格式或同样记录格式的二进制文件.
+ * @version 0.1
+ * @date 2019-01-26
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef _SSVO_TRAJECTORY_WRITER_HPP_
+#define _SSVO_TRAJECTORY_WRITER_HPP_
+
+#include <fstream>
+#include <functional>
+#include "global.hpp"
+
+namespace ssvo
+{
+
+class TrajectoryWriter : public noncopyable
+{
+public:
+
+    typedef std::shared_ptr<TrajectoryWriter> Ptr;
+
+    ///一帧的记录, 位姿为 tx ty tz qx qy qz qw
+    struct Record
+    {
+        double timestamp;
+        uint64_t frame_id;
+        uint64_t keyframe_id;   ///<参考关键帧
+        double Trc[7];          ///<帧在参考关键帧坐标系中的位姿
+        double Twc[7];          ///<记录时帧在世界坐标系中的位姿
+    };
+
+    enum Format {TUM, BINARY};
+
+    ///关键帧id到当前位姿 Twc 的表
+    typedef std::unordered_map<uint64_t, SE3d, std::hash<uint64_t>, std::equal_to<uint64_t>,
+        Eigen::aligned_allocator<std::pair<const uint64_t, SE3d> > > KeyFramePoses;
+
+    ~TrajectoryWriter();
+
+    /**
+     * @brief 追加一帧, 每满一块写入文件
+     *
+     * @param[in] timestamp     时间戳
+     * @param[in] frame_id      帧id
+     * @param[in] keyframe_id   参考关键帧id
+     * @param[in] Twr           参考关键帧的位姿
+     * @param[in] Twc           帧的位姿
+     */
+    void append(double timestamp, uint64_t frame_id, uint64_t keyframe_id, const SE3d &Twr, const SE3d &Twc);
+
+    ///把缓存的记录写入文件
+    void flush();
+
+    inline size_t size() const { return count_; }
+
+    /**
+     * @brief 顺序读取所有记录, 位姿按关键帧当前的位姿更新
+     *
+     * @param[in] poses     关键帧当前的位姿, 包括通过父关键帧恢复的被剔除的关键帧
+     * @param[in] callback  每条记录调用一次, 位姿为更新后的 Twc, 参考关键帧不在表中时为记录的 Twc
+     * @return true         成功
+     */
+    bool forEach(const KeyFramePoses &poses, const std::function<void(const Record &, const SE3d &)> &callback);
+
+    /**
+     * @brief 导出轨迹
+     *
+     * @param[in] file_name 文件名
+     * @param[in] poses     关键帧当前的位姿
+     * @param[in] format    TUM 文本或二进制
+     * @return true         成功
+     */
+    bool save(const std::string &file_name, const KeyFramePoses &poses, Format format = TUM);
+
+    /**
+     * @brief 创建轨迹文件, 已存在时覆盖
+     *
+     * @param[in] file_name     二进制轨迹文件
+     * @param[in] chunk_size    每次写入的记录数, 即内存中最多缓存的记录数
+     * @param[in] temporary     为真时, 轨迹被成功读出或导出过的文件在析构时删除, 否则(如程序崩溃)保留
+     * @return Ptr
+     */
+    inline static Ptr create(const std::string &file_name, size_t chunk_size = 256, bool temporary = false)
+    { return Ptr(new TrajectoryWriter(file_name, chunk_size, temporary)); }
+
+private:
+
+    TrajectoryWriter(const std::string &file_name, size_t chunk_size, bool temporary);
+
+    static void toArray(const SE3d &T, double *array);
+
+    static SE3d fromArray(const double *array);
+
+private:
+
+    const std::string file_name_;
+    const size_t chunk_size_;
+    const bool temporary_;
+    size_t count_;
+    bool exported_;
+
+    std::ofstream ofs_;
+    std::vector<Record> records_;
+    std::mutex mutex_records_;
+};
+
+}
+
+#endif //_SSVO_TRAJECTORY_WRITER_HPP_
@@ -4,6 +4,10 @@
 
 #include <opencv2/opencv.hpp>
 
+#if __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace ssvo{
 
 static int bit_pattern_31_[256*4] =
@@ -272,6 +276,13 @@ BRIEF::BRIEF(float scale_factor, int nlevels)://, int height, int width) :
     const int npoints = 512;
     const cv::Point* pattern0 = (const cv::Point*)bit_pattern_31_;
     std::copy(pattern0, pattern0 + npoints, std::back_inserter(pattern_));
+    pattern_x_.resize(npoints);
+    pattern_y_.resize(npoints);
+    for(int i = 0; i < npoints; i++)
+    {
+        pattern_x_[i] = (float) pattern_[i].x;
+        pattern_y_[i] = (float) pattern_[i].y;
+    }
 
     //This is for orientation
     // pre-compute the end of a row in a circular patch
@@ -346,7 +357,7 @@ float BRIEF::IC_Angle(const cv::Mat& image, cv::Point2f pt,  const std::vector<i
 }
 
 
-void BRIEF::compute(const cv::KeyPoint& kpt, const cv::Mat& img, const cv::Point* pattern, uchar* desc) const
+void BRIEF::compute(const cv::KeyPoint& kpt, const cv::Mat& img, uchar* desc) const
 {
     static const float factorPI = (float)(CV_PI/180.f);
     float angle = (float)kpt.angle*factorPI;
@@ -355,43 +366,49 @@ void BRIEF::compute(const cv::KeyPoint& kpt, const cv::Mat& img, const cv::Point
     const uchar* center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
     const int step = (int)img.step;
 
-#define GET_VALUE(idx) \
-        center[cvRound(pattern[idx].x*b + pattern[idx].y*a)*step + \
-               cvRound(pattern[idx].x*a - pattern[idx].y*b)]
-
+    //! rotate all the pattern points at once, the same as cvRound(x*a - y*b) and cvRound(x*b + y*a)
+    const int npoints = (int)pattern_x_.size();
+    const float* px = &pattern_x_[0];
+    const float* py = &pattern_y_[0];
+    int offsets[512];
+
+#if __SSE2__
+    const __m128 va = _mm_set1_ps(a);
+    const __m128 vb = _mm_set1_ps(b);
+    int rx[4], ry[4];
+    for (int i = 0; i < npoints; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(px + i);
+        const __m128 y = _mm_loadu_ps(py + i);
+        _mm_storeu_si128((__m128i*)rx, _mm_cvtps_epi32(_mm_sub_ps(_mm_mul_ps(x, va), _mm_mul_ps(y, vb))));
+        _mm_storeu_si128((__m128i*)ry, _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(x, vb), _mm_mul_ps(y, va))));
+        offsets[i] = ry[0]*step + rx[0];
+        offsets[i+1] = ry[1]*step + rx[1];
+        offsets[i+2] = ry[2]*step + rx[2];
+        offsets[i+3] = ry[3]*step + rx[3];
+    }
+#else
+    for (int i = 0; i < npoints; ++i)
+        offsets[i] = cvRound(px[i]*b + py[i]*a)*step + cvRound(px[i]*a - py[i]*b);
+#endif
 
-    for (int i = 0; i < 32; ++i, pattern += 16)
+    const int* offset = offsets;
+    for (int i = 0; i < 32; ++i, offset += 16)
     {
-        int t0, t1, val;
-        t0 = GET_VALUE(0); t1 = GET_VALUE(1);
-        val = t0 < t1;
-        t0 = GET_VALUE(2); t1 = GET_VALUE(3);
-        val |= (t0 < t1) << 1;
-        t0 = GET_VALUE(4); t1 = GET_VALUE(5);
-        val |= (t0 < t1) << 2;
-        t0 = GET_VALUE(6); t1 = GET_VALUE(7);
-        val |= (t0 < t1) << 3;
-        t0 = GET_VALUE(8); t1 = GET_VALUE(9);
-        val |= (t0 < t1) << 4;
-        t0 = GET_VALUE(10); t1 = GET_VALUE(11);
-        val |= (t0 < t1) << 5;
-        t0 = GET_VALUE(12); t1 = GET_VALUE(13);
-        val |= (t0 < t1) << 6;
-        t0 = GET_VALUE(14); t1 = GET_VALUE(15);
-        val |= (t0 < t1) << 7;
+        int val = 0;
+        for (int k = 0; k < 8; ++k)
+            val |= (center[offset[2*k]] < center[offset[2*k+1]]) << k;
 
         desc[i] = (uchar)val;
     }
-
-#undef GET_VALUE
 }
 
-
-void BRIEF::compute(const std::vector<cv::Mat> &images, std::vector<cv::KeyPoint> &keypoints, cv::Mat &descriptors) const
+BRIEF::Pyramid::Ptr BRIEF::createPyramid(const std::vector<cv::Mat> &images) const
 {
     const size_t nlevels = images.size();
-    std::vector<cv::Mat> image_pyramid_border(nlevels);
-    std::vector<cv::Mat> image_pyramid_border_gauss(nlevels);
+    Pyramid::Ptr pyramid = std::make_shared<Pyramid>();
+    pyramid->border.resize(nlevels);
+    pyramid->border_gauss.resize(nlevels);
     for(size_t i = 0; i < nlevels; ++i)
     {
         cv::Mat image_border;
@@ -400,41 +417,67 @@ void BRIEF::compute(const std::vector<cv::Mat> &images, std::vector<cv::KeyPoint
         else
             cv::copyMakeBorder(images[i], image_border, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD, cv::BORDER_REFLECT_101);
 
-        image_pyramid_border[i] = image_border(cv::Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, images[i].cols, images[i].rows));
+        pyramid->border[i] = image_border(cv::Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, images[i].cols, images[i].rows));
 
         cv::Mat image_border_gauss = cv::Mat(image_border.size(), image_border.type());
 
         // preprocess the resized image
         cv::GaussianBlur(image_border, image_border_gauss, cv::Size(7, 7), 2, 2, cv::BORDER_REFLECT_101);
-        image_pyramid_border_gauss[i] = image_border_gauss(cv::Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, images[i].cols, images[i].rows));
+        pyramid->border_gauss[i] = image_border_gauss(cv::Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, images[i].cols, images[i].rows));
     }
 
+    return pyramid;
+}
 
-    int size = (int)keypoints.size();
-    descriptors = cv::Mat::zeros(size, 32, CV_8UC1);
-    for(int i = 0; i < size; i++)
+void BRIEF::compute(const std::vector<cv::Mat> &images, std::vector<cv::KeyPoint> &keypoints, cv::Mat &descriptors) const
+{
+    Pyramid::Ptr pyramid = createPyramid(images);
+    compute(*pyramid, keypoints, descriptors);
+}
+
+/**
+ * @brief 并行计算一段特征点的方向和描述子, 每个特征点只写自己的方向和描述子的一行
+ *
+ */
+class BRIEFComputeInvoker : public cv::ParallelLoopBody
+{
+public:
+    BRIEFComputeInvoker(const BRIEF &brief, const BRIEF::Pyramid &pyramid, const std::vector<float> &inv_scale_factors,
+                        const std::vector<int> &umax, std::vector<cv::KeyPoint> &keypoints, cv::Mat &descriptors) :
+        brief_(brief), pyramid_(pyramid), inv_scale_factors_(inv_scale_factors), umax_(umax),
+        keypoints_(keypoints), descriptors_(descriptors)
+    {}
+
+    virtual void operator()(const cv::Range &range) const
     {
-        cv::KeyPoint keypoint = keypoints[i];
-        keypoint.pt *= inv_scale_factors_.at(keypoint.octave);
-        keypoint.angle = IC_Angle(image_pyramid_border[keypoint.octave], keypoint.pt, umax_);
-        keypoints[i].angle = keypoint.angle;
-//
-//        if(keypoint.octave>0)
-//        {
-//            cv::Mat show;
-//            cv::cvtColor(images[keypoint.octave], show, cv::COLOR_GRAY2BGR);
-//            cv::circle(show, keypoint.pt, 3, cv::Scalar(0, 255, 0));
-//            cv::imshow("ss", show);
-//            cv::waitKey(0);
-//        }
-//
-//        int a = image_pyramid_border[keypoint.octave].at<uchar>(cvRound(keypoint.pt.y), cvRound(keypoint.pt.x));
-//        int b = images[keypoint.octave].at<uchar>(cvRound(keypoint.pt.y), cvRound(keypoint.pt.x));
-//        int c = image_pyramid_border_gauss[keypoint.octave].at<uchar>(cvRound(keypoint.pt.y), cvRound(keypoint.pt.x));
-//        std::cout << "a: " << a << ", b: " << b  << ", c: " << c << ". px: " << keypoint.pt.x << ", " << keypoint.pt.y<< std::endl;
+        for(int i = range.start; i < range.end; i++)
+        {
+            cv::KeyPoint keypoint = keypoints_[i];
+            keypoint.pt *= inv_scale_factors_.at(keypoint.octave);
+            keypoint.angle = brief_.IC_Angle(pyramid_.border[keypoint.octave], keypoint.pt, umax_);
+            keypoints_[i].angle = keypoint.angle;
 
-        compute(keypoint, image_pyramid_border_gauss[keypoint.octave], &pattern_[0], descriptors.ptr((int)i));
+            brief_.compute(keypoint, pyramid_.border_gauss[keypoint.octave], descriptors_.ptr(i));
+        }
     }
+
+private:
+    const BRIEF &brief_;
+    const BRIEF::Pyramid &pyramid_;
+    const std::vector<float> &inv_scale_factors_;
+    const std::vector<int> &umax_;
+    std::vector<cv::KeyPoint> &keypoints_;
+    cv::Mat &descriptors_;
+};
+
+void BRIEF::compute(const Pyramid &pyramid, std::vector<cv::KeyPoint> &keypoints, cv::Mat &descriptors) const
+{
+    int size = (int)keypoints.size();
+    descriptors = cv::Mat::zeros(size, 32, CV_8UC1);
+    if(size == 0)
+        return;
+
+    cv::parallel_for_(cv::Range(0, size), BRIEFComputeInvoker(*this, pyramid, inv_scale_factors_, umax_, keypoints, descriptors));
 }
 
 //bool BRIEF::checkBorder(const double x, const double y,const int level, const bool bottom_level)
@@ -1,10 +1,14 @@
 #include <future>
+#include <cstring>
 #include "config.hpp"
 #include "utils.hpp"
 #include "depth_filter.hpp"
 #include "feature_alignment.hpp"
 #include "image_alignment.hpp"
 #include "time_tracing.hpp"
+#include "timeline.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
 
 namespace ssvo{
 
@@ -109,10 +113,24 @@ void showAffine(const cv::Mat &src, const Vector2d &px_ref, const Matrix2d &A_re
 //! =================================================================================================
 TimeTracing::Ptr dfltTrace = nullptr;
 
+//! ids of the timers and logs in dfltTrace, in the order they are registered
+namespace dflt_trace{
+enum TimerId{TOTAL_WITHOUT_KLT, KLT_TRACK, UPDATE_SEEDS, EPL_SEARCH, CREATE_SEEDS, SEMI_DENSE};
+enum LogId{FRAME_ID, NUM_TRACKED, NUM_UPDATED, NUM_REPOJ, QUEUE_SIZE, NUM_DROPPED, NUM_DENSE_UPDATED};
+}
+
+namespace dflt_metrics{
+MetricGauge *tracked = Metrics::instance().gauge("ssvo_filter_tracked_seeds", "Seeds tracked by KLT into the last frame");
+MetricGauge *updated = Metrics::instance().gauge("ssvo_filter_updated_seeds", "Seeds updated by the last frame");
+MetricCounter *created = Metrics::instance().counter("ssvo_filter_created_seeds_total", "Number of seeds created on keyframes");
+MetricGauge *queue = Metrics::instance().gauge("ssvo_filter_queue_depth", "Frames waiting for the depth filter thread");
+MetricCounter *dropped = Metrics::instance().counter("ssvo_filter_dropped_frames_total", "Low-disparity frames coalesced in the queue");
+}
+
 //! DepthFilter
 DepthFilter::DepthFilter(const FastDetector::Ptr &fast_detector, const Callback &callback, bool report, bool verbose) :
     seed_coverged_callback_(callback), fast_detector_(fast_detector),
-    report_(report), verbose_(report&&verbose), filter_thread_(nullptr), track_thread_enabled_(true), stop_require_(false)
+    frames_dropped_(0), report_(report), verbose_(report&&verbose), filter_thread_(nullptr), track_thread_enabled_(true), stop_require_(false), klt_time_(0)
 {
     options_.max_kfs = 5;
     options_.max_features = Config::minCornersPerKeyFrame();
@@ -122,9 +140,12 @@ DepthFilter::DepthFilter(const FastDetector::Ptr &fast_detector, const Callback
     options_.align_epslion = 0.0001;
     options_.max_perprocess_kfs = Config::maxPerprocessKeyFrames();
     options_.pixel_error_threshold = 1;
-    options_.min_frame_disparity = 0.0;//2.0;
+    options_.min_frame_disparity = Config::minFrameDisparity();
     options_.min_pixel_disparity = 4.5;
 
+    if(Config::semiDenseEnable())
+        semi_dense_filter_ = SemiDenseFilter::create(verbose_);
+
     //! LOG and timer for system;
     TimeTracing::TraceNames time_names;
     time_names.push_back("total_without_klt");
@@ -132,12 +153,16 @@ DepthFilter::DepthFilter(const FastDetector::Ptr &fast_detector, const Callback
     time_names.push_back("update_seeds");
     time_names.push_back("epl_search");
     time_names.push_back("create_seeds");
+    time_names.push_back("semi_dense");
 
     TimeTracing::TraceNames log_names;
     log_names.push_back("frame_id");
     log_names.push_back("num_tracked");
     log_names.push_back("num_updated");
     log_names.push_back("num_repoj");
+    log_names.push_back("queue_size");
+    log_names.push_back("num_dropped");
+    log_names.push_back("num_dense_updated");
 
     string trace_dir = Config::timeTracingDirectory();
     dfltTrace.reset(new TimeTracing("ssvo_trace_filter", trace_dir, time_names, log_names));
@@ -185,83 +210,199 @@ bool DepthFilter::isRequiredStop()
 void DepthFilter::run()
 {
     LOG(WARNING) << "[Filter][*] Start main thread!";
+    Timeline::instance().setThreadName("depth_filter");
     while(!isRequiredStop())
     {
         Frame::Ptr frame;
         KeyFrame::Ptr keyframe;
-        if(checkNewFrame(frame, keyframe))
+        bool updatable = false;
+        if(checkNewFrame(frame, keyframe, updatable))
         {
-            dfltTrace->startTimer("total_without_klt");
+            ScopedSpan span("filter", "frame_id", frame->id_);
+            dfltTrace->startTimer(dflt_trace::TOTAL_WITHOUT_KLT);
+            dfltTrace->log(dflt_trace::FRAME_ID, frame->id_);
 
             int updated_count = 0;
             int project_count = 0;
-            if(checkDisparity(frame))
+            if(updatable)
             {
-                dfltTrace->startTimer("update_seeds");
+                dfltTrace->startTimer(dflt_trace::UPDATE_SEEDS);
                 updated_count = updateSeeds(frame);
-                dfltTrace->stopTimer("update_seeds");
-                dfltTrace->log("num_updated", updated_count);
+                dfltTrace->stopTimer(dflt_trace::UPDATE_SEEDS);
+                dfltTrace->log(dflt_trace::NUM_UPDATED, updated_count);
+                dflt_metrics::updated->set(updated_count);
 
-                dfltTrace->startTimer("epl_search");
+                dfltTrace->startTimer(dflt_trace::EPL_SEARCH);
                 project_count = reprojectAllSeeds(frame);
-                dfltTrace->stopTimer("epl_search");
-                dfltTrace->log("num_repoj", project_count);
+                dfltTrace->stopTimer(dflt_trace::EPL_SEARCH);
+                dfltTrace->log(dflt_trace::NUM_REPOJ, project_count);
             }
 
-            dfltTrace->startTimer("create_seeds");
+            dfltTrace->startTimer(dflt_trace::SEMI_DENSE);
+            updateSemiDense(frame, keyframe, updatable);
+            dfltTrace->stopTimer(dflt_trace::SEMI_DENSE);
+
+            dfltTrace->startTimer(dflt_trace::CREATE_SEEDS);
             if(keyframe)
             {
                 int new_seeds = createSeeds(keyframe, frame);
+                dflt_metrics::created->inc(new_seeds);
                 updateByConnectedKeyFrames(keyframe, 3);
-                LOG(INFO) << "[Filter] New created depth filter seeds: " << new_seeds;
+                SSVO_LOG(FILTER, 1, INFO) << "[Filter] New created depth filter seeds: " << new_seeds;
             }
-            dfltTrace->stopTimer("create_seeds");
+            dfltTrace->stopTimer(dflt_trace::CREATE_SEEDS);
 
-            dfltTrace->stopTimer("total_without_klt");
+            dfltTrace->stopTimer(dflt_trace::TOTAL_WITHOUT_KLT);
 
             dfltTrace->writeToFile();
 
-            LOG_IF(WARNING, report_) << "[Filter][2] Frame: " << frame->id_
-                                     << ", Seeds after updated: " << updated_count
-                                     << ", new reprojected: " << project_count;
+            SSVO_LOG_IF(FILTER, 2, WARNING, report_) << "[Filter][2] Frame: " << frame->id_
+                                                     << ", Seeds after updated: " << updated_count
+                                                     << ", new reprojected: " << project_count;
         }
 
     }
 }
 
-//void DepthFilter::logSeedsInfo()
-//{
-//    std::unique_lock<std::mutex> lock(mutex_seeds_);
-//    std::list<std::tuple<uint64_t, int, int>> seeds_info;
-//    for(const auto it : seeds_buffer_)
-//    {
-//        auto rate_itr = seeds_convergence_rate_.find(it.first->id_);
-//        if(rate_itr!=seeds_convergence_rate_.end())
-//            std::get<1>(rate_itr->second) = it.second->size();
-//    }
-//
-//    for(const auto it : seeds_convergence_rate_)
-//    {
-//        seeds_info.emplace_back(it.first, std::get<0>(it.second), std::get<1>(it.second));
-//    }
-//
-//    seeds_info.sort([](const std::tuple<uint64_t, int, int> &a, const std::tuple<uint64_t, int, int> &b){
-//      return std::get<0>(a) < std::get<0>(b);
-//    });
-//
-//    std::ofstream f;
-//    f.open("/tmp/ssvo_seeds_rate.txt");
-//
-//    for(const auto &it : seeds_info)
-//    {
-//        f << std::get<0>(it) << " " << std::get<1>(it) << " " << std::get<2>(it) << " " << 1.0*std::get<2>(it)/std::get<1>(it)<< "\n";
-//    }
-//    f.flush();
-//
-//    f.close();
-//}
+void DepthFilter::logSeedsInfo()
+{
+    std::unique_lock<std::mutex> lock(mutex_seeds_info_);
+    finishSeedsInfo(true);
+    if(seeds_info_file_.is_open())
+        seeds_info_file_.close();
+}
+
+void DepthFilter::finishSeedsInfo(bool all)
+{
+    for(auto info_itr = seeds_info_.begin(); info_itr != seeds_info_.end();)
+    {
+        //! the map is ordered by keyframe id, the oldest ones are finished first when there are too many
+        KeyFrame::Ptr kf = info_itr->second.keyframe.lock();
+        const bool finished = all || seeds_info_.size() > (size_t) SeedsInfo::MaxKeyFrames || !kf || kf->isBad() || kf->getSeeds().empty();
+        if(!finished)
+        {
+            info_itr++;
+            continue;
+        }
+
+        writeSeedsInfo(info_itr->first, info_itr->second);
+        info_itr = seeds_info_.erase(info_itr);
+    }
+}
+
+void DepthFilter::writeSeedsInfo(uint64_t keyframe_id, const SeedsInfo &info)
+{
+    if(!seeds_info_file_.is_open())
+    {
+        std::string file_name = Config::timeTracingDirectory();
+        size_t found = file_name.find_last_of("/\\");
+        if(found + 1 != file_name.size())
+            file_name += file_name.substr(found, 1);
+        file_name += "ssvo_trace_seeds.csv";
+
+        seeds_info_file_.open(file_name.c_str());
+        if(!seeds_info_file_.is_open())
+        {
+            LOG(ERROR) << "[Filter] Could not open seeds info file: " << file_name;
+            return;
+        }
+
+        seeds_info_file_ << "keyframe_id,created,converged,diverged,remained,converge_rate,mean_updates,mean_time,max_time";
+        for(int i = 0; i < SeedsInfo::HistSize; i++)
+            seeds_info_file_ << ",updates_" << (1 << i);
+        seeds_info_file_ << "\n";
+
+        seeds_info_file_.precision(6);
+        seeds_info_file_.setf(std::ios::fixed, std::ios::floatfield);
+    }
+
+    //! seeds still in the keyframe are either diverged or not converged yet
+    int diverged = 0;
+    int remained = 0;
+    KeyFrame::Ptr kf = info.keyframe.lock();
+    if(kf)
+    {
+        std::vector<Feature::Ptr> seed_fts = kf->getSeeds();
+        for(const Feature::Ptr &ft : seed_fts)
+        {
+            //! a converged seed is removed from the keyframe after its statistics
+            if(ft->seed_->checkConvergence())
+                continue;
+            if(ft->seed_->checkDivergence())
+                diverged++;
+            else
+                remained++;
+        }
+    }
+
+    const double rate = info.created ? 1.0 * info.converged / info.created : 0.0;
+    const double mean_updates = info.converged ? 1.0 * info.updates / info.converged : 0.0;
+    const double mean_time = info.converged ? info.time_sum / info.converged : 0.0;
+    seeds_info_file_ << keyframe_id << "," << info.created << "," << info.converged << "," << diverged << "," << remained << ","
+                     << rate << "," << mean_updates << "," << mean_time << "," << info.time_max;
+    for(int i = 0; i < SeedsInfo::HistSize; i++)
+        seeds_info_file_ << "," << info.updates_hist[i];
+    seeds_info_file_ << "\n";
+}
+
+void DepthFilter::updateSemiDense(const Frame::Ptr &frame, const KeyFrame::Ptr &keyframe, bool updatable)
+{
+    if(semi_dense_filter_ == nullptr)
+        return;
+
+    int updated_count = 0;
+    if(updatable)
+        updated_count = semi_dense_filter_->updateSeeds(frame);
+    dfltTrace->log(dflt_trace::NUM_DENSE_UPDATED, updated_count);
+
+    if(keyframe)
+    {
+        int new_seeds = semi_dense_filter_->createSeeds(keyframe);
+        SSVO_LOG_IF(FILTER, 3, INFO, verbose_) << "[Filter] New created semi-dense seeds: " << new_seeds;
+    }
+}
+
+bool DepthFilter::getInverseDepthMap(const KeyFrame::Ptr &keyframe, cv::Mat &inv_depth, cv::Mat &variance, bool converged_only)
+{
+    if(semi_dense_filter_ == nullptr || keyframe == nullptr)
+        return false;
+
+    return semi_dense_filter_->getInverseDepthMap(keyframe->id_, inv_depth, variance, converged_only);
+}
+
+void DepthFilter::convergeSeed(const Seed::Ptr &seed)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_seeds_info_);
+        auto info_itr = seeds_info_.find(seed->kf->id_);
+        if(info_itr != seeds_info_.end())
+        {
+            SeedsInfo &info = info_itr->second;
+            const int updates = (int) seed->history.size();
+            int bin = 0;
+            while((2 << bin) <= updates && bin < SeedsInfo::HistSize - 1)
+                bin++;
+            info.converged++;
+            info.updates += updates;
+            info.updates_hist[bin]++;
+
+            std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - info.time_created;
+            info.time_sum += duration.count();
+            info.time_max = MAX(info.time_max, duration.count());
+
+            //! all seeds of the keyframe are converged
+            if(info.converged >= info.created)
+            {
+                writeSeedsInfo(info_itr->first, info);
+                seeds_info_.erase(info_itr);
+            }
+        }
+    }
 
-bool DepthFilter::checkNewFrame(Frame::Ptr &frame, KeyFrame::Ptr &keyframe)
+    seed_coverged_callback_(seed);
+}
+
+bool DepthFilter::checkNewFrame(Frame::Ptr &frame, KeyFrame::Ptr &keyframe, bool &updatable)
 {
     std::unique_lock<std::mutex> lock(mutex_frame_);
     cond_process_main_.wait_for(lock, std::chrono::microseconds(5));
@@ -269,8 +410,12 @@ bool DepthFilter::checkNewFrame(Frame::Ptr &frame, KeyFrame::Ptr &keyframe)
     if(frames_buffer_.empty())
         return false;
 
-    frame = frames_buffer_.front().first;
-    keyframe = frames_buffer_.front().second;
+    dfltTrace->log(dflt_trace::QUEUE_SIZE, frames_buffer_.size());
+    dfltTrace->log(dflt_trace::NUM_DROPPED, frames_dropped_);
+    dflt_metrics::queue->set(frames_buffer_.size() - 1);
+    frames_dropped_ = 0;
+
+    std::tie(frame, keyframe, updatable) = frames_buffer_.front();
     frames_buffer_.pop_front();
 
     return frame != nullptr;
@@ -278,29 +423,27 @@ bool DepthFilter::checkNewFrame(Frame::Ptr &frame, KeyFrame::Ptr &keyframe)
 
 bool DepthFilter::checkDisparity(const Frame::Ptr &frame)
 {
-    static Frame::Ptr frame_ref;
-
     if(frame == nullptr)
         return false;
 
-    if(frame_ref != nullptr && frame_ref->getRefKeyFrame()->id_ == frame->getRefKeyFrame()->id_)
+    if(frame_disparity_ref_ != nullptr && frame_disparity_ref_->getRefKeyFrame()->id_ == frame->getRefKeyFrame()->id_)
     {
-        const double disparity = frame->disparity_ - frame_ref->disparity_;
+        const double disparity = frame->disparity_ - frame_disparity_ref_->disparity_;
         if(std::abs(disparity) < options_.min_frame_disparity)
         {
-            LOG(ERROR) << "Too less disparity:" << disparity << " in frame " << frame->id_;
+            SSVO_LOG_IF(FILTER, 3, INFO, verbose_) << "[Filter] Too less disparity:" << disparity << " in frame " << frame->id_;
             return false;
         }
     }
 
-    frame_ref = frame;
+    frame_disparity_ref_ = frame;
 
     return true;
 }
 
 void DepthFilter::trackFrame(const Frame::Ptr &frame_last, const Frame::Ptr &frame_cur)
 {
-    dfltTrace->log("frame_id", frame_cur->id_);
+    dfltTrace->log(dflt_trace::FRAME_ID, frame_cur->id_);
     if(track_thread_enabled_)
     {
         seeds_track_future_ = std::async(std::launch::async, &DepthFilter::trackSeeds, this, frame_last, frame_cur);
@@ -308,8 +451,10 @@ void DepthFilter::trackFrame(const Frame::Ptr &frame_last, const Frame::Ptr &fra
     else
     {
         int tracked_count = trackSeeds(frame_last, frame_cur);
-        dfltTrace->log("num_tracked", tracked_count);
-        LOG_IF(WARNING, report_) << "[Filter][1] Frame: " << frame_cur->id_ << ", Tracking seeds: " << tracked_count;
+        dfltTrace->setTimer(dflt_trace::KLT_TRACK, klt_time_);
+        dfltTrace->log(dflt_trace::NUM_TRACKED, tracked_count);
+        dflt_metrics::tracked->set(tracked_count);
+        SSVO_LOG_IF(FILTER, 2, WARNING, report_) << "[Filter][1] Frame: " << frame_cur->id_ << ", Tracking seeds: " << tracked_count;
     }
 }
 
@@ -321,50 +466,82 @@ void DepthFilter::insertFrame(const Frame::Ptr &frame, const KeyFrame::Ptr keyfr
     {
         seeds_track_future_.wait();
         int tracked_count = seeds_track_future_.get();
-        dfltTrace->log("num_tracked", tracked_count);
-        LOG_IF(WARNING, report_) << "[Filter][1] Frame: " << frame->id_ << ", Tracking seeds: " << tracked_count;
+        //! the track thread is created for each frame, so its time is recorded in this thread
+        dfltTrace->setTimer(dflt_trace::KLT_TRACK, klt_time_);
+        dfltTrace->log(dflt_trace::NUM_TRACKED, tracked_count);
+        dflt_metrics::tracked->set(tracked_count);
+        SSVO_LOG_IF(FILTER, 2, WARNING, report_) << "[Filter][1] Frame: " << frame->id_ << ", Tracking seeds: " << tracked_count;
     }
 
+    //! evaluate disparity at enqueue time, the reference only moves forward on accepted frames
+    const bool updatable = checkDisparity(frame);
+
     if(filter_thread_ == nullptr)
     {
-        dfltTrace->startTimer("total_without_klt");
+        ScopedSpan span("filter", "frame_id", frame->id_);
+        dfltTrace->startTimer(dflt_trace::TOTAL_WITHOUT_KLT);
         int updated_count = 0;
         int project_count = 0;
-        if(checkDisparity(frame))
+        dfltTrace->log(dflt_trace::QUEUE_SIZE, 0);
+        dfltTrace->log(dflt_trace::NUM_DROPPED, 0);
+        if(updatable)
         {
-            dfltTrace->startTimer("update_seeds");
+            dfltTrace->startTimer(dflt_trace::UPDATE_SEEDS);
             updated_count = updateSeeds(frame);
-            dfltTrace->stopTimer("update_seeds");
-            dfltTrace->log("num_updated", updated_count);
+            dfltTrace->stopTimer(dflt_trace::UPDATE_SEEDS);
+            dfltTrace->log(dflt_trace::NUM_UPDATED, updated_count);
+            dflt_metrics::updated->set(updated_count);
 
-            dfltTrace->startTimer("epl_search");
+            dfltTrace->startTimer(dflt_trace::EPL_SEARCH);
             project_count = reprojectAllSeeds(frame);
-            dfltTrace->stopTimer("epl_search");
-            dfltTrace->log("num_repoj", project_count);
+            dfltTrace->stopTimer(dflt_trace::EPL_SEARCH);
+            dfltTrace->log(dflt_trace::NUM_REPOJ, project_count);
         }
 
-        dfltTrace->startTimer("create_seeds");
+        dfltTrace->startTimer(dflt_trace::SEMI_DENSE);
+        updateSemiDense(frame, keyframe, updatable);
+        dfltTrace->stopTimer(dflt_trace::SEMI_DENSE);
+
+        dfltTrace->startTimer(dflt_trace::CREATE_SEEDS);
         if(keyframe)
         {
             int new_seeds = createSeeds(keyframe, frame);
+            dflt_metrics::created->inc(new_seeds);
             updateByConnectedKeyFrames(keyframe, 3);
-            LOG(INFO) << "[Filter] New created depth filter seeds: " << new_seeds;
+            SSVO_LOG(FILTER, 1, INFO) << "[Filter] New created depth filter seeds: " << new_seeds;
         }
-        dfltTrace->stopTimer("create_seeds");
+        dfltTrace->stopTimer(dflt_trace::CREATE_SEEDS);
 
-        dfltTrace->stopTimer("total_without_klt");
+        dfltTrace->stopTimer(dflt_trace::TOTAL_WITHOUT_KLT);
 
         dfltTrace->writeToFile();
 
-        LOG_IF(WARNING, report_) << "[Filter][2] Frame: " << frame->id_
-                                 << ", Seeds after updated: " << updated_count
-                                 << ", new reprojected: " << project_count;
+        SSVO_LOG_IF(FILTER, 2, WARNING, report_) << "[Filter][2] Frame: " << frame->id_
+                                                 << ", Seeds after updated: " << updated_count
+                                                 << ", new reprojected: " << project_count;
     }
     else
     {
         std::unique_lock<std::mutex> lock(mutex_frame_);
-        frames_buffer_.emplace_back(frame, keyframe);
+        //! a low-disparity frame without keyframe does nothing in the filter except being rejected,
+        //! so consecutive ones are coalesced into the latest one. Frames carrying keyframe are never dropped
+        if(!updatable && keyframe == nullptr && !frames_buffer_.empty())
+        {
+            const auto &last = frames_buffer_.back();
+            if(std::get<1>(last) == nullptr && !std::get<2>(last))
+            {
+                frames_buffer_.pop_back();
+                frames_dropped_++;
+                dflt_metrics::dropped->inc();
+            }
+        }
+        frames_buffer_.emplace_back(frame, keyframe, updatable);
+        dflt_metrics::queue->set(frames_buffer_.size());
         cond_process_main_.notify_one();
+        lock.unlock();
+
+        //! the tracking part is written as a separate row from this thread
+        dfltTrace->writeToFile();
     }
 }
 
@@ -451,6 +628,21 @@ int DepthFilter::createSeeds(const KeyFrame::Ptr &keyframe, const Frame::Ptr &fr
 //        }
 //    }
 
+    {
+        std::unique_lock<std::mutex> lock(mutex_seeds_info_);
+        finishSeedsInfo(false);
+        SeedsInfo &info = seeds_info_[keyframe->id_];
+        if(info.keyframe.expired())
+        {
+            std::memset(&info.updates_hist, 0, sizeof(info.updates_hist));
+            info.keyframe = keyframe;
+            info.created = info.converged = info.updates = 0;
+            info.time_sum = info.time_max = 0;
+            info.time_created = std::chrono::steady_clock::now();
+        }
+        info.created += (int) new_seeds.size();
+    }
+
     for(const Seed::Ptr &seed : new_seeds)
     {
         Feature::Ptr new_ft = Feature::create(seed->px_ref, seed->level_ref, seed);
@@ -498,10 +690,12 @@ int DepthFilter::updateByConnectedKeyFrames(const KeyFrame::Ptr &keyframe, int n
 
 int DepthFilter::trackSeeds(const Frame::Ptr &frame_last, const Frame::Ptr &frame_cur) const
 {
+    klt_time_ = 0;
     if(frame_cur == nullptr || frame_last == nullptr)
         return 0;
 
-    dfltTrace->startTimer("klt_track");
+    SecondTimer timer;
+    timer.start();
 
     //! track seeds by klt
     std::vector<Feature::Ptr> seed_fts = frame_last->getSeeds();
@@ -535,7 +729,7 @@ int DepthFilter::trackSeeds(const Frame::Ptr &frame_last, const Frame::Ptr &fram
         }
     }
 
-    dfltTrace->stopTimer("klt_track");
+    klt_time_ = timer.stop();
 
     return tracked_count;
 }
@@ -603,7 +797,7 @@ int DepthFilter::updateSeeds(const Frame::Ptr &frame)
                 //! check converge
                 if(seed->checkConvergence())
                 {
-                    seed_coverged_callback_(seed);
+                    convergeSeed(seed);
                     kf->removeSeed(seed);
                     frame->removeSeed(seed);
                     continue;
@@ -669,7 +863,7 @@ int DepthFilter::reprojectSeeds(const KeyFrame::Ptr &keyframe, const Frame::Ptr
         //! check converge
         if(seed->checkConvergence())
         {
-            seed_coverged_callback_(seed);
+            convergeSeed(seed);
             keyframe->removeSeed(seed);
             continue;
         }
@@ -869,8 +1063,12 @@ bool DepthFilter::findEpipolarMatch(const Seed::Ptr &seed,
     static const int patch_border_size = patch_size+2;
     cv::Mat image_ref = keyframe->getImage(level_ref);
     Matrix<float, patch_border_size, patch_border_size, RowMajor> patch_with_border;
-    utils::warpAffine<float, patch_border_size>(image_ref, patch_with_border, A_cur_from_ref,
-                                                seed->px_ref, level_ref, level_cur);
+    if(!seed->patch_cache.get(keyframe->id_, level_ref, level_cur, A_cur_from_ref, patch_with_border))
+    {
+        utils::warpAffine<float, patch_border_size>(image_ref, patch_with_border, A_cur_from_ref,
+                                                    seed->px_ref, level_ref, level_cur);
+        seed->patch_cache.set(keyframe->id_, level_ref, level_cur, A_cur_from_ref, patch_with_border);
+    }
 
     Matrix<float, patch_size, patch_size, RowMajor> patch;
     patch = patch_with_border.block(1, 1, patch_size, patch_size);
@@ -934,9 +1132,9 @@ bool DepthFilter::findEpipolarMatch(const Seed::Ptr &seed,
 
         double t1 = (double)cv::getTickCount();
         double time = (t1-t0)/cv::getTickFrequency();
-        LOG_IF(INFO, verbose_) << " Step: " << n_steps << " T:" << time << "(" << time/n_steps << ")"
-                               << " best: [" << index_best << ", " << score_best<< "]"
-                               << " second: [" << index_second << ", " << score_second<< "]";
+        SSVO_LOG_IF(FILTER, 3, INFO, verbose_) << " Step: " << n_steps << " T:" << time << "(" << time/n_steps << ")"
+                                               << " best: [" << index_best << ", " << score_best<< "]"
+                                               << " second: [" << index_second << ", " << score_second<< "]";
     }
     else
     {
@@ -964,9 +1162,9 @@ bool DepthFilter::findEpipolarMatch(const Seed::Ptr &seed,
     //! transform to level-0
     px_matched = estimate.head<2>() / scale_cur;
 
-    LOG_IF(INFO, verbose_) << "Found! [" << seed->px_ref.transpose() << "] "
-                           << "dst: [" << px_matched.transpose() << "] "
-                           << "epl: [" << px_near.transpose() << "]--[" << px_far.transpose() << "]" << std::endl;
+    SSVO_LOG_IF(FILTER, 3, INFO, verbose_) << "Found! [" << seed->px_ref.transpose() << "] "
+                                           << "dst: [" << px_matched.transpose() << "] "
+                                           << "epl: [" << px_near.transpose() << "]--[" << px_far.transpose() << "]" << std::endl;
 
 //    showMatch(image_ref, image_cur, px_near, px_far, seed.ft->px/factor, px_matched/factor);
 
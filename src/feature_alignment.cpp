@@ -1,5 +1,6 @@
 #include "utils.hpp"
 #include "feature_alignment.hpp"
+#include "logging.hpp"
 
 namespace ssvo{
 
@@ -58,7 +59,7 @@ bool AlignPatch::align2DI(const cv::Mat &image_cur,
 
         if(u < u_min || v < v_min || u >= u_max || v >= v_max)
         {
-            LOG_IF(INFO, verbose) << "WARNING! The estimate pixel location is out of the scope!";
+            SSVO_LOG_IF(TRACKER, 3, INFO, verbose) << "WARNING! The estimate pixel location is out of the scope!";
             return false;
         }
 
@@ -86,7 +87,7 @@ bool AlignPatch::align2DI(const cv::Mat &image_cur,
         v -= update[1];
         idiff -= update[2];
 
-        if(verbose)
+        if(SSVO_LOG_ENABLED(TRACKER, 3) && verbose)
         {
             Matrix<float, Size, Size, RowMajor> patch_res = patch_cur - patch_ref_with_border.block<Size,Size>(1,1);
             patch_res.array() += idiff+update[2];
@@ -105,7 +106,7 @@ bool AlignPatch::align2DI(const cv::Mat &image_cur,
         }
     }
 
-    if(verbose)
+    if(SSVO_LOG_ENABLED(TRACKER, 3) && verbose)
     {
         std::string output;
         std::for_each(logs.begin(), logs.end(), [&](const std::string &s) { output += s; });
@@ -158,7 +159,7 @@ bool AlignPatch::align2DI(const cv::Mat &image_cur,
 
         if(u < u_min || v < v_min || u >= u_max || v >= v_max)
         {
-            LOG_IF(INFO, verbose) << "WARNING! The estimate pixel location is out of the scope!";
+            SSVO_LOG_IF(TRACKER, 3, INFO, verbose) << "WARNING! The estimate pixel location is out of the scope!";
             return false;
         }
 
@@ -180,7 +181,7 @@ bool AlignPatch::align2DI(const cv::Mat &image_cur,
         v -= update[1];
         idiff -= update[2];
 
-        if(verbose)
+        if(SSVO_LOG_ENABLED(TRACKER, 3) && verbose)
         {
             using std::to_string;
             std::string log = " Iter:" + to_string(iter) +
@@ -195,7 +196,7 @@ bool AlignPatch::align2DI(const cv::Mat &image_cur,
         }
     }
 
-    if(verbose)
+    if(SSVO_LOG_ENABLED(TRACKER, 3) && verbose)
     {
         std::string output;
         std::for_each(logs.begin(), logs.end(), [&](const std::string &s) { output += s; });
@@ -249,7 +250,7 @@ bool AlignPattern::align2DI(const cv::Mat &image_cur,
 
         if(u < u_min || v < v_min || u >= u_max || v >= v_max)
         {
-            LOG_IF(INFO, verbose) << "WARNING! The estimate pixel location is out of the scope!";
+            SSVO_LOG_IF(TRACKER, 3, INFO, verbose) << "WARNING! The estimate pixel location is out of the scope!";
             return false;
         }
 
@@ -279,7 +280,7 @@ bool AlignPattern::align2DI(const cv::Mat &image_cur,
         v -= update[1];
         idiff -= update[2];
 
-        if(verbose)
+        if(SSVO_LOG_ENABLED(TRACKER, 3) && verbose)
         {
             using std::to_string;
             std::string log = " Iter:" + to_string(iter) +
@@ -294,7 +295,7 @@ bool AlignPattern::align2DI(const cv::Mat &image_cur,
         }
     }
 
-    if(verbose)
+    if(SSVO_LOG_ENABLED(TRACKER, 3) && verbose)
     {
         std::string output;
         std::for_each(logs.begin(), logs.end(), [&](const std::string &s) { output += s; });
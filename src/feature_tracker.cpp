@@ -1,6 +1,7 @@
 #include "feature_tracker.hpp"
 #include "feature_alignment.hpp"
 #include "image_alignment.hpp"
+#include "logging.hpp"
 #include <numeric>
 
 namespace ssvo{
@@ -100,11 +101,11 @@ int FeatureTracker::reprojectLoaclMap(const Frame::Ptr &frame)
     }
 
     double t3 = (double)cv::getTickCount();
-    LOG_IF(WARNING, report_) << "[ Match][*] Time: "
-                           << (t1-t0)/cv::getTickFrequency() << " "
-                           << (t2-t1)/cv::getTickFrequency() << " "
-                           << (t3-t2)/cv::getTickFrequency() << " "
-                           << ", match points " << matches_from_frame << "+" << matches_from_cell << "(" << total_project_ << ", " << local_mpts.size() << ")";
+    SSVO_LOG_IF(TRACKER, 2, WARNING, report_) << "[ Match][*] Time: "
+                                             << (t1-t0)/cv::getTickFrequency() << " "
+                                             << (t2-t1)/cv::getTickFrequency() << " "
+                                             << (t3-t2)/cv::getTickFrequency() << " "
+                                             << ", match points " << matches_from_frame << "+" << matches_from_cell << "(" << total_project_ << ", " << local_mpts.size() << ")";
 
     //! update last frame
     frame_last = frame;
@@ -225,11 +226,15 @@ int FeatureTracker::reprojectMapPoint(const Frame::Ptr &frame,
     utils::getWarpMatrixAffine(kf_ref->cam_, frame->cam_, ft_ref->px_, ft_ref->fn_, ft_ref->level_,
                                obs_ref_dir.norm(), T_cur_from_ref, patch_size, A_cur_from_ref);
 
-    // TODO 如果Affine很小的话，则不用warp
+    //! reuse the last warped patch if the affine warp barely changed
     const cv::Mat image_ref = kf_ref->getImage(ft_ref->level_);
     Matrix<float, patch_border_size, patch_border_size, RowMajor> patch_with_border;
-    utils::warpAffine<float, patch_border_size>(image_ref, patch_with_border, A_cur_from_ref,
-                                                ft_ref->px_, ft_ref->level_, level_cur);
+    if(!mpt->patch_cache_.get(kf_ref->id_, ft_ref->level_, level_cur, A_cur_from_ref, patch_with_border))
+    {
+        utils::warpAffine<float, patch_border_size>(image_ref, patch_with_border, A_cur_from_ref,
+                                                    ft_ref->px_, ft_ref->level_, level_cur);
+        mpt->patch_cache_.set(kf_ref->id_, ft_ref->level_, level_cur, A_cur_from_ref, patch_with_border);
+    }
 
     const cv::Mat image_cur = frame->getImage(level_cur);
 
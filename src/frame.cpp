@@ -52,33 +52,47 @@ const cv::Mat Frame::getImage(int level) const
     return img_pyr_[level];
 }
 
+BRIEF::Pyramid::Ptr Frame::getBriefPyramid(const BRIEF::Ptr &brief)
+{
+    std::lock_guard<std::mutex> lock(mutex_brief_pyr_);
+    if(!brief_pyr_ && brief)
+        brief_pyr_ = brief->createPyramid(img_pyr_);
+    return brief_pyr_;
+}
+
+void Frame::releaseBriefPyramid()
+{
+    std::lock_guard<std::mutex> lock(mutex_brief_pyr_);
+    brief_pyr_.reset();
+}
+
 SE3d Frame::Tcw()
 {
-    std::lock_guard<std::mutex> lock(mutex_pose_);
+    std::lock_guard<NamedMutex> lock(mutex_pose_);
     return Tcw_;
 }
 
 SE3d Frame::Twc()
 {
-    std::lock_guard<std::mutex> lock(mutex_pose_);
+    std::lock_guard<NamedMutex> lock(mutex_pose_);
     return Twc_;
 }
 
 SE3d Frame::pose()
 {
-    std::lock_guard<std::mutex> lock(mutex_pose_);
+    std::lock_guard<NamedMutex> lock(mutex_pose_);
     return Twc_;
 }
 
 Vector3d Frame::ray()
 {
-    std::lock_guard<std::mutex> lock(mutex_pose_);
+    std::lock_guard<NamedMutex> lock(mutex_pose_);
     return Dw_;
 }
 
 void Frame::setPose(const SE3d& pose)
 {
-    std::lock_guard<std::mutex> lock(mutex_pose_);
+    std::lock_guard<NamedMutex> lock(mutex_pose_);
     Twc_ = pose;
     Tcw_ = Twc_.inverse();
     Dw_ = Tcw_.rotationMatrix().determinant() * Tcw_.rotationMatrix().col(2);
@@ -86,7 +100,7 @@ void Frame::setPose(const SE3d& pose)
 
 void Frame::setPose(const Matrix3d& R, const Vector3d& t)
 {
-    std::lock_guard<std::mutex> lock(mutex_pose_);
+    std::lock_guard<NamedMutex> lock(mutex_pose_);
     Twc_ = SE3d(R, t);
     Tcw_ = Twc_.inverse();
     Dw_ = Tcw_.rotationMatrix().determinant() * Tcw_.rotationMatrix().col(2);
@@ -94,7 +108,7 @@ void Frame::setPose(const Matrix3d& R, const Vector3d& t)
 
 void Frame::setTcw(const SE3d &Tcw)
 {
-    std::lock_guard<std::mutex> lock(mutex_pose_);
+    std::lock_guard<NamedMutex> lock(mutex_pose_);
     Tcw_ = Tcw;
     Twc_ = Tcw_.inverse();
     Dw_ = Tcw_.rotationMatrix().determinant() * Tcw_.rotationMatrix().col(2);
@@ -105,7 +119,7 @@ bool Frame::isVisiable(const Vector3d &xyz_w, const int border)
 {
     SE3d Tcw;
     {
-        std::lock_guard<std::mutex> lock(mutex_pose_);
+        std::lock_guard<NamedMutex> lock(mutex_pose_);
         Tcw = Tcw_;
     }
     const Vector3d xyz_c = Tcw * xyz_w;
@@ -118,19 +132,19 @@ bool Frame::isVisiable(const Vector3d &xyz_w, const int border)
 
 std::unordered_map<MapPoint::Ptr, Feature::Ptr> Frame::features()
 {
-    std::lock_guard<std::mutex> lock(mutex_feature_);
+    std::lock_guard<NamedMutex> lock(mutex_feature_);
     return mpt_fts_;
 }
 
 int Frame::featureNumber()
 {
-    std::lock_guard<std::mutex> lock(mutex_feature_);
+    std::lock_guard<NamedMutex> lock(mutex_feature_);
     return (int)mpt_fts_.size();
 }
 
 std::vector<Feature::Ptr> Frame::getFeatures()
 {
-    std::lock_guard<std::mutex> lock(mutex_feature_);
+    std::lock_guard<NamedMutex> lock(mutex_feature_);
     std::vector<Feature::Ptr> fts;
     fts.reserve(mpt_fts_.size());
     for(const auto &it : mpt_fts_)
@@ -141,7 +155,7 @@ std::vector<Feature::Ptr> Frame::getFeatures()
 
 std::vector<MapPoint::Ptr> Frame::getMapPoints()
 {
-    std::lock_guard<std::mutex> lock(mutex_feature_);
+    std::lock_guard<NamedMutex> lock(mutex_feature_);
     std::vector<MapPoint::Ptr> mpts;
     mpts.reserve(mpt_fts_.size());
     for(const auto &it : mpt_fts_)
@@ -152,7 +166,7 @@ std::vector<MapPoint::Ptr> Frame::getMapPoints()
 
 void Frame::getFeaturesAndMapPoints(std::vector<Feature::Ptr> &features, std::vector<MapPoint::Ptr> &mappoints)
 {
-    std::lock_guard<std::mutex> lock(mutex_feature_);
+    std::lock_guard<NamedMutex> lock(mutex_feature_);
     for(const auto &it : mpt_fts_)
     {
         features.push_back(it.second);
@@ -163,7 +177,7 @@ void Frame::getFeaturesAndMapPoints(std::vector<Feature::Ptr> &features, std::ve
 bool Frame::addFeature(const Feature::Ptr &ft)
 {
     LOG_ASSERT(ft->mpt_ != nullptr) << " The feature is invalid with empty mappoint!";
-    std::lock_guard<std::mutex> lock(mutex_feature_);
+    std::lock_guard<NamedMutex> lock(mutex_feature_);
     if(mpt_fts_.count(ft->mpt_))
     {
         LOG(ERROR) << " The mappoint is already be observed! Frame: " << id_ << " Mpt: " << ft->mpt_->id_
@@ -178,19 +192,19 @@ bool Frame::addFeature(const Feature::Ptr &ft)
 
 bool Frame::removeFeature(const Feature::Ptr &ft)
 {
-    std::lock_guard<std::mutex> lock(mutex_feature_);
+    std::lock_guard<NamedMutex> lock(mutex_feature_);
     return (bool)mpt_fts_.erase(ft->mpt_);
 }
 
 bool Frame::removeMapPoint(const MapPoint::Ptr &mpt)
 {
-    std::lock_guard<std::mutex> lock(mutex_feature_);
+    std::lock_guard<NamedMutex> lock(mutex_feature_);
     return (bool)mpt_fts_.erase(mpt);
 }
 
 Feature::Ptr Frame::getFeatureByMapPoint(const MapPoint::Ptr &mpt)
 {
-    std::lock_guard<std::mutex> lock(mutex_feature_);
+    std::lock_guard<NamedMutex> lock(mutex_feature_);
     const auto it = mpt_fts_.find(mpt);
     if(it != mpt_fts_.end())
         return it->second;
@@ -200,13 +214,13 @@ Feature::Ptr Frame::getFeatureByMapPoint(const MapPoint::Ptr &mpt)
 
 int Frame::seedNumber()
 {
-    std::lock_guard<std::mutex> lock(mutex_seed_);
+    std::lock_guard<NamedMutex> lock(mutex_seed_);
     return (int)seed_fts_.size();
 }
 
 std::vector<Feature::Ptr> Frame::getSeeds()
 {
-    std::lock_guard<std::mutex> lock(mutex_seed_);
+    std::lock_guard<NamedMutex> lock(mutex_seed_);
     std::vector<Feature::Ptr> fts;
     fts.reserve(seed_fts_.size());
     for(const auto &it : seed_fts_)
@@ -220,7 +234,7 @@ bool Frame::addSeed(const Feature::Ptr &ft)
     LOG_ASSERT(ft->seed_ != nullptr) << " The feature is invalid with empty mappoint!";
 
     {
-        std::lock_guard<std::mutex> lock(mutex_seed_);
+        std::lock_guard<NamedMutex> lock(mutex_seed_);
         if(seed_fts_.count(ft->seed_))
         {
             LOG(ERROR) << " The seed is already exited ! Frame: " << id_ << " Seed: " << ft->seed_->id;
@@ -235,13 +249,13 @@ bool Frame::addSeed(const Feature::Ptr &ft)
 
 bool Frame::removeSeed(const Seed::Ptr &seed)
 {
-    std::lock_guard<std::mutex> lock(mutex_seed_);
+    std::lock_guard<NamedMutex> lock(mutex_seed_);
     return (bool) seed_fts_.erase(seed);
 }
 
 bool Frame::hasSeed(const Seed::Ptr &seed)
 {
-    std::lock_guard<std::mutex> lock(mutex_seed_);
+    std::lock_guard<NamedMutex> lock(mutex_seed_);
     return (bool) seed_fts_.count(seed);
 }
 
@@ -249,12 +263,12 @@ bool Frame::getSceneDepth(double &depth_mean, double &depth_min)
 {
     SE3d Tcw;
     {
-        std::lock_guard<std::mutex> lock(mutex_pose_);
+        std::lock_guard<NamedMutex> lock(mutex_pose_);
         Tcw = Tcw_;
     }
     Features fts;
     {
-        std::lock_guard<std::mutex> lock(mutex_feature_);
+        std::lock_guard<NamedMutex> lock(mutex_feature_);
         for(const auto &it : mpt_fts_)
             fts.push_back(it.second);
     }
@@ -1,6 +1,7 @@
 #include "utils.hpp"
 #include "image_alignment.hpp"
 #include "optimizer.hpp"
+#include "logging.hpp"
 
 namespace ssvo
 {
@@ -77,7 +78,7 @@ int AlignSE3::run(Frame::Ptr reference_frame,
     jacbian_cache_.resize(N * PatchArea, NoChange);
 
     T_cur_from_ref_ = cur_frame_->Tcw() * ref_frame_->pose();
-    LOG_IF(INFO, verbose_) << "T_cur_from_ref_ " << T_cur_from_ref_.log().transpose();
+    SSVO_LOG_IF(TRACKER, 3, INFO, verbose_) << "T_cur_from_ref_ " << T_cur_from_ref_.log().transpose();
 
     for(int l = top_level; l >= bottom_level; l--)
     {
@@ -101,10 +102,13 @@ int AlignSE3::run(Frame::Ptr reference_frame,
             SE3d::Tangent se3 = Hessian_.ldlt().solve(Jres_);
             T_cur_from_ref_ = T_cur_from_ref_ * SE3d::exp(-se3);
 
-            using std::to_string;
-            std::string log = "Level: " + to_string(l) + " iter:" + to_string(i) + " res: " + to_string(res) + " step: "
-                + to_string(se3.dot(se3));
-            logs_.push_back(log);
+            if(SSVO_LOG_ENABLED(TRACKER, 3) && verbose_)
+            {
+                using std::to_string;
+                std::string log = "Level: " + to_string(l) + " iter:" + to_string(i) + " res: " + to_string(res) + " step: "
+                    + to_string(se3.dot(se3));
+                logs_.push_back(log);
+            }
 
             //! termination
             if(se3.dot(se3) < epslion_squared)
@@ -113,7 +117,7 @@ int AlignSE3::run(Frame::Ptr reference_frame,
     }
 
     cur_frame_->setTcw(T_cur_from_ref_ * ref_frame_->Tcw());
-    if(verbose_)
+    if(SSVO_LOG_ENABLED(TRACKER, 3) && verbose_)
     {
         std::string output;
         std::for_each(logs_.begin(), logs_.end(), [&](const std::string &s) { output += s; });
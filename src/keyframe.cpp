@@ -7,10 +7,11 @@ namespace ssvo{
 uint64_t KeyFrame::next_id_ = 0;
 
 KeyFrame::KeyFrame(const Frame::Ptr frame):
-    Frame(frame->images(), next_id_++, frame->timestamp_, frame->cam_), frame_id_(frame->id_), isBad_(false), loop_query_(0),
+    Frame(frame->images(), next_id_++, frame->timestamp_, frame->cam_), frame_id_(frame->id_), dbow_Id_(-1), isBad_(false), loop_query_(0),
     notErase(false),toBeErase(false),GBA_KF_(0)
 {
     mpt_fts_ = frame->features();
+    brief_pyr_ = frame->getBriefPyramid();
     setRefKeyFrame(frame->getRefKeyFrame());
     setPose(frame->pose());
 }
@@ -21,7 +22,7 @@ void KeyFrame::updateConnections()
 
     Features fts;
     {
-        std::lock_guard<std::mutex> lock(mutex_feature_);
+        std::lock_guard<NamedMutex> lock(mutex_feature_);
         for(const auto &it : mpt_fts_)
             fts.push_back(it.second);
     }
@@ -85,7 +86,7 @@ void KeyFrame::updateConnections()
 
     //! update
     {
-        std::lock_guard<std::mutex> lock(mutex_connection_);
+        std::lock_guard<NamedMutex> lock(mutex_connection_);
 
         connectedKeyFrames_.clear();
         for(const auto &item : weight_connections)
@@ -100,7 +101,7 @@ void KeyFrame::updateConnections()
 
 std::set<KeyFrame::Ptr> KeyFrame::getConnectedKeyFrames(int num, int min_fts)
 {
-    std::lock_guard<std::mutex> lock(mutex_connection_);
+    std::lock_guard<NamedMutex> lock(mutex_connection_);
 
     std::set<KeyFrame::Ptr> connected_keyframes;
     if(num == -1) num = (int) orderedConnectedKeyFrames_.size();
@@ -164,7 +165,7 @@ std::set<KeyFrame::Ptr> KeyFrame::getSubConnectedKeyFrames(int num)
 
 void KeyFrame::setNotErase()
 {
-    std::unique_lock<std::mutex> lock(mutex_connection_);
+    std::unique_lock<NamedMutex> lock(mutex_connection_);
     notErase = true;
 }
 
@@ -173,7 +174,7 @@ void KeyFrame::setErase()
 {
     {
         //todo 2 add loop detect finish condition
-        std::unique_lock<std::mutex> lock(mutex_connection_);
+        std::unique_lock<NamedMutex> lock(mutex_connection_);
         if(false)
         {
             notErase = false;
@@ -189,7 +190,7 @@ void KeyFrame::setBad()
 {
 
     {
-        std::unique_lock<std::mutex> lock(mutex_connection_);
+        std::unique_lock<NamedMutex> lock(mutex_connection_);
         if(id_ == 0)
             return;
         //! 这里是如果想删除，就等一等，设置toBeErase变量，等闭环结束之后会调用keyframe的seterase，如果想删除的话那会再删除
@@ -204,7 +205,7 @@ void KeyFrame::setBad()
 
     std::unordered_map<MapPoint::Ptr, Feature::Ptr> mpt_fts;
     {
-        std::lock_guard<std::mutex> lock(mutex_feature_);
+        std::lock_guard<NamedMutex> lock(mutex_feature_);
         mpt_fts = mpt_fts_;
     }
 
@@ -214,7 +215,7 @@ void KeyFrame::setBad()
     }
 
     {
-        std::lock_guard<std::mutex> lock(mutex_connection_);
+        std::lock_guard<NamedMutex> lock(mutex_connection_);
 
         isBad_ = true;
 
@@ -233,14 +234,14 @@ void KeyFrame::setBad()
 
 bool KeyFrame::isBad()
 {
-    std::lock_guard<std::mutex> lock(mutex_connection_);
+    std::lock_guard<NamedMutex> lock(mutex_connection_);
     return isBad_;
 }
 
 void KeyFrame::addConnection(const KeyFrame::Ptr &kf, const int weight)
 {
     {
-        std::lock_guard<std::mutex> lock(mutex_connection_);
+        std::lock_guard<NamedMutex> lock(mutex_connection_);
 
         if(!connectedKeyFrames_.count(kf))
             connectedKeyFrames_[kf] = weight;
@@ -256,7 +257,7 @@ void KeyFrame::addConnection(const KeyFrame::Ptr &kf, const int weight)
 void KeyFrame::updateOrderedConnections()
 {
     int max = 0;
-    std::lock_guard<std::mutex> lock(mutex_connection_);
+    std::lock_guard<NamedMutex> lock(mutex_connection_);
     orderedConnectedKeyFrames_.clear();
     for(const auto &connect : connectedKeyFrames_)
     {
@@ -274,7 +275,7 @@ void KeyFrame::updateOrderedConnections()
 void KeyFrame::removeConnection(const KeyFrame::Ptr &kf)
 {
     {
-        std::lock_guard<std::mutex> lock(mutex_connection_);
+        std::lock_guard<NamedMutex> lock(mutex_connection_);
         if(connectedKeyFrames_.count(kf))
         {
             connectedKeyFrames_.erase(kf);
@@ -301,14 +302,14 @@ std::vector<int > KeyFrame::getFeaturesInArea(const double &x, const double &y,
 
 void KeyFrame::addLoopEdge(KeyFrame::Ptr pKF)
 {
-    std::unique_lock<std::mutex > lock(mutex_connection_);
+    std::unique_lock<NamedMutex> lock(mutex_connection_);
     notErase = true;
     loopEdges_.insert(pKF);
 }
 
 int KeyFrame::getWight(KeyFrame::Ptr pKF)
 {
-    std::lock_guard<std::mutex> lock(mutex_connection_);
+    std::lock_guard<NamedMutex> lock(mutex_connection_);
     return connectedKeyFrames_[pKF];
 }
 KeyFrame::Ptr KeyFrame::getParent()
@@ -318,7 +319,7 @@ KeyFrame::Ptr KeyFrame::getParent()
 
 std::set<KeyFrame::Ptr> KeyFrame::getLoopEdges()
 {
-    std::lock_guard<std::mutex> lock(mutex_connection_);
+    std::lock_guard<NamedMutex> lock(mutex_connection_);
     return loopEdges_;
 
 }
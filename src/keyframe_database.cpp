@@ -0,0 +1,203 @@
+#include "keyframe_database.hpp"
+
+namespace ssvo{
+
+KeyFrameDatabase::KeyFrameDatabase(DBoW3::Vocabulary* vocabulary) :
+    vocabulary_(vocabulary), scoring_(vocabulary->getScoringType()), num_keyframes_(0), num_postings_(0), num_dead_postings_(0)
+{
+    options_.max_dead_ratio = 0.25;
+    options_.min_dead_postings = 10000;
+
+    inverted_index_.resize(vocabulary_->size());
+
+    LOG_IF(WARNING, scoring_ != DBoW3::L1_NORM && scoring_ != DBoW3::L2_NORM)
+        << "[KeyFrameDatabase] Scoring type " << scoring_ << " is not accumulated in the inverted index, fall back to DBoW3::Vocabulary::score!";
+}
+
+void KeyFrameDatabase::add(const KeyFrame::Ptr &kf)
+{
+    std::unique_lock<std::mutex> lock(mutex_database_);
+
+    LOG_ASSERT(kf->dbow_Id_ >= entries_.size() || entries_[kf->dbow_Id_] != kf) << "KeyFrame " << kf->id_ << " has already been added to the database!";
+
+    const unsigned int slot = (unsigned int) entries_.size();
+    entries_.push_back(kf);
+    alive_.push_back(true);
+    kf->dbow_Id_ = slot;
+    num_keyframes_++;
+
+    for(const auto &word : kf->bow_vec_)
+    {
+        if(word.first >= inverted_index_.size())
+            inverted_index_.resize(word.first+1);
+        inverted_index_[word.first].push_back(Posting{slot, word.second});
+    }
+    num_postings_ += kf->bow_vec_.size();
+}
+
+bool KeyFrameDatabase::erase(const KeyFrame::Ptr &kf)
+{
+    //! the slot is kept until compaction, so the keyframe's dbow_Id_ is not touched here
+    const unsigned int slot = kf->dbow_Id_;
+    if(slot >= entries_.size() || entries_[slot] != kf || !alive_[slot])
+        return false;
+
+    alive_[slot] = false;
+    num_keyframes_--;
+    num_dead_postings_ += kf->bow_vec_.size();
+    return true;
+}
+
+bool KeyFrameDatabase::remove(const KeyFrame::Ptr &kf)
+{
+    std::unique_lock<std::mutex> lock(mutex_database_);
+    return erase(kf);
+}
+
+int KeyFrameDatabase::compact(bool force)
+{
+    std::unique_lock<std::mutex> lock(mutex_database_);
+
+    //! keyframes set bad after a deferred erase are never removed explicitly
+    int count = 0;
+    for(size_t i = 0; i < entries_.size(); i++)
+    {
+        if(alive_[i] && entries_[i]->isBad())
+        {
+            erase(entries_[i]);
+            count++;
+        }
+    }
+
+    if(num_dead_postings_ == 0)
+        return count;
+
+    if(!force && (num_dead_postings_ < options_.min_dead_postings || num_dead_postings_ < options_.max_dead_ratio * num_postings_))
+        return count;
+
+    //! remap the live keyframes to dense slots in insertion order
+    std::vector<unsigned int> remap(entries_.size(), (unsigned int)-1);
+    std::vector<KeyFrame::Ptr> entries;
+    entries.reserve(num_keyframes_);
+    for(size_t i = 0; i < entries_.size(); i++)
+    {
+        if(!alive_[i])
+            continue;
+        remap[i] = (unsigned int) entries.size();
+        entries.push_back(entries_[i]);
+    }
+
+    for(std::vector<Posting> &postings : inverted_index_)
+    {
+        size_t n = 0;
+        for(const Posting &posting : postings)
+        {
+            const unsigned int slot = remap[posting.slot];
+            if(slot == (unsigned int)-1)
+                continue;
+            postings[n++] = Posting{slot, posting.value};
+        }
+        postings.resize(n);
+        if(postings.capacity() > 2 * n)
+            postings.shrink_to_fit();
+    }
+
+    //! the removed keyframes are no longer in the database, and their memory is released here
+    for(size_t i = 0; i < entries_.size(); i++)
+        entries_[i]->dbow_Id_ = remap[i];
+
+    LOG(INFO) << "[KeyFrameDatabase] Compacted from " << entries_.size() << " to " << entries.size() << " keyframes, "
+              << num_dead_postings_ << " of " << num_postings_ << " postings are removed.";
+
+    entries_.swap(entries);
+    alive_.assign(entries_.size(), true);
+    num_postings_ -= num_dead_postings_;
+    num_dead_postings_ = 0;
+
+    return count;
+}
+
+size_t KeyFrameDatabase::size()
+{
+    std::unique_lock<std::mutex> lock(mutex_database_);
+    return num_keyframes_;
+}
+
+void KeyFrameDatabase::accumulate(const DBoW3::BowVector &bow_vec, QueryResult &result)
+{
+    const size_t N = entries_.size();
+    result.keyframes.clear();
+    result.common_words.assign(N, 0);
+    result.scores.assign(N, 0.0);
+
+    //! both vectors are normalized, so only the common words contribute to the score
+    //! L1: 1 - 0.5*|v-w| = 0.5*sum(|v_i|+|w_i|-|v_i-w_i|) = sum(min(v_i, w_i)) for non-negative weights
+    //! L2: 1 - sqrt(1 - v.w)
+    for(const auto &word : bow_vec)
+    {
+        if(word.first >= inverted_index_.size())
+            continue;
+
+        const DBoW3::WordValue v = word.second;
+        for(const Posting &posting : inverted_index_[word.first])
+        {
+            const unsigned int slot = posting.slot;
+            if(!alive_[slot])
+                continue;
+
+            if(result.common_words[slot]++ == 0)
+                result.keyframes.push_back(entries_[slot]);
+
+            if(scoring_ == DBoW3::L1_NORM)
+                result.scores[slot] += std::min(v, posting.value);
+            else
+                result.scores[slot] += v * posting.value;
+        }
+    }
+
+    if(scoring_ == DBoW3::L1_NORM)
+        return;
+
+    for(const KeyFrame::Ptr &kf : result.keyframes)
+    {
+        double &score = result.scores[kf->dbow_Id_];
+        if(scoring_ == DBoW3::L2_NORM)
+            score = score >= 1.0 ? 1.0 : 1.0 - std::sqrt(1.0 - score);
+        else
+            score = vocabulary_->score(bow_vec, kf->bow_vec_);
+    }
+}
+
+void KeyFrameDatabase::query(const DBoW3::BowVector &bow_vec, QueryResult &result)
+{
+    std::unique_lock<std::mutex> lock(mutex_database_);
+    accumulate(bow_vec, result);
+}
+
+void KeyFrameDatabase::query(const DBoW3::BowVector &bow_vec, std::vector<KeyFrame::Ptr> &keyframes, std::vector<double> &scores, int max_results)
+{
+    QueryResult result;
+    std::vector<std::pair<double, KeyFrame::Ptr> > candidates;
+    {
+        //! the slots may be remapped by compaction once the lock is released
+        std::unique_lock<std::mutex> lock(mutex_database_);
+        accumulate(bow_vec, result);
+        candidates.reserve(result.keyframes.size());
+        for(const KeyFrame::Ptr &kf : result.keyframes)
+            candidates.emplace_back(result.scores[kf->dbow_Id_], kf);
+    }
+
+    const size_t num = max_results < 0 ? candidates.size() : std::min(candidates.size(), (size_t) max_results);
+    std::partial_sort(candidates.begin(), candidates.begin()+num, candidates.end(),
+                      [](const std::pair<double, KeyFrame::Ptr> &a, const std::pair<double, KeyFrame::Ptr> &b) { return a.first > b.first; });
+
+    keyframes.resize(num);
+    scores.resize(num);
+    for(size_t i = 0; i < num; i++)
+    {
+        scores[i] = candidates[i].first;
+        keyframes[i] = candidates[i].second;
+    }
+}
+
+}
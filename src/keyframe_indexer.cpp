@@ -0,0 +1,228 @@
+#include "config.hpp"
+#include "keyframe_indexer.hpp"
+#include "loop_closure.hpp"
+#include "time_tracing.hpp"
+#include "timeline.hpp"
+#include "metrics.hpp"
+#include "logging.hpp"
+
+namespace ssvo{
+
+TimeTracing::Ptr indexTrace = nullptr;
+
+//! ids of the timers and logs in indexTrace, in the order they are registered
+namespace index_trace{
+enum TimerId{TOTAL, DETECT, BRIEF, BOW, DB_ADD};
+enum LogId{KEYFRAME_ID, NUM_FEATURES, QUEUE_SIZE};
+}
+
+namespace index_metrics{
+MetricGauge *queue = Metrics::instance().gauge("ssvo_indexer_queue_depth", "Keyframes waiting for the indexing thread");
+}
+
+KeyFrameIndexer::KeyFrameIndexer(DBoW3::Vocabulary* vocabulary, const KeyFrameDatabase::Ptr &database, const FastDetector::Ptr &fast, bool report, bool verbose) :
+    vocabulary_(vocabulary), database_(database), fast_detector_(fast), report_(report), verbose_(report&&verbose),
+    indexing_thread_(nullptr), stop_require_(false)
+{
+    brief_ = BRIEF::create(2.0, Config::imageNLevel());
+
+    options_.max_features = 1000;
+    options_.max_new_corners = 1200;
+    options_.direct_index_levels = 4;
+
+    //! LOG and timer for indexer;
+    TimeTracing::TraceNames time_names;
+    time_names.push_back("total");
+    time_names.push_back("detect");
+    time_names.push_back("brief");
+    time_names.push_back("bow");
+    time_names.push_back("db_add");
+
+    TimeTracing::TraceNames log_names;
+    log_names.push_back("keyframe_id");
+    log_names.push_back("num_features");
+    log_names.push_back("queue_size");
+
+    string trace_dir = Config::timeTracingDirectory();
+    indexTrace.reset(new TimeTracing("ssvo_trace_indexer", trace_dir, time_names, log_names));
+}
+
+void KeyFrameIndexer::startMainThread()
+{
+    if(indexing_thread_ == nullptr)
+        indexing_thread_ = std::make_shared<std::thread>(std::bind(&KeyFrameIndexer::run, this));
+}
+
+void KeyFrameIndexer::stopMainThread()
+{
+    setStop();
+    if(indexing_thread_)
+    {
+        if(indexing_thread_->joinable())
+            indexing_thread_->join();
+        indexing_thread_.reset();
+    }
+}
+
+void KeyFrameIndexer::setStop()
+{
+    std::unique_lock<std::mutex> lock(mutex_stop_);
+    stop_require_ = true;
+}
+
+bool KeyFrameIndexer::isRequiredStop()
+{
+    std::unique_lock<std::mutex> lock(mutex_stop_);
+    return stop_require_;
+}
+
+void KeyFrameIndexer::setLoopCloser(std::shared_ptr<LoopClosure> loop_closure)
+{
+    loop_closure_ = loop_closure;
+}
+
+size_t KeyFrameIndexer::queueSize()
+{
+    std::unique_lock<std::mutex> lock(mutex_keyframe_);
+    return keyframes_buffer_.size();
+}
+
+void KeyFrameIndexer::insertKeyFrame(const KeyFrame::Ptr &keyframe)
+{
+    if(indexing_thread_ != nullptr)
+    {
+        std::unique_lock<std::mutex> lock(mutex_keyframe_);
+        keyframes_buffer_.push_back(keyframe);
+        index_metrics::queue->set(keyframes_buffer_.size());
+        cond_process_.notify_one();
+    }
+    else
+    {
+        indexKeyFrame(keyframe);
+    }
+}
+
+KeyFrame::Ptr KeyFrameIndexer::checkNewKeyFrame()
+{
+    std::unique_lock<std::mutex> lock(mutex_keyframe_);
+    cond_process_.wait_for(lock, std::chrono::milliseconds(5));
+
+    if(keyframes_buffer_.empty())
+        return nullptr;
+
+    KeyFrame::Ptr keyframe = keyframes_buffer_.front();
+    keyframes_buffer_.pop_front();
+    index_metrics::queue->set(keyframes_buffer_.size());
+    indexTrace->log(index_trace::QUEUE_SIZE, keyframes_buffer_.size());
+
+    return keyframe;
+}
+
+void KeyFrameIndexer::run()
+{
+    Timeline::instance().setThreadName("kf_indexer");
+    while(!isRequiredStop())
+    {
+        KeyFrame::Ptr keyframe = checkNewKeyFrame();
+        if(keyframe)
+            indexKeyFrame(keyframe);
+    }
+}
+
+void KeyFrameIndexer::indexKeyFrame(const KeyFrame::Ptr &keyframe)
+{
+    ScopedSpan span("indexing", "keyframe_id", keyframe->id_);
+    indexTrace->startTimer(index_trace::TOTAL);
+    indexTrace->log(index_trace::KEYFRAME_ID, keyframe->id_);
+
+    std::vector<uint64_t > mpt_id;
+    std::vector<Feature::Ptr> fts;
+    std::vector<MapPoint::Ptr> mpts;
+    keyframe->getFeaturesAndMapPoints(fts,mpts);
+
+    keyframe->featuresInBow = fts;
+    keyframe->mapPointsInBow = mpts;
+
+    Corners old_corners;
+    old_corners.reserve(fts.size());
+    for(const Feature::Ptr &ft : fts)
+    {
+        old_corners.emplace_back(Corner(ft->px_[0], ft->px_[1], 0, ft->level_));
+        mpt_id.emplace_back(ft->mpt_->id_);
+    }
+
+    //! 1. detect new corners besides the features
+    indexTrace->startTimer(index_trace::DETECT);
+    Corners new_corners;
+    fast_detector_->detect(keyframe->images(), new_corners, old_corners, options_.max_new_corners);
+
+    if(new_corners.size()+old_corners.size() > (size_t)options_.max_features)
+    {
+        std::sort(new_corners.begin(),new_corners.end(),[](Corner a,Corner b) -> bool { return a.score>b.score;});
+        new_corners.resize(old_corners.size() < (size_t)options_.max_features ? options_.max_features - old_corners.size() : 0);
+    }
+    indexTrace->stopTimer(index_trace::DETECT);
+
+    std::vector<cv::KeyPoint> kps;
+    for(const Corner & corner : old_corners)
+        kps.emplace_back(cv::KeyPoint(corner.x, corner.y, 31, -1, 0, corner.level));
+    for(const Corner & corner : new_corners)
+        kps.emplace_back(cv::KeyPoint(corner.x, corner.y, 31, -1, 0, corner.level));
+
+    //! 2. descriptors, the pyramid may be built by relocalization already, and it is no longer needed after this
+    indexTrace->startTimer(index_trace::BRIEF);
+    BRIEF::Pyramid::Ptr brief_pyramid = keyframe->getBriefPyramid(brief_);
+    brief_->compute(*brief_pyramid, kps, keyframe->descriptors_);
+    keyframe->releaseBriefPyramid();
+
+    LOG_ASSERT(old_corners.size()==fts.size())<<"the number of two should be equal"<<std::endl;
+    for (size_t j = 0; j < fts.size(); ++j) {
+        fts[j]->angle = kps[j].angle;
+    }
+
+    keyframe->KeyPoints.assign(kps.begin(),kps.end());
+
+    //! save descriptors of every mpt
+    packDescriptors(keyframe->descriptors_, keyframe->descriptorsInBow, (int)mpt_id.size());
+    for(size_t i=0;i< mpt_id.size();i++)
+    {
+        fts[i]->descriptor_ = keyframe->descriptorsInBow[i];
+    }
+    indexTrace->stopTimer(index_trace::BRIEF);
+
+    //! 3. BoW vectors are computed outside the database lock
+    indexTrace->startTimer(index_trace::BOW);
+    std::vector<cv::Mat> descriptors;
+    descriptors.reserve(keyframe->descriptors_.rows);
+    for(int i = 0; i < keyframe->descriptors_.rows; i++)
+        descriptors.push_back(keyframe->descriptors_.row(i));
+    vocabulary_->transform(descriptors, keyframe->bow_vec_, keyframe->feat_vec_, options_.direct_index_levels);
+
+    for(auto &it:keyframe->feat_vec_)
+    {
+        for(auto &id:it.second)
+        {
+            if(id < mpt_id.size())
+            {
+                keyframe->mptId_nodeId.insert(std::make_pair(mpt_id[id],it.first));
+                LOG_ASSERT(std::find(keyframe->mapPointsInBow.begin(),keyframe->mapPointsInBow.end(),mpts[id])!=keyframe->mapPointsInBow.end());
+            }
+        }
+    }
+    indexTrace->stopTimer(index_trace::BOW);
+
+    //! 4. publish to the database
+    indexTrace->startTimer(index_trace::DB_ADD);
+    database_->add(keyframe);
+    indexTrace->stopTimer(index_trace::DB_ADD);
+
+    indexTrace->log(index_trace::NUM_FEATURES, kps.size());
+    indexTrace->stopTimer(index_trace::TOTAL);
+    indexTrace->writeToFile();
+
+    SSVO_LOG_IF(MAPPER, 3, INFO, verbose_) << "[Indexer] KeyFrame " << keyframe->id_ << " indexed with " << kps.size() << " features, " << fts.size() << " of them have map points.";
+
+    loop_closure_->insertKeyFrame(keyframe);
+}
+
+}
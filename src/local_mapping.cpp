@@ -5,6 +5,9 @@
 #include "image_alignment.hpp"
 #include "optimizer.hpp"
 #include "time_tracing.hpp"
+#include "timeline.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
 
 #ifdef SSVO_DBOW_ENABLE
 #include <DBoW3/DescManip.h>
@@ -26,15 +29,26 @@ std::ostream& operator<<(std::ostream& out, const Feature& ft)
 
 TimeTracing::Ptr mapTrace = nullptr;
 
+//! ids of the timers and logs in mapTrace, in the order they are registered
+namespace map_trace{
+enum TimerId{TOTAL, SEEDS, LOCAL_BA, REPROJ};
+enum LogId{FRAME_ID, KEYFRAME_ID, NUM_REPROJ_KFS, NUM_REPROJ_MPTS, NUM_MATCHED, NUM_FUSION, NUM_SEED_MPTS};
+}
+
+namespace map_metrics{
+MetricGauge *queue = Metrics::instance().gauge("ssvo_mapper_queue_depth", "Keyframes waiting for the local mapping thread");
+MetricGauge *keyframes = Metrics::instance().gauge("ssvo_map_keyframes", "Keyframes in the map");
+MetricGauge *mappoints = Metrics::instance().gauge("ssvo_map_points", "Map points in the map");
+MetricHistogram *local_ba_time = Metrics::instance().histogram("ssvo_local_ba_seconds", "Time of the local BA", Metrics::timeBuckets());
+}
+
 //! LocalMapper
 LocalMapper::LocalMapper(const FastDetector::Ptr fast, bool report, bool verbose) :
     fast_detector_(fast), report_(report), verbose_(report&&verbose),
-    mapping_thread_(nullptr), stop_require_(false),finish_once_(false)
+    mapping_thread_(nullptr), converged_seeds_(nullptr), stop_require_(false),finish_once_(false)
 {
     map_ = Map::create();
 
-    brief_ = BRIEF::create(2.0, Config::imageNLevel());//,fast_detector_->getHeight(),fast_detector_->getWidth());
-
     options_.min_disparity = 100;
     options_.min_redundant_observations = 3;
     options_.max_features = Config::minCornersPerKeyFrame();
@@ -49,9 +63,9 @@ LocalMapper::LocalMapper(const FastDetector::Ptr fast, bool report, bool verbose
     //! LOG and timer for system;
     TimeTracing::TraceNames time_names;
     time_names.push_back("total");
+    time_names.push_back("seeds");
     time_names.push_back("local_ba");
     time_names.push_back("reproj");
-    time_names.push_back("dbow");
 
     TimeTracing::TraceNames log_names;
     log_names.push_back("frame_id");
@@ -60,6 +74,7 @@ LocalMapper::LocalMapper(const FastDetector::Ptr fast, bool report, bool verbose
     log_names.push_back("num_reproj_mpts");
     log_names.push_back("num_matched");
     log_names.push_back("num_fusion");
+    log_names.push_back("num_seed_mpts");
 
 
     string trace_dir = Config::timeTracingDirectory();
@@ -67,14 +82,12 @@ LocalMapper::LocalMapper(const FastDetector::Ptr fast, bool report, bool verbose
 
 }
 #ifdef SSVO_DBOW_ENABLE
-LocalMapper::LocalMapper(DBoW3::Vocabulary* vocabulary, DBoW3::Database* database,const FastDetector::Ptr fast, bool report, bool verbose) :
+LocalMapper::LocalMapper(DBoW3::Vocabulary* vocabulary, const KeyFrameDatabase::Ptr &database,const FastDetector::Ptr fast, bool report, bool verbose) :
         fast_detector_(fast), report_(report), verbose_(report&&verbose),
-        mapping_thread_(nullptr), stop_require_(false), vocabulary_(vocabulary), database_(database)
+        mapping_thread_(nullptr), converged_seeds_(nullptr), stop_require_(false), vocabulary_(vocabulary), database_(database)
 {
     map_ = Map::create();
 
-    brief_ = BRIEF::create(2.0, Config::imageNLevel());//,fast_detector_->getHeight(),fast_detector_->getWidth());
-
     options_.min_disparity = 100;
     options_.min_redundant_observations = 3;
     options_.max_features = Config::minCornersPerKeyFrame();
@@ -89,9 +102,9 @@ LocalMapper::LocalMapper(DBoW3::Vocabulary* vocabulary, DBoW3::Database* databas
     //! LOG and timer for system;
     TimeTracing::TraceNames time_names;
     time_names.push_back("total");
+    time_names.push_back("seeds");
     time_names.push_back("local_ba");
     time_names.push_back("reproj");
-    time_names.push_back("dbow");
 
     TimeTracing::TraceNames log_names;
     log_names.push_back("frame_id");
@@ -100,6 +113,7 @@ LocalMapper::LocalMapper(DBoW3::Vocabulary* vocabulary, DBoW3::Database* databas
     log_names.push_back("num_reproj_mpts");
     log_names.push_back("num_matched");
     log_names.push_back("num_fusion");
+    log_names.push_back("num_seed_mpts");
 
 
     string trace_dir = Config::timeTracingDirectory();
@@ -109,6 +123,17 @@ LocalMapper::LocalMapper(DBoW3::Vocabulary* vocabulary, DBoW3::Database* databas
 
 #endif
 
+LocalMapper::~LocalMapper()
+{
+    SeedNode *node = converged_seeds_.exchange(nullptr);
+    while(node)
+    {
+        SeedNode *next = node->next;
+        delete node;
+        node = next;
+    }
+}
+
 void LocalMapper::createInitalMap(const Frame::Ptr &frame_ref, const Frame::Ptr &frame_cur)
 {
     map_->clear();
@@ -188,27 +213,35 @@ bool LocalMapper::finish_once()
 
 void LocalMapper::run()
 {
+    Timeline::instance().setThreadName("local_mapper");
     while(!isRequiredStop())
     {
         finish_once_ = false;
         KeyFrame::Ptr keyframe_cur = checkNewKeyFrame();
         if(keyframe_cur)
         {
-            mapTrace->startTimer("total");
+            ScopedSpan span("mapping", "keyframe_id", keyframe_cur->id_);
+            mapTrace->startTimer(map_trace::TOTAL);
+            mapTrace->startTimer(map_trace::SEEDS);
+            int new_seed_features = createFeatureFromSeeds();
+            mapTrace->stopTimer(map_trace::SEEDS);
+            mapTrace->log(map_trace::NUM_SEED_MPTS, new_seed_features);
+
             std::list<MapPoint::Ptr> bad_mpts;
-            int new_seed_features = 0;
             int new_local_features = 0;
             if(map_->kfs_.size() > 2)
             {
-//                new_seed_features = createFeatureFromSeedFeature(keyframe_cur);
-                mapTrace->startTimer("reproj");
+                mapTrace->startTimer(map_trace::REPROJ);
                 new_local_features = createFeatureFromLocalMap(keyframe_cur, options_.num_reproject_kfs);
-                mapTrace->stopTimer("reproj");
-                LOG_IF(INFO, report_) << "[Mapper] create " << new_seed_features << " features from seeds and " << new_local_features << " from local map.";
-
-                mapTrace->startTimer("local_ba");
-                Optimizer::localBundleAdjustment(keyframe_cur, bad_mpts, options_.num_local_ba_kfs, options_.min_local_ba_connected_fts, report_, verbose_);
-                mapTrace->stopTimer("local_ba");
+                mapTrace->stopTimer(map_trace::REPROJ);
+                SSVO_LOG_IF(MAPPER, 1, INFO, report_) << "[Mapper] create " << new_seed_features << " features from seeds and " << new_local_features << " from local map.";
+
+                mapTrace->startTimer(map_trace::LOCAL_BA);
+                SecondTimer local_ba_timer;
+                local_ba_timer.start();
+                Optimizer::localBundleAdjustment(map_, keyframe_cur, bad_mpts, options_.num_local_ba_kfs, options_.min_local_ba_connected_fts, report_, verbose_);
+                map_metrics::local_ba_time->observe(local_ba_timer.stop());
+                mapTrace->stopTimer(map_trace::LOCAL_BA);
             }
             for(const MapPoint::Ptr &mpt : bad_mpts)
             {
@@ -217,18 +250,24 @@ void LocalMapper::run()
 
             checkCulling(keyframe_cur);
 
-            mapTrace->startTimer("dbow");
-            addToDatabase(keyframe_cur);
-            mapTrace->stopTimer("dbow");
-
-            mapTrace->stopTimer("total");
+            mapTrace->stopTimer(map_trace::TOTAL);
+            map_metrics::keyframes->set(map_->KeyFramesInMap());
+            map_metrics::mappoints->set(map_->MapPointsInMap());
             mapTrace->writeToFile();
 
             keyframe_last_ = keyframe_cur;
 
-            loop_closure_->insertKeyFrame(keyframe_cur);
+#ifdef SSVO_DBOW_ENABLE
+            //! descriptors and BoW are computed by the indexer, which then passes the keyframe to loop closure
+            indexer_->insertKeyFrame(keyframe_cur);
+#endif
 
         }
+        else
+        {
+            //! no keyframe is waiting, create the seeds converged so far to keep the latency low
+            createFeatureFromSeeds();
+        }
         finish_once_ = true;
     }
 }
@@ -243,6 +282,7 @@ KeyFrame::Ptr LocalMapper::checkNewKeyFrame()
 
     KeyFrame::Ptr keyframe = keyframes_buffer_.front();
     keyframes_buffer_.pop_front();
+    map_metrics::queue->set(keyframes_buffer_.size());
 
     return keyframe;
 }
@@ -253,31 +293,38 @@ void LocalMapper::insertKeyFrame(const KeyFrame::Ptr &keyframe)
     if(!map_->insertKeyFrame(keyframe))
         return;
 
-    mapTrace->log("frame_id", keyframe->frame_id_);
-    mapTrace->log("keyframe_id", keyframe->id_);
+    mapTrace->log(map_trace::FRAME_ID, keyframe->frame_id_);
+    mapTrace->log(map_trace::KEYFRAME_ID, keyframe->id_);
     if(mapping_thread_ != nullptr)
     {
         std::unique_lock<std::mutex> lock(mutex_keyframe_);
         keyframes_buffer_.push_back(keyframe);
+        map_metrics::queue->set(keyframes_buffer_.size());
         cond_process_.notify_one();
     }
     else
     {
-        mapTrace->startTimer("total");
+        mapTrace->startTimer(map_trace::TOTAL);
+        mapTrace->startTimer(map_trace::SEEDS);
+        int new_seed_features = createFeatureFromSeeds();
+        mapTrace->stopTimer(map_trace::SEEDS);
+        mapTrace->log(map_trace::NUM_SEED_MPTS, new_seed_features);
+
         std::list<MapPoint::Ptr> bad_mpts;
-        int new_seed_features = 0;
         int new_local_features = 0;
         if(map_->kfs_.size() > 2)
         {
-//            new_seed_features = createFeatureFromSeedFeature(keyframe);
-            mapTrace->startTimer("reproj");
+            mapTrace->startTimer(map_trace::REPROJ);
             new_local_features = createFeatureFromLocalMap(keyframe, options_.num_reproject_kfs);
-            mapTrace->stopTimer("reproj");
-            LOG_IF(INFO, report_) << "[Mapper] create " << new_seed_features << " features from seeds and " << new_local_features << " from local map.";
-
-            mapTrace->startTimer("local_ba");
-            Optimizer::localBundleAdjustment(keyframe, bad_mpts, options_.num_local_ba_kfs, options_.min_local_ba_connected_fts, report_, verbose_);
-            mapTrace->stopTimer("local_ba");
+            mapTrace->stopTimer(map_trace::REPROJ);
+            SSVO_LOG_IF(MAPPER, 1, INFO, report_) << "[Mapper] create " << new_seed_features << " features from seeds and " << new_local_features << " from local map.";
+
+            mapTrace->startTimer(map_trace::LOCAL_BA);
+            SecondTimer local_ba_timer;
+            local_ba_timer.start();
+            Optimizer::localBundleAdjustment(map_, keyframe, bad_mpts, options_.num_local_ba_kfs, options_.min_local_ba_connected_fts, report_, verbose_);
+            map_metrics::local_ba_time->observe(local_ba_timer.stop());
+            mapTrace->stopTimer(map_trace::LOCAL_BA);
         }
 
         for(const MapPoint::Ptr &mpt : bad_mpts)
@@ -287,12 +334,16 @@ void LocalMapper::insertKeyFrame(const KeyFrame::Ptr &keyframe)
 
         checkCulling(keyframe);
 
-        addToDatabase(keyframe);
-
-        mapTrace->stopTimer("total");
+        mapTrace->stopTimer(map_trace::TOTAL);
+        map_metrics::keyframes->set(map_->KeyFramesInMap());
+        map_metrics::mappoints->set(map_->MapPointsInMap());
         mapTrace->writeToFile();
 
         keyframe_last_ = keyframe;
+
+#ifdef SSVO_DBOW_ENABLE
+        indexer_->insertKeyFrame(keyframe);
+#endif
     }
 }
 
@@ -301,52 +352,113 @@ void LocalMapper::finishLastKeyFrame()
 //    DepthFilter::updateByConnectedKeyFrames(keyframe_last_, 3);
 }
 
-void LocalMapper::createFeatureFromSeed(const Seed::Ptr &seed)
+void LocalMapper::insertSeed(const Seed::Ptr &seed)
 {
-    //! create new feature
-    MapPoint::Ptr mpt = MapPoint::create(seed->kf->Twc() * (seed->fn_ref/seed->getInvDepth()));
-    Feature::Ptr ft = Feature::create(seed->px_ref, seed->fn_ref, seed->level_ref, mpt);
-    seed->kf->addFeature(ft);
-    map_->insertMapPoint(mpt);
-    mpt->addObservation(seed->kf, ft);
-    mpt->updateViewAndDepth();
+    SeedNode *node = new SeedNode{seed, converged_seeds_.load(std::memory_order_relaxed)};
+    while(!converged_seeds_.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed));
 
-    std::set<KeyFrame::Ptr> local_keyframes = seed->kf->getConnectedKeyFrames(10);
+    //! without mapping thread, create it at once as before
+    if(mapping_thread_ == nullptr)
+        createFeatureFromSeeds();
+}
 
-    for(const KeyFrame::Ptr &kf : local_keyframes)
+std::vector<Seed::Ptr> LocalMapper::takeConvergedSeeds()
+{
+    //! take the whole stack at once, so there is no ABA problem with a single consumer
+    SeedNode *node = converged_seeds_.exchange(nullptr, std::memory_order_acquire);
+
+    std::vector<Seed::Ptr> seeds;
+    while(node)
     {
-        Vector3d xyz_cur(kf->Tcw() * mpt->pose());
-        if(xyz_cur[2] < 0.0f)
-            continue;
+        seeds.push_back(node->seed);
+        SeedNode *next = node->next;
+        delete node;
+        node = next;
+    }
 
-        Vector2d px_cur(kf->cam_->project(xyz_cur));
-        if(!kf->cam_->isInFrame(px_cur.cast<int>(), 8))
-            continue;
+    //! stack is LIFO, keep the converged order
+    std::reverse(seeds.begin(), seeds.end());
+    return seeds;
+}
 
-        int level_cur = 0;
-        const Vector2d px_cur_last = px_cur;
-        int result = FeatureTracker::reprojectMapPoint(kf, mpt, px_cur, level_cur, options_.num_align_iter, options_.max_align_epsilon, options_.max_align_error2);
-        if(result != 1)
+int LocalMapper::createFeatureFromSeeds()
+{
+    std::vector<Seed::Ptr> seeds = takeConvergedSeeds();
+    if(seeds.empty())
+        return 0;
+
+    //! create new features, grouped by the reference keyframe of seeds
+    std::vector<MapPoint::Ptr> new_mpts;
+    new_mpts.reserve(seeds.size());
+    std::unordered_map<KeyFrame::Ptr, std::vector<MapPoint::Ptr> > kf_new_mpts;
+    for(const Seed::Ptr &seed : seeds)
+    {
+        if(seed->kf->isBad())
             continue;
 
-        double error = (px_cur_last-px_cur).norm();
-        if(error > 2.0)
-            continue;
+        MapPoint::Ptr mpt = MapPoint::create(seed->kf->Twc() * (seed->fn_ref/seed->getInvDepth()));
+        Feature::Ptr ft = Feature::create(seed->px_ref, seed->fn_ref, seed->level_ref, mpt);
+        seed->kf->addFeature(ft);
+        mpt->addObservation(seed->kf, ft);
+        mpt->updateViewAndDepth();
 
-        Vector3d ft_cur = kf->cam_->lift(px_cur);
-        Feature::Ptr new_feature = Feature::create(px_cur, ft_cur, level_cur, mpt);
-        kf->addFeature(new_feature);
+        new_mpts.push_back(mpt);
+        kf_new_mpts[seed->kf].push_back(mpt);
+    }
 
-        if(mpt->isBad())
-            continue;
+    map_->insertMapPoints(new_mpts);
+
+    //! reproject to the connected keyframes, which are shared by all seeds in the same keyframe
+    for(const auto &kf_mpts : kf_new_mpts)
+    {
+        std::set<KeyFrame::Ptr> local_keyframes = kf_mpts.first->getConnectedKeyFrames(10);
+
+        for(const KeyFrame::Ptr &kf : local_keyframes)
+        {
+            const SE3d Tcw = kf->Tcw();
+            for(const MapPoint::Ptr &mpt : kf_mpts.second)
+            {
+                Vector3d xyz_cur(Tcw * mpt->pose());
+                if(xyz_cur[2] < 0.0f)
+                    continue;
+
+                Vector2d px_cur(kf->cam_->project(xyz_cur));
+                if(!kf->cam_->isInFrame(px_cur.cast<int>(), 8))
+                    continue;
+
+                int level_cur = 0;
+                const Vector2d px_cur_last = px_cur;
+                int result = FeatureTracker::reprojectMapPoint(kf, mpt, px_cur, level_cur, options_.num_align_iter, options_.max_align_epsilon, options_.max_align_error2);
+                if(result != 1)
+                    continue;
+
+                double error = (px_cur_last-px_cur).norm();
+                if(error > 2.0)
+                    continue;
+
+                Vector3d ft_cur = kf->cam_->lift(px_cur);
+                Feature::Ptr new_feature = Feature::create(px_cur, ft_cur, level_cur, mpt);
+                kf->addFeature(new_feature);
+
+                if(mpt->isBad())
+                    continue;
+
+                mpt->addObservation(kf, new_feature);
+            }
+        }
+    }
+
+    for(const MapPoint::Ptr &mpt : new_mpts)
+    {
+        mpt->updateViewAndDepth();
 
-        mpt->addObservation(kf, new_feature);
+        if(mpt->observations() > 1)
+            Optimizer::refineMapPoint(mpt, 10, true);
     }
 
-    mpt->updateViewAndDepth();
+    SSVO_LOG_IF(MAPPER, 3, INFO, verbose_) << "[Mapper] create " << new_mpts.size() << " map points from " << seeds.size() << " converged seeds.";
 
-    if(mpt->observations() > 1)
-        Optimizer::refineMapPoint(mpt, 10, true);
+    return (int) new_mpts.size();
 }
 
 int LocalMapper::createFeatureFromSeedFeature(const KeyFrame::Ptr &keyframe)
@@ -482,7 +594,7 @@ int LocalMapper::createFeatureFromLocalMap(const KeyFrame::Ptr &keyframe, const
             ft->mpt_->increaseFound(2);
 //            addOptimalizeMapPoint(ft->mpt_);
             created_count++;
-            LOG_IF(INFO, verbose_) << " create new feature from mpt " << ft->mpt_->id_;
+            SSVO_LOG_IF(MAPPER, 3, INFO, verbose_) << " create new feature from mpt " << ft->mpt_->id_;
         }
         //! if already occupied, check whether the mappoint is the same
         else
@@ -587,7 +699,7 @@ int LocalMapper::createFeatureFromLocalMap(const KeyFrame::Ptr &keyframe, const
 
 //                addOptimalizeMapPoint(mpt_old);
 
-                LOG_IF(INFO, verbose_) << " Fusion mpt " << mpt_old->id_ << " with mpt " << mpt_new->id_;
+                SSVO_LOG_IF(MAPPER, 3, INFO, verbose_) << " Fusion mpt " << mpt_old->id_ << " with mpt " << mpt_new->id_;
 //                goto SHOW;
             }
             else
@@ -657,7 +769,7 @@ int LocalMapper::createFeatureFromLocalMap(const KeyFrame::Ptr &keyframe, const
 
 //                addOptimalizeMapPoint(mpt_new);
 
-                LOG_IF(INFO, verbose_) << " Fusion mpt " << mpt_new->id_ << " with mpt " << mpt_old->id_;
+                SSVO_LOG_IF(MAPPER, 3, INFO, verbose_) << " Fusion mpt " << mpt_new->id_ << " with mpt " << mpt_old->id_;
 //                goto SHOW;
             }
 
@@ -701,12 +813,12 @@ int LocalMapper::createFeatureFromLocalMap(const KeyFrame::Ptr &keyframe, const
 
     }
 
-    mapTrace->log("num_reproj_mpts", project_count);
-    mapTrace->log("num_reproj_kfs", local_keyframes.size());
-    mapTrace->log("num_fusion", fusion_count);
-    mapTrace->log("num_matched", created_count);
-    LOG_IF(WARNING, report_) << "[Mapper][1] old points: " << mpts_cur.size() << ". All candidate: " << candidate_mpts.size() << ", projected: " << project_count
-                             << ", points matched: " << new_fts.size() << " with " << created_count << " created, " << fusion_count << " fusioned. ";
+    mapTrace->log(map_trace::NUM_REPROJ_MPTS, project_count);
+    mapTrace->log(map_trace::NUM_REPROJ_KFS, local_keyframes.size());
+    mapTrace->log(map_trace::NUM_FUSION, fusion_count);
+    mapTrace->log(map_trace::NUM_MATCHED, created_count);
+    SSVO_LOG_IF(MAPPER, 1, WARNING, report_) << "[Mapper][1] old points: " << mpts_cur.size() << ". All candidate: " << candidate_mpts.size() << ", projected: " << project_count
+                                             << ", points matched: " << new_fts.size() << " with " << created_count << " created, " << fusion_count << " fusioned. ";
 
     return created_count;
 }
@@ -793,8 +905,8 @@ int LocalMapper::refineMapPoints(const int max_optimalize_num, const double outl
     }
 
     double t1 = (double)cv::getTickCount();
-    LOG_IF(WARNING, report_) << "[Mapper][2] Refine MapPoint Time: " << (t1-t0)*1000/cv::getTickFrequency()
-                             << "ms, mpts: " << mpts_for_optimizing.size() << ", remained: " << remain_num;
+    SSVO_LOG_IF(MAPPER, 1, WARNING, report_) << "[Mapper][2] Refine MapPoint Time: " << (t1-t0)*1000/cv::getTickFrequency()
+                                             << "ms, mpts: " << mpts_for_optimizing.size() << ", remained: " << remain_num;
 
     return (int)mpts_for_optimizing.size();
 }
@@ -845,6 +957,9 @@ void LocalMapper::checkCulling(const KeyFrame::Ptr &keyframe)
             {
                 kf->setBad();
                 map_->removeKeyFrame(kf);
+#ifdef SSVO_DBOW_ENABLE
+                database_->remove(kf);
+#endif
                 count++;
             }
         }
@@ -863,132 +978,15 @@ inline size_t Grid<Feature::Ptr>::getIndex(const Feature::Ptr &element)
         + static_cast<size_t>(px[0]/grid_size_);
 }
 
-void LocalMapper::addToDatabase(const KeyFrame::Ptr &keyframe)
-{
 #ifdef SSVO_DBOW_ENABLE
-
-    std::vector<uint64_t > mpt_id;
-    std::vector<Feature::Ptr> fts;
-    std::vector<MapPoint::Ptr> mpts;
-    keyframe->getFeaturesAndMapPoints(fts,mpts);
-
-    keyframe->featuresInBow = fts;
-    keyframe->mapPointsInBow = mpts;
-
-    Corners old_corners;
-    old_corners.reserve(fts.size());
-    for(const Feature::Ptr &ft : fts)
-    {
-        old_corners.emplace_back(Corner(ft->px_[0], ft->px_[1], 0, ft->level_));
-        mpt_id.emplace_back(ft->mpt_->id_);
-    }
-
-    Corners new_corners;
-    fast_detector_->detect(keyframe->images(), new_corners, old_corners, 1200);
-
-    if(new_corners.size()+old_corners.size()>1000)
-    {
-        std::sort(new_corners.begin(),new_corners.end(),[](Corner a,Corner b) -> bool { return a.score>b.score;});
-        new_corners.resize(1000 - old_corners.size());
-    }
-
-    std::vector<cv::KeyPoint> kps;
-    for(const Corner & corner : old_corners)
-        kps.emplace_back(cv::KeyPoint(corner.x, corner.y, 31, -1, 0, corner.level));
-    for(const Corner & corner : new_corners)
-        kps.emplace_back(cv::KeyPoint(corner.x, corner.y, 31, -1, 0, corner.level));
-
-    brief_->compute(keyframe->images(), kps, keyframe->descriptors_);
-
-    LOG_ASSERT(old_corners.size()==fts.size())<<"the number of two should be equal"<<std::endl;
-    for (int j = 0; j < fts.size(); ++j) {
-        fts[j]->angle = kps[j].angle;
-    }
-
-    keyframe->KeyPoints.assign(kps.begin(),kps.end());
-
-    //! save descriptors of every mpt
-    for(int i=0;i< mpt_id.size();i++)
-    {
-        keyframe->mptId_des.insert(std::make_pair(mpt_id[i],keyframe->descriptors_.row(i)));
-    }
-    for(int i=0;i< mpt_id.size();i++)
-    {
-        fts[i]->descriptors_ = keyframe->descriptors_.row(i);
-    }
-
-    {
-        std::unique_lock<std::mutex> lock(loop_closure_->mutex_database_);
-        keyframe->dbow_Id_ = database_->add(keyframe->descriptors_, &keyframe->bow_vec_, &keyframe->feat_vec_);
-    }
-
-    for(auto &it:keyframe->feat_vec_)
-    {
-        for(auto &id:it.second)
-        {
-            if((int)id < mpt_id.size())
-            {
-                keyframe->mptId_nodeId.insert(std::make_pair(mpt_id[id],it.first));
-                LOG_ASSERT(std::find(keyframe->mapPointsInBow.begin(),keyframe->mapPointsInBow.end(),mpts[id])!=keyframe->mapPointsInBow.end());
-            }
-
-        }
-    }
-    LOG_ASSERT(keyframe->dbow_Id_ == keyframe->id_) << "DBoW Id(" << keyframe->dbow_Id_ << ") is not match the keyframe's Id(" << keyframe->id_ << ")!";
-#endif
-}
-
-KeyFrame::Ptr LocalMapper::relocalizeByDBoW(const Frame::Ptr &frame, const Corners &corners)
+void LocalMapper::setLoopCloser(LoopClosure::Ptr loop_closure)
 {
-    KeyFrame::Ptr reference = nullptr;
-
-#ifdef SSVO_DBOW_ENABLE
-
-    std::vector<cv::KeyPoint> kps;
-    for(const Corner & corner : corners)
-    {
-//        if(!brief_->checkBorder(corner.x,corner.y,corner.level,true))
-//            continue;
-
-        kps.emplace_back(cv::KeyPoint(corner.x, corner.y, 31, -1, 0, corner.level));
-    }
-
-    cv::Mat _descriptors;
-    brief_->compute(frame->images(), kps, _descriptors);
-    std::vector<cv::Mat> descriptors;
-    descriptors.reserve(_descriptors.rows);
-    for(int i = 0; i < _descriptors.rows; i++)
-        descriptors.push_back(_descriptors.row(i));
-
-    DBoW3::BowVector bow_vec;
-    DBoW3::FeatureVector feat_vec;
-    vocabulary_->transform(descriptors, bow_vec, feat_vec, 4);
-
-    DBoW3::QueryResults results;
-    database_->query(bow_vec, results, 1);
-
-    if(results.empty())
-        return nullptr;
-
-    DBoW3::Result result = results[0];
-
-    reference = map_->getKeyFrame(result.Id);
-
-#endif
-
-    // TODO 如果有关键帧剔除，则数据库索引存在问题。
-    if(reference == nullptr)
-        return nullptr;
-
-    LOG_ASSERT(reference->dbow_Id_ == reference->id_) << "DBoW Id(" << reference->dbow_Id_ << ") is not match the keyframe's Id(" << reference->id_ << ")!";
-
-    return reference;
+    loop_closure_ = loop_closure;
 }
 
-#ifdef SSVO_DBOW_ENABLE
-void LocalMapper::setLoopCloser(LoopClosure::Ptr loop_closure)
+void LocalMapper::setIndexer(KeyFrameIndexer::Ptr indexer)
 {
-    loop_closure_ = loop_closure;
+    indexer_ = indexer;
 }
 
 #endif
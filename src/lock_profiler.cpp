@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <sstream>
+#include "lock_profiler.hpp"
+
+namespace ssvo{
+
+LockSite::LockSite(const std::string &name) :
+    name(name), acquisitions(0), contentions(0), wait_ns(0), max_wait_ns(0), hold_ns(0), max_hold_ns(0)
+{}
+
+LockProfiler &LockProfiler::instance()
+{
+    static LockProfiler profiler;
+    return profiler;
+}
+
+LockProfiler::LockProfiler() :
+    start_ns_(now()), last_report_ns_(start_ns_), stop_(false)
+{}
+
+LockProfiler::~LockProfiler()
+{
+    stopReporting();
+}
+
+LockSite *LockProfiler::site(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(mutex_sites_);
+    std::unique_ptr<LockSite> &site = sites_[name];
+    if(!site)
+        site.reset(new LockSite(name));
+    return site.get();
+}
+
+void LockProfiler::collect(std::vector<Stats> &stats)
+{
+    std::vector<LockSite*> sites;
+    {
+        std::lock_guard<std::mutex> lock(mutex_sites_);
+        for(const auto &it : sites_)
+            sites.push_back(it.second.get());
+    }
+
+    //! take the counters since the last collection, the maximums are reset for the next period
+    stats.clear();
+    for(LockSite *site : sites)
+    {
+        Stats stat;
+        stat.name = site->name;
+        stat.acquisitions = site->acquisitions.exchange(0, std::memory_order_relaxed);
+        stat.contentions = site->contentions.exchange(0, std::memory_order_relaxed);
+        stat.wait_ns = site->wait_ns.exchange(0, std::memory_order_relaxed);
+        stat.max_wait_ns = site->max_wait_ns.exchange(0, std::memory_order_relaxed);
+        stat.hold_ns = site->hold_ns.exchange(0, std::memory_order_relaxed);
+        stat.max_hold_ns = site->max_hold_ns.exchange(0, std::memory_order_relaxed);
+        stats.push_back(stat);
+
+        auto it = totals_.find(stat.name);
+        if(it == totals_.end())
+        {
+            totals_.emplace(stat.name, stat);
+            continue;
+        }
+
+        Stats &total = it->second;
+        total.acquisitions += stat.acquisitions;
+        total.contentions += stat.contentions;
+        total.wait_ns += stat.wait_ns;
+        total.max_wait_ns = std::max(total.max_wait_ns, stat.max_wait_ns);
+        total.hold_ns += stat.hold_ns;
+        total.max_hold_ns = std::max(total.max_hold_ns, stat.max_hold_ns);
+    }
+}
+
+void LockProfiler::print(const std::string &title, std::vector<Stats> stats, const double elapsed)
+{
+    std::sort(stats.begin(), stats.end(), [](const Stats &a, const Stats &b){ return a.wait_ns > b.wait_ns; });
+
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << "[LockProfiler] " << title << " in " << elapsed << " s\n";
+    ss << std::left << std::setw(28) << "site" << std::right
+       << std::setw(12) << "acquire" << std::setw(10) << "contend%"
+       << std::setw(12) << "wait(ms)" << std::setw(12) << "wait_max" << std::setw(10) << "wait%"
+       << std::setw(12) << "hold(ms)" << std::setw(14) << "hold_avg(us)" << std::setw(12) << "hold_max" << std::setw(10) << "hold%";
+
+    const double elapsed_ns = std::max(elapsed * 1e9, 1.0);
+    for(const Stats &stat : stats)
+    {
+        if(stat.acquisitions == 0)
+            continue;
+
+        //! the percentages of wall time, over 100% means several threads are waiting on or holding the same site
+        ss << "\n" << std::left << std::setw(28) << stat.name << std::right
+           << std::setw(12) << stat.acquisitions
+           << std::setw(10) << 100.0 * stat.contentions / stat.acquisitions
+           << std::setw(12) << stat.wait_ns * 1e-6
+           << std::setw(12) << stat.max_wait_ns * 1e-6
+           << std::setw(10) << 100.0 * stat.wait_ns / elapsed_ns
+           << std::setw(12) << stat.hold_ns * 1e-6
+           << std::setw(14) << stat.hold_ns * 1e-3 / stat.acquisitions
+           << std::setw(12) << stat.max_hold_ns * 1e-6
+           << std::setw(10) << 100.0 * stat.hold_ns / elapsed_ns;
+    }
+
+    LOG(INFO) << ss.str();
+}
+
+void LockProfiler::report()
+{
+    std::lock_guard<std::mutex> lock(mutex_report_);
+    const uint64_t current = now();
+    std::vector<Stats> stats;
+    collect(stats);
+    print("Lock sites", stats, (current - last_report_ns_) * 1e-9);
+    last_report_ns_ = current;
+}
+
+void LockProfiler::reportTotal()
+{
+    std::lock_guard<std::mutex> lock(mutex_report_);
+    const uint64_t current = now();
+    std::vector<Stats> stats;
+    collect(stats);
+    last_report_ns_ = current;
+
+    stats.clear();
+    for(const auto &it : totals_)
+        stats.push_back(it.second);
+    print("Total of lock sites", stats, (current - start_ns_) * 1e-9);
+}
+
+void LockProfiler::startReporting(double interval)
+{
+    if(interval <= 0 || reporter_)
+        return;
+
+    stop_ = false;
+    const std::chrono::milliseconds period((int64_t)(interval * 1000));
+    reporter_ = std::make_shared<std::thread>([this, period](){
+        std::unique_lock<std::mutex> lock(mutex_stop_);
+        while(!cond_stop_.wait_for(lock, period, [this]{ return stop_; }))
+        {
+            lock.unlock();
+            report();
+            lock.lock();
+        }
+    });
+}
+
+void LockProfiler::stopReporting()
+{
+    if(!reporter_)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_stop_);
+        stop_ = true;
+    }
+    cond_stop_.notify_one();
+    reporter_->join();
+    reporter_.reset();
+}
+
+}
@@ -0,0 +1,222 @@
+#include <cstdio>
+#include <cstdlib>
+#include "logging.hpp"
+
+namespace ssvo{
+
+//! replaces the file logger of one severity, glog calls it with its log mutex held
+class AsyncLogging::FileLogger : public google::base::Logger
+{
+public:
+
+    FileLogger(AsyncLogging *logging, int severity, google::base::Logger *logger) :
+        logging_(logging), severity_(severity), logger_(logger)
+    {}
+
+    virtual void Write(bool force_flush, time_t timestamp, const char *message, int message_len)
+    {
+        logging_->push(Record{severity_, force_flush, timestamp, std::string(message, message_len)});
+    }
+
+    virtual void Flush()
+    {
+        logging_->flush();
+    }
+
+    virtual google::uint32 LogSize()
+    {
+        return logger_->LogSize();
+    }
+
+private:
+
+    AsyncLogging *logging_;
+    const int severity_;
+    google::base::Logger *logger_;
+};
+
+//! takes over the stderr output of alsologtostderr and stderrthreshold
+class AsyncLogging::StderrSink : public google::LogSink
+{
+public:
+
+    StderrSink(AsyncLogging *logging, bool also_log_to_stderr, int stderr_threshold) :
+        logging_(logging), also_log_to_stderr_(also_log_to_stderr), stderr_threshold_(stderr_threshold)
+    {}
+
+    virtual void send(google::LogSeverity severity, const char *full_filename, const char *base_filename, int line,
+                      const struct ::tm *tm_time, const char *message, size_t message_len)
+    {
+        //! the fatal message is still written by glog
+        if(severity >= google::GLOG_FATAL || (!also_log_to_stderr_ && severity < stderr_threshold_))
+            return;
+
+        std::string text = FLAGS_log_prefix ? ToString(severity, base_filename, line, tm_time, message, message_len) : std::string(message, message_len);
+        text += "\n";
+        logging_->push(Record{-1, false, 0, std::move(text)});
+    }
+
+private:
+
+    AsyncLogging *logging_;
+    const bool also_log_to_stderr_;
+    const int stderr_threshold_;
+};
+
+//! writes the queued messages before glog aborts on a fatal message
+static void flushAndAbort()
+{
+    AsyncLogging::instance().flush();
+    abort();
+}
+
+AsyncLogging &AsyncLogging::instance()
+{
+    static AsyncLogging logging;
+    return logging;
+}
+
+AsyncLogging::AsyncLogging() :
+    max_bytes_(0), bytes_(0), dropped_(0), pushed_(0), written_(0), stop_(false),
+    also_log_to_stderr_(false), stderr_threshold_(google::GLOG_ERROR)
+{}
+
+AsyncLogging::~AsyncLogging()
+{
+    stop();
+}
+
+void AsyncLogging::start(size_t max_bytes)
+{
+    if(thread_ != nullptr)
+        return;
+
+    file_loggers_.clear();
+    async_loggers_.clear();
+    for(int severity = google::GLOG_INFO; severity < google::GLOG_FATAL; severity++)
+    {
+        file_loggers_.push_back(google::base::GetLogger(severity));
+        async_loggers_.emplace_back(new FileLogger(this, severity, file_loggers_.back()));
+    }
+
+    max_bytes_ = max_bytes;
+    stop_ = false;
+    thread_ = std::make_shared<std::thread>(std::bind(&AsyncLogging::run, this));
+
+    for(size_t i = 0; i < async_loggers_.size(); i++)
+        google::base::SetLogger((int) i, async_loggers_[i].get());
+
+    //! with logtostderr glog writes stderr directly and never calls the file loggers
+    also_log_to_stderr_ = FLAGS_alsologtostderr;
+    stderr_threshold_ = FLAGS_stderrthreshold;
+    if(!FLAGS_logtostderr)
+    {
+        stderr_sink_.reset(new StderrSink(this, also_log_to_stderr_, stderr_threshold_));
+        google::AddLogSink(stderr_sink_.get());
+        FLAGS_alsologtostderr = false;
+        FLAGS_stderrthreshold = google::GLOG_FATAL;
+    }
+
+    google::InstallFailureFunction(&flushAndAbort);
+}
+
+void AsyncLogging::stop()
+{
+    if(thread_ == nullptr)
+        return;
+
+    //! restore glog first, so nothing is pushed after the thread stops
+    if(stderr_sink_)
+    {
+        google::RemoveLogSink(stderr_sink_.get());
+        FLAGS_alsologtostderr = also_log_to_stderr_;
+        FLAGS_stderrthreshold = stderr_threshold_;
+    }
+
+    for(size_t i = 0; i < file_loggers_.size(); i++)
+        google::base::SetLogger((int) i, file_loggers_[i]);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_records_);
+        stop_ = true;
+    }
+    cond_process_.notify_one();
+    thread_->join();
+    thread_.reset();
+
+    for(google::base::Logger *logger : file_loggers_)
+        logger->Flush();
+}
+
+bool AsyncLogging::push(Record &&record)
+{
+    std::lock_guard<std::mutex> lock(mutex_records_);
+    if(bytes_ + record.message.size() > max_bytes_)
+    {
+        dropped_++;
+        return false;
+    }
+
+    bytes_ += record.message.size();
+    pushed_++;
+    records_.push_back(std::move(record));
+    cond_process_.notify_one();
+    return true;
+}
+
+void AsyncLogging::flush()
+{
+    if(thread_ == nullptr || std::this_thread::get_id() == thread_->get_id())
+        return;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_records_);
+        const uint64_t target = pushed_;
+        cond_written_.wait(lock, [&]{ return written_ >= target || stop_; });
+    }
+
+    for(google::base::Logger *logger : file_loggers_)
+        logger->Flush();
+}
+
+void AsyncLogging::run()
+{
+    std::deque<Record> records;
+    std::unique_lock<std::mutex> lock(mutex_records_);
+    while(true)
+    {
+        cond_process_.wait(lock, [this]{ return stop_ || !records_.empty(); });
+        if(records_.empty() && stop_)
+            break;
+
+        records.swap(records_);
+        bytes_ = 0;
+        const uint64_t dropped = dropped_;
+        dropped_ = 0;
+        lock.unlock();
+
+        if(dropped > 0)
+        {
+            const std::string message = "[AsyncLogging] " + std::to_string(dropped) + " log messages are dropped as the queue is full\n";
+            file_loggers_[google::GLOG_WARNING]->Write(true, time(nullptr), message.data(), (int) message.size());
+            fwrite(message.data(), 1, message.size(), stderr);
+        }
+
+        for(const Record &record : records)
+        {
+            if(record.severity < 0)
+                fwrite(record.message.data(), 1, record.message.size(), stderr);
+            else
+                file_loggers_[record.severity]->Write(record.force_flush, record.timestamp, record.message.data(), (int) record.message.size());
+        }
+
+        const uint64_t count = records.size();
+        records.clear();
+
+        lock.lock();
+        written_ += count;
+        cond_written_.notify_all();
+    }
+}
+
+}
@@ -2,8 +2,14 @@
 // Created by jh on 18-11-29.
 //
 
+#include "config.hpp"
 #include "loop_closure.hpp"
 #include "optimizer.hpp"
+#include "timeline.hpp"
+#include "metrics.hpp"
+#include "time_tracing.hpp"
+#include <deque>
+#include <unordered_set>
 
 namespace ssvo{
 
@@ -13,6 +19,12 @@ const int HISTO_LENGTH = 30;
 const float fNNratio =0.75;
 const bool CheckOrientation = true;
 
+namespace loop_metrics{
+MetricCounter *loops = Metrics::instance().counter("ssvo_loops_total", "Number of loops corrected");
+MetricCounter *global_ba_aborted = Metrics::instance().counter("ssvo_global_ba_aborted_total", "Number of global BA aborted by a new loop");
+MetricHistogram *global_ba_time = Metrics::instance().histogram("ssvo_global_ba_seconds", "Time of the finished global BA", {0.1, 0.2, 0.5, 1.0, 2.0, 5.0, 10.0, 20.0, 50.0});
+}
+
 void ComputeThreeMaxima(std::vector<int>* histo, const int L, int &ind1, int &ind2, int &ind3)
 {
     int max1=0;
@@ -56,31 +68,21 @@ void ComputeThreeMaxima(std::vector<int>* histo, const int L, int &ind1, int &in
     }
 }
 
-cv::Mat computeDistinctiveDescriptors(std::vector<cv::Mat> &descriptors)
+BriefDescriptor computeDistinctiveDescriptors(const BriefDescriptors &descriptors)
 {
-    const size_t N = descriptors.size();
+    const int N = descriptors.size();
 
-    std::vector<std::vector<double > > Distances;
-    Distances.resize(N, std::vector<double >(N, 0));
-    for (size_t i = 0; i<N; i++)
-    {
-        Distances[i][i]=0;
-        for(size_t j = i+1; j < N;j++)
-        {
-            double distij = DBoW3::DescManip::distance(descriptors[i],descriptors[j]);
-            Distances[i][j]=distij;
-            Distances[j][i]=distij;
-        }
-    }
+    std::vector<int> Distances(N * N);
+    hammingDistances(descriptors.data(), N, descriptors.data(), N, Distances.data());
 
     // Take the descriptor with least median distance to the rest
     int BestMedian = INT_MAX;
     int BestIdx = 0;
-    for(size_t i=0;i<N;i++)
+    for(int i=0;i<N;i++)
     {
         // 第i个描述子到其它所有所有描述子之间的距离
         //vector<int> vDists(Distances[i],Distances[i]+N);
-        std::vector<int> vDists(Distances[i].begin(), Distances[i].end());
+        std::vector<int> vDists(Distances.begin() + i * N, Distances.begin() + (i + 1) * N);
         std::sort(vDists.begin(), vDists.end());
 
         int median = vDists[0.5*(N-1)];
@@ -131,14 +133,21 @@ cv::Mat showFeatures(const cv::Mat& src, const std::vector<Feature::Ptr> &featur
     return img;
 }
 
-LoopClosure::LoopClosure(DBoW3::Vocabulary* vocabulary, DBoW3::Database* database_):
-        vocabulary_(vocabulary), database_(database_),LastLoopKFid_(0),
-        ifFinished(true),RunningGBA_(false), FinishedGBA_(true), StopGBA_(false), thread_GBA_(NULL),
+LoopClosure::LoopClosure(DBoW3::Vocabulary* vocabulary, const KeyFrameDatabase::Ptr &database):
+        vocabulary_(vocabulary), database_(database),LastLoopKFid_(0),
+        ifFinished(true),stop_require_(false),RunningGBA_(false), FinishedGBA_(true), StopGBA_(false), thread_GBA_(NULL),
         FullBAIdx_(0),update_finish_(false),loop_time_(0)
 {
     sim3_cw = Sophus::Sim3d();
     mnCovisibilityConsistencyTh = 3;
+    GBA_update_batch_ = 50;
 }
+
+LoopClosure::~LoopClosure()
+{
+    stopMainThread();
+}
+
 void LoopClosure::startMainThread()
 {
     if(loop_closure_thread_ == nullptr)
@@ -149,12 +158,28 @@ void LoopClosure::startMainThread()
 
 void LoopClosure::stopMainThread()
 {
+    setStop();
     if(loop_closure_thread_)
     {
         if(loop_closure_thread_->joinable())
             loop_closure_thread_->join();
         loop_closure_thread_.reset();
     }
+
+    //! the global BA is only started by the loop closure thread, no new one after the join
+    StopGlobalBundleAdjustment();
+}
+
+void LoopClosure::setStop()
+{
+    std::unique_lock<std::mutex> lock(mutex_stop_);
+    stop_require_ = true;
+}
+
+bool LoopClosure::isRequiredStop()
+{
+    std::unique_lock<std::mutex> lock(mutex_stop_);
+    return stop_require_;
 }
 
 void LoopClosure::insertKeyFrame(KeyFrame::Ptr kf)
@@ -162,22 +187,25 @@ void LoopClosure::insertKeyFrame(KeyFrame::Ptr kf)
     std::unique_lock<std::mutex> lock(mutex_keyFramesList_);
     keyFramesList_.push_back(kf);
     cond_process_.notify_one();
-
-    KeyFrames.push_back(kf);
 }
 
 void LoopClosure::run()
 {
     ifFinished = false;
-    while(1)
+    Timeline::instance().setThreadName("loop_closure");
+    while(!isRequiredStop())
     {
         if(CheckNewKeyFrames())
         {
-            if(DetectLoop())
+            ScopedSpan span("loop_closure");
+            const bool detected = DetectLoop();
+            span.setArg("keyframe_id", curKeyFrame_->id_);
+            if(detected)
             {
                 if(ComputeSim3())
                 {
                     CorrectLoop();
+                    loop_metrics::loops->inc();
                 }
             }
         }
@@ -212,6 +240,9 @@ bool LoopClosure::DetectLoop()
         curKeyFrame_->setNotErase();
     }
 
+    //! the database is only compacted in this thread, so the slots in a query result stay valid
+    database_->compact();
+
     if(curKeyFrame_->id_<LastLoopKFid_+10)
     {
         curKeyFrame_->setErase();
@@ -222,43 +253,18 @@ bool LoopClosure::DetectLoop()
     //! step 1
     const std::set<KeyFrame::Ptr> ConnectedKeyFrames = curKeyFrame_->getConnectedKeyFrames(-1);
 
-    const DBoW3::BowVector &currentBowVec = curKeyFrame_->bow_vec_;
+    //! one query gives the common words and scores of all keyframes, including the connected ones
+    KeyFrameDatabase::QueryResult query;
+    database_->query(curKeyFrame_->bow_vec_, query);
 
     bool test_shareword = false;
 
     if(test_shareword)
     {
-        DBoW3::QueryResults results;
-        database_->query(curKeyFrame_->bow_vec_,results,-1,-1);
-        for(const DBoW3::Result ret : results)
+        for(const KeyFrame::Ptr &kf : query.keyframes)
         {
-            if(ret.Id != curKeyFrame_->id_)
-            {
-                DBoW3::BowVector::iterator bv1_iter = curKeyFrame_->bow_vec_.begin();
-                DBoW3::BowVector::iterator bv1_end = curKeyFrame_->bow_vec_.end();
-
-                LOG_ASSERT(KeyFrames[ret.Id]->id_ == ret.Id);
-                DBoW3::BowVector::iterator bv2_iter = KeyFrames[ret.Id]->bow_vec_.begin();
-                DBoW3::BowVector::iterator bv2_end = KeyFrames[ret.Id]->bow_vec_.end();
-
-                int count = 0;
-                while(bv1_iter != bv1_end && bv2_iter != bv2_end)
-                {
-
-                    if(bv1_iter->first == bv2_iter->first)
-                    {
-                        count++;
-                        bv2_iter++;
-                        bv1_iter++;
-                    }
-                    else if(bv1_iter->first > bv2_iter->first)
-                        bv2_iter = KeyFrames[ret.Id]->bow_vec_.lower_bound(bv1_iter->first);
-                    else
-                        bv1_iter = curKeyFrame_->bow_vec_.lower_bound(bv2_iter->first);
-                }
-
-                std::cout << "share words <" << curKeyFrame_->id_ << ", " << ret.Id << "> : " << count << std::endl;
-            }
+            if(kf != curKeyFrame_)
+                std::cout << "share words <" << curKeyFrame_->id_ << ", " << kf->id_ << "> : " << query.commonWords(kf) << std::endl;
         }
     }
 
@@ -269,23 +275,14 @@ bool LoopClosure::DetectLoop()
     {
         if(pKF->isBad())
             continue;
-        const DBoW3::BowVector &BowVec = pKF->bow_vec_;
 
-        int same_word = 0;
-        for (auto wordId:currentBowVec)
-        {
-            if(BowVec.count(wordId.first))
-            {
-                same_word ++;
-            }
-        }
-        double score = (*vocabulary_).score(currentBowVec, BowVec);
+        const double score = query.score(pKF);
 
         bool check_score = false;
         if(check_score)
         {
             std::cout<<"time :"<<std::fixed <<std::setprecision(6)<<pKF->timestamp_<<std::endl;
-            std::cout<<"KeyFrame "<<pKF->id_<<" frame id "<<pKF->frame_id_<<" score:["<<score<<"] have ["<<same_word<<"] word."<<std::endl;
+            std::cout<<"KeyFrame "<<pKF->id_<<" frame id "<<pKF->frame_id_<<" score:["<<score<<"] have ["<<query.commonWords(pKF)<<"] word."<<std::endl;
             std::cout<<"======================================"<<std::endl;
         }
 
@@ -299,7 +296,7 @@ bool LoopClosure::DetectLoop()
     LOG(WARNING) << "[LoopClosure] <minScore,maxScore>: <"<<minScore<<","<<maxScore<<">";
 
     //! step 3 Query the database imposing the minimum score
-    std::vector<KeyFrame::Ptr> vpCandidateKFs = DetectLoopCandidates(minScore);
+    std::vector<KeyFrame::Ptr> vpCandidateKFs = DetectLoopCandidates(minScore, query);
 
     LOG(WARNING) << "[LoopClosure] CandidateKFs number after DetectLoopCandidates: "<<vpCandidateKFs.size();
 
@@ -402,254 +399,231 @@ bool LoopClosure::DetectLoop()
     }
 }
 
-bool LoopClosure::ComputeSim3()
+/**
+ * @brief 验证一个闭环候选帧, 可以在多个线程中同时调用
+ *      1. 通过词袋匹配当前帧与候选帧的地图点
+ *      2. Sim3 RANSAC, 每次50次迭代, 得到假设后用 SearchBySim3 补充匹配并用 optimizeSim3 优化
+ *      3. 任意一个候选通过后其他候选停止
+ * @param[in] loopKeyFrame      候选帧
+ * @param[in,out] found         是否已经有候选通过, 本候选通过时设置
+ * @param[out] sim3_lkf2cur     候选帧到当前帧的Sim3
+ * @param[out] MapPointMatches  当前帧 mapPointsInBow 对应的候选帧地图点
+ * @return 是否通过
+ */
+bool LoopClosure::verifyLoopCandidate(const KeyFrame::Ptr &loopKeyFrame, std::atomic<bool> &found, Sophus::Sim3d &sim3_lkf2cur, std::vector<MapPoint::Ptr> &MapPointMatches)
 {
+    if(loopKeyFrame->isBad() || (curKeyFrame_->frame_id_-loopKeyFrame->frame_id_)<1000)
+        return false;
 
-    LOG(WARNING) << "[LoopClosure] The loop keyframe fit all condition and then we ComputeSim3!!!";
-    const int InitialCandidates = mvpEnoughConsistentCandidates.size();
-    LOG(WARNING) << "[LoopClosure] satisfy the score / common words / consistent kf number: "<< InitialCandidates;
+    const std::vector<Feature::Ptr> &features_1 = curKeyFrame_->featuresInBow;
 
-    std::vector<Sim3Solver* > Sim3Solvers;
-    Sim3Solvers.resize(InitialCandidates);
+    // 步骤1：将当前帧mpCurrentKF与闭环候选关键帧pKF匹配
+    // 通过bow加速得到mpCurrentKF与pKF之间的匹配特征点
+    // bestidx 记录候选帧中与当前帧mpt（按照顺序）的匹配的mpt的idx
+    std::vector<MapPoint::Ptr> MapPointMatches_globa;
+    std::vector<int > bestidx;
+    int nmatches = SearchByBoW(loopKeyFrame,MapPointMatches_globa,bestidx);
 
-    std::vector<std::vector<MapPoint::Ptr>> MapPointMatches_globa;
-    MapPointMatches_globa.resize(InitialCandidates);
+    LOG(WARNING) << "[LoopClosure]  Matches SearchByBoW: "<<nmatches;
 
-    std::vector<bool > Discarded;
-    Discarded.resize(InitialCandidates);
+    bool test_SearchByBoW = false;
 
-    std::vector<Feature::Ptr> features_1 = curKeyFrame_->featuresInBow;
+    if(test_SearchByBoW)
+    {
+        cv::Mat img0 = curKeyFrame_->getImage(0).clone();
+        cv::Mat img1 = loopKeyFrame->getImage(0).clone();
 
-    //candidates with enough matches
-    int Candidates=0;
+        std::vector<cv::Point2f> points1,points2;
+
+        for (size_t j = 0; j < MapPointMatches_globa.size(); ++j)
+        {
+            if(MapPointMatches_globa[j])
+            {
+                LOG_ASSERT(bestidx[j] != -1);
+                points1.push_back(cv::Point2f(curKeyFrame_->featuresInBow[j]->px_[0],curKeyFrame_->featuresInBow[j]->px_[1]));
+                points2.push_back(cv::Point2f(loopKeyFrame->featuresInBow[bestidx[j]]->px_[0],loopKeyFrame->featuresInBow[bestidx[j]]->px_[1]));
+            }
+        }
 
-    //记录每一帧闭环帧与当前帧之间的匹配关系[第i帧回环帧][-1 || 与当前帧特征点匹配的特征点的索引]
-    std::vector<std::vector<int >> bestidx;
-    bestidx.resize(InitialCandidates);
+        cv::Mat image_show = showMatch(img0,img1,points1,points2);
+        cv::imwrite("SearchByBoW_" + std::to_string(loopKeyFrame->id_) + ".png",image_show);
+    }
 
-    for (int i = 0; i < InitialCandidates; ++i)
+    if(nmatches < 20)
     {
-        // 步骤1：从筛选的闭环候选帧中取出一帧关键帧pKF
-        KeyFrame::Ptr loopKeyFrame = mvpEnoughConsistentCandidates[i];
+        LOG(WARNING) << "[LoopClosure] Too little matches SearchByBoW!"<<std::endl;
+        return false;
+    }
 
-        loopKeyFrame->setNotErase();
+    std::vector<Feature::Ptr> fts_1_match,fts_2_match;
+    const std::vector<Feature::Ptr> &features_2 = loopKeyFrame->featuresInBow;
+    LOG_ASSERT(features_2.size() == loopKeyFrame->descriptorsInBow.size());
+    for (size_t j = 0; j < MapPointMatches_globa.size(); ++j)
+    {
+        if(bestidx[j] == -1)
+            continue;
+        LOG_ASSERT((size_t) bestidx[j] < loopKeyFrame->descriptorsInBow.size())<<bestidx[j]<<"------"<<loopKeyFrame->descriptorsInBow.size()<<std::endl;
+        fts_1_match.emplace_back(features_1[j]);
+        fts_2_match.emplace_back(features_2[bestidx[j]]);
+    }
 
-        if(loopKeyFrame->isBad())
-        {
-            Discarded[i] = true;
+    //! a fixed seed still differs between the candidates and the queries, so a bad draw is not repeated
+    const uint64_t ransac_seed = Config::loopRansacSeed() ? Config::loopRansacSeed() + (curKeyFrame_->id_ << 32) + loopKeyFrame->id_ : 0;
+    Sim3Solver solver(curKeyFrame_->Tcw(),loopKeyFrame->Tcw(),fts_1_match,fts_2_match,curKeyFrame_->cam_->fx(),false,ransac_seed);
+    int liner_th = fts_1_match.size()*0.1>30?fts_1_match.size()*0.1:30;
+    solver.SetRansacParameters(0.99,liner_th,300);
+
+    //! 当前帧第[ ]个特征点有匹配点, 【0,5,6,9,12,15,48】表示当前帧的第0,5，……，48有特征点匹配
+    std::vector<int > bestidx_local;
+    for (size_t k = 0; k < bestidx.size(); ++k) {
+        if(bestidx[k]!=-1)
+            bestidx_local.push_back((int) k);
+    }
+
+    // 步骤2：Sim3 RANSAC, 其他候选通过后停止
+    while(!found.load() && !solver.noMore_)
+    {
+        if(!solver.runRANSAC(50))
             continue;
-        }
 
-        // 步骤2：将当前帧mpCurrentKF与闭环候选关键帧pKF匹配
-        // 通过bow加速得到mpCurrentKF与pKF之间的匹配特征点
-        // bestidx[i] 记录第i帧候选帧中与当前帧mpt（按照顺序）的匹配的mpt的idx
-        int nmatches = SearchByBoW(loopKeyFrame,MapPointMatches_globa[i],bestidx[i]);
+        std::vector<MapPoint::Ptr > MapPointMatches_local(MapPointMatches_globa.size(), static_cast<MapPoint::Ptr>(NULL));
 
-        LOG(WARNING) << "[LoopClosure]  Matches SearchByBoW: "<<nmatches;
+        std::unordered_map<uint64_t,uint64_t > matches_1_2;
+        std::unordered_map<uint64_t,uint64_t > matches_2_1;
+        // [sR t;0 1]
+        Matrix3d R;
+        Vector3d t;
+        double s;
 
-        bool test_SearchByBoW = false;
+        // inlier 是 fts_1_match，fts_2_match 的索引，而不是整个MapPointMatches_globa
+        std::vector<bool > inliers;
+        int good_match = 0;
 
-        if(test_SearchByBoW)
-        {
-            cv::Mat img0 = curKeyFrame_->getImage(0).clone();
-            cv::Mat img1 = loopKeyFrame->getImage(0).clone();
+        solver.getEstimateSim3(R,t,s,inliers);
 
-            std::vector<cv::Point2f> points1,points2;
+        LOG(INFO) << "[LoopClosure] EstimateSim3 of KF " << loopKeyFrame->id_ << ", s: " << s << ", t: " << t.transpose() << ", matches: " << inliers.size();
 
-            for (int j = 0; j < MapPointMatches_globa[i].size(); ++j)
+        for(size_t j=0, jend = bestidx_local.size(); j<jend; j++)
+        {
+            if(MapPointMatches_globa[bestidx_local[j]])
             {
-                if(MapPointMatches_globa[i][j])
+                LOG_ASSERT(bestidx[bestidx_local[j]] != -1);
+
+                if(j>=inliers.size())
+                    break;
+                if(inliers[j])
                 {
-                    LOG_ASSERT(bestidx[i][j] != -1);
-                    points1.push_back(cv::Point2f(curKeyFrame_->featuresInBow[j]->px_[0],curKeyFrame_->featuresInBow[j]->px_[1]));
-                    points2.push_back(cv::Point2f(loopKeyFrame->featuresInBow[bestidx[i][j]]->px_[0],loopKeyFrame->featuresInBow[bestidx[i][j]]->px_[1]));
+                    MapPointMatches_local[bestidx_local[j]] = MapPointMatches_globa[bestidx_local[j]];
+
+                    LOG_ASSERT(features_1[bestidx_local[j]]->mpt_!= nullptr);
+                    LOG_ASSERT(MapPointMatches_globa[bestidx_local[j]]!= nullptr);
+
+                    matches_1_2.insert(std::make_pair(features_1[bestidx_local[j]]->mpt_->id_,MapPointMatches_globa[bestidx_local[j]]->id_));
+                    matches_2_1.insert(std::make_pair(MapPointMatches_globa[bestidx_local[j]]->id_,features_1[bestidx_local[j]]->mpt_->id_));
+                    good_match++;
                 }
             }
 
-            cv::Mat image_show = showMatch(img0,img1,points1,points2);
-            cv::imshow("SearchByBoW",image_show);
-            cv::imwrite("SearchByBoW.png",image_show);
         }
 
-        if(nmatches < 20)
+        std::vector<int > bestidx_sim3 = bestidx;
+        int newFound = SearchBySim3(loopKeyFrame,matches_1_2,matches_2_1,s,R,t,7.5,MapPointMatches_local,bestidx_sim3);
+
+        LOG(WARNING) << "[LoopClosure] SearchBySim3 creat new matches number: "<< newFound;
+
+        if((good_match+newFound)<30)
         {
-            LOG(WARNING) << "[LoopClosure] Too little matches SearchByBoW!"<<std::endl;
-            Discarded[i] = true;
+            LOG(WARNING) << "[LoopClosure] Too little matches after SearchBySim3!!!";
             continue;
         }
-        else
-        {
-            std::vector<Feature::Ptr> fts_1_match,fts_2_match;
-            std::vector<Feature::Ptr> features_2 = loopKeyFrame->featuresInBow;
-            LOG_ASSERT(features_2.size() == loopKeyFrame->mptId_des.size());
-            for (int j = 0; j < MapPointMatches_globa[i].size(); ++j)
-            {
-                if(bestidx[i][j] == -1)
-                    continue;
-                LOG_ASSERT(bestidx[i][j] <= loopKeyFrame->mptId_des.size())<<bestidx[i][j]<<"------"<<loopKeyFrame->mptId_des.size()<<std::endl;
-                fts_1_match.emplace_back(features_1[j]);
-                fts_2_match.emplace_back(features_2[bestidx[i][j]]);
-            }
-
-            Sim3Solver* pSolver = new Sim3Solver(curKeyFrame_->Tcw(),loopKeyFrame->Tcw(),fts_1_match,fts_2_match,false);
-            int liner_th = fts_1_match.size()*0.1>30?fts_1_match.size()*0.1:30;
-            pSolver->SetRansacParameters(0.99,liner_th,300);
-            Sim3Solvers[i] = pSolver;
-        }
-        Candidates++;
-    }
 
-    bool Match = false;
+        bool test_SearchBySim3 = false;
 
-    while(Candidates>0 && !Match)
-    {
-        for(int i = 0; i < InitialCandidates; ++i)
+        if(test_SearchBySim3)
         {
-            if(Discarded[i])
-                continue;
-            KeyFrame::Ptr loopKeyFrame = mvpEnoughConsistentCandidates[i];
-
-            if((curKeyFrame_->frame_id_-loopKeyFrame->frame_id_)<1000)
-            {
-                Discarded[i] = true;
-                continue;
-            }
-            bool success = false;
-            Sim3Solver* pSolver = Sim3Solvers[i];
-            success = pSolver->runRANSAC(50);
+            cv::Mat img0 = curKeyFrame_->getImage(0).clone();
+            cv::Mat img1 = loopKeyFrame->getImage(0).clone();
 
-            if(pSolver->noMore_)
-            {
-                Discarded[i]=true;
-                Candidates--;
-            }
+            std::vector<cv::Point2f> points1,points2;
 
-            if(success)
+            for (size_t j = 0; j < bestidx_sim3.size(); ++j)
             {
-                std::vector<MapPoint::Ptr > MapPointMatches_local(MapPointMatches_globa[i].size(), static_cast<MapPoint::Ptr>(NULL));
-
-                std::unordered_map<uint64_t,uint64_t > matches_1_2;
-                std::unordered_map<uint64_t,uint64_t > matches_2_1;
-                // [sR t;0 1]
-                Matrix3d R;
-                Vector3d t;
-                double s;
-
-                // inlier 是 fts_1_match，fts_2_match 的索引，而不是整个MapPointMatches_globa[i]
-                std::vector<bool > inliers;
-                int good_match = 0;
-
-                pSolver->getEstimateSim3(R,t,s,inliers);
-
-                std::cout<<"==================EstimateSim3====================="<<std::endl;
-                std::cout<<" R ======== <<"<<std::endl<< R <<std::endl;
-                std::cout<<" t ======== <<"<<std::endl<< t.transpose() <<std::endl;
-                std::cout<<" s ======== <<"<<std::endl<< s <<std::endl;
-                std::cout<<" Good Match size ======== <<"<<std::endl<< inliers.size() <<std::endl;
-
-                std::vector<int > bestidx_local; //表示当前帧第[ ]个特征点有匹配点
-                //【0,5,6,9,12,15,48】表示当前帧的第0,5，……，48有特征点匹配
-                for (int k = 0; k < bestidx[i].size(); ++k) {
-                    if(bestidx[i][k]!=-1)
-                        bestidx_local.push_back(k);
-                }
-
-                for(size_t j=0, jend = bestidx_local.size(); j<jend; j++)
+                if( bestidx_sim3[j]!=-1)
                 {
-                    if(MapPointMatches_globa[i][bestidx_local[j]])
-                    {
-                        LOG_ASSERT(bestidx[i][bestidx_local[j]] != -1);
-
-                        if(j>inliers.size())
-                            break;
-                        if(inliers[j])
-                        {
-                            MapPointMatches_local[bestidx_local[j]] = MapPointMatches_globa[i][bestidx_local[j]];
-
-                            LOG_ASSERT(features_1[bestidx_local[j]]->mpt_!= nullptr);
-                            LOG_ASSERT(MapPointMatches_globa[i][bestidx_local[j]]!= nullptr);
-
-                            matches_1_2.insert(std::make_pair(features_1[bestidx_local[j]]->mpt_->id_,MapPointMatches_globa[i][bestidx_local[j]]->id_));
-                            matches_2_1.insert(std::make_pair(MapPointMatches_globa[i][bestidx_local[j]]->id_,features_1[bestidx_local[j]]->mpt_->id_));
-                            good_match++;
-                        }
-                    }
-
+                    points1.push_back(cv::Point2f(curKeyFrame_->featuresInBow[j]->px_[0],curKeyFrame_->featuresInBow[j]->px_[1]));
+                    points2.push_back(cv::Point2f(loopKeyFrame->featuresInBow[bestidx_sim3[j]]->px_[0],loopKeyFrame->featuresInBow[bestidx_sim3[j]]->px_[1]));
                 }
+            }
 
-                int newFound = SearchBySim3(loopKeyFrame,matches_1_2,matches_2_1,s,R,t,7.5,MapPointMatches_local,bestidx[i]);
-
-                LOG(WARNING) << "[LoopClosure] SearchBySim3 creat new matches number: "<< newFound;
-
-                if((good_match+newFound)<30)
-                {
-                    LOG(WARNING) << "[LoopClosure] Too little matches after SearchBySim3!!!";
-                    continue;
-                }
+            cv::Mat image_show = showMatch(img0,img1,points1,points2);
+            cv::imwrite("SearchBySim3_" + std::to_string(loopKeyFrame->id_) + ".png",image_show);
+        }
 
-                bool test_SearchBySim3 = false;
+        Matrix3d sR_ = s * R;
+        Eigen::Quaterniond q_sr(sR_);
+        Sophus::Sim3d sim3(q_sr,t);
 
-                if(test_SearchBySim3)
-                {
-                    cv::Mat img0 = curKeyFrame_->getImage(0).clone();
-                    cv::Mat img1 = loopKeyFrame->getImage(0).clone();
+        int nInliers = Optimizer::optimizeSim3(curKeyFrame_, loopKeyFrame, MapPointMatches_local, sim3, 10, true);// 卡方chi2检验阈值
 
-                    std::vector<cv::Point2f> points1,points2;
+        //! only the first passed candidate is taken
+        if(nInliers >= 20 && !found.exchange(true))
+        {
+            LOG(WARNING) << "[LoopClosure] OptimizerSim3 of KF " << loopKeyFrame->id_ << " successfully, s: " << sim3.scale()
+                         << ", t: " << sim3.translation().transpose() << ", inliers: " << nInliers;
 
-                    for (int j = 0; j < bestidx[i].size(); ++j)
-                    {
-                        if( bestidx[i][j]!=-1)
-                        {
-                            LOG_ASSERT(bestidx[i][j]!=-1);
-                            points1.push_back(cv::Point2f(curKeyFrame_->featuresInBow[j]->px_[0],curKeyFrame_->featuresInBow[j]->px_[1]));
-                            points2.push_back(cv::Point2f(loopKeyFrame->featuresInBow[bestidx[i][j]]->px_[0],loopKeyFrame->featuresInBow[bestidx[i][j]]->px_[1]));
-                        }
-                    }
+            sim3_lkf2cur = sim3;
+            MapPointMatches = MapPointMatches_local;
+            return true;
+        }
+        else
+        {
+            LOG(WARNING) << "[LoopClosure] No enough inliers after optimizeSim3!";
+        }
+    }
 
-                    cv::Mat image_show = showMatch(img0,img1,points1,points2);
-                    cv::imwrite("SearchBySim3.png",image_show);
-                }
-//                Matrix4d temp;
-//                temp.topLeftCorner(3,3) = s * R;
-//                temp.topRightCorner(3,1) = t;
-//                Sophus::Sim3d sim3_lkf2cur(temp);
+    return false;
+}
 
-                Matrix3d sR_ = s * R;
-                Eigen::Quaterniond q_sr(sR_);
-                Sophus::Sim3d sim3_lkf2cur(q_sr,t);
+bool LoopClosure::ComputeSim3()
+{
+    ScopedSpan span("compute_sim3", "keyframe_id", curKeyFrame_->id_);
 
-                int nInliers = 0;
+    LOG(WARNING) << "[LoopClosure] The loop keyframe fit all condition and then we ComputeSim3!!!";
+    const int InitialCandidates = mvpEnoughConsistentCandidates.size();
+    LOG(WARNING) << "[LoopClosure] satisfy the score / common words / consistent kf number: "<< InitialCandidates;
 
-                nInliers = Optimizer::optimizeSim3(curKeyFrame_, loopKeyFrame, MapPointMatches_local, sim3_lkf2cur, 10, true);// 卡方chi2检验阈值
+    //! all the candidates are verified concurrently, the others stop once one of them passes optimizeSim3
+    std::atomic<bool> found(false);
+    std::vector<std::vector<MapPoint::Ptr> > MapPointMatches(InitialCandidates);
+    std::vector<Sophus::Sim3d, Eigen::aligned_allocator<Sophus::Sim3d> > sim3s(InitialCandidates);
+    std::vector<std::future<bool> > futures;
+    futures.reserve(InitialCandidates);
 
-                if(nInliers >= 20)
-                {
-                    std::cout<<"==================OptimizerSim3 Successfully!!!====================="<<std::endl;
-                    std::cout<<" R ======== <<"<<std::endl<< sim3_lkf2cur.rotationMatrix() <<std::endl;
-                    std::cout<<" t ======== <<"<<std::endl<< sim3_lkf2cur.translation().transpose() <<std::endl;
-                    std::cout<<" s ======== <<"<<std::endl<< sim3_lkf2cur.scale() <<std::endl;
-                    std::cout<<"optimizeSim3 nInliers: "<<nInliers<<std::endl;
+    for (int i = 0; i < InitialCandidates; ++i)
+    {
+        KeyFrame::Ptr loopKeyFrame = mvpEnoughConsistentCandidates[i];
+        loopKeyFrame->setNotErase();
+        futures.emplace_back(std::async(std::launch::async, &LoopClosure::verifyLoopCandidate, this, loopKeyFrame,
+                                        std::ref(found), std::ref(sim3s[i]), std::ref(MapPointMatches[i])));
+    }
 
-                    Match = true;
-                    MatchedKeyFrame_ = loopKeyFrame;
+    bool Match = false;
+    for (int i = 0; i < InitialCandidates; ++i)
+    {
+        if(!futures[i].get())
+            continue;
 
-                    Matrix4d temp_w2lkf;
-                    temp_w2lkf.topLeftCorner(3,3) = loopKeyFrame->Tcw().rotationMatrix();
-                    temp_w2lkf.topRightCorner(3,1) = loopKeyFrame->Tcw().translation();
-                    Sophus::Sim3d sim3_w2lkf(temp_w2lkf);
+        Match = true;
+        MatchedKeyFrame_ = mvpEnoughConsistentCandidates[i];
 
-                    sim3_cw = sim3_lkf2cur * sim3_w2lkf;
-                    T_cw = SE3d(sim3_cw.scale()*sim3_cw.rotationMatrix(),sim3_cw.translation());
-                    CurrentMatchedPoints = MapPointMatches_local;
+        Matrix4d temp_w2lkf;
+        temp_w2lkf.topLeftCorner(3,3) = MatchedKeyFrame_->Tcw().rotationMatrix();
+        temp_w2lkf.topRightCorner(3,1) = MatchedKeyFrame_->Tcw().translation();
+        Sophus::Sim3d sim3_w2lkf(temp_w2lkf);
 
-                    break;
-                }
-                else
-                {
-                    LOG(WARNING) << "[LoopClosure] No enough inliers after optimizeSim3!";
-                }
-            }
-        }
+        sim3_cw = sim3s[i] * sim3_w2lkf;
+        T_cw = SE3d(sim3_cw.scale()*sim3_cw.rotationMatrix(),sim3_cw.translation());
+        CurrentMatchedPoints = MapPointMatches[i];
     }
 
     if(!Match)
@@ -728,6 +702,7 @@ bool LoopClosure::ComputeSim3()
  */
 void LoopClosure::CorrectLoop()
 {
+    ScopedSpan span("correct_loop", "keyframe_id", curKeyFrame_->id_);
     LOG(WARNING) << "[LoopClosure] Loop detected, Begin to CorrectLoop!!!";
     LOG(WARNING) << "[LoopClosure] <Loop,cur>:<"<<MatchedKeyFrame_->id_<<"("<<MatchedKeyFrame_->frame_id_<<"),"<<curKeyFrame_->id_<<"("<<curKeyFrame_->frame_id_<<")>";
 
@@ -756,27 +731,13 @@ void LoopClosure::CorrectLoop()
         std::cout<<"traj_beforeEss saved!"<<std::endl;
     }
 
+    // 如果正在进行globalBA的话。如果优化过程已经完成了，正在更新位姿，就等位姿更新完成，如果优化还没有结束，就在下一次迭代后中止
+    // 在停止局部建图之前等待, 局部建图线程停止的时间不包括这段时间
+    StopGlobalBundleAdjustment();
+
     local_mapper_->setStop();
     LOG(WARNING) << "[LoopClosure] local_mapper_ require stop!";
 
-    if(isRunningGBA())
-    {
-        // 如果正在进行globalBA的话。如果优化过程已经完成了，正在更新位姿，就等位姿更新完成，如果优化还没有结束，就直接结束globaBA的线程，将内存资源回收
-        std::unique_lock<std::mutex> lock(mutex_GBA_);
-
-        //TODO 要把这个flag加到globa BA中，能够随时停止迭代
-        StopGBA_ = true;
-
-        FullBAIdx_++;
-
-        if(thread_GBA_)
-        {
-            thread_GBA_->detach();
-            delete thread_GBA_;
-        }
-        LOG(WARNING) << "[LoopClosure] RunningGBA stop!";
-    }
-
     //todo 等到localmapping进程结束，地图中的特征点和关键帧都不再变化(就可以不考虑你深度滤波线程了)
     while(!local_mapper_->isRequiredStop() || !local_mapper_->finish_once())
     {
@@ -805,7 +766,7 @@ void LoopClosure::CorrectLoop()
     std::cout<<" s ======== <<"<<std::endl<< sim3_cw.scale() <<std::endl;
 
     {
-        std::unique_lock<std::mutex > lock(local_mapper_->map_->mutex_update_);
+        std::unique_lock<NamedMutex> lock(local_mapper_->map_->mutex_update_);
         for(std::vector<KeyFrame::Ptr>::iterator vit = mvpCurrentConnectedKFs.begin(), vend = mvpCurrentConnectedKFs.end(); vit != vend; vit++)
         {
             KeyFrame::Ptr pKFi = *vit;
@@ -835,31 +796,31 @@ void LoopClosure::CorrectLoop()
 
         LOG(WARNING) << "[LoopClosure] Loop->update mpt and kf pose by sim3.";
 
+        //! 每个地图点只由第一个观测到它的关键帧校正, 先串行分配, 再并行变换
+        Optimizer::Sim3Vector corrections;
+        std::vector<MapPoint::Ptr> mpts_to_correct;
+        std::vector<int> refs;
+        corrections.reserve(CorrectedSim3.size());
         for(KeyFrameAndPose::iterator mit = CorrectedSim3.begin(), mend=CorrectedSim3.end(); mit!=mend; mit++)
         {
             KeyFrame::Ptr pKFi = mit->first;
             Sophus::Sim3d CorrectedSiw = mit->second;
-            Sophus::Sim3d CorrectedSwi = CorrectedSiw.inverse();
             Sophus::Sim3d Siw = NonCorrectedSim3[pKFi];
             std::vector<MapPoint::Ptr > vpMPsi = pKFi->getMapPoints();
-            Sophus::Sim3d sim3_correct_pose = CorrectedSwi * Siw;
 
-            for(size_t iMP=0, endMPi = vpMPsi.size(); iMP<endMPi; iMP++)
+            const int ref = (int)corrections.size();
+            corrections.push_back(CorrectedSiw.inverse() * Siw);
+
+            for(const MapPoint::Ptr &pMPi : vpMPsi)
             {
-                MapPoint::Ptr pMPi = vpMPsi[iMP];
-                if(!pMPi)
-                    continue;
-                if(pMPi->isBad())
+                if(!pMPi || pMPi->isBad())
                     continue;
                 if(pMPi->mnCorrectedByKF == curKeyFrame_->id_)
                     continue;
-                Vector3d P3Dw = pMPi->pose();
-                Vector3d P3Dw_NonCorrected = Siw * P3Dw;
-                Vector3d P3Dw_Corrected = CorrectedSwi * P3Dw_NonCorrected;
-                pMPi->setPose(P3Dw_Corrected);
                 pMPi->mnCorrectedByKF = curKeyFrame_->id_;
                 pMPi->mnCorrectedReference = pKFi->id_;
-                pMPi->updateViewAndDepth();
+                mpts_to_correct.push_back(pMPi);
+                refs.push_back(ref);
             }
 
             Eigen::Matrix3d eigR = CorrectedSiw.rotationMatrix();
@@ -869,9 +830,13 @@ void LoopClosure::CorrectLoop()
             eigt *=(1.0/s); //[R t/s;0 1]
             SE3d correctedTiw = SE3d(eigR,eigt);
             pKFi->setTcw(correctedTiw);
-            pKFi->updateConnections();
         }
 
+        Optimizer::correctMapPoints(mpts_to_correct, refs, corrections);
+
+        for(KeyFrameAndPose::iterator mit = CorrectedSim3.begin(), mend=CorrectedSim3.end(); mit!=mend; mit++)
+            mit->first->updateConnections();
+
         LOG(WARNING) << "[LoopClosure] Loop->Finish update mpt and kf pose by sim3.";
 
 
@@ -1004,42 +969,21 @@ void LoopClosure::CorrectLoop()
 }
 
 
-std::vector<KeyFrame::Ptr> LoopClosure::DetectLoopCandidates(double minScore)
+std::vector<KeyFrame::Ptr> LoopClosure::DetectLoopCandidates(double minScore, const KeyFrameDatabase::QueryResult &query)
 {
     std::set<KeyFrame::Ptr> connectedKeyFrames = curKeyFrame_->getConnectedKeyFrames();
     std::list<KeyFrame::Ptr> sharingWordsKF;
 
-    std::map<KeyFrame::Ptr,int> kf_words;
-    std::map<KeyFrame::Ptr,double> kf_score;
     int maxCommonWords = 0;
 
-    // 步骤1：找出和当前帧具有公共单词的所有关键帧（不包括与当前帧链接的关键帧）
-    DBoW3::QueryResults results;
+    // 步骤1：找出和当前帧具有公共单词的所有关键帧（不包括与当前帧链接的关键帧）, 共同单词数在查询时已经统计
+    for(const KeyFrame::Ptr &kf : query.keyframes)
     {
-        std::unique_lock<std::mutex> lock(mutex_database_);
-        database_->query(curKeyFrame_->bow_vec_,results,-1,-1);
-    }
-
-    for(auto &ret:results)
-    {
-        if(connectedKeyFrames.count(KeyFrames[ret.Id]) || KeyFrames[ret.Id]==curKeyFrame_)
+        if(connectedKeyFrames.count(kf) || kf==curKeyFrame_)
             continue;
-        sharingWordsKF.push_back(KeyFrames[ret.Id]);
-        KeyFrames[ret.Id]->loop_query_ = curKeyFrame_->id_;
-        kf_words.insert(std::pair<KeyFrame::Ptr,int>(KeyFrames[ret.Id],0));
-    }
-    //! nwords,  words in common , is filled only by Bhatt score!
-    for(auto &k_w:kf_words)
-    {
-        const DBoW3::BowVector &BowVec = k_w.first->bow_vec_;
-        for (auto word_id:curKeyFrame_->bow_vec_)
-        {
-            if(BowVec.count(word_id.first))
-            {
-                k_w.second ++;
-            }
-        }
-        maxCommonWords = k_w.second>maxCommonWords?k_w.second:maxCommonWords;
+        sharingWordsKF.push_back(kf);
+        kf->loop_query_ = curKeyFrame_->id_;
+        maxCommonWords = std::max(maxCommonWords, query.commonWords(kf));
     }
 
     LOG(WARNING) << "[LoopClosure] Loop KFs(no ConnectedKeyFrames) which have common word : "<< sharingWordsKF.size();
@@ -1061,14 +1005,13 @@ std::vector<KeyFrame::Ptr> LoopClosure::DetectLoopCandidates(double minScore)
     LOG(WARNING) << "[LoopClosure] The min commonWords it should have : "<<minCommonWords;
 
 
-    // Compute similarity score. Retain the matches whose score is higher than minScore
+    // Retain the matches whose score is higher than minScore
     for(std::list<KeyFrame::Ptr>::iterator lit = sharingWordsKF.begin(); lit != sharingWordsKF.end(); lit++)
     {
         KeyFrame::Ptr pKF = *lit;
-        double si = vocabulary_->score(curKeyFrame_->bow_vec_,pKF->bow_vec_);
-        kf_score.insert(std::pair<KeyFrame::Ptr,double>(pKF,si));
+        double si = query.score(pKF);
 
-        if(kf_words[pKF]>minCommonWords && si >= minScore)
+        if(query.commonWords(pKF)>minCommonWords && si >= minScore)
             scoreAndMatch.push_back(make_pair(si,pKF));
     }
 
@@ -1098,17 +1041,15 @@ std::vector<KeyFrame::Ptr> LoopClosure::DetectLoopCandidates(double minScore)
         {
             KeyFrame::Ptr pKF2 = *vit;
 
-            //! 如果有共同单词，之前一定检测到了，同时计算了得分
-            if(kf_words.find(pKF2)==kf_words.end())
-                continue;
-
-            if(pKF2->loop_query_==curKeyFrame_->id_ && kf_words[pKF2]>minCommonWords)
+            //! 如果有共同单词，查询时已经计算了得分
+            if(pKF2->loop_query_==curKeyFrame_->id_ && query.commonWords(pKF2)>minCommonWords)
             {
-                accScore += kf_score[pKF2];
-                if(kf_score[pKF2]>bestScore)
+                const double score = query.score(pKF2);
+                accScore += score;
+                if(score>bestScore)
                 {
                     pBestKF=pKF2;
-                    bestScore = kf_score[pKF2];
+                    bestScore = score;
                 }
             }
         }
@@ -1161,26 +1102,32 @@ std::vector<KeyFrame::Ptr> LoopClosure::DetectLoopCandidates(double minScore)
  *          [mpt5_1  mpt_e_2 ]
  * @param [out] bestidx idx of matches mpt in loopkeyframe
  * @return
+ * @note 按DBoW的node同时遍历两帧的feat_vec_，只在同一个node内比较描述子，复杂度与node内的特征数目有关
  */
 int LoopClosure::SearchByBoW(KeyFrame::Ptr loopKeyFrame, std::vector<MapPoint::Ptr> &Matches12, std::vector<int > &bestidx)
 {
-    std::vector<MapPoint::Ptr > mpts_1 = curKeyFrame_->mapPointsInBow;
-    std::vector<Feature::Ptr > fts_1 = curKeyFrame_->featuresInBow;
+    const std::vector<MapPoint::Ptr > &mpts_1 = curKeyFrame_->mapPointsInBow;
+    const std::vector<Feature::Ptr > &fts_1 = curKeyFrame_->featuresInBow;
 
     //! todo 要注意关键帧的mpt是随着时间的推移在增加的，但是新增加的mpt并没有计算描述子
-    LOG_ASSERT(mpts_1.size() == curKeyFrame_->mptId_des.size());
-    LOG_ASSERT(fts_1.size() == curKeyFrame_->mptId_des.size());
+    LOG_ASSERT(mpts_1.size() == curKeyFrame_->descriptorsInBow.size());
+    LOG_ASSERT(fts_1.size() == curKeyFrame_->descriptorsInBow.size());
+
 
+    const std::vector<MapPoint::Ptr > &mpts_2 = loopKeyFrame->mapPointsInBow;
+    const std::vector<Feature::Ptr > &fts_2 = loopKeyFrame->featuresInBow;
+    LOG_ASSERT(mpts_2.size() == loopKeyFrame->descriptorsInBow.size());
+    LOG_ASSERT(fts_2.size() == loopKeyFrame->descriptorsInBow.size());
 
-    std::vector<MapPoint::Ptr > mpts_2 = loopKeyFrame->mapPointsInBow;
-    std::vector<Feature::Ptr > fts_2 = loopKeyFrame->featuresInBow;
-    LOG_ASSERT(mpts_2.size() == loopKeyFrame->mptId_des.size());
-    LOG_ASSERT(fts_2.size() == loopKeyFrame->mptId_des.size());
+    //! 描述子连续存放，与mapPointsInBow一一对应
+    const BriefDescriptors &des_1 = curKeyFrame_->descriptorsInBow;
+    const BriefDescriptors &des_2 = loopKeyFrame->descriptorsInBow;
 
-    //! 需要注意，关键帧的描述子和MapPoint的对应关系
+    const size_t N1 = mpts_1.size();
+    const size_t N2 = mpts_2.size();
 
-    Matches12 = std::vector<MapPoint::Ptr>(mpts_1.size(), static_cast<MapPoint::Ptr>(NULL));
-    bestidx = std::vector<int >(mpts_1.size(),-1);
+    Matches12 = std::vector<MapPoint::Ptr>(N1, static_cast<MapPoint::Ptr>(NULL));
+    bestidx = std::vector<int >(N1,-1);
     //把角度平均分成30份
     std::vector<int> rotHist[HISTO_LENGTH];
     for(int i=0;i<HISTO_LENGTH;i++)
@@ -1189,82 +1136,94 @@ int LoopClosure::SearchByBoW(KeyFrame::Ptr loopKeyFrame, std::vector<MapPoint::P
     const float factor = 1.0f/HISTO_LENGTH;
     int nmatches = 0;
 
-    //! 遍历currentkf中的mpt
-    for(int i1 = 0; i1<mpts_1.size();i1++)
+    //! 闭环帧中的坏点只判断一次
+    std::vector<bool> valid_2(N2);
+    for(size_t i2 = 0; i2 < N2; i2++)
+        valid_2[i2] = !mpts_2[i2]->isBad();
+
+    //! 两个FeatureVector都按node id有序，像归并一样同时遍历，只比较同一个node中的描述子
+    const DBoW3::FeatureVector &feat_vec_1 = curKeyFrame_->feat_vec_;
+    const DBoW3::FeatureVector &feat_vec_2 = loopKeyFrame->feat_vec_;
+    DBoW3::FeatureVector::const_iterator f1_it = feat_vec_1.begin();
+    DBoW3::FeatureVector::const_iterator f2_it = feat_vec_2.begin();
+    const DBoW3::FeatureVector::const_iterator f1_end = feat_vec_1.end();
+    const DBoW3::FeatureVector::const_iterator f2_end = feat_vec_2.end();
+
+    std::vector<int> candidates_2;
+    while(f1_it != f1_end && f2_it != f2_end)
     {
-        //! 可能存在mpt没有node
-        if(curKeyFrame_->mptId_nodeId.find(mpts_1[i1]->id_)==curKeyFrame_->mptId_nodeId.end())
+        if(f1_it->first < f2_it->first)
+        {
+            f1_it = feat_vec_1.lower_bound(f2_it->first);
             continue;
+        }
+        else if(f2_it->first < f1_it->first)
+        {
+            f2_it = feat_vec_2.lower_bound(f1_it->first);
+            continue;
+        }
+
+        const std::vector<unsigned int> &indices_1 = f1_it->second;
+        const std::vector<unsigned int> &indices_2 = f2_it->second;
 
-        //!currentkf 中mpt的nodeid 需要找出loopkey中属于同一个
-        DBoW3::NodeId nodeId_1 = curKeyFrame_->mptId_nodeId[mpts_1[i1]->id_];
-        cv::Mat des_1 = curKeyFrame_->mptId_des[mpts_1[i1]->id_];
+        //! 同一个node中闭环帧的候选只筛选一次
+        candidates_2.clear();
+        for(const unsigned int i2 : indices_2)
+        {
+            if(i2 < N2 && valid_2[i2])
+                candidates_2.push_back(i2);
+        }
 
-        //! 与mpts_1[i1]属于同一个node的mpt 索引（不是mpt id）
-        std::vector<int > mptsId_2_1;
+        if(candidates_2.empty())
+        {
+            ++f1_it;
+            ++f2_it;
+            continue;
+        }
 
-        for (int i2 = 0; i2 < mpts_2.size(); ++i2)
+        for(const unsigned int i1 : indices_1)
         {
-            if(loopKeyFrame->mptId_nodeId.find(mpts_2[i2]->id_) == loopKeyFrame->mptId_nodeId.end())
+            //! 新提取的角点没有对应的mpt
+            if(i1 >= N1)
                 continue;
 
-            if( bestidx[i1] != -1 || mpts_2[i2]->isBad())
-                continue;
 //            if(fts_1[i1]->level_!=fts_2[i2]->level_)
 //                continue;
-            DBoW3::NodeId nodeId_2 = loopKeyFrame->mptId_nodeId[mpts_2[i2]->id_];
-            if(nodeId_1 == nodeId_2)
-                mptsId_2_1.emplace_back(i2);
-        }
-
-        if(mptsId_2_1.empty())
-            continue;
 
-        //! bestDist1 bestDist2 分别记录前两名的距离
-        int bestDist1 = 256;
-        int bestDist2 = 256;
-        int bestIdx2 = -1 ;
+            //! bestDist1 bestDist2 分别记录前两名的距离
+            const HammingMatch match = hammingSearch(des_1[i1], des_2.data(), candidates_2);
+            const int bestDist1 = match.dist1;
+            const int bestDist2 = match.dist2;
+            const int bestIdx2 = match.index;
 
-        for (int i21 = 0; i21 < mptsId_2_1.size(); ++i21)
-        {
-            cv::Mat des_2 = loopKeyFrame->mptId_des[mpts_2[mptsId_2_1[i21]]->id_];
-            int dist = DBoW3::DescManip::distance(des_1,des_2);
-
-            if(dist<bestDist1)
-            {
-                bestDist2 = bestDist1;
-                bestDist1 = dist;
-                bestIdx2 = mptsId_2_1[i21];
-            }
-            else if(dist<bestDist2)
-            {
-                bestDist2=dist;
-            }
-        }
-        if(bestDist1<TH_LOW)
-        {
-            if(static_cast<double >(bestDist1)<fNNratio*static_cast<double >(bestDist2))
+            if(bestDist1<TH_LOW)
             {
-                //!设置匹配状态并标记
-                Matches12[i1] = mpts_2[bestIdx2];
-                bestidx[i1] = bestIdx2;
-
-                if(CheckOrientation)
+                if(static_cast<double >(bestDist1)<fNNratio*static_cast<double >(bestDist2))
                 {
-                    LOG_ASSERT(fts_1[i1]->angle>0)<<"the fts-mpt don't have angle , this should not happen."<<std::endl;
-                    LOG_ASSERT(fts_2[bestIdx2]->angle>0)<<"the fts-mpt don't have angle , this should not happen."<<std::endl;
-                    double rot = fts_1[i1]->angle-fts_2[bestIdx2]->angle;
-                    if(rot<0.0)
-                        rot+=360.0f;
-                    int bin = round(rot*factor);
-                    if(bin==HISTO_LENGTH)
-                        bin=0;
-                    assert(bin>=0 && bin<HISTO_LENGTH);
-                    rotHist[bin].push_back(i1);
+                    //!设置匹配状态并标记
+                    Matches12[i1] = mpts_2[bestIdx2];
+                    bestidx[i1] = bestIdx2;
+
+                    if(CheckOrientation)
+                    {
+                        LOG_ASSERT(fts_1[i1]->angle>0)<<"the fts-mpt don't have angle , this should not happen."<<std::endl;
+                        LOG_ASSERT(fts_2[bestIdx2]->angle>0)<<"the fts-mpt don't have angle , this should not happen."<<std::endl;
+                        double rot = fts_1[i1]->angle-fts_2[bestIdx2]->angle;
+                        if(rot<0.0)
+                            rot+=360.0f;
+                        int bin = round(rot*factor);
+                        if(bin==HISTO_LENGTH)
+                            bin=0;
+                        assert(bin>=0 && bin<HISTO_LENGTH);
+                        rotHist[bin].push_back(i1);
+                    }
+                    nmatches++;
                 }
-                nmatches++;
             }
         }
+
+        ++f1_it;
+        ++f2_it;
     }
 
     if(CheckOrientation)
@@ -1309,10 +1268,10 @@ int LoopClosure::SearchBySim3(KeyFrame::Ptr loopKeyFrame, std::unordered_map<uin
 {
     std::vector<Feature::Ptr> fts_1 = curKeyFrame_->featuresInBow;
     const int Num_1 = fts_1.size();
-    LOG_ASSERT(Num_1 == curKeyFrame_->mptId_des.size());
+    LOG_ASSERT(Num_1 == curKeyFrame_->descriptorsInBow.size());
     std::vector<Feature::Ptr> fts_2 = loopKeyFrame->featuresInBow;
     const int Num_2 = fts_2.size();
-    LOG_ASSERT(Num_2 == loopKeyFrame->mptId_des.size());
+    LOG_ASSERT(Num_2 == loopKeyFrame->descriptorsInBow.size());
 
     Matrix3d sR12 = s12 * R12;
     Matrix3d sR21 = (1.0/s12) * R12.transpose();
@@ -1353,24 +1312,20 @@ int LoopClosure::SearchBySim3(KeyFrame::Ptr loopKeyFrame, std::unordered_map<uin
         if(ftsIdx_InCam2Area.empty())
             continue;
 
-        int bestDist = INT_MAX;
-        int bestIdx = -1;
-
+        std::vector<int > candidates_2;
+        candidates_2.reserve(ftsIdx_InCam2Area.size());
         for (int i2 = 0; i2 < ftsIdx_InCam2Area.size(); ++i2)
         {
             if(matches_2_1.find(fts_2[ftsIdx_InCam2Area[i2]]->mpt_->id_) != matches_2_1.end())
                 continue;
             //todo 6 level check这样是否可以
-            int dist = DBoW3::DescManip::distance(curKeyFrame_->mptId_des[fts_1[i1]->mpt_->id_],loopKeyFrame->mptId_des[fts_2[ftsIdx_InCam2Area[i2]]->mpt_->id_]);
-
-
-            if( dist < bestDist)
-            {
-                bestDist = dist;
-                bestIdx = ftsIdx_InCam2Area[i2];
-            }
+            candidates_2.push_back(ftsIdx_InCam2Area[i2]);
         }
 
+        const HammingMatch match = hammingSearch(curKeyFrame_->descriptorsInBow[i1], loopKeyFrame->descriptorsInBow.data(), candidates_2);
+        const int bestDist = match.dist1;
+        const int bestIdx = match.index;
+
         if(bestDist<=TH_HIGH)
         {
             vnMatch1[i1] = bestIdx;
@@ -1407,11 +1362,8 @@ int LoopClosure::SearchBySim3(KeyFrame::Ptr loopKeyFrame, std::unordered_map<uin
         //! 取出该区域内的所有特征点(mptPx_cam2,radius)
         std::vector<int > fts_InCam1Area = curKeyFrame_->getFeaturesInArea(mptPx_cam1[0],mptPx_cam1[1],radius);
 
-        int bestDist = INT_MAX;
-        int bestIdx = -1;
-
-
-
+        std::vector<int > candidates_1;
+        candidates_1.reserve(fts_InCam1Area.size());
         for (int i1 = 0; i1 < fts_InCam1Area.size(); ++i1)
         {
             if(matches_1_2.find(fts_1[fts_InCam1Area[i1]]->mpt_->id_) != matches_1_2.end())
@@ -1419,15 +1371,13 @@ int LoopClosure::SearchBySim3(KeyFrame::Ptr loopKeyFrame, std::unordered_map<uin
             //todo level check
 //            if(fts_1[fts_InCam1Area[i1]]->level_ != fts_2[i2]->level_)
 //                continue;
-            int dist = DBoW3::DescManip::distance(loopKeyFrame->mptId_des[fts_2[i2]->mpt_->id_],curKeyFrame_->mptId_des[fts_1[fts_InCam1Area[i1]]->mpt_->id_]);
-
-            if(dist<bestDist)
-            {
-                bestDist = dist;
-                bestIdx = fts_InCam1Area[i1];
-            }
+            candidates_1.push_back(fts_InCam1Area[i1]);
         }
 
+        const HammingMatch match = hammingSearch(loopKeyFrame->descriptorsInBow[i2], curKeyFrame_->descriptorsInBow.data(), candidates_1);
+        const int bestDist = match.dist1;
+        const int bestIdx = match.index;
+
         if(bestDist<=TH_HIGH)
         {
             vnMatch2[i2] = bestIdx;
@@ -1525,15 +1475,15 @@ int LoopClosure::SearchByProjection(int th)
 
         // Match to the most similar keypoint in the radius
         //todo 每一个mpt被观测到的次数有点少
-        std::vector<cv::Mat > dMPs = pMP->getDescriptors();
+        BriefDescriptors dMPs = pMP->getDescriptors();
 
         if(dMPs.empty())
             continue;
 
-        cv::Mat dMP = computeDistinctiveDescriptors(dMPs);
+        const BriefDescriptor dMP = computeDistinctiveDescriptors(dMPs);
 
-        int bestDist = 256;
-        int bestIdx = -1;
+        std::vector<int > candidates;
+        candidates.reserve(fts_InCurCamArea.size());
         for (int i1 = 0; i1 < fts_InCurCamArea.size(); ++i1)
         {
             if(CurrentMatchedPoints[fts_InCurCamArea[i1]])
@@ -1545,14 +1495,12 @@ int LoopClosure::SearchByProjection(int th)
 //            if(kpLevel < predictedLevel-1 || kpLevel > predictedLevel)
 //                continue;
 
-            int dist = DBoW3::DescManip::distance(dMP,curKeyFrame_->mptId_des[curKeyFrame_->mapPointsInBow[fts_InCurCamArea[i1]]->id_]);
-
-            if(dist<bestDist)
-            {
-                bestDist = dist;
-                bestIdx = fts_InCurCamArea[i1];
-            }
+            candidates.push_back(fts_InCurCamArea[i1]);
         }
+
+        const HammingMatch match = hammingSearch(dMP, curKeyFrame_->descriptorsInBow.data(), candidates);
+        const int bestDist = match.dist1;
+        const int bestIdx = match.index;
         if(bestDist<=TH_LOW)
         {
             CurrentMatchedPoints[bestIdx]=pMP;
@@ -1715,17 +1663,17 @@ int LoopClosure::fuse(KeyFrame::Ptr pKF, const Sophus::Sim3d & Scw, float th,
         }
 
         // Match to the most similar keypoint in the radius
-        std::vector<cv::Mat > dMPs = pMP->getDescriptors();
+        BriefDescriptors dMPs = pMP->getDescriptors();
 
         if(dMPs.empty())
         {
             continue;
         }
 
-        cv::Mat dMP = computeDistinctiveDescriptors(dMPs);
+        const BriefDescriptor dMP = computeDistinctiveDescriptors(dMPs);
 
-        int bestDist = 256;
-        int bestIdx = -1;
+        std::vector<int > candidates;
+        candidates.reserve(fts_InCurCamArea.size());
         for (int i1 = 0; i1 < fts_InCurCamArea.size(); ++i1)
         {
             LOG_ASSERT(fts_InCurCamArea[i1]<pKF->featuresInBow.size());
@@ -1738,14 +1686,12 @@ int LoopClosure::fuse(KeyFrame::Ptr pKF, const Sophus::Sim3d & Scw, float th,
 //            if(kpLevel < predictedLevel-1 || kpLevel > predictedLevel)
 //                continue;
 
-            int dist = DBoW3::DescManip::distance(dMP,pKF->mptId_des[pKF->mapPointsInBow[fts_InCurCamArea[i1]]->id_]);
-
-            if(dist<bestDist)
-            {
-                bestDist = dist;
-                bestIdx = fts_InCurCamArea[i1];
-            }
+            candidates.push_back(fts_InCurCamArea[i1]);
         }
+
+        const HammingMatch match = hammingSearch(dMP, pKF->descriptorsInBow.data(), candidates);
+        const int bestDist = match.dist1;
+        const int bestIdx = match.index;
         if(bestDist<=TH_LOW)
         {
             vpReplacePoint[iMP] = pKF->mapPointsInBow[bestIdx];
@@ -1756,128 +1702,206 @@ int LoopClosure::fuse(KeyFrame::Ptr pKF, const Sophus::Sim3d & Scw, float th,
     return nFused;
 }
 
+void LoopClosure::StopGlobalBundleAdjustment()
+{
+    if(!thread_GBA_)
+        return;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_GBA_);
+        StopGBA_ = true;
+        FullBAIdx_++;
+    }
+
+    //! the solver checks the flag after every iteration, so it is not detached any more
+    if(thread_GBA_->joinable())
+        thread_GBA_->join();
+    delete thread_GBA_;
+    thread_GBA_ = nullptr;
+
+    std::unique_lock<std::mutex> lock(mutex_GBA_);
+    RunningGBA_ = false;
+    LOG(WARNING) << "[LoopClosure] RunningGBA stop!";
+}
+
 void LoopClosure::RunGlobalBundleAdjustment(uint64_t nLoopKF)
 {
+    Timeline::instance().setThreadName("global_ba");
+    ScopedSpan span("global_ba", "keyframe_id", nLoopKF);
     LOG(WARNING) << "[LoopClosure] Starting Global Bundle Adjustment! " << std::endl;
 
-    int idx = FullBAIdx_;
+    int idx;
+    {
+        std::unique_lock<std::mutex> lock(mutex_GBA_);
+        idx = FullBAIdx_;
+    }
 
-    Optimizer::globleBundleAdjustment(local_mapper_->map_, 20, nLoopKF, true, true);
+    SecondTimer timer;
+    timer.start();
+    const bool finished = Optimizer::globleBundleAdjustment(local_mapper_->map_, 20, nLoopKF, true, true, &StopGBA_);
+    const double ba_time = timer.stop();
 
     {
         std::unique_lock<std::mutex> lock(mutex_GBA_);
-        if(idx != FullBAIdx_)
+        if(!finished || idx != FullBAIdx_)
+        {
+            loop_metrics::global_ba_aborted->inc();
+            LOG(WARNING) << "[LoopClosure] Global Bundle Adjustment aborted for a new loop" << std::endl;
             return;
+        }
+    }
+
+    loop_metrics::global_ba_time->observe(ba_time);
+    LOG(WARNING) << "[LoopClosure] Global Bundle Adjustment finished" << std::endl;
+    LOG(WARNING) << "[LoopClosure] Updating map ..." << std::endl;
 
-        if(!StopGBA_)
+    UpdateMapByGlobalBundleAdjustment(nLoopKF);
+
+    LOG(WARNING) << "[LoopClosure] Map updated!";
+
+    std::vector<KeyFrame::Ptr > kfs = local_mapper_->map_->getAllKeyFrames();
+
+    bool traj_afterGBA = true;
+    if(traj_afterGBA)
+    {
+        std::sort(kfs.begin(),kfs.end(),[](KeyFrame::Ptr kf1,KeyFrame::Ptr kf2)->bool{ return kf1->timestamp_<kf2->timestamp_;});
+        std::string trajAfterGBA = "traj_afterGBA.txt";
+        std::ofstream f_trajAfterGBA;
+        f_trajAfterGBA.open(trajAfterGBA.c_str());
+        f_trajAfterGBA << std::fixed;
+        for(KeyFrame::Ptr kf:kfs)
         {
-            LOG(WARNING) << "[LoopClosure] Global Bundle Adjustment finished" << std::endl;
-            LOG(WARNING) << "[LoopClosure] Updating map ..." << std::endl;
-            local_mapper_->setStop();
+            Sophus::SE3d frame_pose = kf->pose();//(*reference_keyframe_ptr)->Twc() * (*frame_pose_ptr);
+            Vector3d t = frame_pose.translation();
+            Quaterniond q = frame_pose.unit_quaternion();
 
-            while(!local_mapper_->isRequiredStop())
-            {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-            }
+            f_trajAfterGBA << std::setprecision(6) << kf->timestamp_ << " "
+                           << std::setprecision(9) << t[0] << " " << t[1] << " " << t[2] << " " << q.x() << " " << q.y() << " " << q.z() << " " << q.w() << std::endl;
 
-            std::vector<KeyFrame::Ptr > kfs = local_mapper_->map_->getAllKeyFrames();
-            std::vector<MapPoint::Ptr > mpts = local_mapper_->map_->getAllMapPoints();
-            std::list<KeyFrame::Ptr > kfs_miss;
+        }
+        f_trajAfterGBA.close();
+        std::cout<<"traj_afterGBA saved!"<<std::endl;
+    }
 
-            for(KeyFrame::Ptr kf:kfs)
-            {
-                kf->beforeUpdate_Tcw_ = kf->Tcw();
-            }
+    std::unique_lock<std::mutex> lock(mutex_GBA_);
+    FinishedGBA_ = true;
+    RunningGBA_ = false;
+}
+
+void LoopClosure::UpdateMapByGlobalBundleAdjustment(uint64_t nLoopKF)
+{
+    ScopedSpan span("gba_update", "keyframe_id", nLoopKF);
+    const Map::Ptr &map = local_mapper_->map_;
+
+    std::unordered_set<KeyFrame::Ptr> visited;
+    std::unordered_set<MapPoint::Ptr> updated_mpts;
+    std::deque<KeyFrame::Ptr> queue;
+    int num_batches = 0;
+
+    //! 调用时需持有 mutex_update_
+    auto update_keyframe = [&](const KeyFrame::Ptr &kf)
+    {
+        const KeyFrame::Ptr parent = kf->getParent();
+        kf->beforeGBA_Tcw_ = kf->Tcw();
+        if(kf->GBA_KF_ != nLoopKF)
+        {
+            //! inserted during the optimization, follow the correction of its parent
+            if(!parent || !visited.count(parent))
+                return;
+            kf->optimal_Tcw_ = kf->Tcw() * parent->beforeGBA_Tcw_.inverse() * parent->Tcw();
+            kf->GBA_KF_ = nLoopKF;
+        }
+        kf->setTcw(kf->optimal_Tcw_);
 
-            for (int iK = 0; iK < kfs.size(); ++iK)
+        const std::vector<MapPoint::Ptr> mpts = kf->getMapPoints();
+        for(const MapPoint::Ptr &mpt : mpts)
+        {
+            if(!mpt || mpt->isBad() || updated_mpts.count(mpt))
+                continue;
+
+            if(mpt->GBA_KF_ == nLoopKF)
+                mpt->setPose(mpt->optimal_pose_);
+            else if(mpt->getReferenceKeyFrame() == kf)
+                mpt->setPose(kf->Twc() * (kf->beforeGBA_Tcw_ * mpt->pose()));
+            else
+                continue;
+
+            updated_mpts.insert(mpt);
+        }
+    };
+
+    //! pass 0 starts from the roots of the spanning tree,
+    //! pass 1 picks up the optimized keyframes whose parents were culled
+    for(int pass = 0; pass < 2; pass++)
+    {
+        {
+            std::unique_lock<NamedMutex> lock(map->mutex_update_);
+            const std::vector<KeyFrame::Ptr> kfs = map->getAllKeyFrames();
+            for(const KeyFrame::Ptr &kf : kfs)
             {
-                KeyFrame::Ptr kf = kfs[iK];
-                kf->updateConnections();
+                if(kf->isBad() || visited.count(kf))
+                    continue;
 
-                kf->beforeGBA_Tcw_ = kf->Tcw();
+                const bool is_root = pass == 0 ? !kf->getParent() : kf->GBA_KF_ == nLoopKF;
+                if(!is_root)
+                    continue;
 
-                if(kf->GBA_KF_ != nLoopKF)
-                {
-                    kfs_miss.push_back(kf);
-                    break;
-                }
-                kf->setTcw(kf->optimal_Tcw_);
+                visited.insert(kf);
+                queue.push_back(kf);
             }
+        }
 
-            int iter = 0;
-            while(!kfs_miss.empty())
+        while(!queue.empty())
+        {
+            std::unique_lock<NamedMutex> lock(map->mutex_update_);
+
+            const std::vector<KeyFrame::Ptr> kfs = map->getAllKeyFrames();
+
+            //! the tracker has re-anchored its last frame since the last batch
+            if(!update_finish_)
             {
-                iter ++;
-                KeyFrame::Ptr kf = kfs_miss.front();
-                std::set<KeyFrame::Ptr > connectedKeyFrames = kf->getConnectedKeyFrames(5+iter,-1);
-                for(KeyFrame::Ptr rkf:connectedKeyFrames)
-                {
-                    if(rkf->GBA_KF_ == nLoopKF)
-                    {
-                        SE3d Tci_c = kf->Tcw() * (rkf->beforeGBA_Tcw_.inverse());
-                        kf->optimal_Tcw_ = Tci_c * (rkf->optimal_Tcw_);
-                        kf->GBA_KF_ = nLoopKF;
-                        kf->setTcw(kf->optimal_Tcw_);
-                        break;
-                    }
-                }
-                if(kf->GBA_KF_ != nLoopKF)
-                {
-                    kfs_miss.push_back(kf);
-                    break;
-                }
-                kfs_miss.pop_front();
+                for(const KeyFrame::Ptr &kf : kfs)
+                    kf->beforeUpdate_Tcw_ = kf->Tcw();
             }
-            LOG_ASSERT(kfs_miss.size() ==0 )<<"There are some independent kfs.";
 
-            for (int iM = 0; iM < mpts.size(); ++iM)
+            //! the keyframes inserted by the mapper meanwhile join the tree here
+            std::unordered_map<KeyFrame::Ptr, std::vector<KeyFrame::Ptr> > children;
+            for(const KeyFrame::Ptr &kf : kfs)
             {
-                MapPoint::Ptr mpt = mpts[iM];
-
-                if(mpt->isBad())
+                if(kf->isBad())
                     continue;
-
-                if(mpt->GBA_KF_ == nLoopKF)
-                    mpt->setPose(mpt->optimal_pose_);
-                else
-                {
-                    KeyFrame::Ptr rkf = mpt->getReferenceKeyFrame();
-                    Vector3d Pcb =  rkf->beforeGBA_Tcw_ * mpt->pose();
-                    mpt->optimal_pose_ = rkf->Twc() * Pcb;
-                    mpt->setPose(mpt->optimal_pose_);
-                }
-
+                const KeyFrame::Ptr parent = kf->getParent();
+                if(parent)
+                    children[parent].push_back(kf);
             }
-            LOG(WARNING) << "[LoopClosure] Map updated!";
 
-            bool traj_afterGBA = true;
-            if(traj_afterGBA)
+            for(int n = 0; n < GBA_update_batch_ && !queue.empty(); n++)
             {
-                std::sort(kfs.begin(),kfs.end(),[](KeyFrame::Ptr kf1,KeyFrame::Ptr kf2)->bool{ return kf1->timestamp_<kf2->timestamp_;});
-                std::string trajAfterGBA = "traj_afterGBA.txt";
-                std::ofstream f_trajAfterGBA;
-                f_trajAfterGBA.open(trajAfterGBA.c_str());
-                f_trajAfterGBA << std::fixed;
-                for(KeyFrame::Ptr kf:kfs)
-                {
-                    Sophus::SE3d frame_pose = kf->pose();//(*reference_keyframe_ptr)->Twc() * (*frame_pose_ptr);
-                    Vector3d t = frame_pose.translation();
-                    Quaterniond q = frame_pose.unit_quaternion();
+                KeyFrame::Ptr kf = queue.front();
+                queue.pop_front();
 
-                    f_trajAfterGBA << std::setprecision(6) << kf->timestamp_ << " "
-                                   << std::setprecision(9) << t[0] << " " << t[1] << " " << t[2] << " " << q.x() << " " << q.y() << " " << q.z() << " " << q.w() << std::endl;
+                update_keyframe(kf);
+
+                auto it = children.find(kf);
+                if(it == children.end())
+                    continue;
 
+                for(const KeyFrame::Ptr &child : it->second)
+                {
+                    if(visited.insert(child).second)
+                        queue.push_back(child);
                 }
-                f_trajAfterGBA.close();
-                std::cout<<"traj_afterGBA saved!"<<std::endl;
             }
 
-            local_mapper_->release();
+            update_finish_ = true;
+            num_batches++;
+
+            lock.unlock();
+            std::this_thread::yield();
         }
-        FinishedGBA_ = true;
-        RunningGBA_ = false;
-        update_finish_ = true;
     }
+
+    LOG(WARNING) << "[LoopClosure] Updated " << visited.size() << " keyframes and " << updated_mpts.size() << " mappoints in " << num_batches << " batches";
 }
 }
 
@@ -4,33 +4,46 @@ namespace ssvo{
 
 void Map::clear()
 {
-    std::lock_guard<std::mutex> lock_kf(mutex_kf_);
-    std::lock_guard<std::mutex> lock_mpt(mutex_mpt_);
+    std::lock_guard<NamedMutex> lock_kf(mutex_kf_);
+    std::lock_guard<NamedMutex> lock_mpt(mutex_mpt_);
     kfs_.clear();
+    removed_kfs_.clear();
     mpts_.clear();
 }
 
 bool Map::insertKeyFrame(const KeyFrame::Ptr &kf)
 {
-    std::lock_guard<std::mutex> lock(mutex_kf_);
+    std::lock_guard<NamedMutex> lock(mutex_kf_);
     return kfs_.emplace(kf->id_, kf).second;
 }
 
 void Map::removeKeyFrame(const KeyFrame::Ptr &kf)
 {
-    std::lock_guard<std::mutex> lock(mutex_kf_);
+    std::lock_guard<NamedMutex> lock(mutex_kf_);
     kfs_.erase(kf->id_);
+
+    //! the root has no parent, its frames keep the recorded poses
+    const KeyFrame::Ptr parent = kf->getParent();
+    if(parent)
+        removed_kfs_[kf->id_] = RemovedKeyFrame{parent->id_, parent->Tcw() * kf->Twc()};
 }
 
 void Map::insertMapPoint(const MapPoint::Ptr &mpt)
 {
-    std::lock_guard<std::mutex> lock(mutex_mpt_);
+    std::lock_guard<NamedMutex> lock(mutex_mpt_);
     mpts_.emplace(mpt->id_, mpt);
 }
 
+void Map::insertMapPoints(const std::vector<MapPoint::Ptr> &mpts)
+{
+    std::lock_guard<NamedMutex> lock(mutex_mpt_);
+    for(const MapPoint::Ptr &mpt : mpts)
+        mpts_.emplace(mpt->id_, mpt);
+}
+
 void Map::removeMapPoint(const MapPoint::Ptr &mpt)
 {
-    std::lock_guard<std::mutex> lock(mutex_mpt_);
+    std::lock_guard<NamedMutex> lock(mutex_mpt_);
     mpts_.erase(mpt->id_);
     removed_mpts_.insert(mpt);
 //    std::string log;
@@ -45,7 +58,7 @@ void Map::removeMapPoint(const MapPoint::Ptr &mpt)
 
 std::vector<KeyFrame::Ptr> Map::getAllKeyFrames()
 {
-    std::lock_guard<std::mutex> lock(mutex_kf_);
+    std::lock_guard<NamedMutex> lock(mutex_kf_);
     std::vector<KeyFrame::Ptr> kfs;
     kfs.reserve(kfs_.size());
     for(const auto &kf : kfs_)
@@ -56,7 +69,7 @@ std::vector<KeyFrame::Ptr> Map::getAllKeyFrames()
 
 KeyFrame::Ptr Map::getKeyFrame(uint64_t id)
 {
-    std::lock_guard<std::mutex> lock(mutex_kf_);
+    std::lock_guard<NamedMutex> lock(mutex_kf_);
     if(kfs_.count(id))
         return kfs_[id];
     else
@@ -65,7 +78,7 @@ KeyFrame::Ptr Map::getKeyFrame(uint64_t id)
 
 std::vector<MapPoint::Ptr> Map::getAllMapPoints()
 {
-    std::lock_guard<std::mutex> lock(mutex_mpt_);
+    std::lock_guard<NamedMutex> lock(mutex_mpt_);
     std::vector<MapPoint::Ptr> mpts;
     mpts.reserve(mpts_.size());
     for(const auto &mpt : mpts_)
@@ -76,14 +89,20 @@ std::vector<MapPoint::Ptr> Map::getAllMapPoints()
 
 uint64_t Map::KeyFramesInMap()
 {
-    std::lock_guard<std::mutex> lock(mutex_kf_);
+    std::lock_guard<NamedMutex> lock(mutex_kf_);
     return kfs_.size();
 }
 
 uint64_t Map::MapPointsInMap()
 {
-    std::lock_guard<std::mutex> lock(mutex_mpt_);
+    std::lock_guard<NamedMutex> lock(mutex_mpt_);
     return mpts_.size();
 }
 
+Map::RemovedKeyFrames Map::getRemovedKeyFrames()
+{
+    std::lock_guard<NamedMutex> lock(mutex_kf_);
+    return removed_kfs_;
+}
+
 }
\ No newline at end of file
@@ -16,13 +16,13 @@ MapPoint::MapPoint(const Vector3d &p) :
 
 MapPoint::Type MapPoint::type()
 {
-    std::lock_guard<std::mutex> lock(mutex_obs_);
+    std::lock_guard<NamedMutex> lock(mutex_obs_);
     return type_;
 }
 
 void MapPoint::resetType(MapPoint::Type type)
 {
-    std::lock_guard<std::mutex> lock(mutex_obs_);
+    std::lock_guard<NamedMutex> lock(mutex_obs_);
     type_ = type;
 }
 
@@ -30,7 +30,7 @@ void MapPoint::setBad()
 {
     std::unordered_map<KeyFramePtr, Feature::Ptr> obs;
     {
-        std::lock_guard<std::mutex> lock(mutex_obs_);
+        std::lock_guard<NamedMutex> lock(mutex_obs_);
         type_ = BAD;
         obs = obs_;
     }
@@ -42,20 +42,20 @@ void MapPoint::setBad()
         it.first->updateConnections();
 
     {
-        std::lock_guard<std::mutex> lock(mutex_obs_);
+        std::lock_guard<NamedMutex> lock(mutex_obs_);
         obs_.clear();
     }
 }
 
 bool MapPoint::isBad()
 {
-    std::lock_guard<std::mutex> lock(mutex_obs_);
+    std::lock_guard<NamedMutex> lock(mutex_obs_);
     return type_ == BAD;
 }
 
 KeyFrame::Ptr MapPoint::getReferenceKeyFrame()
 {
-    std::lock_guard<std::mutex> lock(mutex_obs_);
+    std::lock_guard<NamedMutex> lock(mutex_obs_);
     return refKF_;
 }
 
@@ -63,7 +63,7 @@ void MapPoint::addObservation(const KeyFrame::Ptr &kf, const Feature::Ptr &ft)
 {
     LOG_ASSERT(kf && kf) << " Error input kf: " << kf << ", or ft: " << ft;
 
-    std::lock_guard<std::mutex> lock(mutex_obs_);
+    std::lock_guard<NamedMutex> lock(mutex_obs_);
     LOG_ASSERT(type_ != BAD) << " Error to use a BAD MapPoint!";
 
     if(refKF_ == nullptr)
@@ -77,7 +77,7 @@ bool MapPoint::fusion(const MapPoint::Ptr &mpt, const bool loop)
     const auto obs = mpt->getObservations();
     bool update = false;
     {
-        std::lock_guard<std::mutex> lock(mutex_obs_);
+        std::lock_guard<NamedMutex> lock(mutex_obs_);
         found_cunter_ += mpt->getFound();
         visiable_cunter_ += mpt->getVisible();
 
@@ -107,7 +107,7 @@ bool MapPoint::replace(const MapPoint::Ptr &mpt)
     const auto obs = mpt->getObservations();
     bool update = false;
     {
-        std::lock_guard<std::mutex> lock(mutex_obs_);
+        std::lock_guard<NamedMutex> lock(mutex_obs_);
         found_cunter_ += mpt->getFound();
         visiable_cunter_ += mpt->getVisible();
 
@@ -143,7 +143,7 @@ bool MapPoint::replace(const MapPoint::Ptr &mpt)
 
 int MapPoint::observations()
 {
-    std::lock_guard<std::mutex> lock(mutex_obs_);
+    std::lock_guard<NamedMutex> lock(mutex_obs_);
     return (int)obs_.size();
 }
 
@@ -151,7 +151,7 @@ int MapPoint::observations()
 bool MapPoint::removeObservation(const KeyFramePtr &kf)
 {
     {
-        std::lock_guard<std::mutex> lock(mutex_obs_);
+        std::lock_guard<NamedMutex> lock(mutex_obs_);
         const auto it = obs_.find(kf);
         if(it == obs_.end())
             return false;
@@ -171,7 +171,7 @@ bool MapPoint::removeObservation(const KeyFramePtr &kf)
 
     KeyFrame::Ptr ref_kf;
     {
-        std::lock_guard<std::mutex> lock(mutex_pose_);
+        std::lock_guard<NamedMutex> lock(mutex_pose_);
         ref_kf = refKF_;
     }
 
@@ -188,7 +188,7 @@ void MapPoint::updateRefKF()
     uint64_t min_id = std::numeric_limits<uint64_t>::max();
     KeyFrame::Ptr ref_kf;
     {
-        std::lock_guard<std::mutex> lock(mutex_obs_);
+        std::lock_guard<NamedMutex> lock(mutex_obs_);
         for(const auto &item : obs_)
         {
             if(item.first->id_ < min_id)
@@ -200,20 +200,20 @@ void MapPoint::updateRefKF()
     }
 
     {
-        std::lock_guard<std::mutex> lock(mutex_pose_);
+        std::lock_guard<NamedMutex> lock(mutex_pose_);
         refKF_ = ref_kf;
     }
 }
 
 std::map<KeyFrame::Ptr, Feature::Ptr> MapPoint::getObservations()
 {
-    std::lock_guard<std::mutex> lock(mutex_obs_);
+    std::lock_guard<NamedMutex> lock(mutex_obs_);
     return std::map<KeyFrame::Ptr, Feature::Ptr>(obs_.begin(), obs_.end());
 }
 
 Feature::Ptr MapPoint::findObservation(const KeyFrame::Ptr kf)
 {
-    std::lock_guard<std::mutex> lock(mutex_obs_);
+    std::lock_guard<NamedMutex> lock(mutex_obs_);
     const auto it = obs_.find(kf);
     if(it != obs_.end())
         return it->second;
@@ -224,7 +224,7 @@ Feature::Ptr MapPoint::findObservation(const KeyFrame::Ptr kf)
 void MapPoint::updateViewAndDepth()
 {
     {
-        std::lock_guard<std::mutex> lock(mutex_obs_);
+        std::lock_guard<NamedMutex> lock(mutex_obs_);
 
         if(obs_.empty())
             return;
@@ -242,7 +242,7 @@ void MapPoint::updateViewAndDepth()
     }
 
     {
-        std::lock_guard<std::mutex> lock(mutex_pose_);
+        std::lock_guard<NamedMutex> lock(mutex_pose_);
         Vector3d ref_obs_dir = refKF_->pose().translation() - pose_;
 
         const double dist = ref_obs_dir.norm();
@@ -257,13 +257,13 @@ void MapPoint::updateViewAndDepth()
 
 double MapPoint::getMinDistanceInvariance()
 {
-    std::lock_guard<std::mutex> lock(mutex_pose_);
+    std::lock_guard<NamedMutex> lock(mutex_pose_);
     return 0.8f * min_distance_;
 }
 
 double MapPoint::getMaxDistanceInvariance()
 {
-    std::lock_guard<std::mutex> lock(mutex_pose_);
+    std::lock_guard<NamedMutex> lock(mutex_pose_);
     return 1.2f * max_distance_;
 }
 
@@ -271,7 +271,7 @@ int MapPoint::predictScale(const double dist, const int max_level)
 {
     double ratio;
     {
-        std::lock_guard<std::mutex> lock(mutex_pose_);
+        std::lock_guard<NamedMutex> lock(mutex_pose_);
         ratio = max_distance_ / dist;
     }
 
@@ -299,31 +299,31 @@ int MapPoint::predictScale(const double dist_ref, const double dist_cur, const i
 
 void MapPoint::increaseFound(int n)
 {
-    std::lock_guard<std::mutex> lock(mutex_obs_);
+    std::lock_guard<NamedMutex> lock(mutex_obs_);
     found_cunter_ += n;
 }
 
 void MapPoint::increaseVisible(int n)
 {
-    std::lock_guard<std::mutex> lock(mutex_obs_);
+    std::lock_guard<NamedMutex> lock(mutex_obs_);
     visiable_cunter_ += n;
 }
 
 uint64_t MapPoint::getFound()
 {
-    std::lock_guard<std::mutex> lock(mutex_obs_);
+    std::lock_guard<NamedMutex> lock(mutex_obs_);
     return found_cunter_;
 }
 
 uint64_t MapPoint::getVisible()
 {
-    std::lock_guard<std::mutex> lock(mutex_obs_);
+    std::lock_guard<NamedMutex> lock(mutex_obs_);
     return visiable_cunter_;
 }
 
 double MapPoint::getFoundRatio()
 {
-    std::lock_guard<std::mutex> lock(mutex_obs_);
+    std::lock_guard<NamedMutex> lock(mutex_obs_);
     return static_cast<double>(found_cunter_)/visiable_cunter_;
 }
 
@@ -332,7 +332,7 @@ bool MapPoint::getCloseViewObs(const Frame::Ptr &frame, KeyFrame::Ptr &keyframe,
     std::unordered_map<KeyFramePtr, Feature::Ptr> obs;
     Vector3d obs_dir;
     {
-        std::lock_guard<std::mutex> lock(mutex_obs_);
+        std::lock_guard<NamedMutex> lock(mutex_obs_);
         if(type_ == BAD)
             return false;
         //todo remove
@@ -348,7 +348,7 @@ bool MapPoint::getCloseViewObs(const Frame::Ptr &frame, KeyFrame::Ptr &keyframe,
     //! 1. scale invariance region check
     Vector3d frame_obs_dir;
     {
-        std::lock_guard<std::mutex> lock(mutex_pose_);
+        std::lock_guard<NamedMutex> lock(mutex_pose_);
         frame_obs_dir = frame->pose().translation() - pose_;
     }
     const double dist = frame_obs_dir.norm();
@@ -385,20 +385,20 @@ bool MapPoint::getCloseViewObs(const Frame::Ptr &frame, KeyFrame::Ptr &keyframe,
     return true;
 }
 
-std::vector<cv::Mat > MapPoint::getDescriptors()
+BriefDescriptors MapPoint::getDescriptors()
 {
-    std::vector<cv::Mat > descriptors;
+    BriefDescriptors descriptors;
 
-    std::lock_guard<std::mutex> lock(mutex_obs_);
+    std::lock_guard<NamedMutex> lock(mutex_obs_);
     if(type_ == BAD)
-        return cv::Mat();
+        return descriptors;
     // TODO 这里可能还有问题，bad 的 mpt没有被删除？
     LOG_ASSERT(!obs_.empty()) << " Map point is invalid!";
 
     for(std::pair<KeyFrame::Ptr, Feature::Ptr> item : obs_)
     {
         if(item.second->angle != -1)
-            descriptors.emplace_back(item.second->descriptors_);
+            descriptors.push_back(item.second->descriptor_);
     }
 
     return descriptors;
@@ -406,7 +406,7 @@ std::vector<cv::Mat > MapPoint::getDescriptors()
 
 Vector3d MapPoint::getObsVec()
 {
-    std::lock_guard<std::mutex> lock(mutex_obs_);
+    std::lock_guard<NamedMutex> lock(mutex_obs_);
     Vector3d ret = obs_dir_;
     ret.normalize();
     return ret;
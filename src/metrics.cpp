@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "metrics.hpp"
+#include "time_tracing.hpp"
+
+namespace ssvo{
+
+MetricHistogram::MetricHistogram(const std::vector<double> &bounds) :
+    bounds_(bounds), buckets_(new std::atomic<uint64_t>[bounds.size() + 1]), count_(0), sum_(0)
+{
+    LOG_ASSERT(std::is_sorted(bounds_.begin(), bounds_.end())) << "[Metrics] The bounds of histogram should be sorted!";
+    for(size_t i = 0; i <= bounds_.size(); i++)
+        buckets_[i].store(0, std::memory_order_relaxed);
+}
+
+void MetricHistogram::observe(const double value)
+{
+    const size_t i = std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin();
+    buckets_[i].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+
+    double sum = sum_.load(std::memory_order_relaxed);
+    while(!sum_.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed));
+}
+
+Metrics &Metrics::instance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Entry *Metrics::find(const std::string &name, Type type)
+{
+    for(const auto &entry : entries_)
+    {
+        if(entry->name != name)
+            continue;
+
+        LOG_ASSERT(entry->type == type) << "[Metrics] Metric " << name << " is registered with another type!";
+        return entry.get();
+    }
+    return nullptr;
+}
+
+MetricCounter *Metrics::counter(const std::string &name, const std::string &help)
+{
+    std::lock_guard<std::mutex> lock(mutex_entries_);
+    Entry *entry = find(name, COUNTER);
+    if(entry)
+        return entry->counter.get();
+
+    entries_.emplace_back(new Entry{name, help, COUNTER, std::unique_ptr<MetricCounter>(new MetricCounter), nullptr, nullptr});
+    return entries_.back()->counter.get();
+}
+
+MetricGauge *Metrics::gauge(const std::string &name, const std::string &help)
+{
+    std::lock_guard<std::mutex> lock(mutex_entries_);
+    Entry *entry = find(name, GAUGE);
+    if(entry)
+        return entry->gauge.get();
+
+    entries_.emplace_back(new Entry{name, help, GAUGE, nullptr, std::unique_ptr<MetricGauge>(new MetricGauge), nullptr});
+    return entries_.back()->gauge.get();
+}
+
+MetricHistogram *Metrics::histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds)
+{
+    std::lock_guard<std::mutex> lock(mutex_entries_);
+    Entry *entry = find(name, HISTOGRAM);
+    if(entry)
+        return entry->histogram.get();
+
+    entries_.emplace_back(new Entry{name, help, HISTOGRAM, nullptr, nullptr, std::unique_ptr<MetricHistogram>(new MetricHistogram(bounds))});
+    return entries_.back()->histogram.get();
+}
+
+std::vector<double> Metrics::timeBuckets()
+{
+    return {0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0, 2.0};
+}
+
+std::string Metrics::exposition()
+{
+    std::ostringstream ss;
+    ss.precision(9);
+
+    std::lock_guard<std::mutex> lock(mutex_entries_);
+    for(const auto &entry : entries_)
+    {
+        ss << "# HELP " << entry->name << " " << entry->help << "\n";
+        if(COUNTER == entry->type)
+        {
+            ss << "# TYPE " << entry->name << " counter\n";
+            ss << entry->name << " " << entry->counter->value() << "\n";
+        }
+        else if(GAUGE == entry->type)
+        {
+            ss << "# TYPE " << entry->name << " gauge\n";
+            ss << entry->name << " " << entry->gauge->value() << "\n";
+        }
+        else
+        {
+            //! the buckets are cumulative in the exposition format
+            const MetricHistogram &histogram = *entry->histogram;
+            const std::vector<double> &bounds = histogram.bounds();
+            ss << "# TYPE " << entry->name << " histogram\n";
+            uint64_t cumulative = 0;
+            for(size_t i = 0; i < bounds.size(); i++)
+            {
+                cumulative += histogram.bucket(i);
+                ss << entry->name << "_bucket{le=\"" << bounds[i] << "\"} " << cumulative << "\n";
+            }
+            cumulative += histogram.bucket(bounds.size());
+            ss << entry->name << "_bucket{le=\"+Inf\"} " << cumulative << "\n";
+            ss << entry->name << "_sum " << histogram.sum() << "\n";
+            ss << entry->name << "_count " << cumulative << "\n";
+        }
+    }
+
+    return ss.str();
+}
+
+bool Metrics::writeSnapshot(const std::string &file_name)
+{
+    const std::string tmp_name = file_name + ".tmp";
+    std::ofstream ofs(tmp_name.c_str());
+    if(!ofs.is_open())
+    {
+        LOG(ERROR) << "[Metrics] Could not open file: " << tmp_name;
+        return false;
+    }
+
+    ofs << exposition();
+    ofs.close();
+
+    if(!ofs.good() || std::rename(tmp_name.c_str(), file_name.c_str()) != 0)
+    {
+        LOG(ERROR) << "[Metrics] Could not write file: " << file_name;
+        return false;
+    }
+
+    return true;
+}
+
+MetricsServer::MetricsServer(const std::string &socket_path, const std::string &snapshot_file, double snapshot_interval) :
+    socket_path_(socket_path), snapshot_file_(snapshot_file), snapshot_interval_(snapshot_interval),
+    socket_fd_(-1), stop_(false)
+{}
+
+MetricsServer::~MetricsServer()
+{
+    stopMainThread();
+}
+
+void MetricsServer::startMainThread()
+{
+    if(server_thread_ != nullptr)
+        return;
+
+    if(!socket_path_.empty() && !openSocket())
+        LOG(ERROR) << "[Metrics] Could not listen on " << socket_path_ << ": " << std::strerror(errno);
+
+    stop_ = false;
+    server_thread_ = std::make_shared<std::thread>(std::bind(&MetricsServer::run, this));
+}
+
+void MetricsServer::stopMainThread()
+{
+    if(server_thread_ == nullptr)
+        return;
+
+    stop_ = true;
+    server_thread_->join();
+    server_thread_.reset();
+
+    //! the last snapshot contains the final values
+    if(!snapshot_file_.empty())
+        Metrics::instance().writeSnapshot(snapshot_file_);
+
+    if(socket_fd_ >= 0)
+    {
+        close(socket_fd_);
+        unlink(socket_path_.c_str());
+        socket_fd_ = -1;
+    }
+}
+
+bool MetricsServer::openSocket()
+{
+    sockaddr_un address;
+    if(socket_path_.size() >= sizeof(address.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+
+    socket_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(socket_fd_ < 0)
+        return false;
+
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socket_path_.c_str(), sizeof(address.sun_path) - 1);
+
+    //! a socket file left by the last run would make bind fail
+    unlink(socket_path_.c_str());
+    if(bind(socket_fd_, (sockaddr*) &address, sizeof(address)) < 0 || listen(socket_fd_, 4) < 0)
+    {
+        const int error = errno;
+        close(socket_fd_);
+        errno = error;
+        socket_fd_ = -1;
+        return false;
+    }
+
+    LOG(INFO) << "[Metrics] Serving on " << socket_path_;
+    return true;
+}
+
+void MetricsServer::serve(int fd)
+{
+    //! wait a moment for a request, clients like socat only read
+    char request[1024];
+    ssize_t size = 0;
+    pollfd client = {fd, POLLIN, 0};
+    if(poll(&client, 1, 100) > 0)
+        size = recv(fd, request, sizeof(request) - 1, 0);
+
+    const std::string body = Metrics::instance().exposition();
+    std::string response;
+    if(size >= 3 && std::strncmp(request, "GET", 3) == 0)
+    {
+        response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+            + std::to_string(body.size()) + "\r\n\r\n" + body;
+    }
+    else
+        response = body;
+
+    size_t sent = 0;
+    while(sent < response.size())
+    {
+        const ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if(n <= 0)
+            break;
+        sent += n;
+    }
+
+    close(fd);
+}
+
+void MetricsServer::run()
+{
+    SecondTimer timer;
+    timer.start();
+    while(!stop_)
+    {
+        if(socket_fd_ >= 0)
+        {
+            pollfd server = {socket_fd_, POLLIN, 0};
+            if(poll(&server, 1, 200) > 0)
+            {
+                const int fd = accept(socket_fd_, nullptr, nullptr);
+                if(fd >= 0)
+                    serve(fd);
+            }
+        }
+        else
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        if(!snapshot_file_.empty() && timer.stop() >= snapshot_interval_)
+        {
+            Metrics::instance().writeSnapshot(snapshot_file_);
+            timer.start();
+        }
+    }
+}
+
+}
@@ -2,8 +2,10 @@
 #include "optimizer.hpp"
 #include "config.hpp"
 #include "utils.hpp"
+#include "logging.hpp"
 #include <opencv2/core/eigen.hpp>
 #include <string>
+#include <unordered_map>
 
 namespace ssvo{
 
@@ -65,10 +67,10 @@ bool compute_residualInv(const Sophus::Sim3d& camera, const double* const point,
     return true;
 }
 
-void Optimizer::globleBundleAdjustment(const Map::Ptr &map, int max_iters,const uint64_t nLoopKF, bool report, bool verbose)
+bool Optimizer::globleBundleAdjustment(const Map::Ptr &map, int max_iters,const uint64_t nLoopKF, bool report, bool verbose, const std::atomic<bool> *stop)
 {
     if (map->KeyFramesInMap() < 2)
-        return;
+        return true;
 
     std::vector<KeyFrame::Ptr> all_kfs = map->getAllKeyFrames();
     std::vector<MapPoint::Ptr> all_mpts = map->getAllMapPoints();
@@ -113,8 +115,23 @@ void Optimizer::globleBundleAdjustment(const Map::Ptr &map, int max_iters,const
 //    options_.function_tolerance = 1e-4;
     //options_.max_solver_time_in_seconds = 0.2;
 
+    ceres_slover::StopFlagCallback stop_callback(stop);
+    if(stop != nullptr)
+    {
+        //! building the problem of the whole map takes a while too
+        if(stop->load())
+            return false;
+        options.callbacks.push_back(&stop_callback);
+    }
+
     ceres::Solve(options, &problem, &summary);
 
+    if(stop != nullptr && stop->load())
+    {
+        LOG(WARNING) << "[Optimizer] Global BA aborted after " << summary.num_successful_steps << " successful steps";
+        return false;
+    }
+
     std::cout<<"globleBundleAdjustment FullReport()"<<std::endl;
     std::cout<<summary.FullReport()<<std::endl;
 
@@ -126,23 +143,19 @@ void Optimizer::globleBundleAdjustment(const Map::Ptr &map, int max_iters,const
     }
     else
     {
-        //! set flag
-    for(auto kf:all_kfs)
-    {
-        kf->GBA_KF_ = nLoopKF;kf->beforeGBA_Tcw_ = kf->Tcw();
-    }
-    for(auto mpt:all_mpts)
-    {
-        mpt->GBA_KF_ = nLoopKF;
-    }
-
+        //! set flag, the map is updated by the loop closure
+        for(auto kf:all_kfs)
+            kf->GBA_KF_ = nLoopKF;
+        for(auto mpt:all_mpts)
+            mpt->GBA_KF_ = nLoopKF;
     }
 
     //! Report
     reportInfo<2>(problem, summary, report, verbose);
+    return true;
 }
 
-void Optimizer::localBundleAdjustment(const KeyFrame::Ptr &keyframe, std::list<MapPoint::Ptr> &bad_mpts, int size, int min_shared_fts, bool report, bool verbose)
+void Optimizer::localBundleAdjustment(const Map::Ptr &map, const KeyFrame::Ptr &keyframe, std::list<MapPoint::Ptr> &bad_mpts, int size, int min_shared_fts, bool report, bool verbose)
 {
     static double focus_length = MIN(keyframe->cam_->fx(), keyframe->cam_->fy());
     static double pixel_usigma = Config::imagePixelSigma()/focus_length;
@@ -175,37 +188,57 @@ void Optimizer::localBundleAdjustment(const KeyFrame::Ptr &keyframe, std::list<M
         }
     }
 
+    //! optimal_Tcw_ and optimal_pose_ may hold the result of a global BA waiting to be applied,
+    //! so the local BA solves on its own copies
+    typedef std::map<KeyFrame::Ptr, SE3d, std::less<KeyFrame::Ptr>,
+                     Eigen::aligned_allocator<std::pair<const KeyFrame::Ptr, SE3d> > > KeyFramePoses;
+    KeyFramePoses kf_poses;
+    std::unordered_map<MapPoint::Ptr, Vector3d> mpt_poses;
+    //! the GBA_KF_ and pose of each keyframe and mappoint when the solve starts
+    std::unordered_map<KeyFrame::Ptr, uint64_t> kf_gba_ids;
+    std::unordered_map<MapPoint::Ptr, uint64_t> mpt_gba_ids;
+    KeyFramePoses kf_initial_poses;
+    std::unordered_map<MapPoint::Ptr, Vector3d> mpt_initial_poses;
+
     ceres::Problem problem;
     ceres::LocalParameterization* local_parameterization = new ceres_slover::SE3Parameterization();
 
     for(const KeyFrame::Ptr &kf : fixed_keyframe)
     {
-        kf->optimal_Tcw_ = kf->Tcw();
-        problem.AddParameterBlock(kf->optimal_Tcw_.data(), SE3d::num_parameters, local_parameterization);
-        problem.SetParameterBlockConstant(kf->optimal_Tcw_.data());
+        SE3d &Tcw = kf_poses[kf] = kf->Tcw();
+        problem.AddParameterBlock(Tcw.data(), SE3d::num_parameters, local_parameterization);
+        problem.SetParameterBlockConstant(Tcw.data());
     }
 
     for(const KeyFrame::Ptr &kf : actived_keyframes)
     {
-        kf->optimal_Tcw_ = kf->Tcw();
-        problem.AddParameterBlock(kf->optimal_Tcw_.data(), SE3d::num_parameters, local_parameterization);
+        kf_gba_ids[kf] = kf->GBA_KF_;
+        kf_initial_poses[kf] = kf->Tcw();
+        SE3d &Tcw = kf_poses[kf] = kf_initial_poses[kf];
+        problem.AddParameterBlock(Tcw.data(), SE3d::num_parameters, local_parameterization);
         if(kf->id_ <= 1)
-            problem.SetParameterBlockConstant(kf->optimal_Tcw_.data());
+            problem.SetParameterBlockConstant(Tcw.data());
     }
 
     double scale = pixel_usigma * 2;
     ceres::LossFunction* lossfunction = new ceres::HuberLoss(scale);
     for(const MapPoint::Ptr &mpt : local_mappoints)
     {
-        mpt->optimal_pose_ = mpt->pose();
+        mpt_gba_ids[mpt] = mpt->GBA_KF_;
+        mpt_initial_poses[mpt] = mpt->pose();
+        Vector3d &pose = mpt_poses[mpt] = mpt_initial_poses[mpt];
         const std::map<KeyFrame::Ptr, Feature::Ptr> obs = mpt->getObservations();
 
         for(const auto &item : obs)
         {
             const KeyFrame::Ptr &kf = item.first;
             const Feature::Ptr &ft = item.second;
+            auto it = kf_poses.find(kf);
+            if(it == kf_poses.end())
+                continue;
+
             ceres::CostFunction* cost_function1 = ceres_slover::ReprojectionErrorSE3::Create(ft->fn_[0]/ft->fn_[2], ft->fn_[1]/ft->fn_[2]);//, 1.0/(1<<ft->level_));
-            problem.AddResidualBlock(cost_function1, lossfunction, kf->optimal_Tcw_.data(), mpt->optimal_pose_.data());
+            problem.AddResidualBlock(cost_function1, lossfunction, it->second.data(), pose.data());
         }
     }
 
@@ -217,10 +250,20 @@ void Optimizer::localBundleAdjustment(const KeyFrame::Ptr &keyframe, std::list<M
 
     ceres::Solve(options, &problem, &summary);
 
+    //! the loop closure applies the global BA under mutex_update_ without stopping the mapper,
+    //! the keyframes and mappoints it has marked or corrected during the solve are left untouched
+    std::unique_lock<NamedMutex> lock(map->mutex_update_);
+    size_t skipped = 0;
+
     //! update pose
     for(const KeyFrame::Ptr &kf : actived_keyframes)
     {
-        kf->setTcw(kf->optimal_Tcw_);
+        if(kf->GBA_KF_ != kf_gba_ids[kf] || kf->Tcw().matrix() != kf_initial_poses[kf].matrix())
+        {
+            skipped++;
+            continue;
+        }
+        kf->setTcw(kf_poses[kf]);
     }
 
     //! update mpts & remove mappoint with large error
@@ -228,10 +271,17 @@ void Optimizer::localBundleAdjustment(const KeyFrame::Ptr &keyframe, std::list<M
     static const double max_residual = pixel_usigma * pixel_usigma * std::sqrt(3.81);
     for(const MapPoint::Ptr &mpt : local_mappoints)
     {
+        if(mpt->GBA_KF_ != mpt_gba_ids[mpt] || mpt->pose() != mpt_initial_poses[mpt])
+        {
+            skipped++;
+            continue;
+        }
+
+        const Vector3d &pose = mpt_poses[mpt];
         const std::map<KeyFrame::Ptr, Feature::Ptr> obs = mpt->getObservations();
         for(const auto &item : obs)
         {
-            double residual = utils::reprojectError(item.second->fn_.head<2>(), item.first->Tcw(), mpt->optimal_pose_);
+            double residual = utils::reprojectError(item.second->fn_.head<2>(), item.first->Tcw(), pose);
             if(residual < max_residual)
                 continue;
 
@@ -245,9 +295,11 @@ void Optimizer::localBundleAdjustment(const KeyFrame::Ptr &keyframe, std::list<M
             }
         }
 
-        mpt->setPose(mpt->optimal_pose_);
+        mpt->setPose(pose);
     }
 
+    lock.unlock();
+
     for(const KeyFrame::Ptr &kf : changed_keyframes)
     {
         kf->updateConnections();
@@ -255,10 +307,11 @@ void Optimizer::localBundleAdjustment(const KeyFrame::Ptr &keyframe, std::list<M
 
     //! Report
     double t1 = (double)cv::getTickCount();
-    LOG_IF(INFO, report) << "[Optimizer] Finish local BA for KF: " << keyframe->id_ << "(" << keyframe->frame_id_ << ")"
+    SSVO_LOG_IF(MAPPER, 1, INFO, report) << "[Optimizer] Finish local BA for KF: " << keyframe->id_ << "(" << keyframe->frame_id_ << ")"
                          << ", KFs: " << actived_keyframes.size() << "(+" << fixed_keyframe.size() << ")"
                          << ", Mpts: " << local_mappoints.size()
-                         << ", remove " << bad_mpts.size() << " bad mpts."
+                         << ", remove " << bad_mpts.size() << " bad mpts"
+                         << ", skip " << skipped << " updated by global BA."
                          << " (" << (t1-t0)/cv::getTickFrequency() << "ms)";
 
     reportInfo<2>(problem, summary, report, verbose);
@@ -356,7 +409,7 @@ void Optimizer::motionOnlyBundleAdjustment(const Frame::Ptr &frame, bool use_see
 
         ceres::Solve(options, &problem, &summary);
 
-        LOG_IF(WARNING, report) << "[Optimizer] Motion-only BA removes " << remove_count << " points";
+        SSVO_LOG_IF(TRACKER, 2, WARNING, report) << "[Optimizer] Motion-only BA removes " << remove_count << " points";
     }
 
     //! update pose
@@ -452,7 +505,7 @@ void Optimizer::refineMapPoint(const MapPoint::Ptr &mpt, int max_iter, bool repo
 
         if(last_chi2 < new_chi2)
         {
-            LOG_IF(INFO, progress_out) << "iter " << std::setw(2) << i << ": failure, chi2: " << std::scientific << std::setprecision(6) << new_chi2/n_obs;
+            SSVO_LOG_IF(MAPPER, 3, INFO, progress_out) << "iter " << std::setw(2) << i << ": failure, chi2: " << std::scientific << std::setprecision(6) << new_chi2/n_obs;
             mpt->setPose(pose_last);
             return;
         }
@@ -464,7 +517,7 @@ void Optimizer::refineMapPoint(const MapPoint::Ptr &mpt, int max_iter, bool repo
         pose_last = mpt->optimal_pose_;
         mpt->optimal_pose_.noalias() += dp;
 
-        LOG_IF(INFO, progress_out) << "iter " << std::setw(2) << i << ": success, chi2: " << std::scientific << std::setprecision(6) << new_chi2/n_obs << ", step: " << dp.transpose();
+        SSVO_LOG_IF(MAPPER, 3, INFO, progress_out) << "iter " << std::setw(2) << i << ": success, chi2: " << std::scientific << std::setprecision(6) << new_chi2/n_obs << ", step: " << dp.transpose();
 
         if(dp.norm() <= EPS)
         {
@@ -475,7 +528,7 @@ void Optimizer::refineMapPoint(const MapPoint::Ptr &mpt, int max_iter, bool repo
 
     mpt->setPose(mpt->optimal_pose_);
     double t1 = (double)cv::getTickCount();
-    LOG_IF(INFO, report) << std::scientific  << "[Optimizer] MapPoint " << mpt->id_
+    SSVO_LOG_IF(MAPPER, 3, INFO, report) << std::scientific  << "[Optimizer] MapPoint " << mpt->id_
                          << " Error(MSE) changed from " << std::scientific << init_chi2/n_obs << " to " << last_chi2/n_obs
                          << "(" << obs.size() << "), time: " << std::fixed << (t1-t0)*1000/cv::getTickFrequency() << "ms, "
                          << (convergence? "Convergence" : "Unconvergence");
@@ -704,281 +757,287 @@ int Optimizer::optimizeSim3(KeyFrame::Ptr pKF1, KeyFrame::Ptr pKF2, std::vector<
     return good;
 }
 
-void Optimizer::OptimizeEssentialGraph(Map::Ptr pMap, KeyFrame::Ptr pLoopKF, KeyFrame::Ptr pCurKF, KeyFrameAndPose &NonCorrectedSim3, KeyFrameAndPose &CorrectedSim3,
-                                       const std::map<KeyFrame::Ptr, std::set<KeyFrame::Ptr> > &LoopConnections, const bool &bFixScale)
+//! 本质图中的一条边, Sji = Sjw * Swi 由优化前的位姿得到
+struct EssentialEdge
 {
-    //! Set ceres problem
-    ceres::Problem problem;
-    const std::vector<KeyFrame::Ptr> vpKFs = pMap->getAllKeyFrames();
-    const std::vector<MapPoint::Ptr> vpMPs = pMap->getAllMapPoints();
+    int i;
+    int j;
+    Sophus::Sim3d Sji;
 
-    for(KeyFrame::Ptr kf:vpKFs)
-    {
-        kf->beforeUpdate_Tcw_ = kf->Tcw();
-    }
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
 
-    int N = vpKFs.size();
+typedef std::vector<EssentialEdge, Eigen::aligned_allocator<EssentialEdge> > EssentialEdges;
 
-    std::vector<Sophus::Sim3d, Eigen::aligned_allocator<Sophus::Sim3d>> mvSim3; //参与优化的变量
-    std::vector<Sophus::Sim3d, Eigen::aligned_allocator<Sophus::Sim3d>> vScw; // 优化前变量，用于mappoint校正
-    mvSim3.resize(N);
-    vScw.resize(N);
+//! 每个关键帧的生成树, 闭环和共视边互不依赖, 并行地收集, 结果按关键帧分开存放
+class EssentialGraphInvoker : public cv::ParallelLoopBody
+{
+public:
+    EssentialGraphInvoker(const std::vector<KeyFrame::Ptr> &keyframes, const std::unordered_map<uint64_t, int> &indices,
+                          const Optimizer::Sim3Vector &Scw, const std::set<std::pair<uint64_t, uint64_t> > &inserted,
+                          const int min_fts, std::vector<EssentialEdges> &edges) :
+        keyframes_(keyframes), indices_(indices), Scw_(Scw), inserted_(inserted), min_fts_(min_fts), edges_(edges)
+    {}
+
+    virtual void operator()(const cv::Range &range) const
+    {
+        for(int i = range.start; i < range.end; i++)
+        {
+            const KeyFrame::Ptr &kf = keyframes_[i];
+            const Sophus::Sim3d Swi = Scw_[i].inverse();
+            EssentialEdges &edges = edges_[i];
+
+            //! spanning tree
+            const KeyFrame::Ptr parent = kf->getParent();
+            if(parent)
+                addEdge(kf, parent, Swi, edges);
+
+            //! loop edges
+            const std::set<KeyFrame::Ptr> loop_edges = kf->getLoopEdges();
+            for(const KeyFrame::Ptr &kf_loop : loop_edges)
+            {
+                if(kf_loop->id_ < kf->id_)
+                    addEdge(kf, kf_loop, Swi, edges);
+            }
 
-    //todo 50->100
-    const int minFeat = 50;
+            //! covisibility edges
+            const std::set<KeyFrame::Ptr> connected_kfs = kf->getConnectedKeyFrames(-1, min_fts_);
+            for(const KeyFrame::Ptr &kf_conn : connected_kfs)
+            {
+                if(kf_conn == parent || loop_edges.count(kf_conn) || kf_conn->getParent() == kf || kf_conn->id_ >= kf->id_)
+                    continue;
+                addEdge(kf, kf_conn, Swi, edges);
+            }
+        }
+    }
 
-    // Set KeyFrame vertices
-    for(size_t i=0; i < vpKFs.size(); i++)
-    {
-        KeyFrame::Ptr pKF = vpKFs[i];
-        if (pKF->isBad())
-            continue;
+private:
 
-        int kfID = pKF->id_;
+    inline void addEdge(const KeyFrame::Ptr &kf_i, const KeyFrame::Ptr &kf_j, const Sophus::Sim3d &Swi, EssentialEdges &edges) const
+    {
+        if(kf_j->isBad())
+            return;
 
-        KeyFrameAndPose::const_iterator it = CorrectedSim3.find(pKF);
+        auto it = indices_.find(kf_j->id_);
+        if(it == indices_.end())
+            return;
 
-        if(it!=CorrectedSim3.end())
-        {
-            vScw[kfID] = it->second;
+        if(inserted_.count(std::make_pair(std::min(kf_i->id_, kf_j->id_), std::max(kf_i->id_, kf_j->id_))))
+            return;
 
-            mvSim3[kfID] = it->second;
-            problem.AddParameterBlock(mvSim3[kfID].data(), 7);
-        }
-        else
-        {
-            Eigen::Matrix<double,3,3> Rcw = pKF->Tcw().rotationMatrix();
-            Eigen::Matrix<double,3,1> tcw = pKF->Tcw().translation( );
+        EssentialEdge edge;
+        edge.i = indices_.at(kf_i->id_);
+        edge.j = it->second;
+        edge.Sji = Scw_[edge.j] * Swi;
+        edges.push_back(edge);
+    }
 
+private:
+    const std::vector<KeyFrame::Ptr> &keyframes_;
+    const std::unordered_map<uint64_t, int> &indices_;
+    const Optimizer::Sim3Vector &Scw_;
+    const std::set<std::pair<uint64_t, uint64_t> > &inserted_;
+    const int min_fts_;
+    std::vector<EssentialEdges> &edges_;
+};
 
-            Eigen::Quaterniond q_r(Rcw);
-//            Matrix4d temp;
-//            temp.topLeftCorner(3,3) =  Rcw;
-//            temp.topRightCorner(3,1) = tcw;
+class MapPointCorrectionInvoker : public cv::ParallelLoopBody
+{
+public:
+    MapPointCorrectionInvoker(const std::vector<MapPoint::Ptr> &mpts, const std::vector<int> &refs, const Optimizer::Sim3Vector &corrections) :
+        mpts_(mpts), refs_(refs), corrections_(corrections)
+    {}
 
-            vScw[kfID] = Sophus::Sim3d(q_r,tcw);
-            mvSim3[kfID] = Sophus::Sim3d(q_r,tcw);
-            problem.AddParameterBlock(mvSim3[kfID].data(), 7);
+    virtual void operator()(const cv::Range &range) const
+    {
+        for(int i = range.start; i < range.end; i++)
+        {
+            const MapPoint::Ptr &mpt = mpts_[i];
+            mpt->setPose(corrections_[refs_[i]] * mpt->pose());
+            mpt->updateViewAndDepth();
         }
-
-        if(pKF==pLoopKF)
-            problem.SetParameterBlockConstant(mvSim3[kfID].data());
     }
 
-    std::set<std::pair<uint64_t ,uint64_t> > sInsertedEdges;
+private:
+    const std::vector<MapPoint::Ptr> &mpts_;
+    const std::vector<int> &refs_;
+    const Optimizer::Sim3Vector &corrections_;
+};
 
-    std::vector<Sophus::Sim3d, Eigen::aligned_allocator<Sophus::Sim3d>> tDeltaSim3Add;
-    std::vector<double*> tDeltaSim3Address;
-    tDeltaSim3Add.reserve(3000);
-    int edge_num = 0;
-    // Set Loop edges
-    for(std::map<KeyFrame::Ptr, std::set<KeyFrame::Ptr> >::const_iterator mit = LoopConnections.begin(), mend=LoopConnections.end(); mit!=mend; mit++)
-    {
-        KeyFrame::Ptr pKF = mit->first;
-        uint64_t nIDi = pKF->id_;
-        const std::set<KeyFrame::Ptr> &spConnections = mit->second;
+void Optimizer::correctMapPoints(const std::vector<MapPoint::Ptr> &mpts, const std::vector<int> &refs, const Sim3Vector &corrections)
+{
+    LOG_ASSERT(mpts.size() == refs.size()) << "The number of map points(" << mpts.size() << ") and references(" << refs.size() << ") should be equal!";
+    cv::parallel_for_(cv::Range(0, (int)mpts.size()), MapPointCorrectionInvoker(mpts, refs, corrections));
+}
 
-        Sophus::Sim3d Swi = mvSim3[nIDi].inverse();
+void Optimizer::OptimizeEssentialGraph(Map::Ptr pMap, KeyFrame::Ptr pLoopKF, KeyFrame::Ptr pCurKF, KeyFrameAndPose &NonCorrectedSim3, KeyFrameAndPose &CorrectedSim3,
+                                       const std::map<KeyFrame::Ptr, std::set<KeyFrame::Ptr> > &LoopConnections, const bool &bFixScale)
+{
+    std::vector<KeyFrame::Ptr> vpKFs = pMap->getAllKeyFrames();
+    const std::vector<MapPoint::Ptr> vpMPs = pMap->getAllMapPoints();
 
-        for(std::set<KeyFrame::Ptr>::const_iterator sit=spConnections.begin(), send=spConnections.end(); sit!=send; sit++)
-        {
-            const long unsigned int nIDj = (*sit)->id_;
-//            std::cout<<" Wight of LoopConnections < "<<pKF->frame_id_<<","<<(*sit)->frame_id_<<"> is "<<pKF->getWight(*sit)<<std::endl;
-            if((nIDi!=pCurKF->id_ || nIDj!=pLoopKF->id_) && pKF->getWight(*sit)< 0.2*minFeat)
-                continue;
-            //! Sji = Sjw*Swi
-            double *Sim3_Address = new double[7];
-            Sophus::Sim3d Sji = mvSim3[nIDj] * Swi;
-            Sim3_Address = Sji.data();
-            tDeltaSim3Address.push_back(Sim3_Address);
+    //! 关键帧的id在剔除后不连续, 以连续的下标存放优化变量
+    vpKFs.erase(std::remove_if(vpKFs.begin(), vpKFs.end(), [](const KeyFrame::Ptr &kf) { return kf->isBad(); }), vpKFs.end());
+    const int N = (int)vpKFs.size();
 
-            ceres::LossFunction *lossfunc = new ceres::HuberLoss(0.5);
-            ceres::CostFunction *costfunc = ceres_slover::RelativeSim3Error::Create(tDeltaSim3Address.back());
-            problem.AddResidualBlock(costfunc, lossfunc, mvSim3[nIDi].data(), mvSim3[nIDj].data());
+    std::unordered_map<uint64_t, int> indices;
+    indices.reserve(N);
 
-            sInsertedEdges.insert(std::make_pair(std::min(nIDi,nIDj),std::max(nIDi,nIDj)));
-            edge_num++;
-        }
-    }
+    Sim3Vector mvSim3(N); //参与优化的变量
+    Sim3Vector vScw(N);   // 优化前变量，用于mappoint校正
+    Sim3Vector vSmeas(N); // 未经闭环校正的位姿, 用于计算普通边的观测
 
-//    std::cout<<"LoopConnections ResidualBlock edge_num: "<<edge_num<<std::endl;
+    //todo 50->100
+    const int minFeat = 50;
 
-    edge_num = 0;
-    // Set normal edges
-    for(size_t i=0, iend=vpKFs.size(); i<iend; i++)
+    for(int i = 0; i < N; i++)
     {
         KeyFrame::Ptr pKF = vpKFs[i];
-        const int nIDi = pKF->id_;
-        Sophus::Sim3d Swi;
+        pKF->beforeUpdate_Tcw_ = pKF->Tcw();
+        indices[pKF->id_] = i;
 
-        KeyFrameAndPose::const_iterator iti = NonCorrectedSim3.find(pKF);
-        if(iti != NonCorrectedSim3.end())
-            Swi = iti->second.inverse();
+        KeyFrameAndPose::const_iterator it = CorrectedSim3.find(pKF);
+        if(it != CorrectedSim3.end())
+            vScw[i] = it->second;
         else
-            Swi = mvSim3[nIDi].inverse();
-
-        //todo add orb-slam spanning tree edges
-
-        // Loop edges
-        const std::set<KeyFrame::Ptr> sLoopEdges = pKF->getLoopEdges();
-        for(std::set<KeyFrame::Ptr>::const_iterator sit=sLoopEdges.begin(), send=sLoopEdges.end(); sit!=send; sit++)
         {
-            KeyFrame::Ptr pLKF = *sit;
-            if(pLKF->id_<pKF->id_)
-            {
-                Sophus::Sim3d Slw;
-
-                KeyFrameAndPose::const_iterator itl = NonCorrectedSim3.find(pLKF);
-
-                if(itl!=NonCorrectedSim3.end())
-                    Slw = itl->second;
-                else
-                    Slw = mvSim3[pLKF->id_];
+            const SE3d Tcw = pKF->Tcw();
+            vScw[i] = Sophus::Sim3d(Eigen::Quaterniond(Tcw.rotationMatrix()), Tcw.translation());
+        }
+        mvSim3[i] = vScw[i];
 
+        KeyFrameAndPose::const_iterator itn = NonCorrectedSim3.find(pKF);
+        vSmeas[i] = itn != NonCorrectedSim3.end() ? itn->second : vScw[i];
+    }
 
-                double *Sim3_Address = new double[7];
-                Sophus::Sim3d Sli = Slw * Swi;
-                Sim3_Address = Sli.data();
-                tDeltaSim3Address.push_back(Sim3_Address);
+    //! Set ceres problem
+    ceres::Problem problem;
+    ceres::LocalParameterization* local_parameterization = new ceres_slover::Sim3Parameterization();
+    ceres::LossFunction *lossfunc = new ceres::HuberLoss(0.5);
 
-                ceres::LossFunction *lossfunc = new ceres::HuberLoss(0.5);
-                ceres::CostFunction *costfunc = ceres_slover::RelativeSim3Error::Create(tDeltaSim3Address.back());
-                problem.AddResidualBlock(costfunc, lossfunc, vScw[nIDi].data(), mvSim3[pLKF->id_].data());
+    for(int i = 0; i < N; i++)
+    {
+        problem.AddParameterBlock(mvSim3[i].data(), Sophus::Sim3d::num_parameters, local_parameterization);
+        if(vpKFs[i] == pLoopKF)
+            problem.SetParameterBlockConstant(mvSim3[i].data());
+    }
 
-                edge_num++;
-            }
-        }
+    // Set Loop edges, 观测由校正后的位姿得到
+    std::set<std::pair<uint64_t ,uint64_t> > sInsertedEdges;
+    int loop_edge_num = 0;
+    for(std::map<KeyFrame::Ptr, std::set<KeyFrame::Ptr> >::const_iterator mit = LoopConnections.begin(), mend=LoopConnections.end(); mit!=mend; mit++)
+    {
+        KeyFrame::Ptr pKF = mit->first;
+        auto iti = indices.find(pKF->id_);
+        if(iti == indices.end())
+            continue;
 
-//        std::cout<<"Loop edge--->: "<<edge_num<<std::endl;
+        const int i = iti->second;
+        const uint64_t nIDi = pKF->id_;
+        const Sophus::Sim3d Swi = mvSim3[i].inverse();
 
-//        edge_num = 0;
-        // Covisibility graph edges
-        const std::set<KeyFrame::Ptr> vpConnectedKFs = pKF->getConnectedKeyFrames(-1,minFeat);
-        for(std::set<KeyFrame::Ptr>::const_iterator vit=vpConnectedKFs.begin(); vit!=vpConnectedKFs.end(); vit++)
+        for(const KeyFrame::Ptr &pKFj : mit->second)
         {
-            KeyFrame::Ptr pKFn = *vit;
-            if(pKFn /*&& pKFn!=pParentKF */&& !sLoopEdges.count(pKFn))
-            {
-                //todo child check of orb slam
-                if(!pKFn->isBad() && pKFn->getParent()!=pKF && pKFn->id_<pKF->id_)
-                {
-                    if(sInsertedEdges.count(std::make_pair(std::min(pKF->id_,pKFn->id_),std::max(pKF->id_,pKFn->id_))))
-                        continue;
-
-                    Sophus::Sim3d Snw;
+            auto itj = indices.find(pKFj->id_);
+            if(itj == indices.end())
+                continue;
 
-                    KeyFrameAndPose::const_iterator itn = NonCorrectedSim3.find(pKFn);
+            const uint64_t nIDj = pKFj->id_;
+            if((nIDi!=pCurKF->id_ || nIDj!=pLoopKF->id_) && pKF->getWight(pKFj) < 0.2*minFeat)
+                continue;
 
-                    if(itn!=NonCorrectedSim3.end())
-                        Snw = itn->second;
-                    else
-                        Snw = mvSim3[pKFn->id_];
+            //! Sji = Sjw*Swi
+            const int j = itj->second;
+            problem.AddResidualBlock(ceres_slover::RelativeSim3Error::Create(mvSim3[j] * Swi), lossfunc, mvSim3[i].data(), mvSim3[j].data());
 
-                    double *Sim3_Address = new double[7];
+            sInsertedEdges.insert(std::make_pair(std::min(nIDi,nIDj),std::max(nIDi,nIDj)));
+            loop_edge_num++;
+        }
+    }
 
-                    Sophus::Sim3d Sni = Snw * Swi;
-                    Sim3_Address = Sni.data();
-                    tDeltaSim3Address.push_back(Sim3_Address);
+    // Set normal edges, 观测由闭环校正前的位姿得到
+    std::vector<EssentialEdges> edges(N);
+    cv::parallel_for_(cv::Range(0, N), EssentialGraphInvoker(vpKFs, indices, vSmeas, sInsertedEdges, minFeat, edges));
 
-                    ceres::LossFunction *lossfunc = new ceres::HuberLoss(0.5);
-                    ceres::CostFunction *costfunc = ceres_slover::RelativeSim3Error::Create(tDeltaSim3Address.back());
-                    problem.AddResidualBlock(costfunc, lossfunc, mvSim3[nIDi].data(), mvSim3[pKFn->id_].data());
-                    edge_num++;
-                }
-            }
+    int normal_edge_num = 0;
+    for(const EssentialEdges &kf_edges : edges)
+    {
+        for(const EssentialEdge &edge : kf_edges)
+        {
+            problem.AddResidualBlock(ceres_slover::RelativeSim3Error::Create(edge.Sji), lossfunc, mvSim3[edge.i].data(), mvSim3[edge.j].data());
+            normal_edge_num++;
         }
     }
 
-//    std::cout<<"normal edges --->: "<<edge_num<<std::endl;
-
-    //solve problem
+    //solve problem, 位姿图的正规方程非常稀疏, 使用稀疏Cholesky分解
     ceres::Solver::Options options;
-    options.sparse_linear_algebra_library_type = ceres::SUITE_SPARSE;
+    if(ceres::IsSparseLinearAlgebraLibraryTypeAvailable(ceres::SUITE_SPARSE))
+        options.sparse_linear_algebra_library_type = ceres::SUITE_SPARSE;
+    else
+        options.sparse_linear_algebra_library_type = ceres::EIGEN_SPARSE;
     options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
     options.trust_region_strategy_type = ceres::LEVENBERG_MARQUARDT;
     options.max_num_iterations = 20;
+    options.num_threads = std::max(1, (int)std::thread::hardware_concurrency());
     //options.minimizer_progress_to_stdout = true;
 
     ceres::Solver::Summary summary;
     ceres::Solve(options, &problem, &summary);
 
-    std::cout<<"OptimizeEssentialGraph FullReport()"<<std::endl;
-    std::cout<<summary.FullReport()<<std::endl;
+    LOG(WARNING) << "[LoopClosure] OptimizeEssentialGraph with " << N << " keyframes, " << loop_edge_num << " loop edges and " << normal_edge_num << " normal edges";
+    LOG(INFO) << summary.BriefReport();
 
-    //todo delete
-    /*
-    std::cout<<"Begin to delete all double*!"<<std::endl;
-    std::cout<<"tDeltaSim3Address size:"<<tDeltaSim3Address.size()<<std::endl;
-    for(std::vector<double*>::iterator lit = tDeltaSim3Address.begin(), lend = tDeltaSim3Address.end(); lit!=lend; lit++)
-    {
-        std::cout<<"Delete"<<std::endl;
-        delete *lit;
-    }
-    tDeltaSim3Address.clear();
-    std::cout<<"Finish to delete all double*!"<<std::endl;
-     */
+    //! 地图点的校正量: 先变换到优化前的参考关键帧坐标系, 再用优化后的位姿变换回来
+    Sim3Vector vCorrections(N);
+    for(int i = 0; i < N; i++)
+        vCorrections[i] = mvSim3[i].inverse() * vScw[i];
 
-    std::vector<Sophus::Sim3d, Eigen::aligned_allocator<Sophus::Sim3d>> vCorrectedSwc(N);
-
-    LOG(WARNING) << "[LoopClosure] Begin to correct kf pose!";
-    std::unique_lock<std::mutex > lock(pMap->mutex_update_);
-    // SE3 Pose Recovering. Sim3:[sR t;0 1] -> SE3:[R t/s;0 1]
-    for(size_t i=0;i<vpKFs.size();i++)
+    std::vector<MapPoint::Ptr> mpts_to_correct;
+    std::vector<int> refs;
+    mpts_to_correct.reserve(vpMPs.size());
+    refs.reserve(vpMPs.size());
+    for(const MapPoint::Ptr &pMP : vpMPs)
     {
-        KeyFrame::Ptr pKFi = vpKFs[i];
-
-        const int nIDi = pKFi->id_;
-
-        vCorrectedSwc[nIDi]=mvSim3[nIDi].inverse();
-        Eigen::Matrix3d eigR = mvSim3[nIDi].rotationMatrix();
-        Eigen::Vector3d eigt = mvSim3[nIDi].translation();
-        double s = mvSim3[nIDi].scale();
-
-        eigt *=(1.0/s); //[R t/s;0 1]
-
-        SE3d Tiw = SE3d(eigR,eigt);
-
-        pKFi->setTcw(Tiw);
-    }
-    LOG(WARNING) << "[LoopClosure] Finish to correct kf pose!";
-
-    LOG(WARNING) << "[LoopClosure] Begin to correct point pose!";
-    // Correct points. Transform to "non-optimized" reference keyframe pose and transform back with optimized pose
-    for(size_t i=0, iend=vpMPs.size(); i<iend; i++)
-    {
-        MapPoint::Ptr pMP = vpMPs[i];
-
         if(pMP->isBad())
             continue;
 
-        int nIDr;
+        uint64_t nIDr;
         // 经过sim3矫正的点
         if(pMP->mnCorrectedByKF==pCurKF->id_)
-        {
             nIDr = pMP->mnCorrectedReference;
-        }
         else
         {
             KeyFrame::Ptr pRefKF = pMP->getReferenceKeyFrame();
+            if(!pRefKF)
+                continue;
             nIDr = pRefKF->id_;
         }
 
-        Sophus::Sim3d Srw = vScw[nIDr];
-        SE3d Srw_se3 = SE3d(Srw.rotationMatrix(),Srw.translation());
-        Sophus::Sim3d correctedSwr = vCorrectedSwc[nIDr];
-        SE3d  correctedSwr_se3 = SE3d(correctedSwr.rotationMatrix(),correctedSwr.translation());
+        auto it = indices.find(nIDr);
+        if(it == indices.end())
+            continue;
+
+        mpts_to_correct.push_back(pMP);
+        refs.push_back(it->second);
+    }
 
-        Vector3d eigP3Dw = pMP->pose();
-//        Eigen::Vector3d eigCorrectedP3Dw = correctedSwr_se3 * (Srw_se3 * eigP3Dw);
-        Eigen::Vector3d eigCorrectedP3Dw = correctedSwr * (Srw * eigP3Dw);
+    LOG(WARNING) << "[LoopClosure] Begin to correct kf pose!";
+    std::unique_lock<NamedMutex> lock(pMap->mutex_update_);
+    // SE3 Pose Recovering. Sim3:[sR t;0 1] -> SE3:[R t/s;0 1]
+    for(int i = 0; i < N; i++)
+    {
+        Eigen::Matrix3d eigR = mvSim3[i].rotationMatrix();
+        Eigen::Vector3d eigt = mvSim3[i].translation();
+        double s = mvSim3[i].scale();
 
-        pMP->setPose(eigCorrectedP3Dw);
-        pMP->updateViewAndDepth();
+        eigt *=(1.0/s); //[R t/s;0 1]
 
+        vpKFs[i]->setTcw(SE3d(eigR,eigt));
     }
-    LOG(WARNING) << "[LoopClosure] Correct all kf and mappoint pose!";
-
 
+    // Correct points. Transform to "non-optimized" reference keyframe pose and transform back with optimized pose
+    correctMapPoints(mpts_to_correct, refs, vCorrections);
+    LOG(WARNING) << "[LoopClosure] Correct " << N << " kfs and " << mpts_to_correct.size() << " mappoints pose!";
 }
 
-}
\ No newline at end of file
+}
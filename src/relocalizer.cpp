@@ -0,0 +1,183 @@
+#include "config.hpp"
+#include "relocalizer.hpp"
+#include "logging.hpp"
+
+namespace ssvo{
+
+Relocalizer::Relocalizer(DBoW3::Vocabulary* vocabulary, const KeyFrameDatabase::Ptr &database, bool report, bool verbose) :
+    vocabulary_(vocabulary), database_(database), report_(report), verbose_(report&&verbose)
+{
+    brief_ = BRIEF::create(2.0, Config::imageNLevel());
+
+    options_.num_candidates = 5;
+    options_.direct_index_levels = 4;
+    options_.max_hamming = 50;
+    options_.nn_ratio = 0.75;
+    options_.min_matches = 20;
+    options_.min_inliers = 20;
+    options_.ransac_iterations = 100;
+    options_.ransac_error = 4.0;
+    options_.time_budget = 30.0;
+}
+
+KeyFrame::Ptr Relocalizer::run(const Frame::Ptr &frame, const Corners &corners)
+{
+    const TimePoint deadline = std::chrono::steady_clock::now() + std::chrono::microseconds((int64_t)(options_.time_budget * 1000));
+
+    //! 1. descriptors and BoW vector of the current frame
+    Query query;
+    std::vector<cv::KeyPoint> kps;
+    kps.reserve(corners.size());
+    query.px.reserve(corners.size());
+    query.fn.reserve(corners.size());
+    for(const Corner & corner : corners)
+    {
+        kps.emplace_back(cv::KeyPoint(corner.x, corner.y, 31, -1, 0, corner.level));
+        query.px.emplace_back(corner.x, corner.y);
+        query.fn.push_back(frame->cam_->lift(query.px.back()));
+    }
+
+    cv::Mat descriptors;
+    brief_->compute(*frame->getBriefPyramid(brief_), kps, descriptors);
+    packDescriptors(descriptors, query.descriptors);
+
+    std::vector<cv::Mat> descriptors_vec;
+    descriptors_vec.reserve(descriptors.rows);
+    for(int i = 0; i < descriptors.rows; i++)
+        descriptors_vec.push_back(descriptors.row(i));
+    vocabulary_->transform(descriptors_vec, query.bow_vec, query.feat_vec, options_.direct_index_levels);
+
+    //! 2. top-k candidates
+    std::vector<KeyFrame::Ptr> keyframes;
+    std::vector<double> scores;
+    database_->query(query.bow_vec, keyframes, scores, options_.num_candidates);
+
+    if(keyframes.empty())
+        return nullptr;
+
+    //! 3. verify the candidates in parallel, the best one by BoW score is verified in this thread
+    const double fx = frame->cam_->fx();
+    std::vector<std::future<Candidate> > futures;
+    for(size_t i = 1; i < keyframes.size(); i++)
+        futures.emplace_back(std::async(std::launch::async, &Relocalizer::verify, this, std::cref(query), keyframes[i], fx, deadline));
+
+    Candidate best = verify(query, keyframes[0], fx, deadline);
+    SSVO_LOG_IF(TRACKER, 3, INFO, verbose_) << "[Relocalizer] Candidate KF " << keyframes[0]->id_ << ", score: " << scores[0] << ", matches: " << best.matches << ", inliers: " << best.inliers;
+    for(size_t i = 0; i < futures.size(); i++)
+    {
+        Candidate candidate = futures[i].get();
+        SSVO_LOG_IF(TRACKER, 3, INFO, verbose_) << "[Relocalizer] Candidate KF " << keyframes[i+1]->id_ << ", score: " << scores[i+1] << ", matches: " << candidate.matches << ", inliers: " << candidate.inliers;
+        if(candidate.inliers > best.inliers)
+            best = candidate;
+    }
+
+    if(best.inliers < options_.min_inliers)
+    {
+        SSVO_LOG_IF(TRACKER, 2, INFO, report_) << "[Relocalizer] Failed in " << keyframes.size() << " candidates, best inliers: " << best.inliers;
+        return nullptr;
+    }
+
+    LOG_IF(INFO, report_) << "[Relocalizer] Relocalized by KF " << best.keyframe->id_ << " with " << best.inliers << " inliers of " << best.matches << " matches";
+
+    frame->setTcw(SE3d(best.Rcw, best.tcw));
+    return best.keyframe;
+}
+
+Relocalizer::Candidate Relocalizer::verify(const Query &query, const KeyFrame::Ptr &keyframe, const double fx, const TimePoint deadline) const
+{
+    Candidate candidate;
+    candidate.keyframe = keyframe;
+    candidate.matches = 0;
+    candidate.inliers = 0;
+
+    if(keyframe->isBad() || std::chrono::steady_clock::now() > deadline)
+        return candidate;
+
+    //! the descriptors of the map points are set by the indexer before the keyframe is added to the database
+    const std::vector<MapPoint::Ptr> &mpts = keyframe->mapPointsInBow;
+    const BriefDescriptors &train = keyframe->descriptorsInBow;
+    const int N = (int) std::min(mpts.size(), train.size());
+
+    std::vector<bool> valid(N);
+    for(int i = 0; i < N; i++)
+        valid[i] = mpts[i] && !mpts[i]->isBad();
+
+    //! 1. match by BoW, keep the nearest query feature of each map point
+    std::vector<int> match_query(N, -1);
+    std::vector<int> match_dist(N, 256);
+    std::vector<int> indices;
+
+    const DBoW3::FeatureVector &feat_vec = keyframe->feat_vec_;
+    DBoW3::FeatureVector::const_iterator it1 = query.feat_vec.begin();
+    DBoW3::FeatureVector::const_iterator it2 = feat_vec.begin();
+    while(it1 != query.feat_vec.end() && it2 != feat_vec.end())
+    {
+        if(it1->first == it2->first)
+        {
+            indices.clear();
+            for(const unsigned int idx : it2->second)
+            {
+                if((int)idx < N && valid[idx])
+                    indices.push_back(idx);
+            }
+
+            if(!indices.empty())
+            {
+                for(const unsigned int q : it1->second)
+                {
+                    const HammingMatch match = hammingSearch(query.descriptors[q], train.data(), indices);
+                    if(match.index < 0 || match.dist1 > options_.max_hamming || match.dist1 >= options_.nn_ratio * match.dist2)
+                        continue;
+
+                    if(match.dist1 < match_dist[match.index])
+                    {
+                        match_dist[match.index] = match.dist1;
+                        match_query[match.index] = q;
+                    }
+                }
+            }
+
+            it1++;
+            it2++;
+        }
+        else if(it1->first < it2->first)
+            it1 = query.feat_vec.lower_bound(it2->first);
+        else
+            it2 = feat_vec.lower_bound(it1->first);
+    }
+
+    std::vector<cv::Point3f> points3d;
+    std::vector<cv::Point2f> points2d;
+    for(int i = 0; i < N; i++)
+    {
+        if(match_query[i] < 0)
+            continue;
+
+        const Vector3d pw = mpts[i]->pose();
+        const Vector3d &fn = query.fn[match_query[i]];
+        points3d.emplace_back((float)pw[0], (float)pw[1], (float)pw[2]);
+        points2d.emplace_back((float)fn[0], (float)fn[1]);
+    }
+
+    candidate.matches = (int) points3d.size();
+    if(candidate.matches < options_.min_matches || std::chrono::steady_clock::now() > deadline)
+        return candidate;
+
+    //! 2. PnP RANSAC on the normalized plane
+    cv::Mat rvec, tvec;
+    std::vector<int> inliers;
+    const bool succeed = cv::solvePnPRansac(points3d, points2d, cv::Mat::eye(3, 3, CV_64FC1), cv::Mat(), rvec, tvec, false,
+                                            options_.ransac_iterations, (float)(options_.ransac_error / fx), 0.99, inliers, cv::SOLVEPNP_EPNP);
+
+    if(!succeed || (int)inliers.size() < options_.min_inliers)
+        return candidate;
+
+    const Vector3d so3(rvec.at<double>(0), rvec.at<double>(1), rvec.at<double>(2));
+    candidate.Rcw = Sophus::SO3d::exp(so3).matrix();
+    candidate.tcw = Vector3d(tvec.at<double>(0), tvec.at<double>(1), tvec.at<double>(2));
+    candidate.inliers = (int) inliers.size();
+
+    return candidate;
+}
+
+}
@@ -7,6 +7,7 @@ namespace ssvo
 
 uint64_t Seed::next_id = 0;
 const double Seed::convergence_rate = 1.0/200.0;
+const double Seed::min_inlier_ratio = 0.1;
 
 //! =================================================================================================
 //! Seed
@@ -105,6 +106,12 @@ bool Seed::checkConvergence()
     return sigma2 / z_range < convergence_rate;
 }
 
+bool Seed::checkDivergence()
+{
+    std::lock_guard<std::mutex> lock(mutex_seed_);
+    return a / (a + b) < min_inlier_ratio;
+}
+
 double Seed::getInvDepth()
 {
     std::lock_guard<std::mutex> lock(mutex_seed_);
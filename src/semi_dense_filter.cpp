@@ -0,0 +1,465 @@
+#include <cstring>
+#if __SSE2__
+#include <emmintrin.h>
+#endif
+#include "config.hpp"
+#include "utils.hpp"
+#include "seed.hpp"
+#include "semi_dense_filter.hpp"
+
+namespace ssvo{
+
+//! zssd between the bilinear interpolated 3x3 patch centered at (u, v) and the zero-mean reference patch,
+//! which is stored as 3 rows of 4 floats with the last one 0. All the 9 pixels share the same interpolation weights,
+//! so a 4x5 block is read without border check.
+inline float zssd3x3(const cv::Mat &img, const double u, const double v, const float *patch_ref)
+{
+    const int iu = (int) u;
+    const int iv = (int) v;
+    const float du = (float) (u - iu);
+    const float dv = (float) (v - iv);
+    const int stride = (int) img.step[0];
+    const uchar *ptr = img.ptr<uchar>(iv - 1) + iu - 1;
+
+#if __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 w00 = _mm_set1_ps(1.0f - du);
+    const __m128 w01 = _mm_set1_ps(du);
+    const __m128 w10 = _mm_set1_ps(1.0f - dv);
+    const __m128 w11 = _mm_set1_ps(dv);
+    const __m128 mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+
+    //! horizontal interpolation of 4 rows, the last lane is not used
+    __m128 rows[4];
+    for(int r = 0; r < 4; r++, ptr += stride)
+    {
+        int left, right;
+        std::memcpy(&left, ptr, sizeof(int));
+        std::memcpy(&right, ptr + 1, sizeof(int));
+        const __m128 p0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(left), zero), zero));
+        const __m128 p1 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(right), zero), zero));
+        rows[r] = _mm_add_ps(_mm_mul_ps(w00, p0), _mm_mul_ps(w01, p1));
+    }
+
+    //! vertical interpolation, then the sum and the squared sum of the differences
+    __m128 sum = _mm_setzero_ps();
+    __m128 sum2 = _mm_setzero_ps();
+    for(int r = 0; r < 3; r++)
+    {
+        const __m128 cur = _mm_add_ps(_mm_mul_ps(w10, rows[r]), _mm_mul_ps(w11, rows[r+1]));
+        const __m128 diff = _mm_and_ps(_mm_sub_ps(cur, _mm_loadu_ps(patch_ref + r * 4)), mask);
+        sum = _mm_add_ps(sum, diff);
+        sum2 = _mm_add_ps(sum2, _mm_mul_ps(diff, diff));
+    }
+
+    float sums[4], sums2[4];
+    _mm_storeu_ps(sums, sum);
+    _mm_storeu_ps(sums2, sum2);
+    const float diff_sum = sums[0] + sums[1] + sums[2];
+    const float diff_sum2 = sums2[0] + sums2[1] + sums2[2];
+#else
+    const float w00 = (1.0f - du) * (1.0f - dv);
+    const float w01 = du * (1.0f - dv);
+    const float w10 = (1.0f - du) * dv;
+    const float w11 = du * dv;
+
+    float diff_sum = 0;
+    float diff_sum2 = 0;
+    for(int r = 0; r < 3; r++, ptr += stride)
+    {
+        for(int c = 0; c < 3; c++)
+        {
+            const float cur = w00 * ptr[c] + w01 * ptr[c+1] + w10 * ptr[stride+c] + w11 * ptr[stride+c+1];
+            const float diff = cur - patch_ref[r * 4 + c];
+            diff_sum += diff;
+            diff_sum2 += diff * diff;
+        }
+    }
+#endif
+
+    //! the reference patch is zero-mean, so removing the mean of the current patch is removing the mean of the differences
+    return diff_sum2 - diff_sum * diff_sum / 9.0f;
+}
+
+//! updates the row blocks of all active keyframes in parallel
+class SemiDenseUpdateInvoker : public cv::ParallelLoopBody
+{
+public:
+    struct Block
+    {
+        SemiDenseFilter::KeyFrameSeeds *seeds;
+        SE3d T_cur_from_ref;
+        int row_begin;
+        int row_end;
+    };
+
+    typedef std::vector<Block, Eigen::aligned_allocator<Block> > Blocks;
+
+    SemiDenseUpdateInvoker(const SemiDenseFilter &filter, const Frame::Ptr &frame, const Blocks &blocks, std::vector<int> &counts) :
+        filter_(filter), frame_(frame), blocks_(blocks), counts_(counts)
+    {}
+
+    virtual void operator()(const cv::Range &range) const
+    {
+        for(int i = range.start; i < range.end; i++)
+        {
+            const Block &block = blocks_[i];
+            counts_[i] = filter_.updateRows(*block.seeds, frame_, block.T_cur_from_ref, block.row_begin, block.row_end);
+        }
+    }
+
+private:
+    const SemiDenseFilter &filter_;
+    const Frame::Ptr &frame_;
+    const Blocks &blocks_;
+    std::vector<int> &counts_;
+};
+
+SemiDenseFilter::SemiDenseFilter(bool verbose) :
+    verbose_(verbose)
+{
+    options_.level = MAX(MIN(Config::semiDenseLevel(), Config::imageNLevel()-1), 0);
+    options_.max_kfs = 3;
+    options_.max_stored_kfs = 20;
+    options_.row_blocks = 4;
+    options_.min_gradient = Config::semiDenseMinGradient();
+    options_.max_epl_length = 40;
+    options_.max_zssd = 15*15;
+    options_.min_unique_ratio = 0.8;
+    options_.pixel_error = 1.0;
+}
+
+int SemiDenseFilter::createSeeds(const KeyFrame::Ptr &keyframe)
+{
+    if(keyframe == nullptr)
+        return 0;
+
+    double depth_mean;
+    double depth_min;
+    if(!keyframe->getSceneDepth(depth_mean, depth_min))
+        return 0;
+
+    const cv::Mat image = keyframe->getImage(options_.level);
+    const int rows = image.rows;
+    const int cols = image.cols;
+    const int border = 2;
+    const double scale = 1 << options_.level;
+    const double min_gradient2 = options_.min_gradient * options_.min_gradient;
+
+    KeyFrameSeeds::Ptr seeds = std::make_shared<KeyFrameSeeds>();
+    seeds->keyframe = keyframe;
+    seeds->keyframe_id = keyframe->id_;
+    seeds->rows = rows;
+    seeds->cols = cols;
+    seeds->z_range = 1.0 / depth_min;
+    seeds->row_start.resize(rows+1, 0);
+
+    //! select high gradient pixels, row by row
+    for(int v = 0; v < rows; v++)
+    {
+        seeds->row_start[v] = (int) seeds->u.size();
+        if(v < border || v >= rows - border)
+            continue;
+
+        const uchar *row = image.ptr<uchar>(v);
+        const uchar *row_up = image.ptr<uchar>(v-1);
+        const uchar *row_down = image.ptr<uchar>(v+1);
+        for(int u = border; u < cols - border; u++)
+        {
+            const double gx = row[u+1] - row[u-1];
+            const double gy = row_down[u] - row_up[u];
+            if(gx*gx + gy*gy < min_gradient2)
+                continue;
+
+            seeds->u.push_back(u);
+        }
+    }
+    seeds->row_start[rows] = (int) seeds->u.size();
+
+    const size_t N = seeds->u.size();
+    if(N == 0)
+        return 0;
+
+    seeds->fn.reserve(N);
+    seeds->patch.assign(N * 12, 0.0f);
+    for(int v = border; v < rows - border; v++)
+    {
+        for(int i = seeds->row_start[v]; i < seeds->row_start[v+1]; i++)
+        {
+            const int u = seeds->u[i];
+            seeds->fn.push_back(keyframe->cam_->lift(Vector2d(u * scale, v * scale)));
+
+            //! zero-mean 3x3 patch, 4 floats per row
+            float *patch = &seeds->patch[i * 12];
+            float mean = 0;
+            for(int dv = -1; dv <= 1; dv++)
+            {
+                const uchar *row = image.ptr<uchar>(v + dv);
+                for(int du = -1; du <= 1; du++)
+                    mean += row[u + du];
+            }
+            mean /= 9.0f;
+            for(int dv = -1; dv <= 1; dv++)
+            {
+                const uchar *row = image.ptr<uchar>(v + dv);
+                for(int du = -1; du <= 1; du++)
+                    patch[(dv + 1) * 4 + du + 1] = row[u + du] - mean;
+            }
+        }
+    }
+
+    seeds->mu.assign(N, 1.0 / depth_mean);
+    seeds->sigma2.assign(N, seeds->z_range * seeds->z_range);
+    seeds->a.assign(N, 10);
+    seeds->b.assign(N, 5);
+    seeds->status.assign(N, KeyFrameSeeds::ACTIVE);
+    seeds->updates.assign(N, 0);
+
+    std::lock_guard<std::mutex> lock(mutex_seeds_);
+    active_seeds_.push_back(seeds);
+    keyframe_seeds_.emplace(seeds->keyframe_id, seeds);
+
+    //! keyframes out of the window are only kept for depth map export
+    while((int) active_seeds_.size() > options_.max_kfs)
+    {
+        KeyFrameSeeds::Ptr inactive = active_seeds_.front();
+        active_seeds_.pop_front();
+
+        std::lock_guard<std::mutex> lock_seeds(inactive->mutex);
+        std::vector<float>().swap(inactive->patch);
+        std::vector<double>().swap(inactive->a);
+        std::vector<double>().swap(inactive->b);
+    }
+
+    while((int) keyframe_seeds_.size() > options_.max_stored_kfs)
+        keyframe_seeds_.erase(keyframe_seeds_.begin());
+
+    LOG_IF(INFO, verbose_) << "[SemiDense] KeyFrame " << keyframe->id_ << " create seeds: " << N;
+
+    return (int) N;
+}
+
+int SemiDenseFilter::updateSeeds(const Frame::Ptr &frame)
+{
+    if(frame == nullptr)
+        return 0;
+
+    std::deque<KeyFrameSeeds::Ptr> active_seeds;
+    {
+        std::lock_guard<std::mutex> lock(mutex_seeds_);
+        active_seeds = active_seeds_;
+    }
+
+    //! split the rows of each keyframe into blocks, all blocks are updated in the thread pool of OpenCV
+    SemiDenseUpdateInvoker::Blocks blocks;
+    std::vector<std::unique_lock<std::mutex> > locks;
+    for(const KeyFrameSeeds::Ptr &seeds : active_seeds)
+    {
+        KeyFrame::Ptr keyframe = seeds->keyframe.lock();
+        if(keyframe == nullptr || keyframe->frame_id_ == frame->id_)
+            continue;
+
+        const SE3d T_cur_from_ref = frame->Tcw() * keyframe->pose();
+        locks.emplace_back(seeds->mutex);
+
+        const int rows = seeds->rows;
+        const int rows_per_block = (rows + options_.row_blocks - 1) / options_.row_blocks;
+        for(int r = 0; r < rows; r += rows_per_block)
+            blocks.push_back(SemiDenseUpdateInvoker::Block{seeds.get(), T_cur_from_ref, r, MIN(r + rows_per_block, rows)});
+    }
+
+    std::vector<int> counts(blocks.size(), 0);
+    cv::parallel_for_(cv::Range(0, (int) blocks.size()), SemiDenseUpdateInvoker(*this, frame, blocks, counts));
+
+    int updated_count = 0;
+    for(const int count : counts)
+        updated_count += count;
+
+    return updated_count;
+}
+
+int SemiDenseFilter::updateRows(KeyFrameSeeds &seeds, const Frame::Ptr &frame, const SE3d &T_cur_from_ref, int row_begin, int row_end) const
+{
+    const cv::Mat image = frame->getImage(options_.level);
+    const AbstractCamera::Ptr &cam = frame->cam_;
+    const double scale = 1.0 / (1 << options_.level);
+    const Matrix3d R_cur_from_ref = T_cur_from_ref.rotationMatrix();
+    const Vector3d t_cur_from_ref = T_cur_from_ref.translation();
+
+    //! the 3x3 patch with bilinear interpolation needs 2 pixels border
+    const double min_px = 2;
+    const double max_u = image.cols - 3;
+    const double max_v = image.rows - 3;
+    const float max_score = (float) options_.max_zssd * 9;
+    const float max_float = std::numeric_limits<float>::max();
+
+    std::vector<float> scores;
+    scores.reserve((size_t) options_.max_epl_length + 2);
+
+    int updated_count = 0;
+    for(int i = seeds.row_start[row_begin]; i < seeds.row_start[row_end]; i++)
+    {
+        if(seeds.status[i] != KeyFrameSeeds::ACTIVE)
+            continue;
+
+        //! epipolar segment of the inverse depth range
+        const double sigma = std::sqrt(seeds.sigma2[i]);
+        const double d_max = seeds.mu[i] + 2 * sigma;
+        const double d_min = MAX(seeds.mu[i] - 2 * sigma, 0.00000001);
+        const Vector3d Rf = R_cur_from_ref * seeds.fn[i];
+        const Vector3d xyz_near = Rf / d_max + t_cur_from_ref;
+        const Vector3d xyz_far = Rf / d_min + t_cur_from_ref;
+        if(xyz_near[2] < 0.001 || xyz_far[2] < 0.001)
+            continue;
+
+        Vector2d px_near = cam->project(xyz_near) * scale;
+        Vector2d epl = cam->project(xyz_far) * scale - px_near;
+        const double epl_length = epl.norm();
+        if(epl_length < 0.001)
+            continue;
+
+        //! too long, search around the current estimate
+        double search_length = epl_length;
+        if(epl_length > options_.max_epl_length)
+        {
+            const Vector3d xyz_mean = Rf / seeds.mu[i] + t_cur_from_ref;
+            if(xyz_mean[2] < 0.001)
+                continue;
+
+            search_length = options_.max_epl_length;
+            px_near = cam->project(xyz_mean) * scale - epl * (0.5 * search_length / epl_length);
+            epl *= search_length / epl_length;
+        }
+
+        const int steps = MAX((int) std::ceil(search_length), 1);
+        const Vector2d step = epl / steps;
+        const float *patch_ref = &seeds.patch[i * 12];
+
+        //! zssd along the epipolar line, one pixel per step
+        scores.assign(steps + 1, max_float);
+        int best_k = -1;
+        float best_score = max_float;
+        for(int k = 0; k <= steps; k++)
+        {
+            const double u = px_near[0] + k * step[0];
+            const double v = px_near[1] + k * step[1];
+            if(u < min_px || v < min_px || u >= max_u || v >= max_v)
+                continue;
+
+            const float score = zssd3x3(image, u, v, patch_ref);
+            scores[k] = score;
+            if(score < best_score)
+            {
+                best_score = score;
+                best_k = k;
+            }
+        }
+
+        if(best_k < 0 || best_score > max_score)
+            continue;
+
+        //! uniqueness, the second best should not be a neighbour of the best
+        float second_score = max_float;
+        for(int k = 0; k <= steps; k++)
+        {
+            if(std::abs(k - best_k) > 2)
+                second_score = MIN(second_score, scores[k]);
+        }
+        if(second_score < max_float && best_score > options_.min_unique_ratio * second_score)
+            continue;
+
+        //! sub-pixel by parabola fitting
+        double offset = 0;
+        if(best_k > 0 && best_k < steps && scores[best_k-1] < max_float && scores[best_k+1] < max_float)
+        {
+            const double s0 = scores[best_k-1];
+            const double s1 = scores[best_k];
+            const double s2 = scores[best_k+1];
+            const double denominator = s0 - 2 * s1 + s2;
+            if(denominator > 0)
+                offset = MAX(MIN(0.5 * (s0 - s2) / denominator, 0.5), -0.5);
+        }
+
+        const Vector2d px_matched = px_near + (best_k + offset) * step;
+        const Vector3d fn_cur = cam->lift(px_matched / scale);
+        double depth = -1;
+        if(!utils::triangulate(R_cur_from_ref, t_cur_from_ref, seeds.fn[i], fn_cur, depth) || depth <= 0)
+            continue;
+
+        //! measurement uncertainty in inverse depth, from the inverse depth change per pixel on the epipolar line
+        const double x = 1.0 / depth;
+        const double tau = (d_max - d_min) / MAX(epl_length, 1.0) * options_.pixel_error;
+        const double tau2 = tau * tau;
+
+        //! same update as Seed::update
+        double &mu = seeds.mu[i];
+        double &sigma2 = seeds.sigma2[i];
+        double &a = seeds.a[i];
+        double &b = seeds.b[i];
+        const double norm_scale = std::sqrt(sigma2 + tau2);
+        if(std::isnan(norm_scale) || tau2 <= 0)
+            continue;
+
+        const double s2 = 1. / (1. / sigma2 + 1. / tau2);
+        const double m = s2 * (mu / sigma2 + x / tau2);
+        double C1 = a / (a + b) * utils::normal_distribution<double>(x, mu, norm_scale);
+        double C2 = b / (a + b) * 1. / seeds.z_range;
+        const double normalization_constant = C1 + C2;
+        C1 /= normalization_constant;
+        C2 /= normalization_constant;
+        const double f = C1 * (a + 1.) / (a + b + 1.) + C2 * a / (a + b + 1.);
+        const double e = C1 * (a + 1.) * (a + 2.) / ((a + b + 1.) * (a + b + 2.))
+            + C2 * a * (a + 1.0) / ((a + b + 1.0) * (a + b + 2.0));
+
+        const double mu_new = C1 * m + C2 * mu;
+        sigma2 = C1 * (s2 + m * m) + C2 * (sigma2 + mu * mu) - mu_new * mu_new;
+        mu = mu_new;
+        a = (e - f) / (f - e / f);
+        b = a * (1.0 - f) / f;
+
+        seeds.updates[i]++;
+        if(sigma2 / seeds.z_range < Seed::convergence_rate)
+            seeds.status[i] = KeyFrameSeeds::CONVERGED;
+        else if(a / (a + b) < Seed::min_inlier_ratio)
+            seeds.status[i] = KeyFrameSeeds::DIVERGED;
+
+        updated_count++;
+    }
+
+    return updated_count;
+}
+
+bool SemiDenseFilter::getInverseDepthMap(const uint64_t keyframe_id, cv::Mat &inv_depth, cv::Mat &variance, bool converged_only)
+{
+    KeyFrameSeeds::Ptr seeds;
+    {
+        std::lock_guard<std::mutex> lock(mutex_seeds_);
+        auto seeds_itr = keyframe_seeds_.find(keyframe_id);
+        if(seeds_itr == keyframe_seeds_.end())
+            return false;
+        seeds = seeds_itr->second;
+    }
+
+    std::lock_guard<std::mutex> lock(seeds->mutex);
+    inv_depth = cv::Mat(seeds->rows, seeds->cols, CV_32FC1, cv::Scalar(0));
+    variance = cv::Mat(seeds->rows, seeds->cols, CV_32FC1, cv::Scalar(-1));
+    for(int v = 0; v < seeds->rows; v++)
+    {
+        float *inv_depth_row = inv_depth.ptr<float>(v);
+        float *variance_row = variance.ptr<float>(v);
+        for(int i = seeds->row_start[v]; i < seeds->row_start[v+1]; i++)
+        {
+            const uint8_t status = seeds->status[i];
+            if(status == KeyFrameSeeds::DIVERGED || (converged_only && status != KeyFrameSeeds::CONVERGED))
+                continue;
+
+            const int u = seeds->u[i];
+            inv_depth_row[u] = (float) seeds->mu[i];
+            variance_row[u] = (float) seeds->sigma2[i];
+        }
+    }
+
+    return true;
+}
+
+}
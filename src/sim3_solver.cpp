@@ -1,3 +1,4 @@
+#include <atomic>
 #include "sim3_solver.hpp"
 
 namespace ssvo{
@@ -18,6 +19,48 @@ void Sim3Solver::getEstimateSim3(Matrix3d &R, Vector3d &t, double &s, std::vecto
         inliers[indices_[i]] = true;
     }
 }
+//! number of hypotheses generated and scored together in one batch
+static const int RANSAC_BATCH_SIZE = 16;
+
+struct Sim3Hypothesis
+{
+    Matrix3d R12;
+    Vector3d t12;
+    double s12;
+    std::vector<bool> inliers;
+    int inliers_count;
+};
+
+/**
+ * @brief 并行地为一批假设打分, 当前最好的内点数在各线程之间共享, 不可能超过它的假设提前放弃
+ *
+ */
+class Sim3ScoreInvoker : public cv::ParallelLoopBody
+{
+public:
+    Sim3ScoreInvoker(const Sim3Solver &solver, std::vector<Sim3Hypothesis> &hypotheses, std::atomic<int> &best_count) :
+        solver_(solver), hypotheses_(hypotheses), best_count_(best_count)
+    {}
+
+    virtual void operator()(const cv::Range &range) const
+    {
+        const int N = (int) solver_.indices_.size();
+        for(int i = range.start; i < range.end; i++)
+        {
+            Sim3Hypothesis &hypothesis = hypotheses_[i];
+            hypothesis.inliers_count = solver_.checkInliers(hypothesis.R12, hypothesis.t12, hypothesis.s12, hypothesis.inliers, N - best_count_.load());
+
+            int best = best_count_.load();
+            while(hypothesis.inliers_count > best && !best_count_.compare_exchange_weak(best, hypothesis.inliers_count));
+        }
+    }
+
+private:
+    const Sim3Solver &solver_;
+    std::vector<Sim3Hypothesis> &hypotheses_;
+    std::atomic<int> &best_count_;
+};
+
 /**
  * @brief compute sim3 by pSolver(curKeyFrame_->Tcw(),loopKeyFrame->Tcw(),fts_1_match,fts_2_match)
  */
@@ -32,64 +75,74 @@ bool Sim3Solver::runRANSAC(const int max_iterations_local_)
     inliers_ = std::vector<bool>(indices_.size(), false);
     inliers_count_best_ = 0;
 
-    std::vector<int> all_indice(indices_.size(), 0);
+    const int N = (int) indices_.size();
+    std::vector<int> all_indice(N, 0);
     std::iota(all_indice.begin(), all_indice.end(), 0);
 
-//    int niters = max_iterations;
-//    for(int iter = 0; iter < niters; iter++)
-    int iter =0;
+    std::vector<Sim3Hypothesis> hypotheses;
+    hypotheses.reserve(RANSAC_BATCH_SIZE);
+
+    int iter = 0;
     while (iterations_<maxIterations_ && iter<max_iterations_local_)
     {
-        iter++;
-        iterations_++;
-        std::vector<Vector3d> mpts1; mpts1.reserve(3);
-        std::vector<Vector3d> mpts2; mpts2.reserve(3);
-        std::vector<int> samples = all_indice;
-        for(int i = 0; i < 3; i++)
-        {
-            int randi = Rand(0, samples.size()-1);
-            mpts1.push_back(mpts1_[samples[randi]]);
-            mpts2.push_back(mpts2_[samples[randi]]);
+        //! 1. generate a batch of hypotheses
+        const int batch = std::min(RANSAC_BATCH_SIZE, std::min(maxIterations_ - iterations_, max_iterations_local_ - iter));
+        iter += batch;
+        iterations_ += batch;
 
-            samples[i] = samples.back();
-            samples.pop_back();
+        hypotheses.resize(batch);
+        for(Sim3Hypothesis &hypothesis : hypotheses)
+        {
+            std::vector<Vector3d> mpts1; mpts1.reserve(3);
+            std::vector<Vector3d> mpts2; mpts2.reserve(3);
+            std::vector<int> samples = all_indice;
+            for(int i = 0; i < 3; i++)
+            {
+                int randi = std::uniform_int_distribution<int>(0, (int) samples.size()-1)(rng_);
+                mpts1.push_back(mpts1_[samples[randi]]);
+                mpts2.push_back(mpts2_[samples[randi]]);
+
+                samples[randi] = samples.back();
+                samples.pop_back();
+            }
+
+            computeSim3(mpts1, mpts2, hypothesis.R12, hypothesis.t12, hypothesis.s12, scale_fixed_);
         }
 
-        Matrix3d R12;
-        Vector3d t12;
-        double s12;
-        computeSim3(mpts1, mpts2, R12, t12, s12, scale_fixed_);
+        //! 2. score them in parallel
+        std::atomic<int> best_count(inliers_count_best_);
+        cv::parallel_for_(cv::Range(0, batch), Sim3ScoreInvoker(*this, hypotheses, best_count));
+
+        bool updated = false;
+        for(Sim3Hypothesis &hypothesis : hypotheses)
+        {
+            if(hypothesis.inliers_count <= inliers_count_best_)
+                continue;
+
+            R12_best_ = hypothesis.R12;
+            t12_best_ = hypothesis.t12;
+            s12_best_ = hypothesis.s12;
 
-        std::vector<bool> inliers;
-        int inliers_count = checkInliers(R12, t12, s12, inliers);
+            inliers_.swap(hypothesis.inliers);
+            inliers_count_best_ = hypothesis.inliers_count;
+            updated = true;
+        }
 
-        if(inliers_count > inliers_count_best_)
+        //! 3. adaptive termination, N = log(1-p)/log(1-omega^s), s = 3
+        if(updated)
         {
-            R12_best_ = R12;
-            t12_best_ = t12;
-            s12_best_ = s12;
-
-            inliers_ = inliers;
-            inliers_count_best_ = inliers_count;
-
-            //todo 这步按理说是应该加上的
-//            if(inliers_count < min_inliers_)
-//            {
-//                //! N = log(1-p)/log(1-omega^s)
-//                //! p = 99%
-//                //! number of set: s = 8
-//                //! omega = inlier points / total points
-//                const static double num = log(1 - 0.99);
-//                const double omega = inliers_count*1.0 / indices_.size();
-//                const double denom = log(1 - pow(omega, 3));
-//
-//                maxIterations_ = (denom >= 0 || -num >= maxIterations_*(-denom)) ? maxIterations_ : round(num / denom);
-//            }
-//            else
-//                break;
+            const double num = std::log(1 - probability_);
+            const double omega = inliers_count_best_ * 1.0 / N;
+            const double denom = std::log(1 - std::pow(omega, 3));
+
+            if(denom < 0 && -num < maxIterations_ * (-denom))
+                maxIterations_ = std::max(iterations_, (int) std::ceil(num / denom));
         }
     }
 
+    if(iterations_ >= maxIterations_)
+        noMore_ = true;
+
     if(inliers_count_best_ > min_inliers_)
     {
         return true;
@@ -174,14 +227,15 @@ void Sim3Solver::computeSim3(const std::vector<Vector3d> &pts1,
     t12 = C1 - s12*R12 * C2;
 }
 
-int Sim3Solver::checkInliers(Matrix3d R12, Vector3d t12, double s12, std::vector<bool>& inliers)
+int Sim3Solver::checkInliers(const Matrix3d &R12, const Vector3d &t12, const double s12, std::vector<bool>& inliers, const int max_outliers) const
 {
     const Matrix3d sR12 = s12 * R12;
     const Matrix3d sR21 = (1.0/s12) * R12.transpose();
     const Vector3d t21 =  sR21 * (-t12);
 
     int inlier_count = 0;
-    inliers.resize(indices_.size(), false);
+    int outlier_count = 0;
+    inliers.assign(indices_.size(), false);
     for(size_t i = 0; i < indices_.size(); i++)
     {
         const Vector3d px12 = sR12 * mpts2_[i] + t12;
@@ -198,8 +252,8 @@ int Sim3Solver::checkInliers(Matrix3d R12, Vector3d t12, double s12, std::vector
             inliers[i] = true;
             inlier_count++;
         }
-        else
-            inliers[i] = false;
+        else if(max_outliers >= 0 && ++outlier_count > max_outliers)
+            break;
     }
     return inlier_count;
 }
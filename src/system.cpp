@@ -1,9 +1,12 @@
+#include <unistd.h>
 #include "config.hpp"
 #include "system.hpp"
 #include "optimizer.hpp"
 #include "image_alignment.hpp"
 #include "feature_alignment.hpp"
 #include "time_tracing.hpp"
+#include "timeline.hpp"
+#include "logging.hpp"
 
 namespace ssvo{
 
@@ -11,6 +14,23 @@ std::string Config::file_name_;
 
 TimeTracing::Ptr sysTrace = nullptr;
 
+//! ids of the timers and logs in sysTrace, in the order they are registered
+namespace sys_trace{
+enum TimerId{TOTAL, PROCESSING, FRAME_CREATE, IMG_ALIGN, FEATURE_REPROJ, MOTION_BA, LIGHT_AFFINE, PER_DEPTH_FILTER, FINISH};
+enum LogId{FRAME_ID, NUM_FEATURE_REPROJ, STAGE};
+}
+
+namespace sys_metrics{
+MetricCounter *frames = Metrics::instance().counter("ssvo_frames_total", "Number of processed frames");
+MetricCounter *keyframes = Metrics::instance().counter("ssvo_keyframes_total", "Number of keyframes created by tracking");
+MetricCounter *lost = Metrics::instance().counter("ssvo_tracking_lost_total", "Number of times the tracking is lost");
+MetricGauge *tracked = Metrics::instance().gauge("ssvo_tracked_features", "Features matched from the local map in the last tracked frame");
+MetricGauge *stage = Metrics::instance().gauge("ssvo_tracking_stage", "Stage of the system, 0 initialize, 1 normal, 2 relocalizing");
+MetricGauge *status = Metrics::instance().gauge("ssvo_tracking_status", "Status of the last frame, 0 reset, 1 initializing, 2 initialized, 3 bad, 4 good");
+MetricHistogram *frame_time = Metrics::instance().histogram("ssvo_frame_seconds", "Processing time of a frame in tracking", Metrics::timeBuckets());
+MetricHistogram *motion_ba_time = Metrics::instance().histogram("ssvo_motion_ba_seconds", "Time of the motion-only BA", Metrics::timeBuckets());
+}
+
 System::System(std::string config_file, std::string calib_flie) :
     stage_(STAGE_INITALIZE), status_(STATUS_INITAL_RESET),
     last_frame_(nullptr), current_frame_(nullptr), reference_keyframe_(nullptr),loopId_(0)
@@ -18,6 +38,8 @@ System::System(std::string config_file, std::string calib_flie) :
     LOG_ASSERT(!calib_flie.empty()) << "Empty Calibration file input!!!";
     LOG_ASSERT(!config_file.empty()) << "Empty Config file input!!!";
     Config::file_name_ = config_file;
+    if(Config::logAsync())
+        AsyncLogging::instance().start();
 
     AbstractCamera::Model model = AbstractCamera::checkCameraModel(calib_flie);
     if(AbstractCamera::Model::PINHOLE == model)
@@ -56,7 +78,7 @@ System::System(std::string config_file, std::string calib_flie) :
 
     LOG_ASSERT(!voc_dir.empty()) << "Please check the config file! The DBoW directory is not set!";
     DBoW3::Vocabulary* vocabulary = new DBoW3::Vocabulary(voc_dir);
-    DBoW3::Database* database= new DBoW3::Database(*vocabulary, true, 4);
+    KeyFrameDatabase::Ptr database = KeyFrameDatabase::create(vocabulary);
 
     mapper_ = LocalMapper::create(vocabulary, database, fast_detector_, true, false);
 
@@ -65,12 +87,25 @@ System::System(std::string config_file, std::string calib_flie) :
 
     mapper_->setLoopCloser(loop_closure_);
     loop_closure_->setLocalMapper(mapper_);
+
+    //! the indexer has its own detector, since it runs in parallel with tracking
+    FastDetector::Ptr index_detector = FastDetector::create(width, height, image_border, nlevel, grid_size, grid_min_size, fast_max_threshold, fast_min_threshold);
+    indexer_ = KeyFrameIndexer::create(vocabulary, database, index_detector, true, false);
+    indexer_->setLoopCloser(loop_closure_);
+    mapper_->setIndexer(indexer_);
+    indexer_->startMainThread();
+
+    relocalizer_ = Relocalizer::create(vocabulary, database, true, false);
 #else
     mapper_ = LocalMapper::create(fast_detector_, true, false);
 #endif
-    DepthFilter::Callback depth_fliter_callback = std::bind(&LocalMapper::createFeatureFromSeed, mapper_, std::placeholders::_1);
+    DepthFilter::Callback depth_fliter_callback = std::bind(&LocalMapper::insertSeed, mapper_, std::placeholders::_1);
     depth_filter_ = DepthFilter::create(fast_detector_, depth_fliter_callback, true);
-    viewer_ = Viewer::create(mapper_->map_, cv::Size(width, height));
+#ifdef SSVO_VIEWER_ENABLE
+    if(Config::viewerEnable())
+        viewer_ = Viewer::create(mapper_->map_, cv::Size(width, height));
+#endif
+    LOG_IF(WARNING, !isViewerEnabled()) << "[System] Running headless, nothing will be drawn";
 
     mapper_->startMainThread();
     depth_filter_->startMainThread();
@@ -100,52 +135,131 @@ System::System(std::string config_file, std::string calib_flie) :
 
     string trace_dir = Config::timeTracingDirectory();
     sysTrace.reset(new TimeTracing("ssvo_trace_system", trace_dir, time_names, log_names));
+
+    //! the default name carries the pid, so the runs sharing Trace.log_dir do not truncate each other's file,
+    //! and the file is removed once the trajectory has been read out
+    std::string trajectory_file = Config::trajectoryFile();
+    const bool trajectory_temporary = trajectory_file.empty();
+    if(trajectory_temporary)
+    {
+        trajectory_file = trace_dir;
+        if(!trajectory_file.empty() && trajectory_file.back() != '/' && trajectory_file.back() != '\\')
+            trajectory_file += "/";
+        trajectory_file += "ssvo_trajectory_" + std::to_string(getpid()) + ".bin";
+    }
+    trajectory_ = TrajectoryWriter::create(trajectory_file, 256, trajectory_temporary);
+
+    Timeline::instance().enable(Config::timelineEnable());
+    Timeline::instance().setThreadName("tracking");
+
+#ifdef SSVO_LOCK_PROFILE
+    LockProfiler::instance().startReporting(Config::lockReportInterval());
+#endif
+
+    if(!Config::metricsSocket().empty() || !Config::metricsSnapshotFile().empty())
+    {
+        metrics_server_ = MetricsServer::create(Config::metricsSocket(), Config::metricsSnapshotFile(), Config::metricsSnapshotInterval());
+        metrics_server_->startMainThread();
+    }
 }
 
 System::~System()
 {
+    LatencyHistogram histogram;
+    sysTrace->flush();
+    if(sysTrace->getHistogram(sys_trace::TOTAL, histogram) && histogram.count() > 0)
+        LOG(INFO) << "[System] Tracking time(ms) of " << histogram.count() << " frames, p50: " << histogram.percentile(0.50) * 1e3
+                  << ", p95: " << histogram.percentile(0.95) * 1e3 << ", p99: " << histogram.percentile(0.99) * 1e3 << ", max: " << histogram.max() * 1e3;
+
     sysTrace.reset();
 
-    viewer_->setStop();
+#ifdef SSVO_VIEWER_ENABLE
+    if(viewer_)
+        viewer_->setStop();
+#endif
     depth_filter_->stopMainThread();
+    depth_filter_->logSeedsInfo();
     mapper_->stopMainThread();
+#ifdef SSVO_DBOW_ENABLE
+    indexer_->stopMainThread();
+#endif
     loop_closure_->stopMainThread();
 
-    viewer_->waitForFinish();
+#ifdef SSVO_VIEWER_ENABLE
+    if(viewer_)
+        viewer_->waitForFinish();
+#endif
+
+    if(Timeline::instance().isEnabled())
+    {
+        std::string trace_dir = Config::timeTracingDirectory();
+        if(!trace_dir.empty() && trace_dir.back() != '/' && trace_dir.back() != '\\')
+            trace_dir += "/";
+        Timeline::instance().save(trace_dir + "ssvo_timeline.json");
+    }
+
+#ifdef SSVO_LOCK_PROFILE
+    LockProfiler::instance().stopReporting();
+    LockProfiler::instance().reportTotal();
+#endif
+
+    if(metrics_server_)
+        metrics_server_->stopMainThread();
+
+    AsyncLogging::instance().stop();
+}
+
+bool System::isViewerEnabled() const
+{
+#ifdef SSVO_VIEWER_ENABLE
+    return viewer_ != nullptr;
+#else
+    return false;
+#endif
 }
 
 void System::process(const cv::Mat &image, const double timestamp)
 {
-    sysTrace->startTimer("total");
-    sysTrace->startTimer("frame_create");
+    ScopedSpan span("process");
+    frame_timer_.start();
+    sysTrace->startTimer(sys_trace::TOTAL);
+    sysTrace->startTimer(sys_trace::FRAME_CREATE);
     //! get gray image
     double t0 = (double)cv::getTickCount();
     rgb_ = image;
-    cv::Mat gray = image.clone();
-    if(gray.channels() == 3)
-        cv::cvtColor(gray, gray, cv::COLOR_RGB2GRAY);
+    //! the color image is converted into a new buffer, only the gray one needs a copy
+    cv::Mat gray;
+    if(image.channels() == 3)
+        cv::cvtColor(image, gray, cv::COLOR_RGB2GRAY);
+    else
+        gray = image.clone();
 
     current_frame_ = Frame::create(gray, timestamp, camera_);
     double t1 = (double)cv::getTickCount();
-    LOG(WARNING) << "[System] Frame " << current_frame_->id_ << " create time: " << (t1-t0)/cv::getTickFrequency();
-    sysTrace->log("frame_id", current_frame_->id_);
-    sysTrace->stopTimer("frame_create");
+    SSVO_LOG(SYSTEM, 2, WARNING) << "[System] Frame " << current_frame_->id_ << " create time: " << (t1-t0)/cv::getTickFrequency();
+    sysTrace->log(sys_trace::FRAME_ID, current_frame_->id_);
+    sysTrace->stopTimer(sys_trace::FRAME_CREATE);
+    span.setArg("frame_id", current_frame_->id_);
 
-    sysTrace->startTimer("processing");
+    sysTrace->startTimer(sys_trace::PROCESSING);
     if(STAGE_NORMAL_FRAME == stage_)
     {
+        ScopedSpan span_stage("tracking");
         status_ = tracking();
     }
     else if(STAGE_INITALIZE == stage_)
     {
+        ScopedSpan span_stage("initialize");
         status_ = initialize();
     }
     else if(STAGE_RELOCALIZING == stage_)
     {
+        ScopedSpan span_stage("relocalize");
         status_ = relocalize();
     }
-    sysTrace->stopTimer("processing");
+    sysTrace->stopTimer(sys_trace::PROCESSING);
 
+    ScopedSpan span_finish("finish_frame");
     finishFrame();
 }
 
@@ -187,7 +301,11 @@ System::Status System::initialize()
 
 System::Status System::tracking()
 {
-    std::unique_lock<std::mutex> lock(mapper_->map_->mutex_update_);
+    std::unique_lock<NamedMutex> lock(mapper_->map_->mutex_update_, std::defer_lock);
+    {
+        ScopedSpan span("wait_map_update");
+        lock.lock();
+    }
     //! loop closure need
     if(loop_closure_->update_finish_ == true)
     {
@@ -206,29 +324,34 @@ System::Status System::tracking()
     current_frame_->setPose(last_frame_->pose());
     //! alignment by SE3
     AlignSE3 align;
-    sysTrace->startTimer("img_align");
+    sysTrace->startTimer(sys_trace::IMG_ALIGN);
     align.run(last_frame_, current_frame_, Config::alignTopLevel(), Config::alignBottomLevel(), 30, 1e-8);
-    sysTrace->stopTimer("img_align");
+    sysTrace->stopTimer(sys_trace::IMG_ALIGN);
 
     //! track local map
-    sysTrace->startTimer("feature_reproj");
+    sysTrace->startTimer(sys_trace::FEATURE_REPROJ);
     int matches = feature_tracker_->reprojectLoaclMap(current_frame_);
-    sysTrace->stopTimer("feature_reproj");
-    sysTrace->log("num_feature_reproj", matches);
-    LOG(WARNING) << "[System] Track with " << matches << " points";
+    sysTrace->stopTimer(sys_trace::FEATURE_REPROJ);
+    sysTrace->log(sys_trace::NUM_FEATURE_REPROJ, matches);
+    sys_metrics::tracked->set(matches);
+    SSVO_LOG(SYSTEM, 2, WARNING) << "[System] Track with " << matches << " points";
 
     // TODO tracking status
     if(matches < Config::minQualityFts())
         return STATUS_TRACKING_BAD;
 
     //! motion-only BA
-    sysTrace->startTimer("motion_ba");
+    sysTrace->startTimer(sys_trace::MOTION_BA);
+    SecondTimer motion_ba_timer;
+    motion_ba_timer.start();
     Optimizer::motionOnlyBundleAdjustment(current_frame_, false, false, true);
-    sysTrace->stopTimer("motion_ba");
+    sys_metrics::motion_ba_time->observe(motion_ba_timer.stop());
+    sysTrace->stopTimer(sys_trace::MOTION_BA);
 
-    sysTrace->startTimer("per_depth_filter");
+    sysTrace->startTimer(sys_trace::PER_DEPTH_FILTER);
     if(createNewKeyFrame())
     {
+        sys_metrics::keyframes->inc();
         depth_filter_->insertFrame(current_frame_, reference_keyframe_);
         mapper_->insertKeyFrame(reference_keyframe_);
     }
@@ -236,16 +359,15 @@ System::Status System::tracking()
     {
         depth_filter_->insertFrame(current_frame_, nullptr);
     }
-    sysTrace->stopTimer("per_depth_filter");
+    sysTrace->stopTimer(sys_trace::PER_DEPTH_FILTER);
 
-    sysTrace->startTimer("light_affine");
+    sysTrace->startTimer(sys_trace::LIGHT_AFFINE);
     calcLightAffine();
-    sysTrace->stopTimer("light_affine");
+    sysTrace->stopTimer(sys_trace::LIGHT_AFFINE);
 
-    //！ save frame pose
-    frame_timestamp_buffer_.push_back(current_frame_->timestamp_);
-    reference_keyframe_buffer_.push_back(current_frame_->getRefKeyFrame());
-    frame_pose_buffer_.push_back(current_frame_->pose());//current_frame_->getRefKeyFrame()->Tcw() * current_frame_->pose());
+    //！ save frame pose relative to the reference keyframe, which may be corrected by loop closure later
+    const KeyFrame::Ptr frame_ref_keyframe = current_frame_->getRefKeyFrame();
+    trajectory_->append(current_frame_->timestamp_, current_frame_->id_, frame_ref_keyframe->id_, frame_ref_keyframe->pose(), current_frame_->pose());
 
     return STATUS_TRACKING_GOOD;
 }
@@ -256,13 +378,16 @@ System::Status System::relocalize()
     Corners corners_old;
     fast_detector_->detect(current_frame_->images(), corners_new, corners_old, Config::minCornersPerKeyFrame());
 
-    reference_keyframe_ = mapper_->relocalizeByDBoW(current_frame_, corners_new);
+#ifdef SSVO_DBOW_ENABLE
+    //! the pose of the frame is set by PnP against the best candidate
+    reference_keyframe_ = relocalizer_->run(current_frame_, corners_new);
+#else
+    reference_keyframe_ = nullptr;
+#endif
 
     if(reference_keyframe_ == nullptr)
         return STATUS_TRACKING_BAD;
 
-    current_frame_->setPose(reference_keyframe_->pose());
-
     //! alignment by SE3
     AlignSE3 align;
     int matches = align.run(reference_keyframe_, current_frame_, Config::alignTopLevel(), Config::alignBottomLevel(), 30, 1e-8);
@@ -415,7 +540,7 @@ bool System::createNewKeyFrame()
     if(!disparities.empty())
         current_frame_->disparity_ = *std::next(disparities.begin(), disparities.size()/2);
 
-    LOG(INFO) << "[System] Max overlap: " << max_overlap << " min disaprity " << disparities.front() << ", median: " << current_frame_->disparity_;
+    SSVO_LOG(SYSTEM, 2, INFO) << "[System] Max overlap: " << max_overlap << " min disaprity " << disparities.front() << ", median: " << current_frame_->disparity_;
 
 //    int all_features = current_frame_->featureNumber() + current_frame_->seedNumber();
     bool c2 = disparities.front() > options_.min_kf_disparity;
@@ -456,13 +581,14 @@ bool System::createNewKeyFrame()
 
 void System::finishFrame()
 {
-    sysTrace->startTimer("finish");
+    sysTrace->startTimer(sys_trace::FINISH);
     cv::Mat image_show;
 //    Stage last_stage = stage_;
     if(STAGE_NORMAL_FRAME == stage_)
     {
         if(STATUS_TRACKING_BAD == status_)
         {
+            sys_metrics::lost->inc();
             stage_ = STAGE_RELOCALIZING;
             current_frame_->setPose(last_frame_->pose());
         }
@@ -474,7 +600,8 @@ void System::finishFrame()
         else if(STATUS_INITAL_RESET == status_)
             initializer_->reset();
 
-        initializer_->drowOpticalFlow(image_show);
+        if(isViewerEnabled())
+            initializer_->drowOpticalFlow(image_show);
     }
     else if(STAGE_RELOCALIZING == stage_)
     {
@@ -488,40 +615,66 @@ void System::finishFrame()
     last_frame_ = current_frame_;
 
     //! display
-    viewer_->setCurrentFrame(current_frame_, image_show);
+#ifdef SSVO_VIEWER_ENABLE
+    if(viewer_)
+        viewer_->setCurrentFrame(current_frame_, image_show);
+#endif
 
-    sysTrace->log("stage", stage_);
-    sysTrace->stopTimer("finish");
-    sysTrace->stopTimer("total");
-    const double time = sysTrace->getTimer("total");
-    LOG(WARNING) << "[System] Finish Current Frame with Stage: " << stage_ << ", total time: " << time;
+    sysTrace->log(sys_trace::STAGE, stage_);
+    sysTrace->stopTimer(sys_trace::FINISH);
+    sysTrace->stopTimer(sys_trace::TOTAL);
+    const double time = frame_timer_.stop();
+    sys_metrics::frames->inc();
+    sys_metrics::stage->set(stage_);
+    sys_metrics::status->set(status_);
+    sys_metrics::frame_time->observe(time);
+    SSVO_LOG(SYSTEM, 2, WARNING) << "[System] Finish Current Frame with Stage: " << stage_ << ", total time: " << time;
 
     sysTrace->writeToFile();
 
 }
 
-void System::saveTrajectoryTUM(const std::string &file_name)
+TrajectoryWriter::KeyFramePoses System::getKeyFramePoses() const
 {
-    std::ofstream f;
-    f.open(file_name.c_str());
-    f << std::fixed;
+    TrajectoryWriter::KeyFramePoses poses;
+    for(const KeyFrame::Ptr &kf : mapper_->map_->getAllKeyFrames())
+    {
+        if(!kf->isBad())
+            poses.emplace(kf->id_, kf->pose());
+    }
 
-    std::list<double>::iterator frame_timestamp_ptr = frame_timestamp_buffer_.begin();
-    std::list<Sophus::SE3d>::iterator frame_pose_ptr = frame_pose_buffer_.begin();
-    std::list<KeyFrame::Ptr>::iterator reference_keyframe_ptr = reference_keyframe_buffer_.begin();
-    const std::list<double>::iterator frame_timestamp = frame_timestamp_buffer_.end();
-    for(; frame_timestamp_ptr!= frame_timestamp; frame_timestamp_ptr++, frame_pose_ptr++, reference_keyframe_ptr++)
+    //! the removed keyframes follow the corrections of their first ancestor still in the map
+    const Map::RemovedKeyFrames removed_kfs = mapper_->map_->getRemovedKeyFrames();
+    TrajectoryWriter::KeyFramePoses removed_poses;
+    for(const auto &item : removed_kfs)
     {
-        Sophus::SE3d frame_pose = (*frame_pose_ptr);//(*reference_keyframe_ptr)->Twc() * (*frame_pose_ptr);
-        Vector3d t = frame_pose.translation();
-        Quaterniond q = frame_pose.unit_quaternion();
+        SE3d T_parent_kf = item.second.T_parent_kf;
+        uint64_t parent_id = item.second.parent_id;
+        for(size_t n = 0; n < removed_kfs.size() && !poses.count(parent_id); n++)
+        {
+            const auto it = removed_kfs.find(parent_id);
+            if(it == removed_kfs.end())
+                break;
 
-        f << std::setprecision(6) << *frame_timestamp_ptr << " "
-          << std::setprecision(9) << t[0] << " " << t[1] << " " << t[2] << " " << q.x() << " " << q.y() << " " << q.z() << " " << q.w() << std::endl;
+            T_parent_kf = it->second.T_parent_kf * T_parent_kf;
+            parent_id = it->second.parent_id;
+        }
+
+        const auto it = poses.find(parent_id);
+        if(it != poses.end())
+            removed_poses.emplace(item.first, it->second * T_parent_kf);
     }
-    f.close();
-    LOG(INFO) << " trajectory saved!";
 
+    poses.insert(removed_poses.begin(), removed_poses.end());
+    return poses;
+}
+
+void System::saveTrajectoryTUM(const std::string &file_name)
+{
+    if(trajectory_->save(file_name, getKeyFramePoses(), TrajectoryWriter::TUM))
+        LOG(INFO) << " trajectory saved!";
+
+    std::ofstream f;
     std::string KFfilename = "KF" + file_name;
 
     f.open(KFfilename.c_str());
@@ -545,5 +698,35 @@ void System::saveTrajectoryTUM(const std::string &file_name)
 
 }
 
+void System::saveTrajectoryBinary(const std::string &file_name)
+{
+    if(trajectory_->save(file_name, getKeyFramePoses(), TrajectoryWriter::BINARY))
+        LOG(INFO) << " binary trajectory saved!";
+}
+
+void System::getTrajectory(std::vector<double> &timestamps, std::vector<Vector3d> &positions) const
+{
+    timestamps.clear();
+    positions.clear();
+    timestamps.reserve(trajectory_->size());
+    positions.reserve(trajectory_->size());
+    trajectory_->forEach(getKeyFramePoses(), [&](const TrajectoryWriter::Record &record, const SE3d &Twc){
+        timestamps.push_back(record.timestamp);
+        positions.push_back(Twc.translation());
+    });
+}
+
+bool System::getInverseDepthMap(cv::Mat &inv_depth, cv::Mat &variance, SE3d &Twc, bool converged_only) const
+{
+    if(reference_keyframe_ == nullptr)
+        return false;
+
+    if(!depth_filter_->getInverseDepthMap(reference_keyframe_, inv_depth, variance, converged_only))
+        return false;
+
+    Twc = reference_keyframe_->pose();
+    return true;
+}
+
 }
 
@@ -0,0 +1,106 @@
+#include <fstream>
+#include "timeline.hpp"
+
+namespace ssvo{
+
+Timeline &Timeline::instance()
+{
+    static Timeline timeline;
+    return timeline;
+}
+
+Timeline::Timeline() :
+    start_(std::chrono::steady_clock::now()), enabled_(false), max_events_per_thread_(1 << 20)
+{}
+
+void Timeline::enable(bool enable)
+{
+    enabled_.store(enable, std::memory_order_relaxed);
+}
+
+Timeline::ThreadBuffer &Timeline::local()
+{
+    //! the timeline is never destroyed before the threads, so the buffer can be cached
+    thread_local ThreadBuffer *buffer = nullptr;
+    if(buffer)
+        return *buffer;
+
+    std::lock_guard<std::mutex> lock(mutex_buffers_);
+    buffers_.emplace_back(new ThreadBuffer);
+    buffer = buffers_.back().get();
+    buffer->tid = (uint32_t) buffers_.size();
+    buffer->dropped = 0;
+    return *buffer;
+}
+
+void Timeline::setThreadName(const std::string &name)
+{
+    ThreadBuffer &buffer = local();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.name = name;
+}
+
+void Timeline::record(const char *name, uint64_t begin, uint64_t end, const char *arg_name, int64_t arg)
+{
+    ThreadBuffer &buffer = local();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    if(buffer.events.size() >= max_events_per_thread_)
+    {
+        buffer.dropped++;
+        return;
+    }
+
+    buffer.events.push_back(Event{name, arg_name, arg, begin, end > begin ? end - begin : 0});
+}
+
+bool Timeline::save(const std::string &file_name)
+{
+    std::ofstream ofs(file_name.c_str());
+    if(!ofs.is_open())
+    {
+        LOG(ERROR) << "[Timeline] Could not open file: " << file_name;
+        return false;
+    }
+
+    std::vector<ThreadBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_buffers_);
+        for(const auto &buffer : buffers_)
+            buffers.push_back(buffer.get());
+    }
+
+    //! timestamps are in microseconds
+    ofs << std::fixed << std::setprecision(3);
+    ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    ofs << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"ssvo\"}}";
+
+    size_t count = 0;
+    uint64_t dropped = 0;
+    for(ThreadBuffer *buffer : buffers)
+    {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        const std::string name = buffer->name.empty() ? "thread_" + std::to_string(buffer->tid) : buffer->name;
+        ofs << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid << ",\"args\":{\"name\":\"" << name << "\"}}";
+
+        for(const Event &event : buffer->events)
+        {
+            ofs << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"ts\":" << event.begin * 1e-3 << ",\"dur\":" << event.duration * 1e-3;
+            if(event.arg_name)
+                ofs << ",\"args\":{\"" << event.arg_name << "\":" << event.arg << "}";
+            ofs << "}";
+        }
+
+        count += buffer->events.size();
+        dropped += buffer->dropped;
+    }
+    ofs << "\n]}\n";
+    ofs.close();
+
+    LOG(INFO) << "[Timeline] Saved " << count << " events of " << buffers.size() << " threads to " << file_name;
+    LOG_IF(WARNING, dropped > 0) << "[Timeline] " << dropped << " events are dropped as the buffers are full";
+
+    return ofs.good();
+}
+
+}
@@ -0,0 +1,179 @@
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include "trajectory_writer.hpp"
+
+namespace ssvo{
+
+//! file header: magic, version and record size
+static const char TRAJECTORY_MAGIC[8] = {'S', 'S', 'V', 'O', 'T', 'R', 'J', '\0'};
+static const uint32_t TRAJECTORY_VERSION = 1;
+static_assert(sizeof(TrajectoryWriter::Record) == 136, "the record is written to file as it is");
+
+static void writeHeader(std::ofstream &ofs)
+{
+    const uint32_t record_size = sizeof(TrajectoryWriter::Record);
+    ofs.write(TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+    ofs.write((const char*) &TRAJECTORY_VERSION, sizeof(TRAJECTORY_VERSION));
+    ofs.write((const char*) &record_size, sizeof(record_size));
+}
+
+static bool readHeader(std::ifstream &ifs)
+{
+    char magic[sizeof(TRAJECTORY_MAGIC)];
+    uint32_t version = 0;
+    uint32_t record_size = 0;
+    ifs.read(magic, sizeof(magic));
+    ifs.read((char*) &version, sizeof(version));
+    ifs.read((char*) &record_size, sizeof(record_size));
+    return ifs.good() && std::memcmp(magic, TRAJECTORY_MAGIC, sizeof(magic)) == 0
+        && version == TRAJECTORY_VERSION && record_size == sizeof(TrajectoryWriter::Record);
+}
+
+TrajectoryWriter::TrajectoryWriter(const std::string &file_name, size_t chunk_size, bool temporary) :
+    file_name_(file_name), chunk_size_(std::max(chunk_size, (size_t)1)), temporary_(temporary), count_(0), exported_(false)
+{
+    ofs_.open(file_name_.c_str(), std::ios::binary | std::ios::trunc);
+    LOG_IF(ERROR, !ofs_.is_open()) << "[Trajectory] Could not open file: " << file_name_;
+    if(ofs_.is_open())
+        writeHeader(ofs_);
+
+    records_.reserve(chunk_size_);
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+    flush();
+    if(!temporary_ || !exported_)
+        return;
+
+    ofs_.close();
+    LOG_IF(WARNING, std::remove(file_name_.c_str()) != 0) << "[Trajectory] Could not remove file: " << file_name_;
+}
+
+void TrajectoryWriter::toArray(const SE3d &T, double *array)
+{
+    const Vector3d t = T.translation();
+    const Quaterniond q = T.unit_quaternion();
+    array[0] = t[0]; array[1] = t[1]; array[2] = t[2];
+    array[3] = q.x(); array[4] = q.y(); array[5] = q.z(); array[6] = q.w();
+}
+
+SE3d TrajectoryWriter::fromArray(const double *array)
+{
+    const Quaterniond q(array[6], array[3], array[4], array[5]);
+    return SE3d(q.normalized(), Vector3d(array[0], array[1], array[2]));
+}
+
+void TrajectoryWriter::append(double timestamp, uint64_t frame_id, uint64_t keyframe_id, const SE3d &Twr, const SE3d &Twc)
+{
+    Record record;
+    record.timestamp = timestamp;
+    record.frame_id = frame_id;
+    record.keyframe_id = keyframe_id;
+    toArray(Twr.inverse() * Twc, record.Trc);
+    toArray(Twc, record.Twc);
+
+    std::lock_guard<std::mutex> lock(mutex_records_);
+    records_.push_back(record);
+    count_++;
+    if(records_.size() < chunk_size_)
+        return;
+
+    if(ofs_.is_open())
+        ofs_.write((const char*) records_.data(), records_.size() * sizeof(Record));
+    records_.clear();
+}
+
+void TrajectoryWriter::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex_records_);
+    if(!ofs_.is_open())
+        return;
+
+    if(!records_.empty())
+        ofs_.write((const char*) records_.data(), records_.size() * sizeof(Record));
+    records_.clear();
+    ofs_.flush();
+}
+
+bool TrajectoryWriter::forEach(const KeyFramePoses &poses, const std::function<void(const Record &, const SE3d &)> &callback)
+{
+    flush();
+
+    std::ifstream ifs(file_name_.c_str(), std::ios::binary);
+    if(!ifs.is_open() || !readHeader(ifs))
+    {
+        LOG(ERROR) << "[Trajectory] Could not read file: " << file_name_;
+        return false;
+    }
+
+    //! read by chunks, the whole trajectory is never held in memory
+    std::vector<Record> records(chunk_size_);
+    size_t uncorrected = 0;
+    while(ifs)
+    {
+        ifs.read((char*) records.data(), records.size() * sizeof(Record));
+        const size_t N = ifs.gcount() / sizeof(Record);
+        for(size_t i = 0; i < N; i++)
+        {
+            const Record &record = records[i];
+            const auto it = poses.find(record.keyframe_id);
+            if(it != poses.end())
+                callback(record, it->second * fromArray(record.Trc));
+            else
+            {
+                uncorrected++;
+                callback(record, fromArray(record.Twc));
+            }
+        }
+    }
+
+    LOG_IF(WARNING, uncorrected) << "[Trajectory] " << uncorrected << " frames have no pose for their reference keyframes, the recorded poses are used without correction";
+    exported_ = true;
+    return true;
+}
+
+bool TrajectoryWriter::save(const std::string &file_name, const KeyFramePoses &poses, Format format)
+{
+    LOG_ASSERT(file_name != file_name_) << "[Trajectory] Could not save to the stream file itself: " << file_name;
+
+    std::ofstream ofs;
+    if(BINARY == format)
+    {
+        ofs.open(file_name.c_str(), std::ios::binary);
+        if(ofs.is_open())
+            writeHeader(ofs);
+    }
+    else
+    {
+        ofs.open(file_name.c_str());
+        ofs << std::fixed;
+    }
+
+    if(!ofs.is_open())
+    {
+        LOG(ERROR) << "[Trajectory] Could not open file: " << file_name;
+        return false;
+    }
+
+    const bool succeed = forEach(poses, [&](const Record &record, const SE3d &Twc){
+        if(BINARY == format)
+        {
+            Record updated = record;
+            toArray(Twc, updated.Twc);
+            ofs.write((const char*) &updated, sizeof(Record));
+            return;
+        }
+
+        const Vector3d t = Twc.translation();
+        const Quaterniond q = Twc.unit_quaternion();
+        ofs << std::setprecision(6) << record.timestamp << " "
+            << std::setprecision(9) << t[0] << " " << t[1] << " " << t[2] << " " << q.x() << " " << q.y() << " " << q.z() << " " << q.w() << "\n";
+    });
+
+    ofs.close();
+    return succeed && ofs.good();
+}
+
+}
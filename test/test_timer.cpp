@@ -26,6 +26,25 @@ int main()
 
     timetracing.writeToFile();
 
+    //! timers by id from other threads, each thread writes its own rows
+    const int id_three = timetracing.timerId("three");
+    std::thread thread([&]() {
+        for(int i = 0; i < 10; i++)
+        {
+            timetracing.startTimer(id_three);
+            std::this_thread::sleep_for(std::chrono::microseconds(1000 * (i + 1)));
+            timetracing.stopTimer(id_three);
+            timetracing.writeToFile();
+        }
+    });
+    thread.join();
+
+    timetracing.flush();
+    ssvo::LatencyHistogram histogram;
+    timetracing.getHistogram(id_three, histogram);
+    std::cout << "three: count " << histogram.count() << ", p50 " << histogram.percentile(0.5)
+              << ", p99 " << histogram.percentile(0.99) << ", max " << histogram.max() << std::endl;
+
 
     return 0;
 }